@@ -0,0 +1,160 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark del cifrado autenticado: coste de cifrar y de descifrar cada bloque con AES-256-GCM y con
+ *         ChaCha20-Poly1305 (en segundos de CPU por GB, comparado con el CRC32C que ya se calcula de cada bloque), comprobando
+ *         antes que se descifra lo cifrado y que se rechaza lo modificado o cifrado con otra clave
+ */
+
+#include "header_files/aead.h"
+#include "header_files/checksum.h"
+#include "bench_util.h"
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Tamaños de bloque que se miden (el de la MTU de Ethernet, el de una trama jumbo y el máximo con UDP_SEGMENT) y bytes que
+// se procesan en cada medida (unos 64 MiB)
+const std::vector<size_t> CHUNK_SIZES = {1400, 8900, 65000};
+constexpr size_t MEASURED_BYTES = 64 << 20;
+
+/**
+ * @brief Función que mide el tiempo medio por byte de una operación, repitiéndola sobre todos los bloques del buffer.
+ * @param[in] count: número de bloques.
+ * @param[in] chunk: tamaño de cada bloque.
+ * @param[in] operation: operación que se aplica a cada bloque (recibe su posición en el buffer).
+ * @return Devuelve los nanosegundos por byte.
+ */
+double measure_bytes(size_t count, size_t chunk, const std::function<void(size_t)>& operation) {
+  return measure(count, operation) / static_cast<double>(chunk);
+}
+
+/**
+ * @brief Función que muestra una medida: rendimiento en un hilo y segundos de CPU que cuesta cada GB transferido.
+ * @param[in] name: nombre de la medida.
+ * @param[in] nanoseconds: nanosegundos por byte.
+ */
+void report(const std::string& name, double nanoseconds) {
+  report_line(name, 40, {{1 / nanoseconds, 2, 8, " GB/s"}, {8 / nanoseconds, 2, 9, " Gbit/s"}, {nanoseconds, 3, 9, " s de CPU/GB"}});
+}
+
+/**
+ * @brief Función que comprueba un algoritmo: cifra y descifra bloques de varios tamaños (también en su sitio, como el
+ *        emisor con los bloques comprimidos), y comprueba que no se descifra un bloque con un byte cambiado (en los datos, la
+ *        etiqueta o el prefijo en claro), con otra cabecera o con la clave de otra clave compartida, y que la sal distingue
+ *        las claves de dos emisores.
+ * @return Devuelve true si todo se comporta como debe.
+ */
+bool check(std::mt19937_64& random, aead_algorithm algorithm) {
+  aead_secret secret, other_secret;
+  for (uint8_t& byte : secret) { byte = static_cast<uint8_t>(random()); }
+  for (uint8_t& byte : other_secret) { byte = static_cast<uint8_t>(random()); }
+  std::optional<aead_key> key = make_key(secret, algorithm);
+  std::optional<aead_key> other_sender = make_key(secret, algorithm);
+  if (!key || !other_sender) { return false; }
+  aead_context cipher(*key);
+  std::optional<aead_key> derived = derive_key(secret, algorithm, key->salt.data());
+  std::optional<aead_key> wrong = derive_key(other_secret, algorithm, key->salt.data());
+  if (!derived || !wrong || derived->key != key->key) { return false; }
+  aead_context receiver(*derived);
+  aead_context forger(*wrong);
+  aead_context stranger(*other_sender);
+
+  packet_header header;
+  header.type = packet_type::data;
+  header.flags = cipher.flags();
+  header.session = 0x1234;
+  header.stream = 3;
+  header.sequence = 77;
+  header.offset = 77 * 1400;
+  uint8_t prefix[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  for (size_t length : {size_t{1}, size_t{15}, size_t{1400}, size_t{8191}}) {
+    std::vector<uint8_t> plain(length), sealed(length + AEAD_OVERHEAD), opened;
+    for (uint8_t& byte : plain) { byte = static_cast<uint8_t>(random()); }
+    for (const aead_clear& clear : {aead_clear{}, aead_clear{prefix, sizeof(prefix), 1}}) {
+      if (cipher.seal(header, plain.data(), length, sealed.data(), clear) != length + AEAD_OVERHEAD) { return false; }
+      if (!receiver.matches(packet_algorithm(header.flags), sealed.data()) || stranger.matches(algorithm, sealed.data())) { return false; }
+      auto open = [&](aead_context& context, const packet_header& with, const aead_clear& as) {
+        opened = sealed;
+        std::optional<size_t> result = context.open(with, opened.data(), opened.size(), as);
+        return result && *result == length && std::memcmp(opened.data() + AEAD_SALT_SIZE, plain.data(), length) == 0;
+      };
+      if (!open(receiver, header, clear) || open(forger, header, clear)) { return false; }
+
+      // Cualquier byte cambiado, otra posición en el fichero u otra fila de paridad se rechazan
+      for (size_t position : {size_t{AEAD_SALT_SIZE}, AEAD_SALT_SIZE + length - 1, sealed.size() - 1}) {
+        sealed[position] ^= 0x40;
+        bool accepted = open(receiver, header, clear);
+        sealed[position] ^= 0x40;
+        if (accepted) { return false; }
+      }
+      packet_header moved = header;
+      moved.offset += 1400;
+      if (open(receiver, moved, clear)) { return false; }
+      if (clear.length > 0) {
+        uint8_t changed[8];
+        std::memcpy(changed, prefix, sizeof(changed));
+        changed[4] ^= 1;
+        if (open(receiver, header, {changed, sizeof(changed), 1}) || open(receiver, header, {prefix, sizeof(prefix), 2})) { return false; }
+      }
+    }
+
+    // Cifrado en su sitio, como el de los bloques que se comprimen tras el hueco de la sal
+    std::vector<uint8_t> in_place(length + AEAD_OVERHEAD);
+    std::memcpy(in_place.data() + AEAD_SALT_SIZE, plain.data(), length);
+    cipher.seal(header, in_place.data() + AEAD_SALT_SIZE, length, in_place.data());
+    cipher.seal(header, plain.data(), length, sealed.data());
+    if (in_place != sealed) { return false; }
+  }
+  return true;
+}
+
+int main() {
+  std::mt19937_64 random(42);
+  if (!check(random, aead_algorithm::aes_256_gcm) || !check(random, aead_algorithm::chacha20_poly1305)) {
+    std::cerr << "Error: El cifrado autenticado no descifra lo cifrado o acepta datos modificados." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Algoritmo por defecto en este procesador: " << aead_name(aead_best_algorithm()) << std::endl;
+
+  aead_secret secret;
+  for (uint8_t& byte : secret) { byte = static_cast<uint8_t>(random()); }
+  for (size_t chunk : CHUNK_SIZES) {
+    size_t count = MEASURED_BYTES / chunk;
+    std::vector<uint8_t> buffer(count * chunk);
+    for (uint8_t& byte : buffer) { byte = static_cast<uint8_t>(random()); }
+    std::vector<uint8_t> sealed(count * (chunk + AEAD_OVERHEAD));
+    std::vector<uint8_t> scratch(chunk + AEAD_OVERHEAD);
+
+    std::cout << std::endl << "Bloques de " << chunk << " bytes:" << std::endl;
+    report("CRC32C (ya se calcula de cada bloque)", measure_bytes(count, chunk, [&](size_t i) { crc32c(buffer.data() + i * chunk, chunk); }));
+    for (aead_algorithm algorithm : {aead_algorithm::aes_256_gcm, aead_algorithm::chacha20_poly1305}) {
+      aead_context cipher(*make_key(secret, algorithm));
+      packet_header header;
+      header.flags = cipher.flags();
+      std::string name = aead_name(algorithm);
+      report(name + ", cifrar (emisor)", measure_bytes(count, chunk, [&](size_t i) {
+        header.sequence = i;
+        cipher.seal(header, buffer.data() + i * chunk, chunk, sealed.data() + i * (chunk + AEAD_OVERHEAD));
+      }));
+      // El receptor descifra en su sitio; se hace sobre una copia para poder repetir la medida (la copia se mide aparte)
+      double copy = measure_bytes(count, chunk, [&](size_t i) { std::memcpy(scratch.data(), sealed.data() + i * (chunk + AEAD_OVERHEAD), scratch.size()); });
+      double open = measure_bytes(count, chunk, [&](size_t i) {
+        header.sequence = i;
+        std::memcpy(scratch.data(), sealed.data() + i * (chunk + AEAD_OVERHEAD), scratch.size());
+        if (!cipher.open(header, scratch.data(), scratch.size())) { std::abort(); }
+      });
+      report(name + ", descifrar (receptor)", std::max(open - copy, 1e-6));
+    }
+  }
+  return EXIT_SUCCESS;
+}
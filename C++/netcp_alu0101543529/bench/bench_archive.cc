@@ -0,0 +1,119 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark de la extracción de directorios (-R): ficheros pequeños extraídos por segundo, comprobando antes que
+ *         se rechazan los flujos hostiles (tamaños cuya suma se desborda, enlaces enormes) y que ninguna entrada sale del
+ *         directorio de destino a través de un enlace simbólico, ni de uno que ya estuviera ni de uno extraído antes
+ */
+
+#include "header_files/archive.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Ficheros y tamaño de cada uno del directorio que se extrae en la medida
+constexpr size_t FILE_COUNT = 5000;
+constexpr size_t FILE_SIZE = 4096;
+
+/**
+ * @brief Función que escribe un flujo (manifiesto y contenido) en un fichero y lo extrae en un directorio.
+ * @param[in] entries: manifiesto.
+ * @param[in] contents: contenido de los ficheros y enlaces, que va detrás del manifiesto.
+ * @param[in] root: directorio de destino (ya creado).
+ * @return Devuelve el resultado de extract_archive().
+ */
+std::error_code extract(const std::vector<archive_entry>& entries, const std::vector<uint8_t>& contents, const std::string& root) {
+  std::vector<uint8_t> archive = encode_manifest(entries);
+  archive.insert(archive.end(), contents.begin(), contents.end());
+  const std::string path = "/tmp/bench_archive.flujo";
+  int archive_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  std::error_code error(EIO, std::system_category());
+  if (archive_fd != -1 && root_fd != -1 && write(archive_fd, archive.data(), archive.size()) == static_cast<ssize_t>(archive.size())) {
+    error = extract_archive(archive_fd, root_fd);
+  }
+  if (archive_fd != -1) { close(archive_fd); }
+  if (root_fd != -1) { close(root_fd); }
+  std::remove(path.c_str());
+  return error;
+}
+
+/**
+ * @brief Función que comprueba que la extracción rechaza los flujos hostiles sin salirse del directorio de destino.
+ * @param[in] base: directorio de trabajo (vacío).
+ * @return Devuelve true si todo se comporta como debe.
+ */
+bool check(const std::filesystem::path& base) {
+  std::filesystem::path root = base / "destino";
+  std::filesystem::path outside = base / "fuera";
+  std::filesystem::create_directories(root);
+  std::filesystem::create_directories(outside);
+  std::vector<uint8_t> data = {'h', 'o', 'l', 'a'};
+
+  // Un enlace que ya estaba en el destino no sirve para escribir fuera, ni en un directorio intermedio ni en uno anidado
+  std::filesystem::create_directory_symlink(outside, root / "enlace");
+  const std::vector<archive_entry> through_file = {{archive_entry_type::file, 0644, data.size(), "enlace/fichero", ""}};
+  const std::vector<archive_entry> through_directory = {{archive_entry_type::directory, 0755, 0, "enlace/sub", ""}};
+  bool rejected = extract(through_file, data, root) && extract(through_directory, {}, root);
+  if (!rejected || std::filesystem::exists(outside / "fichero") || std::filesystem::exists(outside / "sub")) { return false; }
+
+  // Tampoco uno extraído antes (en otro flujo al mismo destino)
+  std::string outside_path = outside.string();
+  std::vector<uint8_t> target(outside_path.begin(), outside_path.end());
+  const std::vector<archive_entry> own_link = {{archive_entry_type::symlink, 0777, target.size(), "propio", ""}};
+  const std::vector<archive_entry> through_own_link = {{archive_entry_type::file, 0644, data.size(), "propio/fichero", ""}};
+  if (extract(own_link, target, root) || !extract(through_own_link, data, root) || std::filesystem::exists(outside / "fichero")) {
+    return false;
+  }
+
+  // Tamaños cuya suma se desborda y enlaces más largos que una ruta se rechazan sin llegar a leerlos
+  const std::vector<archive_entry> overflowing = {{archive_entry_type::file, 0644, UINT64_MAX - 2, "a", ""},
+                                                  {archive_entry_type::symlink, 0777, 8, "b", ""}};
+  const std::vector<archive_entry> long_link = {{archive_entry_type::symlink, 0777, data.size() + 1ULL * PATH_MAX, "c", ""}};
+  if (!extract(overflowing, data, root) || !extract(long_link, std::vector<uint8_t>(PATH_MAX + 4), root)) { return false; }
+
+  // Y un flujo normal se extrae bien
+  const std::vector<archive_entry> normal = {{archive_entry_type::directory, 0755, 0, "d", ""},
+                                             {archive_entry_type::file, 0644, data.size(), "d/fichero", ""}};
+  return !extract(normal, data, root) && std::filesystem::file_size(root / "d" / "fichero") == data.size();
+}
+
+int main() {
+  set_log_level(log_level::error);
+  std::filesystem::path base = "/tmp/bench_archive";
+  std::filesystem::remove_all(base);
+  bool ok = check(base);
+  std::filesystem::remove_all(base);
+  if (!ok) {
+    std::cerr << "Error: La extracción acepta un flujo hostil o escribe fuera del directorio de destino." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Un directorio con muchos ficheros pequeños, repartidos en subdirectorios de 100
+  std::vector<archive_entry> entries;
+  for (size_t i = 0; i < FILE_COUNT; ++i) {
+    if (i % 100 == 0) { entries.push_back({archive_entry_type::directory, 0755, 0, "dir" + std::to_string(i / 100), ""}); }
+    entries.push_back({archive_entry_type::file, 0644, FILE_SIZE, "dir" + std::to_string(i / 100) + "/f" + std::to_string(i), ""});
+  }
+  std::vector<uint8_t> contents(FILE_COUNT * FILE_SIZE, 'x');
+  std::filesystem::create_directories(base);
+  auto start = std::chrono::steady_clock::now();
+  std::error_code error = extract(entries, contents, base.string());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::filesystem::remove_all(base);
+  if (error) {
+    std::cerr << "Error: No se ha podido extraer el directorio de prueba." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << FILE_COUNT << " ficheros de " << FILE_SIZE << " bytes extraídos en " << std::fixed << std::setprecision(3) << elapsed.count()
+            << " s (" << std::setprecision(0) << FILE_COUNT / elapsed.count() << " ficheros/s)" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark de la interfaz asíncrona: N transferencias simultáneas por loopback (N emisores y N receptores), todas
+ *         en el bucle de eventos de un solo hilo, comprobando el CRC32C de cada una
+ */
+
+#include "header_files/async.h"
+#include "header_files/checksum.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <sys/resource.h>
+
+// Tamaño del fichero de cada transferencia, primer puerto de los receptores y número de transferencias simultáneas de cada
+// medida (se pueden indicar otras como argumentos: obj/bench/bench_async 10 5000)
+constexpr size_t FILE_SIZE = 256 << 10;
+constexpr uint16_t BASE_PORT = 21000;
+const std::vector<size_t> DEFAULT_COUNTS = {1, 100, 1000};
+
+/**
+ * @brief Tarea que recibe una transferencia y comprueba que su CRC32C es el del fichero.
+ */
+task<void> receive_one(event_loop& loop, std::string path, sockaddr_storage address, netcp_options options, uint32_t expected, size_t& failures) {
+  transfer_result result = co_await receive_file(loop, path, address, options);
+  if (!result || *result != expected) { ++failures; }
+}
+
+/**
+ * @brief Tarea que envía el fichero a un receptor y comprueba el CRC32C que confirma.
+ */
+task<void> send_one(event_loop& loop, std::string path, sockaddr_storage destination, netcp_options options, uint32_t expected, size_t& failures) {
+  transfer_result result = co_await send_file(loop, path, destination, options);
+  if (!result || *result != expected) { ++failures; }
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> counts;
+  for (int i = 1; i < argc; ++i) { counts.push_back(std::strtoull(argv[i], nullptr, 10)); }
+  if (counts.empty()) { counts = DEFAULT_COUNTS; }
+
+  // Cada transferencia necesita dos sockets y dos ficheros abiertos a la vez
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  set_log_level(log_level::error);
+
+  std::vector<uint8_t> data(FILE_SIZE);
+  std::mt19937_64 random(42);
+  for (uint8_t& byte : data) { byte = static_cast<uint8_t>(random()); }
+  const std::string source = "/tmp/bench_async.in";
+  std::ofstream(source, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  const uint32_t expected = crc32c(data.data(), data.size());
+
+  bool ok = true;
+  for (size_t count : counts) {
+    event_loop loop;
+    netcp_options options;
+    size_t failures = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+      sockaddr_storage address = *make_ip_address("127.0.0.1", static_cast<uint16_t>(BASE_PORT + i));
+      loop.spawn(receive_one(loop, "/tmp/bench_async." + std::to_string(i), address, options, expected, failures));
+      loop.spawn(send_one(loop, source, address, options, expected, failures));
+    }
+    // El tiempo incluye los LINGER_TIMEOUT ms que cada receptor sigue respondiendo a los FIN repetidos tras completar el fichero
+    std::error_code error = loop.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    for (size_t i = 0; i < count; ++i) { std::remove(("/tmp/bench_async." + std::to_string(i)).c_str()); }
+
+    std::cout << std::setw(6) << count << " transferencias simultáneas de " << (FILE_SIZE >> 10) << " KiB en un hilo: " << std::fixed
+              << std::setprecision(3) << elapsed.count() << " s (" << std::setprecision(1)
+              << count * FILE_SIZE / elapsed.count() / 1e6 << " MB/s), " << failures << " fallidas" << std::endl;
+    ok &= !error && failures == 0;
+  }
+  std::remove(source.c_str());
+
+  if (!ok) {
+    std::cerr << "Error: Alguna transferencia no ha terminado o su CRC32C no coincide." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
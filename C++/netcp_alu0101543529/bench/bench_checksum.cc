@@ -0,0 +1,69 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark del CRC32C: coste por datagrama frente al tiempo que tarda en enviarse
+ */
+
+#include "header_files/checksum.h"
+#include "header_files/protocol.h"
+#include "bench_util.h"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Tamaño de los datos de un datagrama y número de datagramas que se procesan en cada medida (64 MiB en total)
+constexpr size_t CHUNK = 4096;
+constexpr size_t CHUNKS = 16384;
+
+/**
+ * @brief Función que muestra una medida: tiempo por datagrama, rendimiento y fracción del tiempo de envío del datagrama.
+ * @param[in] name: nombre de la medida.
+ * @param[in] nanoseconds: nanosegundos por datagrama.
+ */
+void report(const std::string& name, double nanoseconds) {
+  // Tiempo que tarda un datagrama (cabecera y datos) en salir por enlaces de 1 y 10 Gbit/s
+  double wire_1g = (PACKET_HEADER_SIZE + CHUNK) * 8 / 1.0;
+  double wire_10g = (PACKET_HEADER_SIZE + CHUNK) * 8 / 10.0;
+  report_line(name, 28, {{nanoseconds, 1, 9, " ns/datagrama"}, {CHUNK / nanoseconds, 1, 9, " GB/s"},
+                         {100 * nanoseconds / wire_1g, 1, 8, "% a 1 Gbit/s"}, {100 * nanoseconds / wire_10g, 1, 8, "% a 10 Gbit/s"}});
+}
+
+int main() {
+  std::mt19937_64 random(42);
+  std::vector<uint8_t> buffer(CHUNKS * CHUNK);
+  for (uint8_t& byte : buffer) { byte = static_cast<uint8_t>(random()); }
+
+  // Antes de medir, comprobamos que las dos implementaciones dan el mismo resultado (y el valor de referencia del CRC32C)
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  if (crc32c(check, sizeof(check)) != 0xE3069283 || crc32c(buffer.data(), buffer.size()) != crc32c_scalar(buffer.data(), buffer.size())) {
+    std::cerr << "Error: Las implementaciones del CRC32C no coinciden." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "CRC32C con instrucciones del procesador: " << (crc32c_hardware() ? "sí (SSE4.2 + PCLMUL)" : "no") << std::endl;
+  volatile uint32_t sink = 0;
+  report("crc32c (tablas)", measure(CHUNKS, [&](size_t i) { sink = crc32c_scalar(buffer.data() + i * CHUNK, CHUNK); }));
+  report("crc32c", measure(CHUNKS, [&](size_t i) { sink = crc32c(buffer.data() + i * CHUNK, CHUNK); }));
+
+  // Lo que hace cada lado por datagrama: el emisor sella la cabecera (el CRC32C de los datos ya está calculado) y el receptor
+  // comprueba el datagrama completo
+  std::vector<uint8_t> packet(PACKET_HEADER_SIZE + CHUNK);
+  packet_header header;
+  header.length = CHUNK;
+  uint32_t payload_checksum = crc32c(buffer.data(), CHUNK);
+  report("seal_header (emisor)", measure(CHUNKS, [&](size_t i) {
+    header.sequence = i;
+    encode_header(header, packet.data());
+    seal_header(packet.data(), payload_checksum, CHUNK);
+  }));
+  std::copy(buffer.begin(), buffer.begin() + CHUNK, packet.begin() + PACKET_HEADER_SIZE);
+  report("verify_checksum (receptor)", measure(CHUNKS, [&](size_t) { sink = verify_checksum(packet.data(), packet.size()); }));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark del envío en abanico: CPU del emisor al enviar un fichero cifrado a N receptores por loopback con un
+ *         solo envío en abanico (cada bloque se lee y se cifra una vez) y con N envíos independientes (cada uno lo lee y lo
+ *         cifra de nuevo), comprobando el CRC32C de lo que recibe cada receptor
+ */
+
+#include "header_files/async.h"
+#include "header_files/fanout.h"
+#include "header_files/checksum.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+// Tamaño del fichero, primer puerto de los receptores y número de receptores de cada medida (se pueden indicar otros como
+// argumentos: obj/bench/bench_fanout 2 8 32)
+constexpr size_t FILE_SIZE = 32 << 20;
+constexpr uint16_t BASE_PORT = 22000;
+const std::vector<size_t> DEFAULT_COUNTS = {1, 4, 16};
+
+/**
+ * @brief Tarea que recibe una transferencia y comprueba que su CRC32C es el del fichero.
+ */
+task<void> receive_one(event_loop& loop, std::string path, sockaddr_storage address, netcp_options options, uint32_t expected,
+                       std::atomic<size_t>& failures) {
+  transfer_result result = co_await receive_file(loop, path, address, options);
+  if (!result || *result != expected) { ++failures; }
+}
+
+/**
+ * @brief Tarea que envía el fichero a un receptor, independientemente de los demás.
+ */
+task<void> send_one(event_loop& loop, std::string path, sockaddr_storage destination, netcp_options options, std::atomic<size_t>& failures) {
+  transfer_result result = co_await send_file(loop, path, destination, options);
+  if (!result) { ++failures; }
+}
+
+/**
+ * @brief Función que devuelve el tiempo de CPU (de usuario y de sistema) consumido hasta ahora por el hilo que la llama.
+ */
+double thread_cpu_seconds() {
+  rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Función que envía el fichero a count receptores, que reciben en otro hilo con su propio bucle de eventos.
+ * @param[in] send: envío que se mide, a los receptores indicados.
+ * @return Devuelve los segundos de CPU del hilo emisor, o un valor negativo si algún receptor no ha recibido bien el fichero.
+ */
+double measure(size_t count, const netcp_options& options, uint32_t expected,
+               const std::function<bool(const std::vector<sockaddr_storage>&)>& send) {
+  std::vector<sockaddr_storage> receivers;
+  for (size_t i = 0; i < count; ++i) { receivers.push_back(*make_ip_address("127.0.0.1", static_cast<uint16_t>(BASE_PORT + i))); }
+
+  std::atomic<size_t> failures = 0;
+  std::thread receiving([&]() {
+    event_loop loop;
+    for (size_t i = 0; i < count; ++i) {
+      loop.spawn(receive_one(loop, "/tmp/bench_fanout." + std::to_string(i), receivers[i], options, expected, failures));
+    }
+    loop.run();
+  });
+  // Los receptores tienen que estar escuchando antes de que llegue el primer datagrama
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  double start = thread_cpu_seconds();
+  bool sent = send(receivers);
+  double cpu = thread_cpu_seconds() - start;
+  receiving.join();
+  for (size_t i = 0; i < count; ++i) { std::remove(("/tmp/bench_fanout." + std::to_string(i)).c_str()); }
+  return (sent && failures == 0) ? cpu : -1;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> counts;
+  for (int i = 1; i < argc; ++i) { counts.push_back(std::strtoull(argv[i], nullptr, 10)); }
+  if (counts.empty()) { counts = DEFAULT_COUNTS; }
+  set_log_level(log_level::error);
+
+  std::vector<uint8_t> data(FILE_SIZE);
+  std::mt19937_64 random(42);
+  for (uint8_t& byte : data) { byte = static_cast<uint8_t>(random()); }
+  const std::string source = "/tmp/bench_fanout.in";
+  std::ofstream(source, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  const uint32_t expected = crc32c(data.data(), data.size());
+
+  netcp_options options;
+  aead_secret secret;
+  for (uint8_t& byte : secret) { byte = static_cast<uint8_t>(random()); }
+  options.secret = secret;
+
+  bool ok = true;
+  std::cout << "Fichero de " << (FILE_SIZE >> 20) << " MiB cifrado; segundos de CPU del emisor:" << std::endl;
+  for (size_t count : counts) {
+    double fanout = measure(count, options, expected, [&](const std::vector<sockaddr_storage>& receivers) {
+      netcp_options fanout_options = options;
+      fanout_options.receivers = receivers;
+      return !netcp_send_fanout(source, fanout_options);
+    });
+    double independent = measure(count, options, expected, [&](const std::vector<sockaddr_storage>& receivers) {
+      event_loop loop;
+      std::atomic<size_t> failures = 0;
+      for (const sockaddr_storage& receiver : receivers) { loop.spawn(send_one(loop, source, receiver, options, failures)); }
+      return !loop.run() && failures == 0;
+    });
+    std::cout << std::setw(4) << count << " receptores: en abanico " << std::fixed << std::setprecision(3) << std::setw(7) << fanout
+              << " s, con envíos independientes " << std::setw(7) << independent << " s" << std::endl;
+    ok &= fanout >= 0 && independent >= 0;
+  }
+  std::remove(source.c_str());
+
+  if (!ok) {
+    std::cerr << "Error: Algún receptor no ha recibido el fichero o su CRC32C no coincide." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
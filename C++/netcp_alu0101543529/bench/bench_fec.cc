@@ -0,0 +1,161 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark de la corrección de errores: rendimiento de cada implementación del producto y suma en GF(2^8) y
+ *         coste de codificar y reconstruir un grupo, comprobando antes que todas las implementaciones coinciden y que
+ *         cualquier combinación de bloques perdidos se reconstruye
+ */
+
+#include "header_files/fec.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Tamaño de los bloques (el de la MTU de Ethernet) y número de bloques que se procesan en cada medida (unos 64 MiB en total)
+constexpr size_t CHUNK = 1400;
+constexpr size_t CHUNKS = 48000;
+
+// Grupo con el que se mide la codificación y la reconstrucción: K bloques de datos y M de paridad
+constexpr size_t GROUP_DATA = 16;
+constexpr size_t GROUP_PARITY = 2;
+
+/**
+ * @brief Función que muestra una medida: tiempo por bloque, rendimiento y velocidad de línea que se puede mantener.
+ * @param[in] name: nombre de la medida.
+ * @param[in] nanoseconds: nanosegundos por bloque.
+ */
+void report(const std::string& name, double nanoseconds) {
+  report_line(name, 36, {{nanoseconds, 1, 9, " ns/bloque"}, {CHUNK / nanoseconds, 1, 9, " GB/s"}, {CHUNK * 8 / nanoseconds, 1, 9, " Gbit/s de datos"}});
+}
+
+/**
+ * @brief Función que comprueba que las implementaciones del producto y suma dan el mismo resultado que el producto elemento a
+ *        elemento, con todos los factores y con tamaños que no son múltiplo del de los registros.
+ * @return Devuelve true si todas coinciden.
+ */
+bool check_kernels(std::mt19937_64& random) {
+  std::vector<gf_kernel> kernels = {gf_kernel::scalar};
+  if (gf_best_kernel() != gf_kernel::scalar) { kernels.push_back(gf_kernel::ssse3); }
+  if (gf_best_kernel() == gf_kernel::avx2) { kernels.push_back(gf_kernel::avx2); }
+
+  std::vector<uint8_t> source(1000), initial(1000), expected(1000), result(1000);
+  for (unsigned factor = 0; factor < 256; ++factor) {
+    size_t length = 1 + random() % source.size();
+    for (size_t i = 0; i < length; ++i) {
+      source[i] = static_cast<uint8_t>(random());
+      initial[i] = static_cast<uint8_t>(random());
+      expected[i] = initial[i] ^ gf_multiply(static_cast<uint8_t>(factor), source[i]);
+    }
+    for (gf_kernel kernel : kernels) {
+      std::copy(initial.begin(), initial.begin() + static_cast<std::ptrdiff_t>(length), result.begin());
+      gf_multiply_add(kernel, result.data(), source.data(), static_cast<uint8_t>(factor), length);
+      if (!std::equal(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(length), expected.begin())) { return false; }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Función que codifica un grupo de K bloques (el último más corto) con M paridades y comprueba que se reconstruye
+ *        perdiendo cada combinación de hasta M bloques de datos, con las paridades que hayan quedado.
+ * @return Devuelve true si todas las combinaciones se reconstruyen.
+ */
+bool check_recovery(std::mt19937_64& random, size_t data_count, size_t parity_count) {
+  std::vector<std::vector<uint8_t>> data(data_count, std::vector<uint8_t>(CHUNK));
+  std::vector<size_t> lengths(data_count, CHUNK);
+  lengths.back() = CHUNK / 3;
+  for (std::vector<uint8_t>& block : data) {
+    for (uint8_t& byte : block) { byte = static_cast<uint8_t>(random()); }
+  }
+  for (size_t i = lengths.back(); i < CHUNK; ++i) { data.back()[i] = 0; }
+
+  std::vector<std::vector<uint8_t>> parity(parity_count, std::vector<uint8_t>(CHUNK, 0));
+  std::vector<uint8_t*> symbols;
+  std::vector<size_t> all_rows;
+  for (size_t row = 0; row < parity_count; ++row) {
+    symbols.push_back(parity[row].data());
+    all_rows.push_back(row);
+  }
+  for (size_t column = 0; column < data_count; ++column) { fec_accumulate(symbols, all_rows, column, data[column].data(), lengths[column]); }
+
+  // Se pierden los bloques de datos marcados en mask (como mucho M) y se usan las últimas paridades, para no usar siempre la 0
+  for (uint64_t mask = 1; mask < (uint64_t{1} << data_count); ++mask) {
+    std::vector<size_t> missing;
+    for (size_t column = 0; column < data_count; ++column) {
+      if (mask >> column & 1) { missing.push_back(column); }
+    }
+    if (missing.size() > parity_count) { continue; }
+
+    std::vector<std::vector<uint8_t>> syndromes;
+    std::vector<size_t> rows;
+    for (size_t row = parity_count - missing.size(); row < parity_count; ++row) {
+      syndromes.push_back(parity[row]);
+      rows.push_back(row);
+    }
+    std::vector<uint8_t*> syndrome_pointers;
+    for (std::vector<uint8_t>& syndrome : syndromes) { syndrome_pointers.push_back(syndrome.data()); }
+    for (size_t column = 0; column < data_count; ++column) {
+      if (!(mask >> column & 1)) { fec_accumulate(syndrome_pointers, rows, column, data[column].data(), lengths[column]); }
+    }
+
+    std::vector<std::vector<uint8_t>> outputs(missing.size(), std::vector<uint8_t>(CHUNK));
+    std::vector<uint8_t*> output_pointers;
+    for (std::vector<uint8_t>& output : outputs) { output_pointers.push_back(output.data()); }
+    if (!fec_recover(syndrome_pointers, rows, missing, output_pointers, CHUNK)) { return false; }
+    for (size_t i = 0; i < missing.size(); ++i) {
+      if (outputs[i] != data[missing[i]]) { return false; }
+    }
+  }
+  return true;
+}
+
+int main() {
+  std::mt19937_64 random(42);
+  // Se prueban grupos pequeños con todas las combinaciones, y uno con el máximo de paridades (con las combinaciones de bloques
+  // de los 10 primeros)
+  if (!check_kernels(random) || !check_recovery(random, 4, 1) || !check_recovery(random, 8, 3) || !check_recovery(random, 12, 4) ||
+      !check_recovery(random, 10, FEC_MAX_PARITY)) {
+    std::cerr << "Error: La aritmética en GF(2^8) o la reconstrucción de los bloques perdidos no es correcta." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<uint8_t> buffer(CHUNKS * CHUNK);
+  for (uint8_t& byte : buffer) { byte = static_cast<uint8_t>(random()); }
+  std::vector<uint8_t> accumulator(CHUNK, 0);
+
+  const char* names[] = {"escalar", "SSSE3", "AVX2"};
+  std::cout << "Implementación del producto en GF(2^8): " << names[static_cast<int>(gf_best_kernel())] << std::endl;
+  for (gf_kernel kernel : {gf_kernel::scalar, gf_kernel::ssse3, gf_kernel::avx2}) {
+    if (kernel > gf_best_kernel()) { break; }
+    std::string name = names[static_cast<int>(kernel)];
+    report(name + " (factor 1, XOR)", measure(CHUNKS, [&](size_t i) { gf_multiply_add(kernel, accumulator.data(), buffer.data() + i * CHUNK, 1, CHUNK); }));
+    report(name + " (factor 0x8E)", measure(CHUNKS, [&](size_t i) { gf_multiply_add(kernel, accumulator.data(), buffer.data() + i * CHUNK, 0x8E, CHUNK); }));
+  }
+
+  // Lo que hace cada lado por bloque de datos con --fec 16,2: el emisor lo suma a las dos paridades de su grupo, y el receptor,
+  // para reconstruir un grupo al que le faltan dos bloques, suma los otros 14 a los síndromes y resuelve el sistema
+  std::vector<uint8_t> parity(GROUP_PARITY * CHUNK, 0);
+  std::vector<uint8_t*> symbols = {parity.data(), parity.data() + CHUNK};
+  std::vector<size_t> rows = {0, 1};
+  report("codificar (--fec 16,2, emisor)", measure(CHUNKS, [&](size_t i) {
+    fec_accumulate(symbols, rows, i % GROUP_DATA, buffer.data() + i * CHUNK, CHUNK);
+  }));
+  std::vector<uint8_t> recovered(GROUP_PARITY * CHUNK);
+  std::vector<uint8_t*> outputs = {recovered.data(), recovered.data() + CHUNK};
+  std::vector<size_t> missing = {3, 11};
+  report("reconstruir (2 de 16, receptor)", measure(CHUNKS, [&](size_t i) {
+    if (i % GROUP_DATA == 0) { fec_recover(symbols, rows, missing, outputs, CHUNK); }
+    fec_accumulate(symbols, rows, i % GROUP_DATA, buffer.data() + i * CHUNK, CHUNK);
+  }));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark del registro de mensajes: coste de emitir un mensaje desde varios hilos a la vez, comprobando antes
+ *         que, aunque el anillo se llene y se descarten mensajes, no se pierde ningún aviso y log_flush() no vuelve hasta que
+ *         se han escrito todos los que se aceptaron
+ */
+
+#include "header_files/logger.h"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Hilos que emiten a la vez, mensajes que emite cada uno en cada ráfaga (muchos más de los que caben en el anillo) y cada
+// cuántos de ellos es un aviso en la ráfaga que comprueba que no se pierden
+constexpr size_t THREADS = 4;
+constexpr size_t MESSAGES = 16 * LOG_RING_SIZE;
+constexpr size_t WARNING_EVERY = 16;
+
+// Tiempo máximo que se espera a log_flush() antes de darlo por bloqueado
+constexpr std::chrono::seconds FLUSH_TIMEOUT{10};
+
+/**
+ * @brief Función que cuenta las líneas escritas hasta ahora en un fichero.
+ */
+size_t count_lines(int fd) {
+  size_t lines = 0;
+  char buffer[65536];
+  ssize_t length;
+  for (off_t offset = 0; (length = pread(fd, buffer, sizeof(buffer), offset)) > 0; offset += length) {
+    for (ssize_t i = 0; i < length; ++i) { lines += (buffer[i] == '\n'); }
+  }
+  return lines;
+}
+
+/**
+ * @brief Función que emite una ráfaga de mensajes desde varios hilos a la vez.
+ * @param[in] warnings: si es true, uno de cada WARNING_EVERY mensajes es un aviso.
+ * @return Devuelve los nanosegundos por mensaje que ha tardado en emitirlos cada hilo (de media).
+ */
+double burst(bool warnings) {
+  std::vector<std::thread> threads;
+  std::vector<double> elapsed(THREADS);
+  for (size_t t = 0; t < THREADS; ++t) {
+    threads.emplace_back([t, warnings, &elapsed]() {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < MESSAGES; ++i) {
+        if (warnings && i % WARNING_EVERY == 0) {
+          log_warning() << "Aviso " << i << " del hilo " << t;
+        } else {
+          log_info() << "Mensaje " << i << " del hilo " << t;
+        }
+      }
+      elapsed[t] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / MESSAGES;
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  double total = 0;
+  for (double value : elapsed) { total += value; }
+  return total / THREADS;
+}
+
+int main() {
+  // Los mensajes van a dos ficheros (uno por salida), en los que se cuentan los que se han escrito
+  const char* path = "/tmp/bench_logger.log";
+  const char* error_path = "/tmp/bench_logger.err";
+  int log_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  int error_fd = open(error_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  int stdout_fd = dup(STDOUT_FILENO);
+  int stderr_fd = dup(STDERR_FILENO);
+  if (log_fd == -1 || error_fd == -1 || stdout_fd == -1 || stderr_fd == -1) {
+    std::cerr << "Error: No se han podido crear los ficheros " << path << " y " << error_path << "." << std::endl;
+    return EXIT_FAILURE;
+  }
+  dup2(log_fd, STDOUT_FILENO);
+  dup2(error_fd, STDERR_FILENO);
+  set_log_level(log_level::info);
+
+  // Cada ráfaga llena el anillo; tras log_flush() están escritos todos los aceptados, así que no aparece ninguno más después
+  bool overflowed = false;
+  bool drained = true;
+  double best = 0;
+  for (int repetition = 0; repetition < 5; ++repetition) {
+    double per_message = burst(false);
+    if (repetition == 0 || per_message < best) { best = per_message; }
+    // Si log_flush() espera a más mensajes de los aceptados, no vuelve nunca: se espera desde otro hilo, con un plazo
+    std::promise<void> flushed;
+    std::future<void> done = flushed.get_future();
+    std::thread([flushed = std::move(flushed)]() mutable {
+      log_flush();
+      flushed.set_value();
+    }).detach();
+    if (done.wait_for(FLUSH_TIMEOUT) != std::future_status::ready) {
+      dup2(stdout_fd, STDOUT_FILENO);
+      dup2(stderr_fd, STDERR_FILENO);
+      std::cerr << "Error: log_flush() no vuelve después de que se llene el anillo." << std::endl;
+      std::_Exit(EXIT_FAILURE);
+    }
+    size_t written = count_lines(log_fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    drained &= count_lines(log_fd) == written;
+    overflowed |= written < (repetition + 1) * THREADS * MESSAGES;
+  }
+
+  // Con el anillo lleno se descartan los mensajes informativos, pero todos los avisos llegan a la salida de error
+  burst(true);
+  log_flush();
+  bool warned = count_lines(error_fd) == THREADS * MESSAGES / WARNING_EVERY;
+
+  dup2(stdout_fd, STDOUT_FILENO);
+  dup2(stderr_fd, STDERR_FILENO);
+  close(stdout_fd);
+  close(stderr_fd);
+  close(log_fd);
+  close(error_fd);
+  std::remove(path);
+  std::remove(error_path);
+  if (!drained || !warned) {
+    std::cerr << "Error: " << (drained ? "Se han descartado avisos con el anillo lleno." : "log_flush() ha vuelto antes de que se escribieran todos los mensajes aceptados.")
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << THREADS << " hilos emitiendo a la vez: " << std::fixed << std::setprecision(1) << best << " ns por mensaje"
+            << (overflowed ? " (con el anillo lleno, descartando mensajes)" : "") << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Microbenchmark del lanzamiento de procesos: fork() frente a posix_spawnp() desde un proceso con mucha memoria, y
+ *         lanzamiento en paralelo con subprocess_pool, comprobando antes que el conjunto no se queda esperando a un proceso
+ *         que ignora SIGTERM y que no pierde los procesos recogidos cuando falla la recogida de otro
+ */
+
+#include "header_files/subprocess.h"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Número de comandos que se lanzan en cada medida y memoria que ocupa el proceso padre (512 MiB)
+constexpr size_t LAUNCHES = 200;
+constexpr size_t PARENT_MEMORY = 512 << 20;
+
+/**
+ * @brief Función que mide el tiempo medio por comando de una forma de lanzar LAUNCHES comandos y esperar a que terminen.
+ * @param[in] name: nombre de la medida.
+ * @param[in] run: función que lanza los comandos y los espera; devuelve false si alguno ha fallado.
+ * @return Devuelve false si algún comando ha fallado.
+ */
+bool report(const std::string& name, const std::function<bool()>& run) {
+  auto start = std::chrono::steady_clock::now();
+  bool ok = run();
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1) << std::setw(9)
+            << elapsed.count() / LAUNCHES << " µs/comando" << std::endl;
+  return ok;
+}
+
+/**
+ * @brief Función que comprueba el conjunto de procesos: al destruirse termina los procesos que ignoran SIGTERM, y si un
+ *        proceso no se puede recoger (aquí, porque lo recogemos antes por nuestra cuenta) devuelve los demás y después el error.
+ * @return Devuelve true si todo se comporta como debe.
+ */
+bool check() {
+  auto start = std::chrono::steady_clock::now();
+  {
+    subprocess_pool pool;
+    if (!pool.launch({"sh", "-c", "trap '' TERM; sleep 30"}, subprocess::stdio::out)) { return false; }
+  }
+  if (std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) { return false; }
+
+  subprocess_pool pool;
+  auto stolen = pool.launch({"true"}, subprocess::stdio::out);
+  auto kept = pool.launch({"true"}, subprocess::stdio::out);
+  if (!stolen || !kept) { return false; }
+  int status = 0;
+  if (waitpid(pool.process(*stolen).pid(), &status, 0) < 0) { return false; }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto finished = pool.wait_all();
+  auto error = pool.reap(0);
+  return finished && finished->size() == 1 && (*finished)[0].id == *kept && !error && pool.running() == 0;
+}
+
+int main() {
+  if (!check()) {
+    std::cerr << "Error: El conjunto de procesos se bloquea al destruirse o pierde procesos recogidos." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // El coste de fork() crece con la memoria del padre (hay que copiar sus tablas de páginas), así que la ocupamos toda
+  std::vector<uint8_t> memory(PARENT_MEMORY);
+  for (size_t i = 0; i < memory.size(); i += 4096) { memory[i] = static_cast<uint8_t>(i); }
+  std::cout << "Lanzando " << LAUNCHES << " veces \"true\" desde un proceso con " << (PARENT_MEMORY >> 20) << " MiB ocupados" << std::endl;
+
+  const std::vector<std::string> command = {"true"};
+  bool ok = report("fork() + execvp() + waitpid()", [&]() {
+    for (size_t i = 0; i < LAUNCHES; ++i) {
+      pid_t pid = fork();
+      if (pid == 0) {
+        char* args[] = {const_cast<char*>("true"), nullptr};
+        execvp(args[0], args);
+        _exit(127);
+      }
+      int status = 0;
+      if (pid < 0 || waitpid(pid, &status, 0) < 0 || status != 0) { return false; }
+    }
+    return true;
+  });
+
+  ok &= report("subprocess (posix_spawnp) + wait()", [&]() {
+    for (size_t i = 0; i < LAUNCHES; ++i) {
+      subprocess process(command, subprocess::stdio::out);
+      if (process.exec() || process.wait() || process.exit_code() != 0) { return false; }
+    }
+    return true;
+  });
+
+  ok &= report("subprocess_pool (pidfd + epoll)", [&]() {
+    subprocess_pool pool;
+    for (size_t i = 0; i < LAUNCHES; ++i) {
+      if (!pool.launch(command, subprocess::stdio::out)) { return false; }
+    }
+    auto finished = pool.wait_all();
+    if (!finished || finished->size() != LAUNCHES) { return false; }
+    for (const finished_process& process : *finished) {
+      if (process.exit_code != 0) { return false; }
+    }
+    return true;
+  });
+
+  if (!ok) {
+    std::cerr << "Error: Algún comando no se ha podido lanzar o ha terminado con error." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,297 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Banco de pruebas de rendimiento de netcp: transfiere ficheros de distintos tamaños por loopback con distintas
+ *         opciones (y a través del proxy con pérdidas, desorden, duplicados y retardo), comprueba que llegan intactos y
+ *         compara los resultados con los de una ejecución anterior
+ *
+ *         Uso: bench_transfer [--netcp RUTA] [--csv FICHERO] [--baseline FICHERO] [TAMAÑO...]   (por ejemplo 1K 1M 4G)
+ */
+
+#include "header_files/netcp.h"
+#include "header_files/reliable.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <sys/resource.h>
+
+// Puertos del receptor y del proxy durante las pruebas
+constexpr uint16_t RECEIVER_PORT = 9400;
+constexpr uint16_t PROXY_PORT = 9401;
+
+// Tamaños que se prueban si no se indica ninguno, y tamaño máximo del fichero con el que se prueban las alteraciones del proxy
+const std::vector<std::string> DEFAULT_SIZES = {"1K", "1M", "64M", "256M"};
+constexpr uint64_t PROXY_CASE_MAX_SIZE = 64000000;
+
+// Caso de prueba: opciones del emisor y, si no está vacío, opciones del proxy por el que pasa la transferencia
+struct transfer_case {
+  std::string name;
+  std::string file;
+  uint64_t size;
+  std::vector<std::string> sender_options;
+  std::vector<std::string> proxy_options;
+  // Tamaño de bloque con el que se envía, para contar los datagramas
+  size_t chunk_size;
+};
+
+// Resultado de un caso: tiempo del emisor, CPU consumida por emisor y receptor, y si el fichero ha llegado intacto
+struct transfer_result {
+  double seconds = 0;
+  double cpu_seconds = 0;
+  bool ok = false;
+};
+
+/**
+ * @brief Función que lee la salida de un proceso hasta que la cierra (para que no se bloquee escribiendo) y espera a que termine.
+ * @param[in] process: proceso lanzado con la salida estándar redirigida.
+ * @return Devuelve true si el proceso ha terminado con código 0.
+ */
+bool drain_and_wait(subprocess& process) {
+  char buffer[4096];
+  while (read(process.stdout_fd(), buffer, sizeof(buffer)) > 0) {}
+  return !process.wait() && process.exit_code() == 0;
+}
+
+/**
+ * @brief Función que crea un fichero de datos aleatorios (que no se pueden comprimir) del tamaño indicado.
+ * @param[in] path: ruta del fichero.
+ * @param[in] size: tamaño en bytes.
+ * @return Devuelve true si se ha podido escribir el fichero.
+ */
+bool make_file(const std::string& path, uint64_t size) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  std::mt19937_64 random(size);
+  std::vector<uint64_t> block(1 << 17);
+  for (uint64_t written = 0; written < size && file;) {
+    for (uint64_t& word : block) { word = random(); }
+    size_t length = static_cast<size_t>(std::min<uint64_t>(size - written, block.size() * sizeof(uint64_t)));
+    file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(length));
+    written += length;
+  }
+  return static_cast<bool>(file);
+}
+
+/**
+ * @brief Función que compara el contenido de dos ficheros.
+ * @return Devuelve true si los dos ficheros existen y son idénticos.
+ */
+bool same_contents(const std::string& first, const std::string& second) {
+  std::ifstream a(first, std::ios::binary), b(second, std::ios::binary);
+  if (!a || !b) { return false; }
+  std::vector<char> buffer_a(1 << 20), buffer_b(1 << 20);
+  while (a && b) {
+    a.read(buffer_a.data(), static_cast<std::streamsize>(buffer_a.size()));
+    b.read(buffer_b.data(), static_cast<std::streamsize>(buffer_b.size()));
+    if (a.gcount() != b.gcount() || !std::equal(buffer_a.begin(), buffer_a.begin() + a.gcount(), buffer_b.begin())) { return false; }
+  }
+  return a.eof() && b.eof();
+}
+
+/**
+ * @brief Función que devuelve el tiempo de CPU (usuario y sistema) de los procesos hijos ya recogidos.
+ */
+double children_cpu_seconds() {
+  rusage usage{};
+  getrusage(RUSAGE_CHILDREN, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief Función que ejecuta un caso: lanza el receptor (y el proxy), mide lo que tarda el emisor en enviar el fichero (termina
+ *        cuando el receptor lo ha confirmado todo) y comprueba que el fichero recibido es idéntico.
+ * @param[in] netcp: ruta del programa netcp.
+ * @param[in] test: caso que se ejecuta.
+ * @param[in] received: ruta en la que el receptor escribe el fichero.
+ * @return Devuelve el resultado del caso.
+ */
+transfer_result run_case(const std::string& netcp, const transfer_case& test, const std::string& received) {
+  transfer_result result;
+  unlink(received.c_str());
+  double cpu_before = children_cpu_seconds();
+
+  // Los procesos heredan el entorno, así que NETCP_PORT se fija justo antes de lanzar cada uno
+  setenv("NETCP_PORT", std::to_string(RECEIVER_PORT).c_str(), 1);
+  subprocess receiver({netcp, "-l", received}, subprocess::stdio::out);
+  if (receiver.exec()) { return result; }
+
+  std::unique_ptr<subprocess> proxy;
+  if (!test.proxy_options.empty()) {
+    std::vector<std::string> args = {netcp, "--proxy", std::to_string(PROXY_PORT), "127.0.0.1:" + std::to_string(RECEIVER_PORT)};
+    args.insert(args.end(), test.proxy_options.begin(), test.proxy_options.end());
+    // El proxy solo termina con una señal, y el aviso que muestra entonces por la salida de error también lo recogemos
+    proxy = std::make_unique<subprocess>(args, subprocess::stdio::outerr);
+    if (proxy->exec()) { return result; }
+  }
+  // Damos tiempo al receptor y al proxy a abrir sus sockets
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::vector<std::string> args = {netcp};
+  args.insert(args.end(), test.sender_options.begin(), test.sender_options.end());
+  args.insert(args.end(), {"-o", test.file});
+  setenv("NETCP_PORT", std::to_string(proxy ? PROXY_PORT : RECEIVER_PORT).c_str(), 1);
+  auto start = std::chrono::steady_clock::now();
+  subprocess sender(args, subprocess::stdio::out);
+  bool sent = !sender.exec() && drain_and_wait(sender);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  bool stored = drain_and_wait(receiver);
+  result.cpu_seconds = children_cpu_seconds() - cpu_before;
+
+  if (proxy) {
+    proxy->kill();
+    drain_and_wait(*proxy);
+  }
+  result.seconds = elapsed.count();
+  result.ok = sent && stored && same_contents(test.file, received);
+  unlink(received.c_str());
+  return result;
+}
+
+/**
+ * @brief Función que lee los resultados de una ejecución anterior (el CSV que escribe este programa).
+ * @return Devuelve los MB/s de cada caso, por nombre.
+ */
+std::map<std::string, double> read_baseline(const std::string& path) {
+  std::map<std::string, double> baseline;
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  while (std::getline(file, line)) {
+    std::stringstream fields(line);
+    std::string name, size, throughput;
+    if (std::getline(fields, name, ',') && std::getline(fields, size, ',') && std::getline(fields, throughput, ',')) {
+      baseline[name] = std::atof(throughput.c_str());
+    }
+  }
+  return baseline;
+}
+
+int main(int argc, char* argv[]) {
+  std::string netcp = "./netcp";
+  std::string csv_path = "obj/bench/bench_transfer.csv";
+  std::string baseline_path;
+  std::vector<std::string> size_names;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--netcp" && i + 1 < argc) { netcp = argv[++i]; }
+    else if (arg == "--csv" && i + 1 < argc) { csv_path = argv[++i]; }
+    else if (arg == "--baseline" && i + 1 < argc) { baseline_path = argv[++i]; }
+    else { size_names.emplace_back(arg); }
+  }
+  if (size_names.empty()) { size_names = DEFAULT_SIZES; }
+  if (access(netcp.c_str(), X_OK) != 0) {
+    std::cerr << "Error: No se encuentra el programa " << netcp << " (compílelo con make o indíquelo con --netcp)." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  char directory_template[] = "/tmp/netcp_bench_XXXXXX";
+  if (mkdtemp(directory_template) == nullptr) {
+    std::cerr << "Error: No se ha podido crear el directorio temporal." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string directory = directory_template;
+  std::string received = directory + "/received";
+
+  // Casos: para cada tamaño, un barrido de lote y número de flujos con el tamaño de bloque que elige el emisor (el de la MTU
+  // de loopback) y otro de tamaños de bloque fijos; con el mayor tamaño que no pase de PROXY_CASE_MAX_SIZE, las alteraciones
+  // del proxy
+  path_socket loopback;
+  loopback.destination = *make_ip_address("127.0.0.1", RECEIVER_PORT);
+  size_t path_chunk_size = choose_chunk_size({loopback}, netcp_options{});
+  std::vector<transfer_case> cases;
+  std::vector<std::string> files;
+  uint64_t proxy_size = 0;
+  std::string proxy_file;
+  std::string proxy_name;
+  for (const std::string& name : size_names) {
+    std::optional<uint64_t> size = parse_size(name);
+    if (!size) {
+      std::cerr << "Error: El tamaño " << name << " no es válido (use, por ejemplo, 1K, 64M o 4G)." << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::string file = directory + "/file_" + name;
+    std::cout << "Generando " << file << " (" << *size << " bytes)..." << std::endl;
+    if (!make_file(file, *size)) {
+      std::cerr << "Error: No se ha podido crear el fichero " << file << "." << std::endl;
+      return EXIT_FAILURE;
+    }
+    files.push_back(file);
+    for (const char* batch : {"8", "32", "128"}) {
+      for (const char* streams : {"1", "4"}) {
+        cases.push_back({name + " -b " + batch + " -j " + streams, file, *size, {"-b", batch, "-j", streams}, {}, path_chunk_size});
+      }
+    }
+    for (const char* chunk_size : {"1400", "4096", "16384"}) {
+      cases.push_back({name + " --chunk-size " + chunk_size, file, *size, {"--chunk-size", chunk_size}, {}, *parse_size(chunk_size)});
+    }
+    // Dos caminos desde distintas direcciones de loopback, para medir lo que cuesta repartir los bloques entre ellos
+    cases.push_back({name + " --path x2", file, *size, {"--path", "127.0.0.2", "--path", "127.0.0.3"}, {}, path_chunk_size});
+    if (*size <= PROXY_CASE_MAX_SIZE && *size >= proxy_size) {
+      proxy_size = *size;
+      proxy_file = file;
+      proxy_name = name;
+    }
+  }
+  if (!proxy_file.empty()) {
+    const std::vector<std::pair<std::string, std::vector<std::string>>> network = {
+        {"pérdida 1%", {"--loss", "0.01"}},
+        {"desorden 5%", {"--reorder", "0.05"}},
+        {"duplicados 5%", {"--duplicate", "0.05"}},
+        {"retardo 5 ms", {"--delay", "5"}},
+        {"todo", {"--loss", "0.01", "--reorder", "0.05", "--duplicate", "0.05", "--delay", "5"}}};
+    for (const auto& [description, options] : network) {
+      cases.push_back({proxy_name + " proxy " + description, proxy_file, proxy_size, {}, options, path_chunk_size});
+    }
+    // Con pérdidas y un RTT largo, cada reenvío cuesta un viaje de ida y vuelta que la paridad de la corrección de errores
+    // ahorra (en lotes pequeños, para que las ráfagas no desborden el socket del proxy)
+    for (bool fec : {false, true}) {
+      std::vector<std::string> sender = {"-b", "4", "--chunk-size", "8000"};
+      if (fec) { sender.insert(sender.end(), {"--fec", "16,2"}); }
+      cases.push_back({proxy_name + " proxy pérdida 5% y 20 ms" + (fec ? " --fec 16,2" : ""), proxy_file, proxy_size, sender,
+                       {"--loss", "0.05", "--delay", "20"}, 8000});
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (!baseline_path.empty()) { baseline = read_baseline(baseline_path); }
+  std::ofstream csv(csv_path);
+  csv << "caso,bytes,MB/s,datagramas/s,CPU s/GB,correcto" << std::endl;
+
+  std::cout << std::left << std::setw(44) << "caso" << std::right << std::setw(10) << "MB/s" << std::setw(14) << "datagramas/s"
+            << std::setw(11) << "CPU s/GB" << std::setw(10) << "correcto" << (baseline.empty() ? "" : "  frente a la referencia") << std::endl;
+  bool all_ok = true;
+  for (const transfer_case& test : cases) {
+    transfer_result result = run_case(netcp, test, received);
+    double megabytes_per_second = test.size / result.seconds / 1e6;
+    double datagrams_per_second = static_cast<double>((test.size + test.chunk_size - 1) / test.chunk_size) / result.seconds;
+    double cpu_per_gigabyte = (test.size > 0) ? result.cpu_seconds / (test.size / 1e9) : 0;
+    all_ok &= result.ok;
+
+    std::cout << std::left << std::setw(44) << test.name << std::right << std::fixed << std::setprecision(1) << std::setw(10)
+              << megabytes_per_second << std::setw(14) << std::setprecision(0) << datagrams_per_second << std::setw(11)
+              << std::setprecision(2) << cpu_per_gigabyte << std::setw(10) << (result.ok ? "sí" : "NO");
+    if (auto it = baseline.find(test.name); it != baseline.end() && it->second > 0) {
+      std::cout << std::showpos << std::setw(10) << std::setprecision(1) << 100 * (megabytes_per_second / it->second - 1) << "%" << std::noshowpos;
+    }
+    std::cout << std::endl;
+    csv << test.name << "," << test.size << "," << megabytes_per_second << "," << datagrams_per_second << "," << cpu_per_gigabyte << ","
+        << (result.ok ? 1 : 0) << std::endl;
+  }
+
+  for (const std::string& file : files) { unlink(file.c_str()); }
+  rmdir(directory.c_str());
+  std::cout << "Resultados guardados en " << csv_path << " (úselo con --baseline para comparar otra versión)." << std::endl;
+  if (!all_ok) {
+    std::cerr << "Error: Algún fichero no ha llegado intacto." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
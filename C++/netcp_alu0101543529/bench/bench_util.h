@@ -0,0 +1,66 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Utilidades comunes de los microbenchmarks que miden una operación bloque a bloque: la medida (la mejor de varias
+ *         repeticiones) y la línea con la que se muestra
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Repeticiones de cada medida, de las que se queda la más rápida
+constexpr int BENCH_REPETITIONS = 5;
+
+// Columna de una medida: valor, decimales, ancho y unidad (que se escribe detrás del valor)
+struct bench_column {
+  double value;
+  int precision;
+  int width;
+  const char* unit;
+};
+
+/**
+ * @brief Función que mide el tiempo medio por bloque de una operación, repitiéndola sobre todos los bloques de un buffer.
+ * @param[in] count: número de bloques.
+ * @param[in] operation: operación que se aplica a cada bloque (recibe su posición en el buffer).
+ * @return Devuelve los nanosegundos por bloque, como mínimo de BENCH_REPETITIONS repeticiones.
+ */
+inline double measure(size_t count, const std::function<void(size_t)>& operation) {
+  double best = 0;
+  for (int repetition = 0; repetition < BENCH_REPETITIONS; ++repetition) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) { operation(i); }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double per_chunk = elapsed.count() / static_cast<double>(count);
+    if (repetition == 0 || per_chunk < best) { best = per_chunk; }
+  }
+  return best;
+}
+
+/**
+ * @brief Función que muestra una medida en una línea: su nombre, alineado a la izquierda, y sus columnas.
+ * @param[in] name: nombre de la medida.
+ * @param[in] name_width: ancho del nombre, para que las columnas de todas las medidas queden alineadas.
+ * @param[in] columns: columnas de la medida.
+ */
+inline void report_line(const std::string& name, int name_width, std::initializer_list<bench_column> columns) {
+  std::cout << std::left << std::setw(name_width) << name << std::right << std::fixed;
+  for (const bench_column& column : columns) {
+    std::cout << std::setprecision(column.precision) << std::setw(column.width) << column.value << column.unit;
+  }
+  std::cout << std::endl;
+}
+
+#endif // BENCH_UTIL_H
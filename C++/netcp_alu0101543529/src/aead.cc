@@ -0,0 +1,297 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del cifrado autenticado de los datagramas con la biblioteca de OpenSSL (libcrypto), que elige al
+ *         empezar, según el procesador, sus implementaciones vectoriales de AES-GCM (AES-NI, VAES y PCLMULQDQ) y de
+ *         ChaCha20-Poly1305 (SSSE3, AVX2 o AVX-512)
+ */
+
+#include "header_files/aead.h"
+#include "header_files/logger.h"
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+
+// Tamaños del nonce (tipo, carril, flujo y número de secuencia del datagrama) y de los datos adicionales autenticados
+constexpr size_t AEAD_NONCE_SIZE = 12;
+constexpr size_t AEAD_AAD_SIZE = 24;
+
+// Bits de flags que se autentican: los que cambian cómo se interpretan los datos (no pueden cambiar entre reenvíos)
+constexpr uint8_t AEAD_AUTHENTICATED_FLAGS = FLAG_COMPRESSED | FLAG_ENCRYPTED | FLAG_CHACHA20;
+
+/**
+ * @brief Función que lee la clave compartida de un fichero: 32 bytes tal cual (por ejemplo, head -c 32 /dev/urandom) o 64
+ *        dígitos hexadecimales, con espacios o un salto de línea al final. Avisa si otros usuarios pueden leer el fichero.
+ * @param[in] path: ruta del fichero de la clave.
+ * @return Devuelve la clave, o un código de error si no se puede leer el fichero o su contenido no es una clave.
+ */
+std::expected<aead_secret, std::error_code> load_secret(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    log_error() << "Error: No se puede abrir el fichero de la clave " << path << ".";
+    return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && (file_stat.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+    log_warning() << "Aviso: Otros usuarios pueden leer el fichero de la clave " << path << " (use chmod 600).";
+  }
+  char contents[2 * AEAD_KEY_SIZE + 2];
+  ssize_t bytes_read = read(fd, contents, sizeof(contents));
+  close(fd);
+
+  size_t length = (bytes_read > 0) ? static_cast<size_t>(bytes_read) : 0;
+  aead_secret secret;
+  if (length == AEAD_KEY_SIZE) {
+    std::memcpy(secret.data(), contents, AEAD_KEY_SIZE);
+    return secret;
+  }
+  while (length > 0 && (contents[length - 1] == '\n' || contents[length - 1] == '\r' || contents[length - 1] == ' ')) { --length; }
+  auto digit = [](char c) -> int {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+  };
+  bool valid = (length == 2 * AEAD_KEY_SIZE);
+  for (size_t i = 0; valid && i < AEAD_KEY_SIZE; ++i) {
+    int high = digit(contents[2 * i]);
+    int low = digit(contents[2 * i + 1]);
+    valid = high >= 0 && low >= 0;
+    secret[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  if (!valid) {
+    log_error() << "Error: El fichero " << path << " no contiene una clave de " << AEAD_KEY_SIZE << " bytes (o " << 2 * AEAD_KEY_SIZE
+                << " dígitos hexadecimales).";
+    return std::unexpected(std::error_code(EINVAL, std::system_category()));
+  }
+  return secret;
+}
+
+/**
+ * @brief Función que elige el algoritmo más rápido en este procesador: AES-256-GCM si tiene instrucciones para AES y para el
+ *        producto sin acarreo (con el que se calcula GHASH); si no, ChaCha20-Poly1305, que solo necesita operaciones
+ *        vectoriales de enteros y es varias veces más rápido que AES sin AES-NI.
+ * @return Devuelve el algoritmo.
+ */
+aead_algorithm aead_best_algorithm() {
+  __builtin_cpu_init();
+  bool aes = __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul");
+  return aes ? aead_algorithm::aes_256_gcm : aead_algorithm::chacha20_poly1305;
+}
+
+/**
+ * @brief Función que devuelve el nombre de un algoritmo, el mismo con el que se pide a OpenSSL.
+ */
+const char* aead_name(aead_algorithm algorithm) {
+  return (algorithm == aead_algorithm::chacha20_poly1305) ? "ChaCha20-Poly1305" : "AES-256-GCM";
+}
+
+/**
+ * @brief Función que indica el algoritmo con el que está cifrado un datagrama.
+ * @param[in] flags: bits FLAG_* de su cabecera.
+ */
+aead_algorithm packet_algorithm(uint8_t flags) {
+  return (flags & FLAG_CHACHA20) ? aead_algorithm::chacha20_poly1305 : aead_algorithm::aes_256_gcm;
+}
+
+/**
+ * @brief Función que crea la clave de un emisor con una sal aleatoria nueva. Cada emisor cifra con su propia clave, de forma
+ *        que el nonce (que solo depende del datagrama) no se repite aunque se haga otra transferencia con la clave compartida.
+ * @param[in] secret: clave compartida.
+ * @param[in] algorithm: algoritmo (automatic para el más rápido en este procesador).
+ * @return Devuelve la clave, o nada si no se ha podido generar la sal o derivarla.
+ */
+std::optional<aead_key> make_key(const aead_secret& secret, aead_algorithm algorithm) {
+  uint8_t salt[AEAD_SALT_SIZE];
+  if (RAND_bytes(salt, sizeof(salt)) != 1) {
+    log_error() << "Error: No se ha podido generar la sal de la clave.";
+    return std::nullopt;
+  }
+  return derive_key(secret, (algorithm == aead_algorithm::automatic) ? aead_best_algorithm() : algorithm, salt);
+}
+
+/**
+ * @brief Función que deriva con HKDF-SHA256 la clave de un emisor a partir de la clave compartida y su sal. El nombre del
+ *        algoritmo forma parte de la derivación, para que la misma sal nunca dé la misma clave en los dos algoritmos.
+ * @param[in] secret: clave compartida.
+ * @param[in] algorithm: algoritmo del emisor.
+ * @param[in] salt: sal del emisor (AEAD_SALT_SIZE bytes).
+ * @return Devuelve la clave, o nada si OpenSSL no ha podido derivarla.
+ */
+std::optional<aead_key> derive_key(const aead_secret& secret, aead_algorithm algorithm, const uint8_t* salt) {
+  aead_key key;
+  key.algorithm = algorithm;
+  std::memcpy(key.salt.data(), salt, AEAD_SALT_SIZE);
+
+  std::string info = std::string("netcp ") + aead_name(algorithm);
+  char digest[] = "SHA256";
+  OSSL_PARAM parameters[] = {
+      OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, digest, 0),
+      OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, const_cast<uint8_t*>(secret.data()), secret.size()),
+      OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, key.salt.data(), key.salt.size()),
+      OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, info.data(), info.size()),
+      OSSL_PARAM_construct_end()};
+  EVP_KDF* kdf = EVP_KDF_fetch(nullptr, "HKDF", nullptr);
+  EVP_KDF_CTX* context = (kdf != nullptr) ? EVP_KDF_CTX_new(kdf) : nullptr;
+  bool derived = context != nullptr && EVP_KDF_derive(context, key.key.data(), key.key.size(), parameters) == 1;
+  EVP_KDF_CTX_free(context);
+  EVP_KDF_free(kdf);
+  if (!derived) {
+    log_error() << "Error: No se ha podido derivar la clave de la transferencia.";
+    return std::nullopt;
+  }
+  return key;
+}
+
+/**
+ * @brief Función que devuelve el algoritmo de OpenSSL, que se busca una sola vez: pedirlo por su nombre en cada contexto
+ *        (como hace EVP_aes_256_gcm()) recorre los proveedores cada vez.
+ * @param[in] algorithm: algoritmo.
+ */
+static EVP_CIPHER* fetch_cipher(aead_algorithm algorithm) {
+  static EVP_CIPHER* aes = EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+  static EVP_CIPHER* chacha = EVP_CIPHER_fetch(nullptr, "ChaCha20-Poly1305", nullptr);
+  return (algorithm == aead_algorithm::chacha20_poly1305) ? chacha : aes;
+}
+
+/**
+ * @brief Función que forma el nonce y los datos adicionales autenticados de un datagrama. El nonce (tipo, carril, flujo y
+ *        número de secuencia) no se repite con la misma clave porque cada bloque, fila de paridad y fin de un flujo se cifra
+ *        una sola vez (los reenvíos llevan los mismos datos cifrados) y la confirmación del fin es de otro tipo. Los datos
+ *        adicionales atan los datos a su transferencia, su flujo y su posición en el fichero.
+ * @param[in] header: cabecera del datagrama.
+ * @param[in] lane: carril del datagrama (la fila, en la paridad; 0 en los demás).
+ * @param[out] nonce: nonce (AEAD_NONCE_SIZE bytes).
+ * @param[out] aad: datos adicionales (AEAD_AAD_SIZE bytes).
+ */
+static void make_nonce(const packet_header& header, uint8_t lane, uint8_t* nonce, uint8_t* aad) {
+  uint16_t stream = htobe16(header.stream);
+  uint64_t sequence = htobe64(header.sequence);
+  nonce[0] = static_cast<uint8_t>(header.type);
+  nonce[1] = lane;
+  std::memcpy(nonce + 2, &stream, sizeof(stream));
+  std::memcpy(nonce + 4, &sequence, sizeof(sequence));
+
+  uint32_t session = htobe32(header.session);
+  uint64_t offset = htobe64(header.offset);
+  aad[0] = static_cast<uint8_t>(header.type);
+  aad[1] = header.flags & AEAD_AUTHENTICATED_FLAGS;
+  std::memcpy(aad + 2, &stream, sizeof(stream));
+  std::memcpy(aad + 4, &session, sizeof(session));
+  std::memcpy(aad + 8, &sequence, sizeof(sequence));
+  std::memcpy(aad + 16, &offset, sizeof(offset));
+}
+
+/**
+ * @brief Constructor de aead_context: prepara los contextos de cifrado y descifrado con la clave, una sola vez (en cada
+ *        datagrama solo cambia el nonce, así que no se vuelve a expandir la clave).
+ * @param[in] key: clave del emisor.
+ */
+aead_context::aead_context(const aead_key& key) : material(key) {
+  EVP_CIPHER* cipher = fetch_cipher(key.algorithm);
+  sealer = EVP_CIPHER_CTX_new();
+  opener = EVP_CIPHER_CTX_new();
+  if (cipher == nullptr || sealer == nullptr || opener == nullptr ||
+      EVP_EncryptInit_ex2(sealer, cipher, material.key.data(), nullptr, nullptr) != 1 ||
+      EVP_DecryptInit_ex2(opener, cipher, material.key.data(), nullptr, nullptr) != 1) {
+    log_error() << "Error: OpenSSL no admite " << aead_name(key.algorithm) << ".";
+    EVP_CIPHER_CTX_free(sealer);
+    EVP_CIPHER_CTX_free(opener);
+    sealer = opener = nullptr;
+  }
+}
+
+/**
+ * @brief Destructor de aead_context: libera los contextos y borra la clave de la memoria.
+ */
+aead_context::~aead_context() {
+  EVP_CIPHER_CTX_free(sealer);
+  EVP_CIPHER_CTX_free(opener);
+  OPENSSL_cleanse(material.key.data(), material.key.size());
+}
+
+/**
+ * @brief Método que indica si un datagrama cifrado con el algoritmo y la sal indicados es de esta clave.
+ * @param[in] algorithm: algoritmo del datagrama.
+ * @param[in] salt: sal que precede a sus datos cifrados.
+ */
+bool aead_context::matches(aead_algorithm algorithm, const uint8_t* salt) const {
+  return algorithm == material.algorithm && std::memcmp(salt, material.salt.data(), AEAD_SALT_SIZE) == 0;
+}
+
+/**
+ * @brief Método que devuelve los bits FLAG_* que indican al receptor que los datos van cifrados con este algoritmo.
+ */
+uint8_t aead_context::flags() const {
+  return FLAG_ENCRYPTED | (material.algorithm == aead_algorithm::chacha20_poly1305 ? FLAG_CHACHA20 : 0);
+}
+
+/**
+ * @brief Método que cifra los datos de un datagrama: escribe en output la sal de la clave, los datos cifrados y la etiqueta
+ *        de autenticación. Los datos se pueden cifrar en su sitio si ya están en output + AEAD_SALT_SIZE.
+ * @param[in] header: cabecera del datagrama (con los bits de flags de esta clave).
+ * @param[in] input: datos en claro.
+ * @param[in] length: tamaño de los datos.
+ * @param[out] output: datos cifrados (length + AEAD_OVERHEAD bytes).
+ * @param[in] clear: datos que van en claro delante de la sal y se autentican con los cifrados.
+ * @return Devuelve el tamaño de los datos cifrados, o 0 si no se han podido cifrar.
+ */
+size_t aead_context::seal(const packet_header& header, const uint8_t* input, size_t length, uint8_t* output, const aead_clear& clear) {
+  uint8_t nonce[AEAD_NONCE_SIZE];
+  uint8_t aad[AEAD_AAD_SIZE];
+  make_nonce(header, clear.lane, nonce, aad);
+
+  int written = 0;
+  int final_length = 0;
+  if (sealer == nullptr || EVP_EncryptInit_ex2(sealer, nullptr, nullptr, nonce, nullptr) != 1 ||
+      EVP_EncryptUpdate(sealer, nullptr, &written, aad, sizeof(aad)) != 1 ||
+      (clear.length > 0 && EVP_EncryptUpdate(sealer, nullptr, &written, clear.data, static_cast<int>(clear.length)) != 1) ||
+      EVP_EncryptUpdate(sealer, output + AEAD_SALT_SIZE, &written, input, static_cast<int>(length)) != 1 ||
+      EVP_EncryptFinal_ex(sealer, output + AEAD_SALT_SIZE + written, &final_length) != 1 ||
+      EVP_CIPHER_CTX_ctrl(sealer, EVP_CTRL_AEAD_GET_TAG, AEAD_TAG_SIZE, output + AEAD_SALT_SIZE + length) != 1) {
+    return 0;
+  }
+  std::memcpy(output, material.salt.data(), AEAD_SALT_SIZE);
+  return length + AEAD_OVERHEAD;
+}
+
+/**
+ * @brief Método que comprueba la etiqueta de los datos de un datagrama y los descifra en su sitio (quedan en payload +
+ *        AEAD_SALT_SIZE). La sal ya se ha comprobado con matches().
+ * @param[in] header: cabecera del datagrama.
+ * @param[in,out] payload: sal, datos cifrados y etiqueta, tal y como han llegado.
+ * @param[in] length: tamaño de todo ello.
+ * @param[in] clear: datos que han llegado en claro delante de la sal.
+ * @return Devuelve el tamaño de los datos en claro, o nada si no superan la autenticación.
+ */
+std::optional<size_t> aead_context::open(const packet_header& header, uint8_t* payload, size_t length, const aead_clear& clear) {
+  if (opener == nullptr || length < AEAD_OVERHEAD) { return std::nullopt; }
+  uint8_t nonce[AEAD_NONCE_SIZE];
+  uint8_t aad[AEAD_AAD_SIZE];
+  make_nonce(header, clear.lane, nonce, aad);
+
+  size_t plain_length = length - AEAD_OVERHEAD;
+  uint8_t* data = payload + AEAD_SALT_SIZE;
+  int written = 0;
+  int final_length = 0;
+  if (EVP_DecryptInit_ex2(opener, nullptr, nullptr, nonce, nullptr) != 1 ||
+      EVP_CIPHER_CTX_ctrl(opener, EVP_CTRL_AEAD_SET_TAG, AEAD_TAG_SIZE, data + plain_length) != 1 ||
+      EVP_DecryptUpdate(opener, nullptr, &written, aad, sizeof(aad)) != 1 ||
+      (clear.length > 0 && EVP_DecryptUpdate(opener, nullptr, &written, clear.data, static_cast<int>(clear.length)) != 1) ||
+      EVP_DecryptUpdate(opener, data, &written, data, static_cast<int>(plain_length)) != 1 ||
+      EVP_DecryptFinal_ex(opener, data + written, &final_length) != 1) {
+    return std::nullopt;
+  }
+  return plain_length;
+}
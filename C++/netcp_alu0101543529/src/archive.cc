@@ -0,0 +1,708 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de la transferencia de directorios y de la clase archive_writer
+ */
+
+#include "header_files/archive.h"
+#include "header_files/reliable.h"
+#include <climits>
+#include <deque>
+#include <iomanip>
+#include <dirent.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Cabecera del manifiesto ("NDIR" y número de entradas) y tamaño fijo de cada entrada (tipo, permisos, tamaño y longitud de
+// la ruta, que va detrás)
+constexpr uint8_t MANIFEST_MAGIC[4] = {'N', 'D', 'I', 'R'};
+constexpr size_t MANIFEST_HEADER_SIZE = 12;
+constexpr size_t MANIFEST_ENTRY_SIZE = 15;
+
+// Bytes de ficheros pequeños que se juntan antes de escribirlos en el flujo con una sola llamada a writev()
+constexpr size_t ARCHIVE_FLUSH_BYTES = 1 << 20;
+
+/**
+ * @brief Funciones que añaden un entero en orden de bytes de red al final de un buffer.
+ */
+static void put_u16(std::vector<uint8_t>& out, uint16_t value) {
+  value = htobe16(value);
+  out.resize(out.size() + sizeof(value));
+  std::memcpy(out.data() + out.size() - sizeof(value), &value, sizeof(value));
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+  value = htobe32(value);
+  out.resize(out.size() + sizeof(value));
+  std::memcpy(out.data() + out.size() - sizeof(value), &value, sizeof(value));
+}
+
+static void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+  value = htobe64(value);
+  out.resize(out.size() + sizeof(value));
+  std::memcpy(out.data() + out.size() - sizeof(value), &value, sizeof(value));
+}
+
+/**
+ * @brief Funciones que leen un entero en orden de bytes de red.
+ */
+static uint16_t get_u16(const uint8_t* in) {
+  uint16_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return be16toh(value);
+}
+
+static uint32_t get_u32(const uint8_t* in) {
+  uint32_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return be32toh(value);
+}
+
+static uint64_t get_u64(const uint8_t* in) {
+  uint64_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return be64toh(value);
+}
+
+/**
+ * @brief Función que añade al manifiesto el contenido de un directorio y, a continuación de cada subdirectorio, el suyo.
+ * @param[in] dir_fd: descriptor del directorio (pasa a ser de la función, que lo cierra).
+ * @param[in] prefix: ruta del directorio respecto a la raíz ("" para la raíz, o terminada en '/').
+ * @param[out] entries: manifiesto al que se añaden las entradas.
+ * @return Devuelve un código de error si no se ha podido leer el directorio, o un código de éxito en caso contrario.
+ */
+static std::error_code scan_entries(int dir_fd, const std::string& prefix, std::vector<archive_entry>& entries) {
+  DIR* dir = fdopendir(dir_fd);
+  if (dir == nullptr) {
+    close(dir_fd);
+    return std::error_code(errno, std::system_category());
+  }
+
+  std::error_code error(0, std::system_category());
+  while (dirent* item = readdir(dir)) {
+    std::string_view name = item->d_name;
+    if (name == "." || name == "..") { continue; }
+    std::string path = prefix + item->d_name;
+    struct stat item_stat{};
+    if (fstatat(dirfd(dir), item->d_name, &item_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+      log_error() << "Error: No se puede consultar " << path << ".";
+      error = std::error_code(errno, std::system_category());
+      break;
+    }
+
+    uint32_t mode = item_stat.st_mode & 07777;
+    if (S_ISDIR(item_stat.st_mode)) {
+      entries.push_back({archive_entry_type::directory, mode, 0, path, {}});
+      int child_fd = openat(dirfd(dir), item->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      error = (child_fd == -1) ? std::error_code(errno, std::system_category()) : scan_entries(child_fd, path + "/", entries);
+      if (error) {
+        if (child_fd == -1) { log_error() << "Error: No se puede abrir el directorio " << path << "."; }
+        break;
+      }
+    } else if (S_ISREG(item_stat.st_mode)) {
+      entries.push_back({archive_entry_type::file, mode, static_cast<uint64_t>(item_stat.st_size), path, {}});
+    } else if (S_ISLNK(item_stat.st_mode)) {
+      std::string target(PATH_MAX, '\0');
+      ssize_t length = readlinkat(dirfd(dir), item->d_name, target.data(), target.size());
+      if (length < 0) {
+        log_error() << "Error: No se puede leer el enlace simbólico " << path << ".";
+        error = std::error_code(errno, std::system_category());
+        break;
+      }
+      target.resize(static_cast<size_t>(length));
+      entries.push_back({archive_entry_type::symlink, mode, target.size(), path, target});
+    } else {
+      log_warning() << "Aviso: Se omite " << path << ", que no es un fichero regular, un directorio ni un enlace simbólico.";
+    }
+  }
+  closedir(dir);
+  return error;
+}
+
+/**
+ * @brief Función que recorre un directorio y devuelve su manifiesto. Cada directorio aparece antes que su contenido, así que
+ *        el receptor puede crear las entradas en orden.
+ * @param[in] root_fd: descriptor del directorio que se envía.
+ * @return Devuelve el manifiesto, o un código de error si no se ha podido recorrer el directorio.
+ */
+std::expected<std::vector<archive_entry>, std::error_code> scan_directory(int root_fd) {
+  std::vector<archive_entry> entries;
+  int dir_fd = dup(root_fd);
+  if (dir_fd == -1) { return std::unexpected(std::error_code(errno, std::system_category())); }
+  if (std::error_code error = scan_entries(dir_fd, "", entries)) { return std::unexpected(error); }
+  return entries;
+}
+
+/**
+ * @brief Función que codifica el manifiesto: la cabecera y, por cada entrada, su tipo, permisos, tamaño y ruta.
+ * @param[in] entries: manifiesto.
+ * @return Devuelve el manifiesto codificado.
+ */
+std::vector<uint8_t> encode_manifest(const std::vector<archive_entry>& entries) {
+  std::vector<uint8_t> out(MANIFEST_MAGIC, MANIFEST_MAGIC + sizeof(MANIFEST_MAGIC));
+  put_u64(out, entries.size());
+  for (const archive_entry& entry : entries) {
+    out.push_back(static_cast<uint8_t>(entry.type));
+    put_u32(out, entry.mode);
+    put_u64(out, entry.size);
+    put_u16(out, static_cast<uint16_t>(entry.path.size()));
+    out.insert(out.end(), entry.path.begin(), entry.path.end());
+  }
+  return out;
+}
+
+/**
+ * @brief Función que decodifica el manifiesto que hay al principio del flujo recibido.
+ * @param[in] data: flujo recibido.
+ * @param[in] size: tamaño del flujo.
+ * @param[out] offset: posición del flujo en la que empieza el contenido de los ficheros.
+ * @return Devuelve el manifiesto, o std::nullopt si no tiene el formato esperado.
+ */
+std::optional<std::vector<archive_entry>> decode_manifest(const uint8_t* data, size_t size, size_t& offset) {
+  if (size < MANIFEST_HEADER_SIZE || std::memcmp(data, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0) { return std::nullopt; }
+  uint64_t count = get_u64(data + 4);
+  // Cada entrada ocupa al menos MANIFEST_ENTRY_SIZE bytes, lo que acota cuántas puede haber antes de reservar memoria
+  if (count > (size - MANIFEST_HEADER_SIZE) / MANIFEST_ENTRY_SIZE) { return std::nullopt; }
+
+  std::vector<archive_entry> entries;
+  entries.reserve(count);
+  offset = MANIFEST_HEADER_SIZE;
+  for (uint64_t i = 0; i < count; ++i) {
+    if (size - offset < MANIFEST_ENTRY_SIZE) { return std::nullopt; }
+    archive_entry entry{static_cast<archive_entry_type>(data[offset]), get_u32(data + offset + 1), get_u64(data + offset + 5), {}, {}};
+    size_t length = get_u16(data + offset + 13);
+    offset += MANIFEST_ENTRY_SIZE;
+    if (size - offset < length) { return std::nullopt; }
+    entry.path.assign(reinterpret_cast<const char*>(data + offset), length);
+    offset += length;
+    if (entry.type != archive_entry_type::directory && entry.type != archive_entry_type::file &&
+        entry.type != archive_entry_type::symlink) { return std::nullopt; }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+/**
+ * @brief Función que escribe varios buffers en un descriptor con writev(), repitiendo hasta que se hayan escrito enteros.
+ * @param[in] fd: descriptor en el que se escribe.
+ * @param[in] parts: buffers que se escriben (se modifican al avanzar).
+ * @return Devuelve un código de error si no se ha podido escribir, o un código de éxito en caso contrario.
+ */
+static std::error_code write_all(int fd, std::vector<iovec> parts) {
+  size_t first = 0;
+  while (first < parts.size()) {
+    ssize_t written = writev(fd, parts.data() + first, static_cast<int>(std::min<size_t>(parts.size() - first, IOV_MAX)));
+    if (written < 0) {
+      if (errno == EINTR) { continue; }
+      return std::error_code(errno, std::system_category());
+    }
+    size_t remaining = static_cast<size_t>(written);
+    while (first < parts.size() && remaining >= parts[first].iov_len) { remaining -= parts[first++].iov_len; }
+    if (remaining > 0) {
+      parts[first].iov_base = static_cast<uint8_t*>(parts[first].iov_base) + remaining;
+      parts[first].iov_len -= remaining;
+    }
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Función que lee entero un fichero pequeño. Si ha cambiado de tamaño desde que se recorrió el directorio, se envía
+ *        con el tamaño del manifiesto (recortado o completado con ceros), para que el flujo siga siendo coherente.
+ * @param[in] root_fd: descriptor del directorio que se envía.
+ * @param[in] entry: entrada del fichero.
+ * @param[out] data: contenido del fichero.
+ * @return Devuelve un código de error si no se ha podido leer el fichero, o un código de éxito en caso contrario.
+ */
+static std::error_code read_small_file(int root_fd, const archive_entry& entry, std::vector<uint8_t>& data) {
+  int fd = openat(root_fd, entry.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) { return std::error_code(errno, std::system_category()); }
+  data.resize(entry.size);
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t bytes_read = pread(fd, data.data() + done, data.size() - done, static_cast<off_t>(done));
+    if (bytes_read < 0 && errno == EINTR) { continue; }
+    if (bytes_read < 0) {
+      std::error_code error(errno, std::system_category());
+      close(fd);
+      return error;
+    }
+    if (bytes_read == 0) {
+      log_warning() << "Aviso: El fichero " << entry.path << " ha cambiado de tamaño durante el envío.";
+      break;
+    }
+    done += static_cast<size_t>(bytes_read);
+  }
+  close(fd);
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Constructor de archive_writer: arranca el hilo que escribe el flujo.
+ * @param[in] root_fd: descriptor del directorio que se envía.
+ * @param[in] entries: manifiesto del directorio (debe seguir existiendo hasta que termine el hilo).
+ * @param[in] output_fd: descriptor (bloqueante) en el que se escribe el flujo, normalmente una tubería.
+ */
+archive_writer::archive_writer(int root_fd, const std::vector<archive_entry>& entries, int output_fd)
+    : root_fd(root_fd), entries(entries), output_fd(output_fd) {
+  worker = std::thread(&archive_writer::run, this);
+}
+
+/**
+ * @brief Destructor de archive_writer: espera al hilo si no se ha esperado antes.
+ */
+archive_writer::~archive_writer() {
+  if (worker.joinable()) { worker.join(); }
+}
+
+/**
+ * @brief Método que espera a que el hilo termine de escribir el flujo.
+ * @return Devuelve el error que haya detenido la escritura, o un código de éxito si se ha escrito entero.
+ */
+std::error_code archive_writer::wait() {
+  if (worker.joinable()) { worker.join(); }
+  return error;
+}
+
+/**
+ * @brief Método del hilo que escribe el flujo: primero el manifiesto y después el contenido de cada fichero y enlace. Los
+ *        ficheros pequeños los leen por adelantado varios hilos, con una ventana de PREFETCH_FILES ficheros o PREFETCH_BYTES
+ *        bytes, y se escriben muchos juntos con una sola llamada, de forma que acaban compartiendo datagramas; los grandes
+ *        pasan de la caché de páginas a la tubería con splice(), sin copiarse en el programa.
+ */
+void archive_writer::run() {
+  // Si el emisor deja de leer (por ejemplo, porque la transferencia ha fallado), preferimos un EPIPE a que SIGPIPE nos mate
+  sigset_t blocked;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &blocked, nullptr);
+
+  std::vector<uint8_t> manifest = encode_manifest(entries);
+  error = write_all(output_fd, {{manifest.data(), manifest.size()}});
+
+  // Ventana de ficheros pequeños leídos (o leyéndose) por adelantado, en el orden del manifiesto. Los primeros consumed ya están
+  // en batch, pendientes de escribirse
+  struct prefetched_file {
+    size_t index;
+    std::vector<uint8_t> data;
+    std::error_code error;
+    std::future<void> done;
+  };
+  std::deque<prefetched_file> window;
+  uint64_t window_bytes = 0;
+  size_t next = 0;
+  size_t consumed = 0;
+  std::vector<iovec> batch;
+  size_t batch_bytes = 0;
+  worker_pool readers(PREFETCH_THREADS);
+
+  auto refill = [&]() {
+    for (; next < entries.size() && window.size() < PREFETCH_FILES && window_bytes < PREFETCH_BYTES; ++next) {
+      const archive_entry& entry = entries[next];
+      if (entry.type != archive_entry_type::file || entry.size == 0 || entry.size > SMALL_FILE_SIZE) { continue; }
+      prefetched_file& slot = window.emplace_back();
+      slot.index = next;
+      window_bytes += entry.size;
+      slot.done = readers.submit([this, &slot, &entry]() { slot.error = read_small_file(root_fd, entry, slot.data); });
+    }
+  };
+  auto flush = [&]() {
+    if (!error && !batch.empty()) { error = write_all(output_fd, batch); }
+    batch.clear();
+    batch_bytes = 0;
+    for (; consumed > 0; --consumed) {
+      window_bytes -= window.front().data.size();
+      window.pop_front();
+    }
+  };
+
+  for (size_t i = 0; i < entries.size() && !error; ++i) {
+    refill();
+    const archive_entry& entry = entries[i];
+    if (entry.type == archive_entry_type::directory || entry.size == 0) { continue; }
+
+    if (entry.type == archive_entry_type::symlink) {
+      batch.push_back({const_cast<char*>(entry.target.data()), entry.target.size()});
+      batch_bytes += entry.target.size();
+    } else if (entry.size > SMALL_FILE_SIZE) {
+      flush();
+      if (!error) { error = write_large_file(entry); }
+      continue;
+    } else {
+      // Si la ventana solo tiene ficheros ya consumidos, los escribimos para dejar sitio al siguiente
+      if (consumed == window.size()) {
+        flush();
+        refill();
+      }
+      prefetched_file& slot = window[consumed++];
+      slot.done.wait();
+      if (slot.error) {
+        log_error() << "Error: No se puede leer el fichero " << entry.path << ".";
+        error = slot.error;
+        break;
+      }
+      batch.push_back({slot.data.data(), slot.data.size()});
+      batch_bytes += slot.data.size();
+    }
+    if (batch_bytes >= ARCHIVE_FLUSH_BYTES || batch.size() >= IOV_MAX) { flush(); }
+  }
+  flush();
+
+  // Las lecturas que queden en marcha usan la ventana, así que hay que esperarlas antes de destruirla
+  for (prefetched_file& slot : window) { slot.done.wait(); }
+  close(output_fd);
+}
+
+/**
+ * @brief Método que escribe en el flujo un fichero grande, pasándolo del disco a la tubería con splice(). Si el descriptor
+ *        de salida no lo admite, se copia con un buffer; si el fichero ha cambiado de tamaño, se completa con ceros.
+ * @param[in] entry: entrada del fichero.
+ * @return Devuelve un código de error si no se ha podido leer el fichero o escribir el flujo, o un código de éxito en caso contrario.
+ */
+std::error_code archive_writer::write_large_file(const archive_entry& entry) {
+  int fd = openat(root_fd, entry.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    log_error() << "Error: No se puede abrir el fichero " << entry.path << ".";
+    return std::error_code(errno, std::system_category());
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  std::error_code result(0, std::system_category());
+  off_t offset = 0;
+  bool use_splice = true;
+  std::vector<uint8_t> buffer;
+  while (static_cast<uint64_t>(offset) < entry.size) {
+    size_t remaining = static_cast<size_t>(entry.size - static_cast<uint64_t>(offset));
+    ssize_t moved;
+    if (use_splice) {
+      moved = splice(fd, &offset, output_fd, nullptr, remaining, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (moved < 0 && errno == EINVAL) {
+        use_splice = false;
+        continue;
+      }
+    } else {
+      buffer.resize(ARCHIVE_FLUSH_BYTES);
+      moved = pread(fd, buffer.data(), std::min(remaining, buffer.size()), offset);
+      if (moved > 0) {
+        result = write_all(output_fd, {{buffer.data(), static_cast<size_t>(moved)}});
+        if (result) { break; }
+        offset += moved;
+      }
+    }
+    if (moved < 0 && errno == EINTR) { continue; }
+    if (moved < 0) {
+      result = std::error_code(errno, std::system_category());
+      break;
+    }
+    if (moved == 0) {
+      log_warning() << "Aviso: El fichero " << entry.path << " ha cambiado de tamaño durante el envío.";
+      buffer.assign(std::min<size_t>(remaining, ARCHIVE_FLUSH_BYTES), 0);
+      while (!result && remaining > 0) {
+        size_t length = std::min(remaining, buffer.size());
+        result = write_all(output_fd, {{buffer.data(), length}});
+        remaining -= length;
+      }
+      break;
+    }
+  }
+  close(fd);
+  return result;
+}
+
+/**
+ * @brief Función que comprueba que una ruta del manifiesto es relativa y no sale del directorio de destino.
+ * @param[in] path: ruta.
+ * @return Devuelve true si la ruta es segura.
+ */
+static bool safe_path(const std::string& path) {
+  if (path.empty() || path.front() == '/') { return false; }
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = std::min(path.find('/', start), path.size());
+    std::string_view component(path.data() + start, end - start);
+    if (component.empty() || component == "." || component == "..") { return false; }
+    start = end + 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Función que abre el directorio que contiene una entrada recorriendo su ruta componente a componente con O_NOFOLLOW,
+ *        de forma que no se sigue ningún enlace simbólico (ni de los que ya hubiera en el destino ni de los extraídos): así
+ *        ninguna entrada puede acabar fuera del directorio de destino.
+ * @param[in] root_fd: descriptor del directorio de destino.
+ * @param[in] path: ruta de la entrada (ya comprobada con safe_path()).
+ * @param[out] name: último componente de la ruta, el de la entrada dentro del directorio devuelto.
+ * @return Devuelve el descriptor del directorio (que hay que cerrar), o -1 (con errno) si algún componente no es un
+ *         directorio o no se puede abrir.
+ */
+static int open_parent(int root_fd, const std::string& path, std::string& name) {
+  int parent = fcntl(root_fd, F_DUPFD_CLOEXEC, 0);
+  size_t start = 0;
+  for (size_t end; parent != -1 && (end = path.find('/', start)) != std::string::npos; start = end + 1) {
+    int child = openat(parent, path.substr(start, end - start).c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    int saved = errno;
+    close(parent);
+    errno = saved;
+    parent = child;
+  }
+  name = path.substr(start);
+  return parent;
+}
+
+/**
+ * @brief Función que cambia los permisos de un directorio extraído, abriéndolo sin seguir enlaces simbólicos.
+ * @param[in] root_fd: descriptor del directorio de destino.
+ * @param[in] path: ruta del directorio.
+ * @param[in] mode: permisos.
+ */
+static void chmod_directory(int root_fd, const std::string& path, mode_t mode) {
+  std::string name;
+  int parent = open_parent(root_fd, path, name);
+  if (parent == -1) { return; }
+  int fd = openat(parent, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd != -1) {
+    fchmod(fd, mode);
+    close(fd);
+  }
+  close(parent);
+}
+
+/**
+ * @brief Función que copia el contenido de un fichero del flujo recibido a su fichero de destino. Los grandes se copian con
+ *        copy_file_range(), que en el mismo sistema de ficheros no pasa por el programa; si no se puede, se escriben desde la
+ *        proyección del flujo.
+ * @param[in] archive_fd: descriptor del flujo recibido.
+ * @param[in] archive: proyección del flujo recibido.
+ * @param[in] offset: posición del contenido en el flujo.
+ * @param[in] size: tamaño del contenido.
+ * @param[in] fd: descriptor del fichero de destino.
+ * @return Devuelve un código de error si no se ha podido escribir el fichero, o un código de éxito en caso contrario.
+ */
+static std::error_code copy_contents(int archive_fd, const uint8_t* archive, size_t offset, size_t size, int fd) {
+  size_t done = 0;
+  if (size > SMALL_FILE_SIZE) {
+    loff_t input = static_cast<loff_t>(offset);
+    while (done < size) {
+      ssize_t copied = copy_file_range(archive_fd, &input, fd, nullptr, size - done, 0);
+      if (copied <= 0) { break; }
+      done += static_cast<size_t>(copied);
+    }
+  }
+  if (done < size) { return write_all(fd, {{const_cast<uint8_t*>(archive + offset + done), size - done}}); }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Función que extrae en un directorio el flujo recibido. Los directorios se crean con permisos de escritura para poder
+ *        llenarlos y reciben los suyos al final; los enlaces simbólicos se crean también al final. Las rutas se recorren sin
+ *        seguir enlaces simbólicos (open_parent()), así que ninguna entrada puede acabar fuera del directorio de destino.
+ * @param[in] archive_fd: descriptor del fichero con el flujo recibido.
+ * @param[in] root_fd: descriptor del directorio de destino.
+ * @return Devuelve un código de error si el flujo no es válido o no se ha podido extraer, o un código de éxito en caso contrario.
+ */
+std::error_code extract_archive(int archive_fd, int root_fd) {
+  struct stat archive_stat{};
+  if (fstat(archive_fd, &archive_stat) != 0) { return std::error_code(errno, std::system_category()); }
+  size_t archive_size = static_cast<size_t>(archive_stat.st_size);
+  void* projection = archive_size > 0 ? mmap(nullptr, archive_size, PROT_READ, MAP_SHARED, archive_fd, 0) : MAP_FAILED;
+  if (projection == MAP_FAILED) {
+    log_error() << "Error: El directorio recibido no tiene el formato esperado.";
+    return std::error_code(EBADMSG, std::system_category());
+  }
+  const uint8_t* archive = static_cast<const uint8_t*>(projection);
+  madvise(projection, archive_size, MADV_SEQUENTIAL);
+
+  size_t offset = 0;
+  auto entries = decode_manifest(archive, archive_size, offset);
+  uint64_t needed = offset;
+  bool valid = entries.has_value();
+  // Los tamaños se comprueban de uno en uno con lo que queda del flujo, para que su suma no pueda desbordarse, y el destino
+  // de un enlace no puede ser más largo que una ruta
+  for (size_t i = 0; valid && i < entries->size(); ++i) {
+    const archive_entry& entry = (*entries)[i];
+    valid = safe_path(entry.path) && entry.size <= archive_size - needed &&
+            (entry.type != archive_entry_type::symlink || entry.size < PATH_MAX);
+    needed += entry.size;
+  }
+  if (!valid) {
+    munmap(projection, archive_size);
+    log_error() << "Error: El directorio recibido no tiene el formato esperado o está incompleto.";
+    return std::error_code(EBADMSG, std::system_category());
+  }
+
+  std::error_code error(0, std::system_category());
+  std::vector<const archive_entry*> directories;
+  std::vector<std::pair<const archive_entry*, size_t>> links;
+  for (const archive_entry& entry : *entries) {
+    std::string name;
+    int parent = (entry.type == archive_entry_type::symlink) ? -1 : open_parent(root_fd, entry.path, name);
+    if (entry.type == archive_entry_type::symlink) {
+      links.emplace_back(&entry, offset);
+    } else if (parent == -1) {
+      error = std::error_code(errno, std::system_category());
+    } else if (entry.type == archive_entry_type::directory) {
+      struct stat existing{};
+      if (mkdirat(parent, name.c_str(), S_IRWXU) != 0 &&
+          (errno != EEXIST || fstatat(parent, name.c_str(), &existing, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(existing.st_mode))) {
+        error = std::error_code(errno == EEXIST ? ENOTDIR : errno, std::system_category());
+      } else if (existing.st_mode != 0) {
+        // El directorio ya existía (por ejemplo, de un envío anterior): también necesitamos poder escribir en él
+        chmod_directory(root_fd, entry.path, (existing.st_mode & 0777) | S_IRWXU);
+      }
+      directories.push_back(&entry);
+    } else {
+      int fd = openat(parent, name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+      error = (fd == -1) ? std::error_code(errno, std::system_category()) : copy_contents(archive_fd, archive, offset, entry.size, fd);
+      // Los bits setuid, setgid y sticky no se restauran: el receptor no tiene por qué fiarse de los del emisor
+      if (fd != -1) {
+        fchmod(fd, entry.mode & 0777);
+        close(fd);
+      }
+    }
+    if (parent != -1) { close(parent); }
+    if (error) {
+      log_error() << "Error: No se ha podido crear " << entry.path << ".";
+      break;
+    }
+    offset += entry.size;
+  }
+
+  for (size_t i = 0; !error && i < links.size(); ++i) {
+    const auto& [entry, position] = links[i];
+    std::string target(reinterpret_cast<const char*>(archive + position), entry->size);
+    std::string name;
+    int parent = open_parent(root_fd, entry->path, name);
+    if (parent != -1) { unlinkat(parent, name.c_str(), 0); }
+    if (parent == -1 || symlinkat(target.c_str(), parent, name.c_str()) != 0) {
+      error = std::error_code(errno, std::system_category());
+      log_error() << "Error: No se ha podido crear el enlace simbólico " << entry->path << ".";
+    }
+    if (parent != -1) { close(parent); }
+  }
+  // Los permisos de los directorios se aplican de dentro hacia fuera, cuando ya no hace falta escribir en ellos
+  for (auto it = directories.rbegin(); !error && it != directories.rend(); ++it) {
+    chmod_directory(root_fd, (*it)->path, (*it)->mode & 0777);
+  }
+
+  munmap(projection, archive_size);
+  return error;
+}
+
+/**
+ * @brief Función que envía un directorio entero: lo recorre, y un hilo escribe en una tubería el manifiesto y el contenido de
+ *        los ficheros mientras el emisor la envía por una única sesión, como la salida de un comando. Así, los ficheros
+ *        pequeños comparten datagramas y no hay que preparar un socket ni una sesión por fichero.
+ * @param[in] dirname: directorio que se envía.
+ * @param[in] options: opciones de la transferencia (tamaño del lote de datagramas, ...).
+ * @return Devuelve un código de error si no se ha podido enviar el directorio, o un código de éxito en caso contrario.
+ */
+std::error_code netcp_send_directory(const std::string& dirname, const netcp_options& options) {
+  if (options.delta) {
+    log_error() << "Error: La opción -d no se puede usar con -R.";
+    return std::error_code(EINVAL, std::system_category());
+  }
+  int root_fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd == -1) {
+    log_error() << "Error: No se puede abrir el directorio " << dirname << ".";
+    return std::error_code(errno, std::system_category());
+  }
+
+  log_debug() << "Recorriendo el directorio...";
+  auto entries = scan_directory(root_fd);
+  if (!entries) {
+    close(root_fd);
+    return entries.error();
+  }
+  size_t files = 0;
+  uint64_t bytes = 0;
+  for (const archive_entry& entry : *entries) {
+    files += (entry.type != archive_entry_type::directory);
+    bytes += entry.size;
+  }
+  log_info() << "Directorio " << dirname << ": " << entries->size() << " entradas, " << files << " ficheros y enlaces, " << bytes << " bytes.";
+
+  auto paths = open_paths(options);
+  if (!paths) {
+    log_error() << "Error: No se ha podido crear el socket.";
+    close(root_fd);
+    return paths.error();
+  }
+
+  // El emisor lee la tubería sin bloquearse, como con -c; el hilo que la llena sí se bloquea cuando se adelanta a la red
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+    close_paths(*paths);
+    close(root_fd);
+    return std::error_code(errno, std::system_category());
+  }
+  fcntl(pipe_fds[0], F_SETFL, fcntl(pipe_fds[0], F_GETFL) | O_NONBLOCK);
+  fcntl(pipe_fds[0], F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+
+  std::unique_ptr<worker_pool> compressor;
+  if (options.compress) { compressor = std::make_unique<worker_pool>(std::thread::hardware_concurrency()); }
+  archive_writer writer(root_fd, *entries, pipe_fds[1]);
+  reliable_sender sender(*paths, options, make_session_id(), 0, 1, compressor.get());
+  std::error_code error = sender.send_pipe(pipe_fds[0]);
+  // Al cerrar la tubería, el hilo que la llena termina aunque la transferencia haya fallado a medias
+  close(pipe_fds[0]);
+  std::error_code writer_error = writer.wait();
+  close_paths(*paths);
+  close(root_fd);
+  if (!error) { error = writer_error; }
+  if (error) {
+    log_error() << "Error: No se ha podido enviar el directorio " << dirname << ".";
+    return error;
+  }
+
+  log_info() << "CRC32C del directorio: " << std::hex << std::setw(8) << std::setfill('0') << sender.digest() << std::dec
+             << " (coincide con el del receptor).";
+  log_info() << "El envío de datos ha finalizado correctamente.";
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Función que recibe un directorio: guarda el flujo en un fichero temporal sin nombre dentro del destino (o en memoria,
+ *        si el sistema de ficheros no lo admite) y después lo extrae.
+ * @param[in] dirname: directorio de destino (se crea si no existe).
+ * @param[in] sockets: sockets del receptor.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve un código de error si no se ha podido recibir o extraer el directorio, o un código de éxito en caso contrario.
+ */
+std::error_code receive_directory(const std::string& dirname, const std::vector<int>& sockets, const netcp_options& options) {
+  if (mkdir(dirname.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) != 0 && errno != EEXIST) {
+    log_error() << "Error: No se puede crear el directorio " << dirname << ".";
+    return std::error_code(errno, std::system_category());
+  }
+  int root_fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd == -1) {
+    log_error() << "Error: No se puede abrir el directorio " << dirname << ".";
+    return std::error_code(errno, std::system_category());
+  }
+  // En el mismo sistema de ficheros que el destino, copy_file_range() puede pasar los datos sin copiarlos
+  int archive_fd = openat(root_fd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (archive_fd == -1) { archive_fd = memfd_create("netcp-archive", MFD_CLOEXEC); }
+  if (archive_fd == -1) {
+    std::error_code error(errno, std::system_category());
+    close(root_fd);
+    return error;
+  }
+
+  log_info() << "Recibiendo el directorio...";
+  auto result = receive_streams(sockets, archive_fd, options);
+  std::error_code error = result ? std::error_code(0, std::system_category()) : result.error();
+  if (!error) {
+    log_info() << "Extrayendo el directorio...";
+    error = extract_archive(archive_fd, root_fd);
+  }
+  close(archive_fd);
+  close(root_fd);
+  return error;
+}
@@ -0,0 +1,294 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del bucle de eventos de la interfaz asíncrona y de las transferencias send_file()/receive_file(),
+ *         que avanzan un reliable_sender o un reliable_receiver con step() y se suspenden hasta que su socket tiene datos o
+ *         vence el plazo que indica el paso
+ */
+
+#include "header_files/async.h"
+#include "header_files/reliable.h"
+#include <climits>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+// Eventos que se recogen como máximo en cada llamada a epoll
+constexpr int EVENT_LOOP_BATCH = 256;
+
+// Corrutina que envuelve a las tareas lanzadas con spawn(): empieza cuando el bucle la saca de la cola y se destruye sola al
+// terminar, así que nadie tiene que esperarla
+struct event_loop::detached_task {
+  struct promise_type {
+    detached_task get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Constructor de event_loop: crea el descriptor de epoll en el que se vigilan los sockets de las tareas.
+ */
+event_loop::event_loop() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+  if (epoll_fd < 0) {
+    log_error() << "Error: No se ha podido crear el descriptor de epoll.";
+  }
+}
+
+/**
+ * @brief Destructor de event_loop: cierra el descriptor de epoll.
+ */
+event_loop::~event_loop() {
+  if (epoll_fd >= 0) { close(epoll_fd); }
+}
+
+/**
+ * @brief Método que prepara la espera a que un descriptor tenga datos, para usarla con co_await.
+ * @param[in] fd: descriptor que se vigila (-1 para esperar solo el plazo).
+ * @param[in] deadline: instante, en microsegundos de now_microseconds(), en que se reanuda la tarea aunque no haya datos.
+ * @return Devuelve la operación de espera, que al reanudarse indica si el descriptor tiene datos.
+ */
+event_loop::wait_operation event_loop::readable(int fd, uint64_t deadline) { return wait_operation{.loop = this, .fd = fd, .deadline = deadline}; }
+
+/**
+ * @brief Método que prepara la espera hasta un instante, para usarla con co_await.
+ * @param[in] deadline: instante, en microsegundos de now_microseconds(), en que se reanuda la tarea.
+ * @return Devuelve la operación de espera.
+ */
+event_loop::wait_operation event_loop::sleep_until(uint64_t deadline) { return readable(-1, deadline); }
+
+/**
+ * @brief Método de la operación de espera que suspende la tarea: la registra en el bucle con su plazo y, si tiene descriptor,
+ *        lo vigila con epoll.
+ * @param[in] handle: corrutina que se reanuda al terminar la espera.
+ */
+void event_loop::wait_operation::await_suspend(std::coroutine_handle<> handle) {
+  waiter = handle;
+  loop->watch(*this);
+}
+
+/**
+ * @brief Método que registra una espera. El descriptor se vigila con EPOLLONESHOT, de forma que epoll lo deja de vigilar tras
+ *        su primer aviso y no hay que quitarlo entre espera y espera: se vuelve a activar con EPOLL_CTL_MOD, y solo la
+ *        primera vez (o si se ha cerrado y el número se ha reutilizado) hay que añadirlo.
+ * @param[in,out] operation: espera que se registra.
+ */
+void event_loop::watch(wait_operation& operation) {
+  operation.timer = timers.emplace(operation.deadline, &operation);
+  if (operation.fd < 0) { return; }
+
+  waiting[operation.fd] = &operation;
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.fd = operation.fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, operation.fd, &event) < 0 &&
+      (errno != ENOENT || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, operation.fd, &event) < 0)) {
+    // Sin epoll la tarea se reanudará al vencer el plazo, y su paso recogerá lo que haya llegado
+    log_error() << "Error: No se ha podido vigilar el descriptor " << operation.fd << " con epoll.";
+    waiting.erase(operation.fd);
+  }
+}
+
+/**
+ * @brief Método que termina una espera y reanuda su tarea.
+ * @param[in,out] operation: espera que termina.
+ * @param[in] ready: si termina porque el descriptor tiene datos (si no, es que ha vencido el plazo).
+ */
+void event_loop::wake(wait_operation& operation, bool ready) {
+  operation.ready = ready;
+  timers.erase(operation.timer);
+  if (operation.fd >= 0) { waiting.erase(operation.fd); }
+  operation.waiter.resume();
+}
+
+/**
+ * @brief Método que lanza una tarea sin esperarla: se empieza a ejecutar en la siguiente vuelta del bucle.
+ * @param[in] work: tarea que se lanza.
+ */
+void event_loop::spawn(task<void> work) {
+  ++active;
+  ready_queue.push_back(detach(std::move(work)).handle);
+}
+
+/**
+ * @brief Método con la corrutina que envuelve a una tarea lanzada con spawn(): la espera y descuenta las tareas en curso.
+ * @param[in] work: tarea lanzada.
+ */
+event_loop::detached_task event_loop::detach(task<void> work) {
+  try {
+    co_await work;
+  } catch (const std::exception& exception) {
+    log_error() << "Error: Una tarea del bucle de eventos ha terminado con una excepción: " << exception.what();
+  }
+  --active;
+}
+
+/**
+ * @brief Método que ejecuta las tareas hasta que terminan todas: empieza las lanzadas, espera con epoll a que los descriptores
+ *        vigilados tengan datos o a que venza el plazo más cercano, y reanuda las tareas correspondientes. La espera usa
+ *        epoll_pwait2(), con resolución de nanosegundos, porque el ritmo de envío necesita plazos más finos que el milisegundo.
+ * @return Devuelve un código de error si no se ha podido esperar con epoll, o un código de éxito en caso contrario.
+ */
+std::error_code event_loop::run() {
+  if (epoll_fd < 0) { return std::error_code(EBADF, std::system_category()); }
+
+  epoll_event events[EVENT_LOOP_BATCH];
+  std::vector<wait_operation*> expired;
+  while (active > 0) {
+    // Las tareas que se lancen mientras se empiezan estas quedan para la siguiente vuelta
+    std::vector<std::coroutine_handle<>> starting;
+    starting.swap(ready_queue);
+    for (std::coroutine_handle<> handle : starting) { handle.resume(); }
+    if (active == 0) { break; }
+
+    uint64_t now = now_microseconds();
+    uint64_t timeout = !ready_queue.empty() ? 0 : timers.empty() ? UINT64_MAX : timers.begin()->first - std::min(now, timers.begin()->first);
+    timespec wait = {static_cast<time_t>(timeout / 1000000), static_cast<long>(timeout % 1000000) * 1000};
+    int ready = epoll_pwait2(epoll_fd, events, EVENT_LOOP_BATCH, timeout == UINT64_MAX ? nullptr : &wait, nullptr);
+    if (ready < 0 && errno == ENOSYS) {
+      int milliseconds = (timeout == UINT64_MAX) ? -1 : static_cast<int>(std::min<uint64_t>((timeout + 999) / 1000, INT_MAX));
+      ready = epoll_wait(epoll_fd, events, EVENT_LOOP_BATCH, milliseconds);
+    }
+    if (ready < 0) {
+      if (errno == EINTR) { continue; }
+      log_error() << "Error: No se ha podido esperar a los eventos con epoll.";
+      return std::error_code(errno, std::system_category());
+    }
+    count_metric(metric::syscalls);
+
+    // Los avisos de un descriptor cuya espera ya ha vencido se ignoran: la tarea recogerá los datos en su siguiente paso
+    for (int i = 0; i < ready; ++i) {
+      auto waiter = waiting.find(events[i].data.fd);
+      if (waiter != waiting.end()) { wake(*waiter->second, true); }
+    }
+
+    // Solo se reanudan las esperas vencidas antes de empezar: si una tarea vuelve a esperar con un plazo que ya ha pasado, no
+    // acapara el bucle y se reanuda en la siguiente vuelta, después de atender a los demás descriptores
+    now = now_microseconds();
+    expired.clear();
+    for (auto timer = timers.begin(); timer != timers.end() && timer->first <= now; ++timer) { expired.push_back(timer->second); }
+    for (wait_operation* operation : expired) { wake(*operation, false); }
+  }
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que devuelve el número de tareas lanzadas con spawn() que aún no han terminado.
+ */
+size_t event_loop::active_tasks() const { return active; }
+
+//-------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Función que envía un fichero desde el bucle de eventos: avanza un reliable_sender de un solo flujo con step() y, entre
+ *        paso y paso, cede el hilo a las demás tareas hasta que llega alguna confirmación o vence el plazo del paso. Las
+ *        opciones que necesitan hilos propios o esperas bloqueantes (varios flujos, compresión, io_uring) no se usan aquí, y
+ *        el fichero va por un solo camino (el bucle espera en un solo socket por tarea).
+ * @param[in,out] loop: bucle de eventos en el que se ejecuta la transferencia.
+ * @param[in] path: ruta del fichero que se envía.
+ * @param[in] destination: dirección del receptor.
+ * @param[in] options: opciones de la transferencia (tamaño del lote, mmap, tasa, control de congestión...).
+ * @return Devuelve el CRC32C del fichero confirmado por el receptor, o un código de error si no se ha podido enviar.
+ */
+task<transfer_result> send_file(event_loop& loop, std::string path, sockaddr_storage destination, netcp_options options) {
+  options.streams = 1;
+  options.compress = false;
+  options.use_io_uring = false;
+  options.paths.clear();
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    log_error() << "Error: No se puede abrir el fichero " << path << ".";
+    co_return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    log_error() << "Error: " << path << " no es un fichero regular.";
+    close(fd);
+    co_return std::unexpected(std::error_code(EINVAL, std::system_category()));
+  }
+  size_t file_size = static_cast<size_t>(file_stat.st_size);
+
+  auto socket_result = make_socket(make_ip_address(destination.ss_family == AF_INET6 ? "::" : "0.0.0.0", 0));
+  if (!socket_result) {
+    close(fd);
+    co_return std::unexpected(socket_result.error());
+  }
+  int socket_fd = *socket_result;
+
+  const uint8_t* mapping = nullptr;
+  if (options.use_mmap && file_size > 0) {
+    void* result = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (result != MAP_FAILED) {
+      madvise(result, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+      mapping = static_cast<const uint8_t*>(result);
+    }
+  }
+
+  std::error_code error;
+  uint32_t digest = 0;
+  {
+    reliable_sender sender({{socket_fd, destination}}, options, make_session_id(), 0, 1, nullptr, file_size);
+    sender.prepare(fd, 0, file_size, mapping);
+    transfer_progress progress;
+    while (!(progress = sender.step()).done) { co_await loop.readable(socket_fd, progress.wake_at); }
+    error = progress.error;
+    digest = sender.digest();
+  }
+
+  if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), file_size); }
+  close(socket_fd);
+  close(fd);
+  if (error) { co_return std::unexpected(error); }
+  co_return digest;
+}
+
+/**
+ * @brief Función que recibe una transferencia desde el bucle de eventos: avanza un reliable_receiver con step() cada vez que
+ *        llegan datagramas al socket o vence el plazo del paso, y escribe los datos en el fichero.
+ * @param[in,out] loop: bucle de eventos en el que se ejecuta la transferencia.
+ * @param[in] path: ruta del fichero en el que se escribe lo recibido.
+ * @param[in] address: dirección IP y puerto en los que se espera al emisor.
+ * @param[in] options: opciones de la transferencia (tamaño del lote, UDP_GRO...).
+ * @return Devuelve el CRC32C de lo recibido (que coincide con el del emisor), o un código de error si no se ha podido recibir.
+ */
+task<transfer_result> receive_file(event_loop& loop, std::string path, sockaddr_storage address, netcp_options options) {
+  auto socket_result = make_socket(address);
+  if (!socket_result) { co_return std::unexpected(socket_result.error()); }
+  int socket_fd = *socket_result;
+  set_receive_buffer(socket_fd, options);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    log_error() << "Error: No se puede abrir el fichero " << path << ".";
+    close(socket_fd);
+    co_return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+
+  receive_state shared;
+  std::error_code error;
+  {
+    reliable_receiver receiver(socket_fd, fd, options, shared);
+    transfer_progress progress;
+    bool readable = false;
+    while (!(progress = receiver.step(readable)).done) { readable = co_await loop.readable(socket_fd, progress.wake_at); }
+    error = progress.error;
+  }
+
+  close(fd);
+  close(socket_fd);
+  if (error) { co_return std::unexpected(error); }
+
+  uint32_t digest = 0;
+  for (const auto& [stream, part] : shared.digests) { digest = crc32c_combine(digest, part.first, part.second); }
+  co_return digest;
+}
@@ -0,0 +1,162 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de las zonas de memoria alineadas y del pool de buffers de tamaño fijo
+ */
+
+#include "header_files/buffer_pool.h"
+#include "header_files/metrics.h"
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+
+/**
+ * @brief Constructor de aligned_region: reserva con mmap() una zona anónima, que empieza en una página y está a cero.
+ * @param[in] size: tamaño de la zona, que se redondea a un número entero de páginas.
+ * @throw std::bad_alloc si el núcleo no concede la memoria (igual que al reservar un std::vector).
+ */
+aligned_region::aligned_region(size_t size) {
+  if (size == 0) { return; }
+  size_t rounded = (size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT;
+  void* mapping = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) { throw std::bad_alloc(); }
+  memory = static_cast<uint8_t*>(mapping);
+  length = rounded;
+  count_metric(metric::buffer_allocations);
+}
+
+/**
+ * @brief Destructor de aligned_region: libera la zona.
+ */
+aligned_region::~aligned_region() {
+  if (memory != nullptr) { munmap(memory, length); }
+}
+
+/**
+ * @brief Constructor de movimiento de aligned_region: la zona pasa a este objeto y el original queda vacío.
+ */
+aligned_region::aligned_region(aligned_region&& other) noexcept
+    : memory(std::exchange(other.memory, nullptr)), length(std::exchange(other.length, 0)) {}
+
+/**
+ * @brief Operador de asignación por movimiento de aligned_region: libera la zona actual y se queda con la del original.
+ */
+aligned_region& aligned_region::operator=(aligned_region&& other) noexcept {
+  if (this != &other) {
+    if (memory != nullptr) { munmap(memory, length); }
+    memory = std::exchange(other.memory, nullptr);
+    length = std::exchange(other.length, 0);
+  }
+  return *this;
+}
+
+/**
+ * @brief Métodos que devuelven el principio de la zona (nullptr si está vacía) y su tamaño en bytes.
+ */
+uint8_t* aligned_region::data() const { return memory; }
+size_t aligned_region::size() const { return length; }
+
+/**
+ * @brief Constructor de pool_buffer, que usa buffer_pool::acquire().
+ * @param[in] pool: pool al que pertenece la ranura.
+ * @param[in] memory: principio de la ranura.
+ */
+pool_buffer::pool_buffer(buffer_pool* pool, uint8_t* memory) : pool(pool), memory(memory) {}
+
+/**
+ * @brief Destructor de pool_buffer: devuelve la ranura a su pool.
+ */
+pool_buffer::~pool_buffer() { reset(); }
+
+/**
+ * @brief Constructor de movimiento de pool_buffer: la ranura pasa a este objeto y el original queda vacío.
+ */
+pool_buffer::pool_buffer(pool_buffer&& other) noexcept
+    : pool(std::exchange(other.pool, nullptr)), memory(std::exchange(other.memory, nullptr)) {}
+
+/**
+ * @brief Operador de asignación por movimiento de pool_buffer: devuelve la ranura actual y se queda con la del original.
+ */
+pool_buffer& pool_buffer::operator=(pool_buffer&& other) noexcept {
+  if (this != &other) {
+    reset();
+    pool = std::exchange(other.pool, nullptr);
+    memory = std::exchange(other.memory, nullptr);
+  }
+  return *this;
+}
+
+/**
+ * @brief Método que devuelve el principio de la ranura (nullptr si el buffer está vacío).
+ */
+uint8_t* pool_buffer::data() const { return memory; }
+
+/**
+ * @brief Método que indica si el buffer tiene una ranura prestada.
+ */
+pool_buffer::operator bool() const { return memory != nullptr; }
+
+/**
+ * @brief Método que devuelve la ranura a su pool, dejando el buffer vacío.
+ */
+void pool_buffer::reset() {
+  if (memory != nullptr) { pool->release(memory); }
+  pool = nullptr;
+  memory = nullptr;
+}
+
+/**
+ * @brief Constructor de buffer_pool
+ * @param[in] slab_size: tamaño de cada ranura en bytes.
+ * @param[in] initial: número de ranuras que se reservan al crear el pool (pueden ser 0, para no reservar hasta el primer uso).
+ * @param[in] growth: número de ranuras que se añaden cada vez que se agotan.
+ */
+buffer_pool::buffer_pool(size_t slab_size, size_t initial, size_t growth)
+    : slab_bytes(slab_size), stride((slab_size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT),
+      growth(std::max<size_t>(growth, 1)) {
+  if (initial > 0) { grow(initial); }
+}
+
+/**
+ * @brief Método que presta una ranura libre. Solo reserva memoria si no queda ninguna: a partir de entonces las ranuras que se
+ *        devuelven son las que se vuelven a prestar.
+ * @return Devuelve el buffer con la ranura, que la devuelve al destruirse.
+ */
+pool_buffer buffer_pool::acquire() {
+  if (free_slabs.empty()) { grow(growth); }
+  uint8_t* memory = free_slabs.back();
+  free_slabs.pop_back();
+  return pool_buffer(this, memory);
+}
+
+/**
+ * @brief Métodos que devuelven el tamaño de las ranuras, el número total de ranuras y el de ranuras libres.
+ */
+size_t buffer_pool::slab_size() const { return slab_bytes; }
+size_t buffer_pool::capacity() const { return slab_count; }
+size_t buffer_pool::available() const { return free_slabs.size(); }
+
+/**
+ * @brief Método que añade ranuras al pool, todas en una nueva zona alineada. La lista de libres se amplía a la vez, para que
+ *        devolver una ranura nunca tenga que reservar memoria.
+ * @param[in] count: número de ranuras que se añaden.
+ */
+void buffer_pool::grow(size_t count) {
+  aligned_region& region = regions.emplace_back(stride * count);
+  slab_count += count;
+  free_slabs.reserve(slab_count);
+  // Las apilamos al revés para que se presten en orden de dirección
+  for (size_t i = count; i > 0; --i) { free_slabs.push_back(region.data() + (i - 1) * stride); }
+}
+
+/**
+ * @brief Método que recibe una ranura devuelta por un pool_buffer.
+ * @param[in] memory: principio de la ranura.
+ */
+void buffer_pool::release(uint8_t* memory) { free_slabs.push_back(memory); }
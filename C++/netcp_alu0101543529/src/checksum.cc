@@ -0,0 +1,193 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del CRC32C: con la instrucción crc32 de SSE4.2 en tres carriles independientes que se combinan con
+ *         PCLMUL, o con tablas (slicing-by-8) si el procesador no tiene esas instrucciones
+ */
+
+#include "header_files/checksum.h"
+#include <array>
+#include <cstring>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+// Polinomio de Castagnoli en representación reflejada: el bit 31 es x^0 y el bit 0 es x^31
+constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+
+// Tamaño de cada uno de los tres carriles que se calculan a la vez (múltiplo de 8). La instrucción crc32 tarda 3 ciclos pero
+// el procesador puede empezar una por ciclo, así que con tres carriles independientes se triplica el rendimiento
+constexpr size_t LANE_SIZE = 1360;
+
+/**
+ * @brief Función que calcula x^n módulo el polinomio, en representación reflejada.
+ * @param[in] n: exponente.
+ * @return Devuelve x^n mod P.
+ */
+constexpr uint32_t x_power(size_t n) {
+  uint32_t value = 0x80000000;
+  for (size_t i = 0; i < n; ++i) { value = (value & 1) ? (value >> 1) ^ CRC32C_POLY : value >> 1; }
+  return value;
+}
+
+// Constantes para desplazar un CRC por uno y dos carriles: clmul(crc, x^(8n-33)) seguido de crc32 sobre 64 bits multiplica
+// el CRC por x^(8n), que es lo que le hacen n bytes a cero
+constexpr uint32_t SHIFT_ONE_LANE = x_power(8 * LANE_SIZE - 33);
+constexpr uint32_t SHIFT_TWO_LANES = x_power(16 * LANE_SIZE - 33);
+
+/**
+ * @brief Función que genera las tablas del método slicing-by-8: la tabla k da el efecto de un byte seguido de k bytes a cero.
+ * @return Devuelve las ocho tablas de 256 entradas.
+ */
+constexpr std::array<std::array<uint32_t, 256>, 8> make_tables() {
+  std::array<std::array<uint32_t, 256>, 8> tables{};
+  for (uint32_t n = 0; n < 256; ++n) {
+    uint32_t crc = n;
+    for (int bit = 0; bit < 8; ++bit) { crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1; }
+    tables[0][n] = crc;
+  }
+  for (size_t k = 1; k < 8; ++k) {
+    for (uint32_t n = 0; n < 256; ++n) { tables[k][n] = (tables[k - 1][n] >> 8) ^ tables[0][tables[k - 1][n] & 0xFF]; }
+  }
+  return tables;
+}
+
+constexpr std::array<std::array<uint32_t, 256>, 8> CRC32C_TABLES = make_tables();
+
+/**
+ * @brief Función que calcula el CRC32C de un bloque con tablas, procesando ocho bytes en cada paso.
+ * @param[in] data: datos del bloque.
+ * @param[in] length: tamaño del bloque.
+ * @param[in] crc: CRC32C de los datos anteriores (0 para empezar).
+ * @return Devuelve el CRC32C de los datos anteriores seguidos del bloque.
+ */
+uint32_t crc32c_scalar(const uint8_t* data, size_t length, uint32_t crc) {
+  const auto& t = CRC32C_TABLES;
+  crc = ~crc;
+  while (length >= 8) {
+    uint32_t low, high;
+    std::memcpy(&low, data, sizeof(low));
+    std::memcpy(&high, data + 4, sizeof(high));
+    low ^= crc;
+    crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+          t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+    data += 8;
+    length -= 8;
+  }
+  while (length-- > 0) { crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF]; }
+  return ~crc;
+}
+
+/**
+ * @brief Función que multiplica un CRC por la constante de desplazamiento con PCLMUL y reduce el producto con crc32.
+ * @param[in] crc: CRC que se desplaza.
+ * @param[in] constant: x^(8n-33) mod P, para desplazarlo n bytes.
+ * @return Devuelve el CRC desplazado.
+ */
+__attribute__((target("sse4.2,pclmul"))) static uint32_t shift_hardware(uint32_t crc, uint32_t constant) {
+  __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc)), _mm_cvtsi32_si128(static_cast<int>(constant)), 0);
+  return static_cast<uint32_t>(_mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+}
+
+/**
+ * @brief Función que calcula el CRC32C de un bloque con la instrucción crc32. Los tramos grandes se reparten en tres carriles
+ *        consecutivos que se calculan intercalados y después se combinan desplazando los dos primeros.
+ * @param[in] data: datos del bloque.
+ * @param[in] length: tamaño del bloque.
+ * @param[in] crc: CRC32C de los datos anteriores (0 para empezar).
+ * @return Devuelve el CRC32C de los datos anteriores seguidos del bloque.
+ */
+__attribute__((target("sse4.2,pclmul"))) static uint32_t crc32c_sse42(const uint8_t* data, size_t length, uint32_t crc) {
+  uint64_t first = ~crc;
+  while (length >= 3 * LANE_SIZE) {
+    uint64_t second = 0;
+    uint64_t third = 0;
+    for (size_t i = 0; i < LANE_SIZE; i += 8) {
+      uint64_t a, b, c;
+      std::memcpy(&a, data + i, sizeof(a));
+      std::memcpy(&b, data + LANE_SIZE + i, sizeof(b));
+      std::memcpy(&c, data + 2 * LANE_SIZE + i, sizeof(c));
+      first = _mm_crc32_u64(first, a);
+      second = _mm_crc32_u64(second, b);
+      third = _mm_crc32_u64(third, c);
+    }
+    first = shift_hardware(static_cast<uint32_t>(first), SHIFT_TWO_LANES) ^ shift_hardware(static_cast<uint32_t>(second), SHIFT_ONE_LANE) ^
+            third;
+    data += 3 * LANE_SIZE;
+    length -= 3 * LANE_SIZE;
+  }
+
+  while (length >= 8) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    first = _mm_crc32_u64(first, value);
+    data += 8;
+    length -= 8;
+  }
+  uint32_t result = static_cast<uint32_t>(first);
+  while (length-- > 0) { result = _mm_crc32_u8(result, *data++); }
+  return ~result;
+}
+
+/**
+ * @brief Función que indica si el procesador tiene las instrucciones SSE4.2 y PCLMUL.
+ * @return Devuelve true si crc32c() usa las instrucciones del procesador.
+ */
+bool crc32c_hardware() {
+  static const bool supported = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+  return supported;
+}
+
+/**
+ * @brief Función que calcula el CRC32C de un bloque, con las instrucciones del procesador si las tiene.
+ * @param[in] data: datos del bloque.
+ * @param[in] length: tamaño del bloque.
+ * @param[in] crc: CRC32C de los datos anteriores (0 para empezar).
+ * @return Devuelve el CRC32C de los datos anteriores seguidos del bloque.
+ */
+uint32_t crc32c(const uint8_t* data, size_t length, uint32_t crc) {
+  return crc32c_hardware() ? crc32c_sse42(data, length, crc) : crc32c_scalar(data, length, crc);
+}
+
+/**
+ * @brief Función que multiplica dos polinomios módulo P, en representación reflejada.
+ * @param[in] a: primer factor.
+ * @param[in] b: segundo factor.
+ * @return Devuelve a * b mod P.
+ */
+static uint32_t multiply_mod(uint32_t a, uint32_t b) {
+  uint32_t product = 0;
+  for (uint32_t mask = 0x80000000; mask != 0; mask >>= 1) {
+    if (a & mask) { product ^= b; }
+    b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+  }
+  return product;
+}
+
+/**
+ * @brief Función que calcula el CRC32C de dos bloques consecutivos sin volver a recorrerlos: añadir length bytes detrás del
+ *        primer bloque equivale a multiplicar su CRC por x^(8·length) y sumarle el del segundo.
+ * @param[in] first: CRC32C del primer bloque.
+ * @param[in] second: CRC32C del segundo bloque.
+ * @param[in] length: tamaño del segundo bloque.
+ * @return Devuelve el CRC32C de los dos bloques seguidos.
+ */
+uint32_t crc32c_combine(uint32_t first, uint32_t second, size_t length) {
+  // x^(2^k) mod P para k = 3, 4, ...: se multiplican los que corresponden a los bits a 1 de la longitud (en bytes, 2^3 bits)
+  static const std::array<uint32_t, 64> powers = []() {
+    std::array<uint32_t, 64> table{};
+    table[0] = x_power(8);
+    for (size_t k = 1; k < table.size(); ++k) { table[k] = multiply_mod(table[k - 1], table[k - 1]); }
+    return table;
+  }();
+
+  uint32_t shift = 0x80000000;
+  for (size_t k = 0; length != 0; ++k, length >>= 1) {
+    if (length & 1) { shift = multiply_mod(powers[k], shift); }
+  }
+  return multiply_mod(shift, first) ^ second;
+}
@@ -0,0 +1,123 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de la compresión de bloques con zlib (deflate sin cabeceras, nivel 1) y del grupo de hilos
+ */
+
+#include "header_files/compression.h"
+#include <algorithm>
+#include <zlib.h>
+
+/**
+ * @brief Función que comprime un bloque con deflate al nivel más rápido. Cada hilo reutiliza su propio estado de zlib,
+ *        porque crearlo para cada bloque cuesta más que comprimirlo.
+ * @param[in] data: datos del bloque.
+ * @param[in] length: tamaño del bloque.
+ * @param[out] output: buffer en el que se escriben los datos comprimidos (al menos de length bytes).
+ * @return Devuelve el tamaño comprimido, o 0 si el bloque no se puede comprimir a menos de su tamaño original (o zlib falla).
+ */
+size_t compress_block(const uint8_t* data, size_t length, uint8_t* output) {
+  struct deflate_state {
+    z_stream stream{};
+    bool ready = false;
+    deflate_state() { ready = deflateInit2(&stream, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK; }
+    ~deflate_state() { if (ready) { deflateEnd(&stream); } }
+  };
+  thread_local deflate_state state;
+  if (!state.ready || length < 2 || deflateReset(&state.stream) != Z_OK) { return 0; }
+
+  // Solo dejamos que la salida ocupe un byte menos que la entrada: si no cabe, el bloque viaja sin comprimir
+  state.stream.next_in = const_cast<Bytef*>(data);
+  state.stream.avail_in = static_cast<uInt>(length);
+  state.stream.next_out = output;
+  state.stream.avail_out = static_cast<uInt>(length - 1);
+  if (deflate(&state.stream, Z_FINISH) != Z_STREAM_END) { return 0; }
+  return length - 1 - state.stream.avail_out;
+}
+
+/**
+ * @brief Función que descomprime un bloque comprimido con compress_block().
+ * @param[in] data: datos comprimidos.
+ * @param[in] length: tamaño de los datos comprimidos.
+ * @param[out] output: buffer en el que se escriben los datos descomprimidos.
+ * @param[in] capacity: tamaño del buffer de salida (el tamaño máximo de un bloque).
+ * @return Devuelve el tamaño descomprimido, o std::nullopt si los datos no son válidos o no caben en el buffer.
+ */
+std::optional<size_t> decompress_block(const uint8_t* data, size_t length, uint8_t* output, size_t capacity) {
+  struct inflate_state {
+    z_stream stream{};
+    bool ready = false;
+    inflate_state() { ready = inflateInit2(&stream, -15) == Z_OK; }
+    ~inflate_state() { if (ready) { inflateEnd(&stream); } }
+  };
+  thread_local inflate_state state;
+  if (!state.ready || inflateReset(&state.stream) != Z_OK) { return std::nullopt; }
+
+  state.stream.next_in = const_cast<Bytef*>(data);
+  state.stream.avail_in = static_cast<uInt>(length);
+  state.stream.next_out = output;
+  state.stream.avail_out = static_cast<uInt>(capacity);
+  if (inflate(&state.stream, Z_FINISH) != Z_STREAM_END) { return std::nullopt; }
+  return capacity - state.stream.avail_out;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Constructor de worker_pool
+ * @param[in] threads: número de hilos que ejecutan los trabajos (al menos uno).
+ */
+worker_pool::worker_pool(size_t threads) {
+  for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) { this->threads.emplace_back(&worker_pool::run, this); }
+}
+
+/**
+ * @brief Destructor de worker_pool: los hilos terminan los trabajos que queden en la cola y después se les espera.
+ */
+worker_pool::~worker_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (std::thread& thread : threads) { thread.join(); }
+}
+
+/**
+ * @brief Método que encarga un trabajo al primer hilo libre.
+ * @param[in] job: función que se ejecuta en uno de los hilos.
+ * @return Devuelve un futuro que se completa cuando el trabajo ha terminado.
+ */
+std::future<void> worker_pool::submit(std::function<void()> job) {
+  std::packaged_task<void()> task(std::move(job));
+  std::future<void> done = task.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(std::move(task));
+  }
+  available.notify_one();
+  return done;
+}
+
+/**
+ * @brief Método que ejecuta cada hilo del grupo: espera trabajos en la cola y los ejecuta, hasta que se destruye el grupo
+ *        y la cola queda vacía.
+ */
+void worker_pool::run() {
+  while (true) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty()) { return; }
+      task = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,454 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de la transferencia por diferencias: suma rodante de rsync, resumen MD5 (OpenSSL) y formato de la delta
+ */
+
+#include "header_files/delta.h"
+#include "header_files/reliable.h"
+#include <cmath>
+#include <cstring>
+#include <endian.h>
+#include <openssl/evp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unordered_map>
+
+// Cabeceras de la firma ("NSIG", tamaño de bloque y número de bloques) y de la delta ("NDLT", tamaño y CRC32C del fichero nuevo)
+constexpr uint8_t SIGNATURE_MAGIC[4] = {'N', 'S', 'I', 'G'};
+constexpr size_t SIGNATURE_HEADER_SIZE = 12;
+constexpr size_t SIGNATURE_ENTRY_SIZE = 20;
+constexpr uint8_t DELTA_MAGIC[4] = {'N', 'D', 'L', 'T'};
+constexpr size_t DELTA_HEADER_SIZE = 16;
+
+// Operaciones de la delta: datos literales (longitud y datos) o copia de un tramo del fichero del receptor (posición y longitud)
+constexpr uint8_t OP_LITERAL = 'L';
+constexpr uint8_t OP_COPY = 'C';
+constexpr size_t MAX_LITERAL = 1 << 20;
+
+// Intentos de la petición de firma, y espera entre ellos en milisegundos
+constexpr int SIGNATURE_ATTEMPTS = 50;
+constexpr int SIGNATURE_RETRY = 200;
+
+// Suma rodante de rsync: a es la suma de los bytes de la ventana y b la suma ponderada por su distancia al final, ambas módulo
+// 2^16. Desplazar la ventana un byte solo cuesta unas pocas operaciones
+struct rolling_checksum {
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint32_t length = 0;
+
+  void reset(const uint8_t* data, size_t size) {
+    a = b = 0;
+    length = static_cast<uint32_t>(size);
+    for (size_t i = 0; i < size; ++i) {
+      a += data[i];
+      b += static_cast<uint32_t>(size - i) * data[i];
+    }
+  }
+
+  void roll(uint8_t out, uint8_t in) {
+    a += in - out;
+    b += a - length * out;
+  }
+
+  uint32_t value() const { return (a & 0xFFFF) | (b << 16); }
+};
+
+/**
+ * @brief Función que calcula el resumen MD5 de un bloque.
+ * @param[in] data: datos del bloque.
+ * @param[in] size: tamaño del bloque.
+ * @return Devuelve los 16 bytes del resumen.
+ */
+static std::array<uint8_t, 16> strong_hash(const uint8_t* data, size_t size) {
+  std::array<uint8_t, 16> digest{};
+  unsigned int digest_size = 0;
+  EVP_Digest(data, size, digest.data(), &digest_size, EVP_md5(), nullptr);
+  return digest;
+}
+
+/**
+ * @brief Funciones que añaden un entero en orden de bytes de red al final de un buffer.
+ */
+static void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+  value = htobe32(value);
+  out.resize(out.size() + sizeof(value));
+  std::memcpy(out.data() + out.size() - sizeof(value), &value, sizeof(value));
+}
+
+static void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+  value = htobe64(value);
+  out.resize(out.size() + sizeof(value));
+  std::memcpy(out.data() + out.size() - sizeof(value), &value, sizeof(value));
+}
+
+/**
+ * @brief Funciones que leen un entero en orden de bytes de red.
+ */
+static uint32_t get_u32(const uint8_t* in) {
+  uint32_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return be32toh(value);
+}
+
+static uint64_t get_u64(const uint8_t* in) {
+  uint64_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return be64toh(value);
+}
+
+/**
+ * @brief Función que calcula la firma de un fichero: la suma rodante y el MD5 de cada bloque completo. El tamaño de bloque
+ *        es, como en rsync, la raíz cuadrada del tamaño del fichero, que equilibra el tamaño de la firma con la precisión
+ *        con la que se localizan los cambios.
+ * @param[in] data: contenido del fichero (nullptr si está vacío).
+ * @param[in] size: tamaño del fichero.
+ * @return Devuelve la firma del fichero.
+ */
+file_signature make_signature(const uint8_t* data, size_t size) {
+  file_signature signature;
+  signature.block_size = std::clamp<uint32_t>(static_cast<uint32_t>(std::sqrt(static_cast<double>(size))) & ~63U, 1024, 131072);
+
+  rolling_checksum weak;
+  for (size_t offset = 0; offset + signature.block_size <= size; offset += signature.block_size) {
+    weak.reset(data + offset, signature.block_size);
+    signature.blocks.push_back({weak.value(), strong_hash(data + offset, signature.block_size)});
+  }
+  return signature;
+}
+
+/**
+ * @brief Función que codifica una firma para enviarla.
+ * @param[in] signature: firma del fichero.
+ * @return Devuelve la firma codificada.
+ */
+std::vector<uint8_t> encode_signature(const file_signature& signature) {
+  std::vector<uint8_t> out(std::begin(SIGNATURE_MAGIC), std::end(SIGNATURE_MAGIC));
+  out.reserve(SIGNATURE_HEADER_SIZE + signature.blocks.size() * SIGNATURE_ENTRY_SIZE);
+  put_u32(out, signature.block_size);
+  put_u32(out, static_cast<uint32_t>(signature.blocks.size()));
+  for (const block_signature& block : signature.blocks) {
+    put_u32(out, block.weak);
+    out.insert(out.end(), block.strong.begin(), block.strong.end());
+  }
+  return out;
+}
+
+/**
+ * @brief Función que decodifica una firma recibida.
+ * @param[in] in: firma codificada.
+ * @param[in] size: tamaño de la firma codificada.
+ * @return Devuelve la firma, o std::nullopt si no tiene el formato esperado.
+ */
+std::optional<file_signature> decode_signature(const uint8_t* in, size_t size) {
+  if (size < SIGNATURE_HEADER_SIZE || std::memcmp(in, SIGNATURE_MAGIC, sizeof(SIGNATURE_MAGIC)) != 0) { return std::nullopt; }
+
+  file_signature signature;
+  signature.block_size = get_u32(in + 4);
+  uint32_t count = get_u32(in + 8);
+  if (signature.block_size == 0 || size != SIGNATURE_HEADER_SIZE + static_cast<size_t>(count) * SIGNATURE_ENTRY_SIZE) { return std::nullopt; }
+
+  signature.blocks.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint8_t* entry = in + SIGNATURE_HEADER_SIZE + static_cast<size_t>(i) * SIGNATURE_ENTRY_SIZE;
+    signature.blocks[i].weak = get_u32(entry);
+    std::memcpy(signature.blocks[i].strong.data(), entry + 4, 16);
+  }
+  return signature;
+}
+
+// Índice de la firma: bloques con cada suma rodante, y un filtro de bits que descarta rápido las sumas que no están
+struct signature_index {
+  std::unordered_map<uint32_t, std::vector<uint32_t>> blocks;
+  std::vector<uint64_t> filter = std::vector<uint64_t>(1 << 14);
+
+  static size_t bit(uint32_t weak) { return (weak ^ (weak >> 20)) & ((1 << 20) - 1); }
+  void add(uint32_t weak, uint32_t block) {
+    blocks[weak].push_back(block);
+    filter[bit(weak) >> 6] |= 1ULL << (bit(weak) & 63);
+  }
+  bool may_contain(uint32_t weak) const { return filter[bit(weak) >> 6] & (1ULL << (bit(weak) & 63)); }
+};
+
+/**
+ * @brief Función que calcula la delta de un tramo del fichero nuevo: desplaza una ventana del tamaño de bloque byte a byte
+ *        y, cuando su suma rodante y su MD5 coinciden con un bloque de la firma, emite una copia de ese bloque y salta la
+ *        ventana entera. Los bytes sin coincidencia se emiten como literales, y las copias de bloques consecutivos se unen.
+ * @param[in] data: contenido del fichero nuevo.
+ * @param[in] begin: posición en la que empieza el tramo.
+ * @param[in] end: posición en la que termina el tramo.
+ * @param[in] signature: firma del fichero del receptor.
+ * @param[in] index: índice de la firma por suma rodante.
+ * @param[out] out: operaciones de la delta del tramo.
+ * @param[out] stats: bytes literales y copiados del tramo.
+ */
+static void encode_range(const uint8_t* data, size_t begin, size_t end, const file_signature& signature, const signature_index& index,
+                         std::vector<uint8_t>& out, delta_stats& stats) {
+  const size_t block_size = signature.block_size;
+  size_t literal_start = begin;
+  uint64_t copy_source = 0;
+  uint64_t copy_length = 0;
+
+  auto flush_copy = [&]() {
+    if (copy_length == 0) { return; }
+    out.push_back(OP_COPY);
+    put_u64(out, copy_source);
+    put_u32(out, static_cast<uint32_t>(copy_length));
+    stats.copied_bytes += copy_length;
+    copy_length = 0;
+  };
+  auto flush_literal = [&](size_t until) {
+    while (literal_start < until) {
+      size_t length = std::min(until - literal_start, MAX_LITERAL);
+      out.push_back(OP_LITERAL);
+      put_u32(out, static_cast<uint32_t>(length));
+      out.insert(out.end(), data + literal_start, data + literal_start + length);
+      stats.literal_bytes += length;
+      literal_start += length;
+    }
+  };
+
+  rolling_checksum weak;
+  size_t position = begin;
+  if (!signature.blocks.empty() && end - begin >= block_size) { weak.reset(data + position, block_size); }
+  while (!signature.blocks.empty() && position + block_size <= end) {
+    std::optional<uint32_t> match;
+    uint32_t value = weak.value();
+    if (index.may_contain(value)) {
+      auto candidates = index.blocks.find(value);
+      if (candidates != index.blocks.end()) {
+        std::array<uint8_t, 16> strong = strong_hash(data + position, block_size);
+        for (uint32_t block : candidates->second) {
+          if (signature.blocks[block].strong != strong) { continue; }
+          match = block;
+          // Si hay varios bloques iguales, preferimos el que continúa la copia anterior
+          if (copy_length > 0 && copy_source + copy_length == static_cast<uint64_t>(block) * block_size) { break; }
+        }
+      }
+    }
+
+    if (match) {
+      flush_literal(position);
+      uint64_t source = static_cast<uint64_t>(*match) * block_size;
+      if (copy_length > 0 && copy_source + copy_length == source && copy_length + block_size <= UINT32_MAX) {
+        copy_length += block_size;
+      } else {
+        flush_copy();
+        copy_source = source;
+        copy_length = block_size;
+      }
+      position += block_size;
+      literal_start = position;
+      if (position + block_size <= end) { weak.reset(data + position, block_size); }
+      continue;
+    }
+
+    // Sin coincidencia, el primer byte de la ventana será literal: la copia pendiente va antes que él
+    flush_copy();
+    if (position + block_size < end) { weak.roll(data[position], data[position + block_size]); }
+    ++position;
+  }
+
+  flush_copy();
+  flush_literal(end);
+}
+
+/**
+ * @brief Función que calcula la delta del fichero nuevo frente a la firma del fichero que tiene el receptor. El fichero se
+ *        reparte en tramos que se codifican en paralelo y se concatenan (las coincidencias no cruzan de un tramo a otro).
+ * @param[in] data: contenido del fichero nuevo (nullptr si está vacío).
+ * @param[in] size: tamaño del fichero nuevo.
+ * @param[in] signature: firma del fichero del receptor.
+ * @param[in] threads: número de hilos (y de tramos).
+ * @param[out] stats: bytes literales y copiados de la delta.
+ * @return Devuelve la delta: cabecera con el tamaño y el CRC32C del fichero nuevo, seguida de las operaciones.
+ */
+std::vector<uint8_t> make_delta(const uint8_t* data, size_t size, const file_signature& signature, size_t threads, delta_stats& stats) {
+  signature_index index;
+  for (uint32_t i = 0; i < signature.blocks.size(); ++i) { index.add(signature.blocks[i].weak, i); }
+
+  // Cada tramo tiene al menos unos cuantos bloques, para que el reparto no impida encontrar coincidencias
+  threads = std::clamp<size_t>(std::min<size_t>(threads, size / (16 * static_cast<size_t>(signature.block_size)) + 1), 1, 256);
+  std::vector<std::vector<uint8_t>> parts(threads);
+  std::vector<delta_stats> part_stats(threads);
+  std::vector<uint32_t> part_digests(threads);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; ++i) {
+    size_t begin = size * i / threads;
+    size_t end = size * (i + 1) / threads;
+    workers.emplace_back([&, i, begin, end]() {
+      encode_range(data, begin, end, signature, index, parts[i], part_stats[i]);
+      part_digests[i] = crc32c(data + begin, end - begin);
+    });
+  }
+  for (std::thread& worker : workers) { worker.join(); }
+
+  uint32_t digest = 0;
+  for (size_t i = 0; i < threads; ++i) {
+    digest = crc32c_combine(digest, part_digests[i], size * (i + 1) / threads - size * i / threads);
+    stats.literal_bytes += part_stats[i].literal_bytes;
+    stats.copied_bytes += part_stats[i].copied_bytes;
+  }
+
+  std::vector<uint8_t> delta(std::begin(DELTA_MAGIC), std::end(DELTA_MAGIC));
+  put_u64(delta, size);
+  put_u32(delta, digest);
+  for (const std::vector<uint8_t>& part : parts) { delta.insert(delta.end(), part.begin(), part.end()); }
+  return delta;
+}
+
+/**
+ * @brief Función que reconstruye el fichero nuevo aplicando las operaciones de la delta en orden: los literales se escriben
+ *        tal cual y las copias se leen del fichero que ya tenía el receptor. Al final se comprueban el tamaño y el CRC32C.
+ * @param[in] delta: delta recibida.
+ * @param[in] size: tamaño de la delta.
+ * @param[in] basis_fd: descriptor del fichero que ya tenía el receptor (-1 si no existía).
+ * @param[in] output_fd: descriptor del fichero en el que se escribe el fichero nuevo.
+ * @return Devuelve un código de error si la delta no es válida o no se ha podido leer o escribir, o un código de éxito en caso contrario.
+ */
+std::error_code apply_delta(const uint8_t* delta, size_t size, int basis_fd, int output_fd) {
+  if (size < DELTA_HEADER_SIZE || std::memcmp(delta, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0) {
+    log_error() << "Error: La delta recibida no tiene el formato esperado.";
+    return std::error_code(EBADMSG, std::system_category());
+  }
+  uint64_t file_size = get_u64(delta + 4);
+  uint32_t expected_digest = get_u32(delta + 12);
+
+  std::vector<uint8_t> buffer(MAX_LITERAL);
+  uint64_t position = 0;
+  uint32_t digest = 0;
+  size_t cursor = DELTA_HEADER_SIZE;
+  while (cursor < size) {
+    uint8_t operation = delta[cursor++];
+    if (operation == OP_LITERAL && size - cursor >= 4 && size - cursor - 4 >= get_u32(delta + cursor)) {
+      uint32_t length = get_u32(delta + cursor);
+      uint8_t* literal = const_cast<uint8_t*>(delta + cursor + 4);
+      if (std::error_code error = write_file_batch(output_fd, {{literal, length}}, static_cast<off_t>(position))) { return error; }
+      digest = crc32c(literal, length, digest);
+      position += length;
+      cursor += 4 + length;
+    } else if (operation == OP_COPY && size - cursor >= 12 && basis_fd != -1) {
+      off_t source = static_cast<off_t>(get_u64(delta + cursor));
+      uint64_t remaining = get_u32(delta + cursor + 8);
+      cursor += 12;
+      while (remaining > 0) {
+        size_t length = std::min<uint64_t>(remaining, buffer.size());
+        ssize_t bytes_read = pread(basis_fd, buffer.data(), length, source);
+        if (bytes_read != static_cast<ssize_t>(length)) {
+          log_error() << "Error: No se puede leer el fichero anterior (¿ha cambiado durante la transferencia?).";
+          return std::error_code(bytes_read < 0 ? errno : EIO, std::system_category());
+        }
+        if (std::error_code error = write_file_batch(output_fd, {{buffer.data(), length}}, static_cast<off_t>(position))) { return error; }
+        digest = crc32c(buffer.data(), length, digest);
+        position += length;
+        source += static_cast<off_t>(length);
+        remaining -= length;
+      }
+    } else {
+      log_error() << "Error: La delta recibida está incompleta o es incoherente.";
+      return std::error_code(EBADMSG, std::system_category());
+    }
+  }
+
+  if (position != file_size || digest != expected_digest) {
+    log_error() << "Error: El fichero reconstruido no coincide con el del emisor.";
+    return std::error_code(EIO, std::system_category());
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Función que pide al receptor la firma de su copia del fichero. La petición se repite hasta que llega algún datagrama
+ *        del receptor, y la firma se recibe después como una transferencia fiable normal, en un fichero anónimo en memoria.
+ * @param[in] socket_fd: socket por el que se pide y se recibe la firma.
+ * @param[in] destination: dirección del receptor.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve la firma, o un código de error si el receptor no responde o la firma no es válida.
+ */
+std::expected<file_signature, std::error_code> request_signature(int socket_fd, const sockaddr_storage& destination, const netcp_options& options) {
+  uint8_t packet[PACKET_HEADER_SIZE];
+  packet_header header;
+  header.type = packet_type::signature_request;
+  header.session = make_session_id();
+  encode_header(header, packet);
+  seal_header(packet, 0, 0);
+
+  pollfd descriptor = {socket_fd, POLLIN, 0};
+  bool answered = false;
+  for (int attempt = 0; attempt < SIGNATURE_ATTEMPTS && !answered && !quit_requested; ++attempt) {
+    if (sendto(socket_fd, packet, sizeof(packet), 0, reinterpret_cast<const sockaddr*>(&destination), address_length(destination)) < 0) {
+      log_error() << "Error: No se ha podido pedir la firma al receptor.";
+      return std::unexpected(std::error_code(errno, std::system_category()));
+    }
+    answered = poll(&descriptor, 1, SIGNATURE_RETRY) > 0;
+  }
+  if (!answered) {
+    log_error() << "Error: El receptor no responde a la petición de firma (¿se ha iniciado con -d?).";
+    return std::unexpected(std::error_code(ETIMEDOUT, std::system_category()));
+  }
+
+  int memory_fd = memfd_create("netcp-signature", 0);
+  if (memory_fd == -1) { return std::unexpected(std::error_code(errno, std::system_category())); }
+  receive_state shared;
+  reliable_receiver receiver(socket_fd, memory_fd, options, shared);
+  std::error_code error = receiver.receive();
+
+  struct stat memory_stat;
+  std::vector<uint8_t> encoded;
+  if (!error && fstat(memory_fd, &memory_stat) == 0) {
+    encoded.resize(static_cast<size_t>(memory_stat.st_size));
+    if (pread(memory_fd, encoded.data(), encoded.size(), 0) != static_cast<ssize_t>(encoded.size())) { error = std::error_code(EIO, std::system_category()); }
+  }
+  close(memory_fd);
+  if (error) { return std::unexpected(error); }
+
+  std::optional<file_signature> signature = decode_signature(encoded.data(), encoded.size());
+  if (!signature) {
+    log_error() << "Error: La firma recibida no tiene el formato esperado.";
+    return std::unexpected(std::error_code(EBADMSG, std::system_category()));
+  }
+  return *signature;
+}
+
+/**
+ * @brief Función que espera en cualquiera de los sockets del receptor la petición de firma del emisor, y le envía la firma
+ *        del fichero que ya tiene el receptor con el protocolo fiable, desde el socket por el que ha llegado la petición.
+ * @param[in] sockets: sockets del receptor.
+ * @param[in] basis: contenido del fichero que ya tiene el receptor (nullptr si no existe o está vacío).
+ * @param[in] size: tamaño de ese fichero.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve un código de error si no se ha podido enviar la firma, o un código de éxito en caso contrario.
+ */
+std::error_code serve_signature(const std::vector<int>& sockets, const uint8_t* basis, size_t size, const netcp_options& options) {
+  std::vector<pollfd> descriptors;
+  for (int socket_fd : sockets) { descriptors.push_back({socket_fd, POLLIN, 0}); }
+
+  std::optional<size_t> requested;
+  sockaddr_storage peer{};
+  uint8_t buffer[PACKET_HEADER_SIZE];
+  while (!requested && !quit_requested) {
+    if (poll(descriptors.data(), descriptors.size(), 100) <= 0) { continue; }
+    for (size_t i = 0; i < descriptors.size() && !requested; ++i) {
+      if (!(descriptors[i].revents & POLLIN)) { continue; }
+      socklen_t peer_size = sizeof(peer);
+      ssize_t received = recvfrom(sockets[i], buffer, sizeof(buffer), MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&peer), &peer_size);
+      packet_header header;
+      if (received > 0 && verify_checksum(buffer, static_cast<size_t>(received)) &&
+          decode_header(buffer, static_cast<size_t>(received), header) && header.type == packet_type::signature_request) {
+        requested = i;
+      }
+    }
+  }
+  if (!requested) { return std::error_code(EINTR, std::system_category()); }
+
+  std::vector<uint8_t> encoded = encode_signature(make_signature(basis, size));
+  log_info() << "Enviando la firma del fichero actual (" << encoded.size() << " bytes)...";
+  reliable_sender sender({{sockets[*requested], peer}}, options, make_session_id());
+  return sender.send(-1, 0, encoded.size(), encoded.data());
+}
@@ -0,0 +1,231 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del envío en abanico y de la clase chunk_feed
+ */
+
+#include "header_files/fanout.h"
+#include "header_files/async.h"
+#include <iomanip>
+#include <sys/mman.h>
+
+/**
+ * @brief Constructor de chunk_feed
+ * @param[in] chunk_size: tamaño de los bloques de la transferencia.
+ * @param[in] capacity: número de bloques recientes que se guardan.
+ * @param[in] key: clave con la que cifran todos los emisores, o nada si los datos van en claro.
+ */
+chunk_feed::chunk_feed(size_t chunk_size, size_t capacity, std::optional<aead_key> key)
+    : slots(chunk_size + (key ? AEAD_OVERHEAD : 0)), cipher_key(key), capacity(std::max<size_t>(capacity, 1)) {}
+
+/**
+ * @brief Método que devuelve el pool del que toman sus ranuras los bloques compartidos.
+ */
+buffer_pool& chunk_feed::pool() { return slots; }
+
+/**
+ * @brief Método que devuelve la clave con la que cifran todos los emisores (nada si los datos van en claro).
+ */
+const std::optional<aead_key>& chunk_feed::key() const { return cipher_key; }
+
+/**
+ * @brief Método que busca un bloque que ya ha preparado alguno de los emisores.
+ * @param[in] sequence: número de secuencia del bloque.
+ * @return Devuelve el bloque compartido, o nullptr si no se ha preparado todavía o ya se ha descartado.
+ */
+std::shared_ptr<shared_chunk> chunk_feed::find(uint64_t sequence) {
+  auto found = recent.find(sequence);
+  if (found == recent.end()) { return nullptr; }
+  ++reused_count;
+  return found->second;
+}
+
+/**
+ * @brief Método que cuenta los bloques que hay que preparar antes de llegar a uno que ya está en el almacén.
+ * @param[in] first: número de secuencia del primer bloque.
+ * @param[in] count: número de bloques que se quieren preparar.
+ * @return Devuelve cuántos de los bloques, a partir de first, no están en el almacén (como mucho count).
+ */
+size_t chunk_feed::missing(uint64_t first, size_t count) const {
+  auto next = recent.lower_bound(first);
+  if (next == recent.end() || next->first - first >= count) { return count; }
+  return static_cast<size_t>(next->first - first);
+}
+
+/**
+ * @brief Método que guarda un bloque recién preparado. Si no cabe, se descartan los de menor número de secuencia, que son los
+ *        que ya han pasado todos los emisores salvo los que van muy por detrás (los bloques que siguen en la ventana de algún
+ *        emisor no se liberan hasta que salen de ella).
+ * @param[in] sequence: número de secuencia del bloque.
+ * @param[in] chunk: bloque compartido.
+ */
+void chunk_feed::publish(uint64_t sequence, std::shared_ptr<shared_chunk> chunk) {
+  recent[sequence] = std::move(chunk);
+  ++prepared_count;
+  while (recent.size() > capacity) { recent.erase(recent.begin()); }
+}
+
+/**
+ * @brief Método que devuelve cuántos bloques han preparado (leído del fichero) los emisores.
+ */
+uint64_t chunk_feed::prepared() const { return prepared_count; }
+
+/**
+ * @brief Método que devuelve cuántas veces un emisor ha tomado un bloque ya preparado en lugar de leerlo.
+ */
+uint64_t chunk_feed::reused() const { return reused_count; }
+
+//-------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Función con la tarea que envía el fichero a uno de los receptores: avanza su emisor con step() y, entre paso y paso,
+ *        cede el hilo a los emisores de los demás receptores hasta que llega alguna confirmación a su socket o vence el plazo.
+ * @param[in,out] loop: bucle de eventos en el que avanzan todos los emisores.
+ * @param[in,out] sender: emisor del receptor.
+ * @param[in] socket_fd: socket del emisor, por el que llegan las confirmaciones del receptor.
+ * @param[out] result: resultado de la transferencia.
+ */
+static task<void> feed_receiver(event_loop& loop, reliable_sender& sender, int socket_fd, transfer_progress& result) {
+  transfer_progress progress;
+  while (!(progress = sender.step()).done) { co_await loop.readable(socket_fd, progress.wake_at); }
+  result = progress;
+}
+
+/**
+ * @brief Función que envía un fichero a varios receptores a la vez. Cada receptor tiene su propio emisor, con su socket, su
+ *        ventana, sus confirmaciones y sus reenvíos, así que uno lento o que deja de responder no frena a los demás; pero el
+ *        fichero se lee (y cada bloque se comprime y se cifra) una sola vez: el primer emisor que necesita un bloque lo
+ *        prepara en el almacén compartido y los demás lo toman de ahí. Todos avanzan en el mismo bucle de eventos, así que
+ *        la E/S del fichero y la CPU no dependen del número de receptores, salvo para los que se quedan más atrás de lo que
+ *        guarda el almacén, que releen sus bloques.
+ * @param[in] filename: fichero que se envía.
+ * @param[in] options: opciones de la transferencia, con los receptores en options.receivers.
+ * @return Devuelve un código de error si no se ha podido enviar el fichero a algún receptor, o un código de éxito si lo han
+ *         recibido todos.
+ */
+std::error_code netcp_send_fanout(const std::string& filename, const netcp_options& options) {
+  if (options.recursive || options.delta || !options.paths.empty()) {
+    log_error() << "Error: El envío a varios receptores (--to) no se puede combinar con -R, --delta ni --path.";
+    return std::error_code(EINVAL, std::system_category());
+  }
+
+  // Cada receptor recibe un solo flujo, por un solo camino, y los emisores se turnan en un solo hilo, así que io_uring (cuyas
+  // ranuras de lectura son de cada emisor) no se usa
+  netcp_options fanout_options = options;
+  if (options.streams > 1) { log_info() << "Con varios receptores, cada uno recibe el fichero en un solo flujo."; }
+  fanout_options.streams = 1;
+  fanout_options.use_io_uring = false;
+
+  int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    log_error() << "Error: No se puede abrir el fichero " << filename << ".";
+    return std::error_code(errno, std::system_category());
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    log_error() << "Error: " << filename << " no es un fichero regular.";
+    close(fd);
+    return std::error_code(EINVAL, std::system_category());
+  }
+  size_t file_size = static_cast<size_t>(file_stat.st_size);
+
+  // Un socket por receptor (el puerto que no se indique es el de NETCP_PORT)
+  const char* netcp_port = std::getenv("NETCP_PORT");
+  uint16_t default_port = (netcp_port != nullptr) ? std::stoi(netcp_port) : 8080;
+  std::vector<path_socket> receivers;
+  auto close_all = [&]() {
+    close_paths(receivers);
+    close(fd);
+  };
+  for (sockaddr_storage destination : options.receivers) {
+    uint16_t& port = (destination.ss_family == AF_INET6) ? reinterpret_cast<sockaddr_in6&>(destination).sin6_port
+                                                          : reinterpret_cast<sockaddr_in&>(destination).sin_port;
+    if (port == 0) { port = htons(default_port); }
+    auto socket_result = make_socket(make_ip_address(destination.ss_family == AF_INET6 ? "::" : "0.0.0.0", 0));
+    if (!socket_result) {
+      log_error() << "Error: No se ha podido crear el socket del receptor " << address_to_string(destination) << ".";
+      close_all();
+      return socket_result.error();
+    }
+    receivers.push_back({*socket_result, destination});
+  }
+
+  // Todos los emisores comparten los bloques, así que usan el mismo tamaño: el que cabe sin fragmentar en el camino de menor
+  // MTU hasta cualquiera de los receptores
+  fanout_options.chunk_size = choose_chunk_size(receivers, options);
+
+  const uint8_t* mapping = nullptr;
+  if (options.use_mmap && file_size > 0) {
+    void* result = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (result == MAP_FAILED) {
+      log_error() << "Error: No se ha podido proyectar el fichero en memoria.";
+      close_all();
+      return std::error_code(errno, std::system_category());
+    }
+    madvise(result, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    mapping = static_cast<const uint8_t*>(result);
+  }
+
+  // Los bloques compartidos van cifrados con una sola clave y pertenecen a una sola sesión, la misma para todos los receptores
+  std::optional<aead_key> key;
+  if (options.secret) {
+    key = make_key(*options.secret, options.cipher);
+    if (!key) {
+      log_error() << "Error: No se ha podido generar la clave del cifrado.";
+      if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), file_size); }
+      close_all();
+      return std::error_code(EIO, std::system_category());
+    }
+    log_info() << "Los datos se cifran con " << aead_name(key->algorithm) << ".";
+  }
+  uint32_t session = make_session_id();
+
+  log_info() << "Enviando el fichero a " << receivers.size() << " receptores...";
+  std::vector<transfer_progress> results(receivers.size());
+  uint64_t prepared = 0;
+  uint64_t reused = 0;
+  {
+    // El almacén se declara antes que los emisores, que guardan bloques suyos en la ventana
+    chunk_feed feed(fanout_options.chunk_size, std::max(FANOUT_CACHE_SIZE / fanout_options.chunk_size, 4 * options.batch_size), key);
+    std::unique_ptr<worker_pool> compressor;
+    if (options.compress) { compressor = std::make_unique<worker_pool>(std::thread::hardware_concurrency()); }
+    std::vector<std::unique_ptr<reliable_sender>> senders;
+    event_loop loop;
+    for (size_t i = 0; i < receivers.size(); ++i) {
+      senders.push_back(std::make_unique<reliable_sender>(std::vector<path_socket>{receivers[i]}, fanout_options, session, 0, 1,
+                                                          compressor.get(), file_size, &feed));
+      senders.back()->prepare(fd, 0, file_size, mapping);
+      loop.spawn(feed_receiver(loop, *senders.back(), receivers[i].socket_fd, results[i]));
+    }
+    loop.run();
+    prepared = feed.prepared();
+    reused = feed.reused();
+
+    for (size_t i = 0; i < receivers.size(); ++i) {
+      if (results[i].error) {
+        log_error() << "Error: No se ha podido enviar el fichero a " << address_to_string(receivers[i].destination) << ".";
+      } else {
+        log_info() << "Fichero enviado a " << address_to_string(receivers[i].destination) << ": CRC32C " << std::hex << std::setw(8)
+                   << std::setfill('0') << senders[i]->digest() << std::dec << std::setfill(' ') << " (coincide con el del receptor).";
+      }
+    }
+  }
+
+  if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), file_size); }
+  close_all();
+
+  log_info() << "Bloques leídos del fichero: " << prepared << "; tomados ya preparados por los emisores de otros receptores: " << reused << ".";
+  size_t failed = static_cast<size_t>(std::count_if(results.begin(), results.end(), [](const transfer_progress& result) { return bool(result.error); }));
+  if (failed > 0) {
+    log_error() << "Error: " << failed << " de " << receivers.size() << " receptores no han recibido el fichero.";
+    auto first = std::find_if(results.begin(), results.end(), [](const transfer_progress& result) { return bool(result.error); });
+    return first->error;
+  }
+  log_info() << "El envío de datos a todos los receptores ha finalizado correctamente.";
+  return std::error_code(0, std::system_category());
+}
@@ -0,0 +1,303 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de la aritmética en GF(2^8) y del código Reed-Solomon de la corrección de errores
+ */
+
+#include "header_files/fec.h"
+#include <array>
+#include <cstring>
+#include <immintrin.h>
+
+// Polinomio irreducible del cuerpo (x^8 + x^4 + x^3 + x^2 + 1), con el que 2 genera todos los elementos distintos de 0
+constexpr unsigned GF_POLY = 0x11D;
+
+// Tablas de exponenciales y logaritmos en base 2: a · b = exp[log a + log b] (la de exponenciales está duplicada para no
+// tener que reducir la suma de logaritmos)
+struct gf_tables {
+  std::array<uint8_t, 512> exp{};
+  std::array<uint8_t, 256> log{};
+};
+
+/**
+ * @brief Función que genera las tablas de exponenciales y logaritmos.
+ * @return Devuelve las tablas.
+ */
+constexpr gf_tables make_gf_tables() {
+  gf_tables tables;
+  unsigned value = 1;
+  for (unsigned i = 0; i < 255; ++i) {
+    tables.exp[i] = tables.exp[i + 255] = static_cast<uint8_t>(value);
+    tables.log[value] = static_cast<uint8_t>(i);
+    value <<= 1;
+    if (value & 0x100) { value ^= GF_POLY; }
+  }
+  return tables;
+}
+
+constexpr gf_tables GF_TABLES = make_gf_tables();
+
+/**
+ * @brief Función que multiplica dos elementos con las tablas (en tiempo de compilación también).
+ */
+constexpr uint8_t multiply(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) { return 0; }
+  return GF_TABLES.exp[GF_TABLES.log[a] + GF_TABLES.log[b]];
+}
+
+/**
+ * @brief Función que genera, para cada factor, las dos tablas de 16 entradas del método de las mitades: el producto de un
+ *        byte es la suma del de su mitad baja y el de su mitad alta, y pshufb busca 16 o 32 mitades en una tabla de 16 a la vez.
+ * @return Devuelve las tablas: 16 productos de la mitad baja y 16 de la alta por factor.
+ */
+constexpr std::array<std::array<uint8_t, 32>, 256> make_split_tables() {
+  std::array<std::array<uint8_t, 32>, 256> tables{};
+  for (unsigned factor = 0; factor < 256; ++factor) {
+    for (unsigned half = 0; half < 16; ++half) {
+      tables[factor][half] = multiply(static_cast<uint8_t>(factor), static_cast<uint8_t>(half));
+      tables[factor][16 + half] = multiply(static_cast<uint8_t>(factor), static_cast<uint8_t>(half << 4));
+    }
+  }
+  return tables;
+}
+
+alignas(32) constexpr std::array<std::array<uint8_t, 32>, 256> GF_SPLIT_TABLES = make_split_tables();
+
+/**
+ * @brief Función que genera los coeficientes de la paridad: una matriz de Cauchy 1 / (x_fila + y_columna), con x_fila = fila
+ *        e y_columna = FEC_MAX_PARITY + columna, con cada columna multiplicada por y_columna para que la primera fila sea de
+ *        unos (la paridad 0 es el XOR de los bloques). Cualquier submatriz cuadrada de una matriz de Cauchy es invertible, y
+ *        multiplicar columnas por constantes no lo cambia, así que con M paridades se recupera cualquier combinación de
+ *        hasta M bloques perdidos.
+ * @return Devuelve los coeficientes por fila de paridad y columna de datos.
+ */
+constexpr std::array<std::array<uint8_t, FEC_MAX_DATA>, FEC_MAX_PARITY> make_coefficients() {
+  std::array<std::array<uint8_t, FEC_MAX_DATA>, FEC_MAX_PARITY> coefficients{};
+  for (size_t row = 0; row < FEC_MAX_PARITY; ++row) {
+    for (size_t column = 0; column < FEC_MAX_DATA; ++column) {
+      uint8_t y = static_cast<uint8_t>(FEC_MAX_PARITY + column);
+      uint8_t sum = static_cast<uint8_t>(row ^ y);
+      coefficients[row][column] = multiply(y, GF_TABLES.exp[255 - GF_TABLES.log[sum]]);
+    }
+  }
+  return coefficients;
+}
+
+constexpr std::array<std::array<uint8_t, FEC_MAX_DATA>, FEC_MAX_PARITY> FEC_COEFFICIENTS = make_coefficients();
+
+/**
+ * @brief Funciones que multiplican dos elementos de GF(2^8) y que calculan el inverso de uno distinto de 0.
+ */
+uint8_t gf_multiply(uint8_t a, uint8_t b) { return multiply(a, b); }
+uint8_t gf_inverse(uint8_t a) { return GF_TABLES.exp[255 - GF_TABLES.log[a]]; }
+
+/**
+ * @brief Función que suma a un bloque otro multiplicado por una constante, byte a byte con las tablas de las mitades (y, si el
+ *        factor es 1, con XOR de 8 bytes).
+ * @param[in,out] destination: bloque al que se suma el producto.
+ * @param[in] source: bloque que se multiplica.
+ * @param[in] factor: constante por la que se multiplica.
+ * @param[in] length: tamaño de los bloques.
+ */
+static void multiply_add_scalar(uint8_t* destination, const uint8_t* source, uint8_t factor, size_t length) {
+  size_t i = 0;
+  if (factor == 1) {
+    for (; i + 8 <= length; i += 8) {
+      uint64_t a, b;
+      std::memcpy(&a, destination + i, sizeof(a));
+      std::memcpy(&b, source + i, sizeof(b));
+      a ^= b;
+      std::memcpy(destination + i, &a, sizeof(a));
+    }
+  }
+  const std::array<uint8_t, 32>& table = GF_SPLIT_TABLES[factor];
+  for (; i < length; ++i) { destination[i] ^= table[source[i] & 0x0F] ^ table[16 + (source[i] >> 4)]; }
+}
+
+/**
+ * @brief Función que suma a un bloque otro multiplicado por una constante, de 16 en 16 bytes con pshufb (SSSE3): cada byte se
+ *        separa en sus dos mitades, que sirven de índice en las tablas de 16 productos del factor.
+ * @param[in,out] destination: bloque al que se suma el producto.
+ * @param[in] source: bloque que se multiplica.
+ * @param[in] factor: constante por la que se multiplica.
+ * @param[in] length: tamaño de los bloques.
+ */
+__attribute__((target("ssse3"))) static void multiply_add_ssse3(uint8_t* destination, const uint8_t* source, uint8_t factor, size_t length) {
+  const __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(GF_SPLIT_TABLES[factor].data()));
+  const __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(GF_SPLIT_TABLES[factor].data() + 16));
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+    __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(data, mask)),
+                                    _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(data, 4), mask)));
+    __m128i* out = reinterpret_cast<__m128i*>(destination + i);
+    _mm_storeu_si128(out, _mm_xor_si128(_mm_loadu_si128(out), product));
+  }
+  multiply_add_scalar(destination + i, source + i, factor, length - i);
+}
+
+/**
+ * @brief Función que multiplica 32 bytes por el factor de las tablas (repetidas en las dos mitades de los registros).
+ */
+__attribute__((target("avx2"))) static inline __m256i multiply_avx2(__m256i data, __m256i low, __m256i high, __m256i mask) {
+  return _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(data, mask)),
+                          _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(data, 4), mask)));
+}
+
+/**
+ * @brief Función que suma a un bloque otro multiplicado por una constante, de 64 en 64 bytes con vpshufb (AVX2), igual que la
+ *        versión SSSE3 pero con las tablas repetidas en las dos mitades de cada registro. Con factor 1 solo hace falta el XOR.
+ * @param[in,out] destination: bloque al que se suma el producto.
+ * @param[in] source: bloque que se multiplica.
+ * @param[in] factor: constante por la que se multiplica.
+ * @param[in] length: tamaño de los bloques.
+ */
+__attribute__((target("avx2"))) static void multiply_add_avx2(uint8_t* destination, const uint8_t* source, uint8_t factor, size_t length) {
+  size_t i = 0;
+  if (factor == 1) {
+    for (; i + 64 <= length; i += 64) {
+      __m256i* out = reinterpret_cast<__m256i*>(destination + i);
+      const __m256i* in = reinterpret_cast<const __m256i*>(source + i);
+      _mm256_storeu_si256(out, _mm256_xor_si256(_mm256_loadu_si256(out), _mm256_loadu_si256(in)));
+      _mm256_storeu_si256(out + 1, _mm256_xor_si256(_mm256_loadu_si256(out + 1), _mm256_loadu_si256(in + 1)));
+    }
+  } else {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(GF_SPLIT_TABLES[factor].data())));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(GF_SPLIT_TABLES[factor].data() + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    for (; i + 64 <= length; i += 64) {
+      __m256i* out = reinterpret_cast<__m256i*>(destination + i);
+      const __m256i* in = reinterpret_cast<const __m256i*>(source + i);
+      __m256i first = multiply_avx2(_mm256_loadu_si256(in), low, high, mask);
+      __m256i second = multiply_avx2(_mm256_loadu_si256(in + 1), low, high, mask);
+      _mm256_storeu_si256(out, _mm256_xor_si256(_mm256_loadu_si256(out), first));
+      _mm256_storeu_si256(out + 1, _mm256_xor_si256(_mm256_loadu_si256(out + 1), second));
+    }
+  }
+  multiply_add_scalar(destination + i, source + i, factor, length - i);
+}
+
+/**
+ * @brief Función que devuelve la implementación más rápida que admite el procesador.
+ */
+gf_kernel gf_best_kernel() {
+  static const gf_kernel best = __builtin_cpu_supports("avx2")    ? gf_kernel::avx2
+                                : __builtin_cpu_supports("ssse3") ? gf_kernel::ssse3
+                                                                  : gf_kernel::scalar;
+  return best;
+}
+
+/**
+ * @brief Función que suma a un bloque otro multiplicado por una constante, con la implementación indicada.
+ * @param[in] kernel: implementación que se usa (debe admitirla el procesador).
+ * @param[in,out] destination: bloque al que se suma el producto.
+ * @param[in] source: bloque que se multiplica.
+ * @param[in] factor: constante por la que se multiplica (con 0 no hay nada que sumar).
+ * @param[in] length: tamaño de los bloques.
+ */
+void gf_multiply_add(gf_kernel kernel, uint8_t* destination, const uint8_t* source, uint8_t factor, size_t length) {
+  if (factor == 0) { return; }
+  switch (kernel) {
+    case gf_kernel::avx2: multiply_add_avx2(destination, source, factor, length); break;
+    case gf_kernel::ssse3: multiply_add_ssse3(destination, source, factor, length); break;
+    case gf_kernel::scalar: multiply_add_scalar(destination, source, factor, length); break;
+  }
+}
+
+/**
+ * @brief Función que suma a un bloque otro multiplicado por una constante, con la implementación más rápida del procesador.
+ */
+void gf_multiply_add(uint8_t* destination, const uint8_t* source, uint8_t factor, size_t length) {
+  gf_multiply_add(gf_best_kernel(), destination, source, factor, length);
+}
+
+/**
+ * @brief Función que devuelve el coeficiente de un bloque de datos en un bloque de paridad.
+ * @param[in] row: número de la paridad dentro del grupo (menor que FEC_MAX_PARITY).
+ * @param[in] column: posición del bloque de datos dentro del grupo (menor que FEC_MAX_DATA).
+ * @return Devuelve el coeficiente.
+ */
+uint8_t fec_coefficient(size_t row, size_t column) { return FEC_COEFFICIENTS[row][column]; }
+
+/**
+ * @brief Función que suma la aportación de un bloque de datos a varios símbolos de paridad. El emisor la usa con todas las
+ *        filas para calcular la paridad; el receptor, con las filas que ha recibido para quitarles los bloques que tiene. Un
+ *        bloque más corto que los símbolos (el último) cuenta como completado con ceros, que no aportan nada.
+ * @param[in,out] symbols: símbolos de paridad, uno por fila.
+ * @param[in] rows: fila de paridad de cada símbolo.
+ * @param[in] column: posición del bloque de datos dentro del grupo.
+ * @param[in] data: datos del bloque.
+ * @param[in] length: tamaño del bloque.
+ */
+void fec_accumulate(const std::vector<uint8_t*>& symbols, const std::vector<size_t>& rows, size_t column, const uint8_t* data,
+                    size_t length) {
+  for (size_t i = 0; i < symbols.size(); ++i) { gf_multiply_add(symbols[i], data, fec_coefficient(rows[i], column), length); }
+}
+
+/**
+ * @brief Función que invierte una matriz cuadrada de GF(2^8) por eliminación de Gauss-Jordan.
+ * @param[in,out] matrix: matriz de n × n, por filas; al terminar, su inversa.
+ * @param[in] n: dimensión.
+ * @return Devuelve false si la matriz no es invertible.
+ */
+static bool invert_matrix(std::vector<uint8_t>& matrix, size_t n) {
+  std::vector<uint8_t> inverse(n * n, 0);
+  for (size_t i = 0; i < n; ++i) { inverse[i * n + i] = 1; }
+  for (size_t column = 0; column < n; ++column) {
+    size_t pivot = column;
+    while (pivot < n && matrix[pivot * n + column] == 0) { ++pivot; }
+    if (pivot == n) { return false; }
+    for (size_t k = 0; k < n; ++k) {
+      std::swap(matrix[pivot * n + k], matrix[column * n + k]);
+      std::swap(inverse[pivot * n + k], inverse[column * n + k]);
+    }
+    uint8_t scale = gf_inverse(matrix[column * n + column]);
+    for (size_t k = 0; k < n; ++k) {
+      matrix[column * n + k] = multiply(matrix[column * n + k], scale);
+      inverse[column * n + k] = multiply(inverse[column * n + k], scale);
+    }
+    for (size_t row = 0; row < n; ++row) {
+      uint8_t factor = matrix[row * n + column];
+      if (row == column || factor == 0) { continue; }
+      for (size_t k = 0; k < n; ++k) {
+        matrix[row * n + k] ^= multiply(factor, matrix[column * n + k]);
+        inverse[row * n + k] ^= multiply(factor, inverse[column * n + k]);
+      }
+    }
+  }
+  matrix = std::move(inverse);
+  return true;
+}
+
+/**
+ * @brief Función que reconstruye los bloques perdidos de un grupo. Cada síndrome es la suma de los bloques perdidos por sus
+ *        coeficientes en esa fila, así que los bloques se obtienen multiplicando los síndromes por la inversa de la submatriz
+ *        de coeficientes de esas filas y de las columnas perdidas.
+ * @param[in] syndromes: síndromes de las filas de paridad recibidas (tantos como bloques perdidos).
+ * @param[in] rows: fila de paridad de cada síndrome.
+ * @param[in] missing: posición dentro del grupo de cada bloque perdido.
+ * @param[out] outputs: espacio para cada bloque reconstruido, de symbol_size bytes.
+ * @param[in] symbol_size: tamaño de los símbolos (el de bloque).
+ * @return Devuelve false si el número de síndromes no coincide con el de bloques perdidos.
+ */
+bool fec_recover(const std::vector<uint8_t*>& syndromes, const std::vector<size_t>& rows, const std::vector<size_t>& missing,
+                 const std::vector<uint8_t*>& outputs, size_t symbol_size) {
+  size_t n = missing.size();
+  if (n == 0 || syndromes.size() != n || rows.size() != n || outputs.size() != n) { return false; }
+  std::vector<uint8_t> matrix(n * n);
+  for (size_t r = 0; r < n; ++r) {
+    for (size_t c = 0; c < n; ++c) { matrix[r * n + c] = fec_coefficient(rows[r], missing[c]); }
+  }
+  if (!invert_matrix(matrix, n)) { return false; }
+  for (size_t c = 0; c < n; ++c) {
+    std::memset(outputs[c], 0, symbol_size);
+    for (size_t r = 0; r < n; ++r) { gf_multiply_add(outputs[c], syndromes[r], matrix[c * n + r], symbol_size); }
+  }
+  return true;
+}
@@ -0,0 +1,98 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración del cifrado autenticado (AEAD) de los datagramas: AES-256-GCM o ChaCha20-Poly1305 con una clave por
+ *         emisor, derivada de la clave compartida y de una sal aleatoria, y un nonce formado por el tipo, el flujo y el número
+ *         de secuencia del datagrama
+ */
+
+#ifndef AEAD_H
+#define AEAD_H
+
+#include "protocol.h"
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+#include <system_error>
+
+// Tamaños de la clave (compartida y derivada), de la sal que precede a los datos cifrados, de la etiqueta de autenticación
+// que los sigue, y lo que ambas añaden a cada datagrama
+constexpr size_t AEAD_KEY_SIZE = 32;
+constexpr size_t AEAD_SALT_SIZE = 16;
+constexpr size_t AEAD_TAG_SIZE = 16;
+constexpr size_t AEAD_OVERHEAD = AEAD_SALT_SIZE + AEAD_TAG_SIZE;
+
+// Algoritmos de cifrado: el emisor elige con automatic el más rápido en el procesador (AES-256-GCM si tiene AES-NI y
+// PCLMULQDQ, ChaCha20-Poly1305 si no)
+enum class aead_algorithm { automatic, aes_256_gcm, chacha20_poly1305 };
+
+// Clave compartida por el emisor y el receptor, que se lee de un fichero
+using aead_secret = std::array<uint8_t, AEAD_KEY_SIZE>;
+
+// Clave con la que cifra un emisor: algoritmo, sal que la identifica (va en cada datagrama) y clave derivada con HKDF-SHA256
+// de la compartida y la sal
+struct aead_key {
+  aead_algorithm algorithm = aead_algorithm::aes_256_gcm;
+  std::array<uint8_t, AEAD_SALT_SIZE> salt{};
+  std::array<uint8_t, AEAD_KEY_SIZE> key{};
+};
+
+// Función que lee la clave compartida de un fichero (32 bytes, o 64 dígitos hexadecimales).
+std::expected<aead_secret, std::error_code> load_secret(const std::string&);
+
+// Funciones que devuelven el algoritmo más rápido en este procesador y el nombre de un algoritmo.
+aead_algorithm aead_best_algorithm();
+const char* aead_name(aead_algorithm);
+
+// Funciones que derivan la clave de un emisor con una sal aleatoria nueva o con la de un datagrama recibido.
+std::optional<aead_key> make_key(const aead_secret&, aead_algorithm);
+std::optional<aead_key> derive_key(const aead_secret&, aead_algorithm, const uint8_t*);
+
+// Datos de un datagrama que viajan en claro delante de los cifrados (el prefijo de la paridad): se autentican con ellos, y
+// lane distingue el nonce de los datagramas con la misma cabecera (las filas de paridad de un grupo)
+struct aead_clear {
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  uint8_t lane = 0;
+};
+
+// Contextos de cifrado de OpenSSL (se declaran aquí para no incluir sus cabeceras)
+struct evp_cipher_ctx_st;
+
+class aead_context {
+ public:
+  // CONSTRUCTOR Y DESTRUCTOR
+  explicit aead_context(const aead_key& key);
+  ~aead_context();
+  aead_context(const aead_context&) = delete;
+  aead_context& operator=(const aead_context&) = delete;
+
+  // MÉTODO QUE INDICA SI UN DATAGRAMA CIFRADO CON EL ALGORITMO Y LA SAL INDICADOS ES DE ESTA CLAVE
+  bool matches(aead_algorithm algorithm, const uint8_t* salt) const;
+
+  // MÉTODO QUE DEVUELVE LOS BITS FLAG_* QUE INDICAN AL RECEPTOR QUE LOS DATOS VAN CIFRADOS CON ESTE ALGORITMO
+  uint8_t flags() const;
+
+  // MÉTODO PARA CIFRAR LOS DATOS DE UN DATAGRAMA: ESCRIBE LA SAL, LOS DATOS CIFRADOS Y LA ETIQUETA, Y DEVUELVE SU TAMAÑO
+  size_t seal(const packet_header& header, const uint8_t* input, size_t length, uint8_t* output, const aead_clear& clear = {});
+
+  // MÉTODO PARA COMPROBAR Y DESCIFRAR EN SU SITIO LOS DATOS DE UN DATAGRAMA, DEVOLVIENDO SU TAMAÑO EN CLARO
+  std::optional<size_t> open(const packet_header& header, uint8_t* payload, size_t length, const aead_clear& clear = {});
+
+ private:
+  aead_key material;
+  evp_cipher_ctx_st* sealer = nullptr;
+  evp_cipher_ctx_st* opener = nullptr;
+};
+
+// Función que indica el algoritmo con el que está cifrado un datagrama, según los bits de su cabecera.
+aead_algorithm packet_algorithm(uint8_t);
+
+#endif // AEAD_H
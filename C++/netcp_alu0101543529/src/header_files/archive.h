@@ -0,0 +1,86 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de la transferencia de directorios: el emisor envía en una sola sesión un manifiesto (rutas, tamaños y
+ *         permisos) seguido del contenido de todos los ficheros, uno detrás de otro, y el receptor lo extrae al terminar
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "netcp.h"
+#include <thread>
+
+// Tipos de las entradas del manifiesto
+enum class archive_entry_type : uint8_t {
+  directory = 'D',  // Directorio (sin contenido)
+  file = 'F',       // Fichero regular (su contenido va en el flujo de datos)
+  symlink = 'L'     // Enlace simbólico (su destino va en el flujo de datos)
+};
+
+// Entrada del manifiesto. Los directorios aparecen antes que lo que contienen, y el contenido de los ficheros y enlaces va
+// en el flujo de datos en el mismo orden que sus entradas
+struct archive_entry {
+  archive_entry_type type;
+  uint32_t mode;
+  uint64_t size;
+  std::string path;
+  // Destino del enlace simbólico (solo para los enlaces)
+  std::string target;
+};
+
+// Ficheros hasta este tamaño que se leen por adelantado (en varios hilos) y se escriben juntos en el flujo; los mayores se
+// pasan al flujo directamente desde el fichero con splice()
+constexpr uint64_t SMALL_FILE_SIZE = 256 * 1024;
+// Hilos que leen por adelantado los ficheros pequeños, y cuántos ficheros y bytes pueden estar leídos sin enviar
+constexpr size_t PREFETCH_THREADS = 8;
+constexpr size_t PREFETCH_FILES = 256;
+constexpr uint64_t PREFETCH_BYTES = 32 * 1024 * 1024;
+
+// Función que recorre un directorio y devuelve su manifiesto (sin incluir el propio directorio).
+std::expected<std::vector<archive_entry>, std::error_code> scan_directory(int);
+
+// Funciones que codifican y decodifican el manifiesto (decode_manifest indica además dónde empiezan los datos).
+std::vector<uint8_t> encode_manifest(const std::vector<archive_entry>&);
+std::optional<std::vector<archive_entry>> decode_manifest(const uint8_t*, size_t, size_t&);
+
+class archive_writer {
+ public:
+  // CONSTRUCTOR (EMPIEZA A ESCRIBIR EN output_fd EL MANIFIESTO Y EL CONTENIDO DE LOS FICHEROS, EN OTRO HILO) Y DESTRUCTOR
+  archive_writer(int root_fd, const std::vector<archive_entry>& entries, int output_fd);
+  ~archive_writer();
+  archive_writer(const archive_writer&) = delete;
+  archive_writer& operator=(const archive_writer&) = delete;
+
+  // MÉTODO PARA ESPERAR A QUE TERMINE, DEVOLVIENDO EL ERROR QUE LO HAYA DETENIDO (SI LO HAY)
+  std::error_code wait();
+
+ private:
+  // MÉTODO DEL HILO QUE ESCRIBE EL FLUJO (CIERRA output_fd AL TERMINAR, PARA QUE EL LECTOR VEA EL FINAL)
+  void run();
+
+  // MÉTODO PARA ESCRIBIR UN FICHERO GRANDE DIRECTAMENTE DESDE EL DISCO
+  std::error_code write_large_file(const archive_entry& entry);
+
+  int root_fd;
+  const std::vector<archive_entry>& entries;
+  int output_fd;
+  std::error_code error;
+  std::thread worker;
+};
+
+// Función que extrae en un directorio el flujo recibido (manifiesto y contenido) que está en un fichero.
+std::error_code extract_archive(int, int);
+
+// Función que envía un directorio entero por una única sesión del protocolo fiable.
+std::error_code netcp_send_directory(const std::string&, const netcp_options&);
+
+// Función que recibe un directorio entero por los sockets indicados y lo extrae en el directorio de destino.
+std::error_code receive_directory(const std::string&, const std::vector<int>&, const netcp_options&);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,192 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de la interfaz asíncrona de libnetcp: las tareas (corrutinas de C++23), el bucle de eventos de un solo
+ *         hilo que las reanuda cuando su socket tiene datos o vence su plazo, y las transferencias send_file()/receive_file(),
+ *         de forma que un programa puede llevar miles de transferencias a la vez con co_await y sin un hilo por cada una
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "netcp.h"
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <expected>
+#include <map>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Resultado de una tarea: el valor devuelto con co_return (nada en las tareas void)
+template <typename T>
+struct task_result {
+  std::optional<T> value;
+  void return_value(T result) { value.emplace(std::move(result)); }
+  T take() { return std::move(*value); }
+};
+
+template <>
+struct task_result<void> {
+  void return_void() {}
+  void take() {}
+};
+
+// Parte común de las promesas de las tareas: empiezan suspendidas (no se ejecutan hasta que alguien las espera con co_await o
+// las lanza el bucle) y, al terminar, reanudan directamente a quien las esperaba
+struct task_promise_base {
+  struct final_awaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept { return handle.promise().continuation; }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  final_awaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+  std::exception_ptr exception;
+};
+
+// Corrutina que devuelve un T: se ejecuta al esperarla con co_await, y la excepción que no capture la relanza quien la espera
+template <typename T = void>
+class task {
+ public:
+  struct promise_type : task_promise_base, task_result<T> {
+    task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+  };
+
+  // CONSTRUCTORES Y DESTRUCTOR (LA TAREA ES DUEÑA DE LA CORRUTINA, ASÍ QUE SOLO SE PUEDE MOVER)
+  task(task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+  task& operator=(task&& other) noexcept {
+    if (this != &other) {
+      if (handle) { handle.destroy(); }
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+  task(const task&) = delete;
+  task& operator=(const task&) = delete;
+  ~task() {
+    if (handle) { handle.destroy(); }
+  }
+
+  // MÉTODOS PARA ESPERAR LA TAREA CON co_await: SE EMPIEZA A EJECUTAR Y REANUDA A QUIEN LA ESPERA AL TERMINAR
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+  T await_resume() {
+    if (handle.promise().exception) { std::rethrow_exception(handle.promise().exception); }
+    return handle.promise().take();
+  }
+
+ private:
+  explicit task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+// Bucle de eventos de un solo hilo: las tareas esperan a que un descriptor tenga datos (o a que venza un plazo) y el bucle
+// las reanuda con lo que indique epoll. Nada de esto es seguro entre hilos: cada hilo que quiera su bucle crea el suyo
+class event_loop {
+ public:
+  // Operación de espera de readable(): la tarea suspendida, y si se ha reanudado porque el descriptor tenía datos
+  struct wait_operation {
+    event_loop* loop;
+    int fd;
+    uint64_t deadline;
+    std::coroutine_handle<> waiter = nullptr;
+    bool ready = false;
+    std::multimap<uint64_t, wait_operation*>::iterator timer{};
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    bool await_resume() const noexcept { return ready; }
+  };
+
+  // CONSTRUCTOR (CREA EL DESCRIPTOR DE EPOLL) Y DESTRUCTOR
+  event_loop();
+  ~event_loop();
+  event_loop(const event_loop&) = delete;
+  event_loop& operator=(const event_loop&) = delete;
+
+  // MÉTODO PARA ESPERAR (CON co_await) A QUE fd TENGA DATOS O A QUE LLEGUE EL INSTANTE deadline, EN MICROSEGUNDOS DE
+  // now_microseconds(); DEVUELVE true SI HAY DATOS. CON fd = -1 SOLO SE ESPERA EL PLAZO
+  wait_operation readable(int fd, uint64_t deadline);
+  wait_operation sleep_until(uint64_t deadline);
+
+  // MÉTODO PARA LANZAR UNA TAREA SIN ESPERARLA: EL BUCLE LA EMPIEZA Y LA DESTRUYE AL TERMINAR
+  void spawn(task<void> work);
+
+  // MÉTODO QUE EJECUTA LAS TAREAS HASTA QUE TERMINAN TODAS (LAS TRANSFERENCIAS TERMINAN SOLAS SI SE PIDE TERMINAR EL PROGRAMA)
+  std::error_code run();
+
+  // MÉTODO QUE DEVUELVE EL NÚMERO DE TAREAS LANZADAS CON spawn() QUE AÚN NO HAN TERMINADO
+  size_t active_tasks() const;
+
+ private:
+  // MÉTODOS PARA VIGILAR EL DESCRIPTOR DE UNA ESPERA (SOLO HASTA SU PRIMER EVENTO) Y PARA REANUDARLA
+  void watch(wait_operation& operation);
+  void wake(wait_operation& operation, bool ready);
+
+  // MÉTODO CON LA CORRUTINA QUE ENVUELVE A LAS TAREAS LANZADAS CON spawn(): LLEVA LA CUENTA DE LAS QUE SIGUEN EN CURSO Y SE
+  // DESTRUYE SOLA AL TERMINAR
+  struct detached_task;
+  detached_task detach(task<void> work);
+
+  int epoll_fd;
+  // Espera pendiente de cada descriptor vigilado, y esperas ordenadas por su plazo
+  std::unordered_map<int, wait_operation*> waiting;
+  std::multimap<uint64_t, wait_operation*> timers;
+  // Tareas lanzadas con spawn() pendientes de empezar, y número de las que no han terminado
+  std::vector<std::coroutine_handle<>> ready_queue;
+  size_t active = 0;
+};
+
+// Función que ejecuta una tarea en el bucle hasta que termina, y devuelve su resultado (para usar la interfaz asíncrona
+// desde código que no es una corrutina).
+template <typename T>
+T run_sync(event_loop& loop, task<T> work) {
+  task_result<T> result;
+  std::exception_ptr exception;
+  auto wrapper = [](task<T>& work, task_result<T>& result, std::exception_ptr& exception) -> task<void> {
+    try {
+      if constexpr (std::is_void_v<T>) {
+        co_await work;
+      } else {
+        result.return_value(co_await work);
+      }
+    } catch (...) {
+      exception = std::current_exception();
+    }
+  };
+  loop.spawn(wrapper(work, result, exception));
+  if (std::error_code error = loop.run()) { throw std::system_error(error); }
+  if (exception) { std::rethrow_exception(exception); }
+  return result.take();
+}
+
+// Resultado de una transferencia asíncrona: el CRC32C de los datos confirmado por el receptor, o el error
+using transfer_result = std::expected<uint32_t, std::error_code>;
+
+// Función que envía un fichero al receptor de la dirección indicada desde el bucle de eventos, en un solo flujo.
+task<transfer_result> send_file(event_loop& loop, std::string path, sockaddr_storage destination, netcp_options options);
+
+// Función que recibe una transferencia en la dirección indicada y la escribe en un fichero, desde el bucle de eventos.
+task<transfer_result> receive_file(event_loop& loop, std::string path, sockaddr_storage address, netcp_options options);
+
+#endif // ASYNC_H
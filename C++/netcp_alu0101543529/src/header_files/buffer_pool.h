@@ -0,0 +1,114 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de las clases aligned_region, pool_buffer y buffer_pool: zonas de memoria alineadas a página, repartidas
+ *         en ranuras de tamaño fijo que se prestan y se devuelven sin reservar memoria una vez alcanzado el régimen estable
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Alineación de las zonas y de las ranuras: la de una página, que es la que exigen O_DIRECT y los buffers registrados de io_uring
+constexpr size_t POOL_ALIGNMENT = 4096;
+
+// Ranuras que se añaden de una vez cuando un pool se queda sin ranuras libres
+constexpr size_t POOL_GROWTH = 64;
+
+// Zona de memoria alineada a página, reservada con mmap() y liberada al destruirse
+class aligned_region {
+ public:
+  // CONSTRUCTORES (LA ZONA VACÍA NO RESERVA NADA) Y DESTRUCTOR
+  aligned_region() = default;
+  explicit aligned_region(size_t size);
+  ~aligned_region();
+
+  aligned_region(const aligned_region&) = delete;
+  aligned_region& operator=(const aligned_region&) = delete;
+  aligned_region(aligned_region&& other) noexcept;
+  aligned_region& operator=(aligned_region&& other) noexcept;
+
+  // MÉTODOS PARA CONSULTAR LA MEMORIA DE LA ZONA
+  uint8_t* data() const;
+  size_t size() const;
+
+ private:
+  uint8_t* memory = nullptr;
+  size_t length = 0;
+};
+
+class buffer_pool;
+
+// Ranura prestada por un buffer_pool: vuelve al pool al destruirse o al llamar a reset()
+class pool_buffer {
+ public:
+  // CONSTRUCTORES (EL BUFFER VACÍO NO TIENE RANURA) Y DESTRUCTOR
+  pool_buffer() = default;
+  pool_buffer(buffer_pool* pool, uint8_t* memory);
+  ~pool_buffer();
+
+  pool_buffer(const pool_buffer&) = delete;
+  pool_buffer& operator=(const pool_buffer&) = delete;
+  pool_buffer(pool_buffer&& other) noexcept;
+  pool_buffer& operator=(pool_buffer&& other) noexcept;
+
+  // MÉTODO QUE DEVUELVE LA MEMORIA DE LA RANURA (TANTOS BYTES COMO EL slab_size() DE SU POOL)
+  uint8_t* data() const;
+
+  // MÉTODO QUE INDICA SI EL BUFFER TIENE RANURA
+  explicit operator bool() const;
+
+  // MÉTODO PARA DEVOLVER LA RANURA AL POOL ANTES DE DESTRUIRSE
+  void reset();
+
+ private:
+  buffer_pool* pool = nullptr;
+  uint8_t* memory = nullptr;
+};
+
+// Conjunto de ranuras del mismo tamaño, cada una alineada a página. Las ranuras libres se reutilizan en orden inverso al de
+// su devolución (las más recientes siguen en la caché); solo se reserva memoria al quedarse sin ninguna libre. No es seguro
+// usarlo desde varios hilos a la vez: cada emisor y cada receptor tiene el suyo
+class buffer_pool {
+ public:
+  // CONSTRUCTOR (RESERVA initial RANURAS DE slab_size BYTES, Y AÑADE growth CADA VEZ QUE SE AGOTAN)
+  explicit buffer_pool(size_t slab_size, size_t initial = POOL_GROWTH, size_t growth = POOL_GROWTH);
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  // MÉTODO QUE PRESTA UNA RANURA LIBRE, AMPLIANDO EL POOL SI NO QUEDA NINGUNA
+  pool_buffer acquire();
+
+  // MÉTODOS PARA CONSULTAR EL TAMAÑO DE LAS RANURAS Y CUÁNTAS HAY EN TOTAL Y LIBRES
+  size_t slab_size() const;
+  size_t capacity() const;
+  size_t available() const;
+
+ private:
+  friend class pool_buffer;
+
+  // MÉTODO PARA AÑADIR count RANURAS NUEVAS, EN UNA SOLA ZONA
+  void grow(size_t count);
+
+  // MÉTODO QUE RECIBE UNA RANURA DEVUELTA
+  void release(uint8_t* memory);
+
+  size_t slab_bytes;
+  // Distancia entre ranuras: su tamaño redondeado a página, para que todas empiecen alineadas
+  size_t stride;
+  size_t growth;
+  std::vector<aligned_region> regions;
+  std::vector<uint8_t*> free_slabs;
+  size_t slab_count = 0;
+};
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,31 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de las funciones que calculan la suma de comprobación CRC32C (Castagnoli)
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Función que calcula el CRC32C de un bloque, continuando el de los datos anteriores (0 para empezar). Usa las instrucciones
+// SSE4.2 y PCLMUL si el procesador las tiene.
+uint32_t crc32c(const uint8_t*, size_t, uint32_t = 0);
+
+// Función que calcula el CRC32C de un bloque byte a byte con tablas, sin instrucciones específicas del procesador.
+uint32_t crc32c_scalar(const uint8_t*, size_t, uint32_t = 0);
+
+// Función que calcula el CRC32C de dos bloques consecutivos a partir del de cada uno y del tamaño del segundo.
+uint32_t crc32c_combine(uint32_t, uint32_t, size_t);
+
+// Función que indica si crc32c() usa las instrucciones del procesador.
+bool crc32c_hardware();
+
+#endif // CHECKSUM_H
@@ -0,0 +1,51 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de la compresión de bloques y de la clase worker_pool, que reparte trabajos entre varios hilos
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "netcp.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// Función que comprime un bloque con deflate; devuelve 0 si el resultado no ocupa menos que el original.
+size_t compress_block(const uint8_t*, size_t, uint8_t*);
+
+// Función que descomprime un bloque; devuelve el tamaño descomprimido, o std::nullopt si los datos no son válidos.
+std::optional<size_t> decompress_block(const uint8_t*, size_t, uint8_t*, size_t);
+
+class worker_pool {
+ public:
+  // CONSTRUCTOR Y DESTRUCTOR (EL DESTRUCTOR TERMINA LOS TRABAJOS PENDIENTES Y ESPERA A LOS HILOS)
+  explicit worker_pool(size_t threads);
+  ~worker_pool();
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+
+  // MÉTODO PARA ENCARGAR UN TRABAJO A LOS HILOS; EL FUTURO SE COMPLETA CUANDO TERMINA
+  std::future<void> submit(std::function<void()> job);
+
+ private:
+  // MÉTODO QUE EJECUTA CADA HILO: SACA TRABAJOS DE LA COLA HASTA QUE SE DESTRUYE EL GRUPO
+  void run();
+
+  std::vector<std::thread> threads;
+  std::deque<std::packaged_task<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable available;
+  bool stopping = false;
+};
+
+#endif // COMPRESSION_H
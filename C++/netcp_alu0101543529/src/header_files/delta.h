@@ -0,0 +1,57 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de la transferencia por diferencias (al estilo de rsync): firmas del fichero de destino, cálculo de la
+ *         delta en el emisor y reconstrucción del fichero en el receptor
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "netcp.h"
+#include <array>
+
+// Firma de un bloque del fichero que ya tiene el receptor: suma rodante (rápida de desplazar byte a byte) y resumen MD5
+// (para confirmar las coincidencias de la suma rodante)
+struct block_signature {
+  uint32_t weak;
+  std::array<uint8_t, 16> strong;
+};
+
+// Firma del fichero que ya tiene el receptor, bloque a bloque
+struct file_signature {
+  uint32_t block_size = 0;
+  std::vector<block_signature> blocks;
+};
+
+// Resumen de una delta: bytes del fichero nuevo que viajan tal cual y bytes que se copian del fichero que ya tiene el receptor
+struct delta_stats {
+  uint64_t literal_bytes = 0;
+  uint64_t copied_bytes = 0;
+};
+
+// Función que calcula la firma de un fichero, con bloques de un tamaño que depende del tamaño del fichero.
+file_signature make_signature(const uint8_t*, size_t);
+
+// Funciones que codifican y decodifican una firma para enviarla.
+std::vector<uint8_t> encode_signature(const file_signature&);
+std::optional<file_signature> decode_signature(const uint8_t*, size_t);
+
+// Función que calcula la delta de un fichero frente a la firma del receptor, repartiendo el fichero entre varios hilos.
+std::vector<uint8_t> make_delta(const uint8_t*, size_t, const file_signature&, size_t, delta_stats&);
+
+// Función que reconstruye el fichero nuevo a partir de la delta y del fichero que ya tenía el receptor.
+std::error_code apply_delta(const uint8_t*, size_t, int, int);
+
+// Función que pide al receptor la firma de su copia del fichero y la recibe por el protocolo fiable.
+std::expected<file_signature, std::error_code> request_signature(int, const sockaddr_storage&, const netcp_options&);
+
+// Función que espera la petición de firma del emisor y le envía la del fichero que ya tiene el receptor.
+std::error_code serve_signature(const std::vector<int>&, const uint8_t*, size_t, const netcp_options&);
+
+#endif // DELTA_H
@@ -0,0 +1,63 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración del envío en abanico: un fichero que se envía a varios receptores a la vez, cada uno con su propio
+ *         emisor (ventana, confirmaciones y reenvíos), pero leyendo, comprimiendo y cifrando cada bloque una sola vez
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "reliable.h"
+#include <map>
+#include <memory>
+#include <optional>
+
+// Memoria que ocupan como mucho los bloques recientes que se guardan para los emisores que van por detrás del más adelantado
+// (los que se quedan más atrás vuelven a leer sus bloques por su cuenta)
+constexpr size_t FANOUT_CACHE_SIZE = 64 << 20;
+
+// Almacén de los bloques que ya ha preparado alguno de los emisores de un envío en abanico, por su número de secuencia. Guarda
+// los más recientes (hasta capacity) y presta las ranuras de los bloques, que así siguen vivas aunque termine el emisor que
+// las pidió. Como los emisores, no es seguro usarlo desde varios hilos: todos avanzan en el mismo bucle de eventos
+class chunk_feed {
+ public:
+  // CONSTRUCTOR (LAS RANURAS CABEN UN BLOQUE Y, SI HAY CLAVE, LA SAL Y LA ETIQUETA DEL CIFRADO)
+  chunk_feed(size_t chunk_size, size_t capacity, std::optional<aead_key> key);
+
+  // MÉTODOS QUE DEVUELVEN EL POOL DE LAS RANURAS DE LOS BLOQUES Y LA CLAVE CON LA QUE CIFRAN TODOS LOS EMISORES
+  buffer_pool& pool();
+  const std::optional<aead_key>& key() const;
+
+  // MÉTODO QUE DEVUELVE UN BLOQUE YA PREPARADO, O nullptr SI NO ESTÁ (NO SE HA PREPARADO O YA SE HA DESCARTADO)
+  std::shared_ptr<shared_chunk> find(uint64_t sequence);
+
+  // MÉTODO QUE DEVUELVE CUÁNTOS DE LOS count BLOQUES QUE EMPIEZAN EN first FALTAN ANTES DEL PRIMERO QUE YA ESTÁ PREPARADO
+  size_t missing(uint64_t first, size_t count) const;
+
+  // MÉTODO PARA GUARDAR UN BLOQUE RECIÉN PREPARADO, DESCARTANDO LOS MÁS ANTIGUOS SI NO CABE
+  void publish(uint64_t sequence, std::shared_ptr<shared_chunk> chunk);
+
+  // MÉTODOS QUE DEVUELVEN CUÁNTOS BLOQUES SE HAN PREPARADO Y CUÁNTAS VECES SE HA TOMADO UNO YA PREPARADO
+  uint64_t prepared() const;
+  uint64_t reused() const;
+
+ private:
+  // Las ranuras se declaran antes que los bloques, para que estos se las devuelvan antes de que se destruyan
+  buffer_pool slots;
+  std::optional<aead_key> cipher_key;
+  std::map<uint64_t, std::shared_ptr<shared_chunk>> recent;
+  size_t capacity;
+  uint64_t prepared_count = 0;
+  uint64_t reused_count = 0;
+};
+
+// Función que envía un fichero a todos los receptores de las opciones (--to), leyendo cada bloque una sola vez.
+std::error_code netcp_send_fanout(const std::string&, const netcp_options&);
+
+#endif // FANOUT_H
@@ -0,0 +1,53 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de la corrección de errores (FEC): aritmética en GF(2^8) con instrucciones SSSE3 y AVX2, y el código
+ *         Reed-Solomon sistemático con el que el emisor calcula M bloques de paridad por cada grupo de K bloques de datos y
+ *         el receptor reconstruye hasta M bloques perdidos del grupo sin esperar a que se los reenvíen
+ */
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Límites de los grupos: bloques de datos y bloques de paridad por grupo
+constexpr size_t FEC_MAX_DATA = 128;
+constexpr size_t FEC_MAX_PARITY = 16;
+
+// Grupos incompletos (con paridad guardada, esperando a poder reconstruirse) que el receptor conserva como máximo por flujo
+constexpr size_t FEC_MAX_PENDING_GROUPS = 64;
+
+// Implementaciones del producto y suma de bloques en GF(2^8)
+enum class gf_kernel { scalar, ssse3, avx2 };
+
+// Funciones que multiplican dos elementos de GF(2^8) y que calculan el inverso de uno distinto de 0.
+uint8_t gf_multiply(uint8_t, uint8_t);
+uint8_t gf_inverse(uint8_t);
+
+// Función que suma (XOR) a un bloque otro multiplicado por una constante: destination ^= factor · source.
+void gf_multiply_add(uint8_t*, const uint8_t*, uint8_t, size_t);
+void gf_multiply_add(gf_kernel, uint8_t*, const uint8_t*, uint8_t, size_t);
+
+// Función que devuelve la implementación más rápida que admite el procesador.
+gf_kernel gf_best_kernel();
+
+// Función que devuelve el coeficiente del bloque de datos column del grupo en el bloque de paridad row (1 en la paridad 0).
+uint8_t fec_coefficient(size_t, size_t);
+
+// Función que suma a los símbolos de las filas de paridad indicadas la aportación del bloque de datos column del grupo.
+void fec_accumulate(const std::vector<uint8_t*>&, const std::vector<size_t>&, size_t, const uint8_t*, size_t);
+
+// Función que reconstruye los bloques de datos perdidos de un grupo a partir de los síndromes de tantas filas de paridad
+// como bloques faltan (la paridad recibida menos la aportación de los bloques que sí han llegado).
+bool fec_recover(const std::vector<uint8_t*>&, const std::vector<size_t>&, const std::vector<size_t>&, const std::vector<uint8_t*>&,
+                 size_t);
+
+#endif // FEC_H
@@ -0,0 +1,94 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración del registro de mensajes asíncrono: los mensajes se formatean en el hilo que los emite, se dejan en un
+ *         anillo sin cerrojos y los escribe un hilo de fondo, de forma que los bucles de E/S nunca esperan a la terminal
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+
+// Niveles de los mensajes, de más a menos importante: solo se muestran los que no superan el nivel escogido
+enum class log_level : int {
+  error,    // Errores (por la salida de error)
+  warning,  // Avisos (por la salida de error)
+  info,     // Resultados y progreso de la transferencia (por la salida estándar)
+  debug     // Cada paso que da el programa (por la salida estándar)
+};
+
+// Tamaño máximo de un mensaje (los más largos se recortan) y número de mensajes que caben en el anillo (con el anillo lleno,
+// los mensajes informativos y de depuración se descartan, y los errores y avisos se escriben sin pasar por él)
+constexpr size_t LOG_MESSAGE_SIZE = 496;
+constexpr size_t LOG_RING_SIZE = 1024;
+
+// Nivel de los mensajes que se muestran.
+extern std::atomic<int> log_threshold;
+
+// Función que cambia el nivel de los mensajes que se muestran.
+void set_log_level(log_level);
+
+// Función que espera a que el hilo de fondo haya escrito todos los mensajes emitidos hasta ahora.
+void log_flush();
+
+// Buffer de tamaño fijo en el que se formatea un mensaje, sin reservar memoria (lo que no cabe se descarta)
+class fixed_buffer : public std::streambuf {
+ public:
+  // CONSTRUCTOR
+  fixed_buffer();
+
+  // MÉTODOS PARA CONSULTAR EL TEXTO FORMATEADO
+  const char* data() const;
+  size_t size() const;
+
+ private:
+  char text[LOG_MESSAGE_SIZE];
+};
+
+// Mensaje que se está formateando: se envía al anillo al destruirse, al final de la sentencia que lo emite
+class log_message {
+ public:
+  // CONSTRUCTOR Y DESTRUCTOR
+  explicit log_message(log_level level);
+  ~log_message();
+
+  log_message(const log_message&) = delete;
+  log_message& operator=(const log_message&) = delete;
+
+  // OPERADOR PARA AÑADIR AL MENSAJE CUALQUIER COSA QUE SE PUEDA ESCRIBIR EN UN std::ostream (SOLO SI SE VA A MOSTRAR)
+  template <typename T>
+  log_message& operator<<(const T& value) {
+    if (enabled) { stream << value; }
+    return *this;
+  }
+
+  // OPERADORES PARA LOS MANIPULADORES SIN ARGUMENTOS (std::fixed, std::hex...)
+  log_message& operator<<(std::ios_base& (*manipulator)(std::ios_base&)) {
+    if (enabled) { stream << manipulator; }
+    return *this;
+  }
+
+ private:
+  log_level level;
+  bool enabled;
+  fixed_buffer buffer;
+  std::ostream stream;
+};
+
+/**
+ * @brief Funciones que empiezan un mensaje de cada nivel, por ejemplo: log_error() << "Error: ...";
+ */
+inline log_message log_error() { return log_message(log_level::error); }
+inline log_message log_warning() { return log_message(log_level::warning); }
+inline log_message log_info() { return log_message(log_level::info); }
+inline log_message log_debug() { return log_message(log_level::debug); }
+
+#endif // LOGGER_H
@@ -0,0 +1,138 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de las métricas de la transferencia (contadores por hilo e histograma de latencia de los bloques) y de
+ *         la clase metrics_reporter, que las muestra durante la transferencia y las resume en JSON al final
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "netcp.h"
+#include <array>
+#include <bit>
+#include <chrono>
+#include <thread>
+
+// Contadores de la transferencia
+enum class metric : size_t {
+  bytes_sent,          // Bytes de datos enviados (sin cabeceras ni reenvíos)
+  datagrams_sent,      // Datagramas de datos enviados, incluidos los reenvíos
+  retransmits,         // Datagramas de datos reenviados
+  send_errors,         // Errores de sendmmsg() (también los que se resuelven reintentando)
+  bytes_received,      // Bytes de los datagramas recibidos (con cabeceras)
+  datagrams_received,  // Datagramas recibidos
+  corrupt_datagrams,   // Datagramas recibidos con el CRC32C incorrecto
+  syscalls,            // Llamadas al sistema de lectura, envío, recepción y escritura
+  short_reads,         // Lecturas del fichero o de la tubería que han devuelto menos de lo pedido
+  short_writes,        // Escrituras en el fichero que han escrito menos de lo pedido
+  read_ns,             // Tiempo leyendo el fichero o la tubería
+  send_ns,             // Tiempo enviando datagramas
+  write_ns,            // Tiempo escribiendo en el fichero
+  buffer_allocations,  // Zonas de memoria reservadas para los buffers de los bloques (0 en régimen estable)
+  parity_sent,         // Datagramas de paridad enviados (corrección de errores)
+  fec_recovered,       // Bloques perdidos que el receptor ha reconstruido con la paridad, sin esperar al reenvío
+  forged_datagrams,    // Datagramas descartados por no superar la autenticación del cifrado
+  count
+};
+constexpr size_t METRIC_COUNT = static_cast<size_t>(metric::count);
+
+// Nombres de los contadores en el resumen JSON, en el orden de la enumeración
+constexpr const char* METRIC_NAMES[METRIC_COUNT] = {"bytes_sent", "datagrams_sent", "retransmits", "send_errors", "bytes_received",
+                                                    "datagrams_received", "corrupt_datagrams", "syscalls", "short_reads",
+                                                    "short_writes", "read_ns", "send_ns", "write_ns", "buffer_allocations",
+                                                    "parity_sent", "fec_recovered", "forged_datagrams"};
+
+// Número de intervalos del histograma de latencia de los bloques: el intervalo i cuenta las latencias de menos de 2^i µs
+constexpr size_t LATENCY_BUCKETS = 32;
+
+// Métricas de un hilo. Solo las modifica su hilo, así que basta con cargar y guardar con memory_order_relaxed (sin
+// instrucciones atómicas de lectura-modificación-escritura); el hilo que las muestra las lee igual, sin bloquear a nadie
+struct metrics_block {
+  std::array<std::atomic<uint64_t>, METRIC_COUNT> counters{};
+  std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> latency{};
+};
+
+// Suma de las métricas de todos los hilos en un instante
+struct metrics_snapshot {
+  std::array<uint64_t, METRIC_COUNT> counters{};
+  std::array<uint64_t, LATENCY_BUCKETS> latency{};
+};
+
+// Función que registra las métricas de un hilo nuevo (solo se llama una vez por hilo).
+metrics_block& register_metrics_block();
+
+// Función que suma las métricas de todos los hilos.
+metrics_snapshot collect_metrics();
+
+/**
+ * @brief Función que devuelve las métricas del hilo que la llama, registrándolas la primera vez.
+ */
+inline metrics_block& local_metrics() {
+  thread_local metrics_block& block = register_metrics_block();
+  return block;
+}
+
+/**
+ * @brief Función que suma una cantidad a uno de los contadores del hilo.
+ * @param[in] which: contador que se incrementa.
+ * @param[in] amount: cantidad que se suma.
+ */
+inline void count_metric(metric which, uint64_t amount = 1) {
+  std::atomic<uint64_t>& counter = local_metrics().counters[static_cast<size_t>(which)];
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Función que añade al histograma del hilo la latencia de un bloque (desde su primer envío hasta su confirmación).
+ * @param[in] microseconds: latencia del bloque.
+ */
+inline void record_latency(uint64_t microseconds) {
+  size_t bucket = std::min<size_t>(std::bit_width(microseconds), LATENCY_BUCKETS - 1);
+  std::atomic<uint64_t>& counter = local_metrics().latency[bucket];
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Cronómetro que suma a un contador de tiempo lo que pasa entre su creación y su destrucción
+class metric_timer {
+ public:
+  // CONSTRUCTOR Y DESTRUCTOR
+  explicit metric_timer(metric which) : which(which), start(std::chrono::steady_clock::now()) {}
+  ~metric_timer() {
+    count_metric(which, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+  }
+
+ private:
+  metric which;
+  std::chrono::steady_clock::time_point start;
+};
+
+class metrics_reporter {
+ public:
+  // CONSTRUCTOR (EMPIEZA A MOSTRAR EL PROGRESO Y A ATENDER EL SOCKET UNIX, SI SE HAN PEDIDO) Y DESTRUCTOR
+  explicit metrics_reporter(const netcp_options& options);
+  ~metrics_reporter();
+
+  // MÉTODO PARA TERMINAR Y ESCRIBIR EL RESUMEN JSON (SI SE HA PEDIDO), INDICANDO SI LA TRANSFERENCIA HA TERMINADO BIEN
+  std::error_code finish(bool succeeded);
+
+ private:
+  // MÉTODO DEL HILO QUE MUESTRA EL PROGRESO Y RESPONDE EN EL SOCKET UNIX
+  void run();
+
+  // MÉTODO QUE DEVUELVE LAS MÉTRICAS ACTUALES EN JSON
+  std::string to_json(bool running, bool succeeded) const;
+
+  netcp_options options;
+  std::chrono::steady_clock::time_point start;
+  int listen_fd = -1;
+  std::atomic<bool> stopping{false};
+  std::thread worker;
+};
+
+#endif // METRICS_H
@@ -9,6 +9,13 @@
  * @brief  netcp - Un programa en C++ que envía el contenido de archivos por la red mediante el uso de un socket configurado en una dirección IP y puerto UDP específico.
  */
 
+#ifndef NETCP_H
+#define NETCP_H
+
+#include "subprocess.h"
+#include "logger.h"
+#include "protocol.h"
+#include "aead.h"
 #include <iostream>
 #include <vector>
 #include <unistd.h>
@@ -20,6 +27,119 @@
 #include <atomic>
 #include <csignal>
 #include <cstring>
+#include <string_view>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Variable que indica si se ha pedido terminar el programa mediante una señal.
+extern std::atomic<bool> quit_requested;
+
+// Algoritmos de control de congestión del emisor
+enum class congestion_mode {
+  none,   // Sin control de congestión: solo la ventana y, si se indica, la tasa fija
+  aimd,   // Incremento aditivo y reducción multiplicativa ante pérdidas
+  delay   // Como aimd, pero reduciendo también la ventana cuando crece el retardo
+};
+
+// Camino por el que el emisor envía una transferencia: dirección local de la que salen los datagramas (con puerto 0, uno
+// cualquiera) y dirección del receptor (con puerto 0, el de NETCP_PORT). Las direcciones pueden ser IPv4 o IPv6
+struct transfer_path {
+  sockaddr_storage local{};
+  sockaddr_storage remote{};
+};
+
+// Camino ya abierto: socket enlazado a la dirección local del camino y dirección del receptor por él
+struct path_socket {
+  int socket_fd = -1;
+  sockaddr_storage destination{};
+};
+
+// Estructura con las opciones de la transferencia que se obtienen de la línea de comandos.
+struct netcp_options {
+  // Número de datagramas que se envían o reciben en cada llamada a sendmmsg()/recvmmsg()
+  size_t batch_size = 32;
+  // Tamaño de los bloques que viajan en cada datagrama (0 para que el emisor lo elija según la MTU del camino al receptor)
+  size_t chunk_size = 0;
+  // Si es true, el emisor proyecta el fichero en memoria con mmap() en lugar de copiarlo a un buffer
+  bool use_mmap = false;
+  // Número de flujos (cada uno con su socket y su hilo) en los que se reparte la transferencia
+  size_t streams = 1;
+  // Tasa máxima de envío en bytes por segundo (0 para no fijar ninguna)
+  double pacing_rate = 0;
+  // Control de congestión que ajusta la tasa de envío con las confirmaciones del receptor
+  congestion_mode congestion = congestion_mode::aimd;
+  // Si es true, el ritmo de envío lo impone el núcleo (SO_MAX_PACING_RATE) en lugar del cubo de tokens del emisor
+  bool kernel_pacing = false;
+  // Si es true (y el núcleo lo admite), el emisor lee el fichero y envía los datagramas con io_uring, solapando ambas operaciones
+  bool use_io_uring = false;
+  // Corrección de errores: por cada grupo de fec_data bloques de datos, el emisor envía fec_parity bloques de paridad con los
+  // que el receptor reconstruye hasta fec_parity bloques perdidos del grupo sin esperar al reenvío (0 para no enviar paridad)
+  size_t fec_data = 0;
+  size_t fec_parity = 0;
+  // Si es true, el emisor comprime los bloques (con varios hilos) antes de enviarlos; los que no se reducen viajan sin comprimir
+  bool compress = false;
+  // Si es true, el receptor envía la firma de su copia del fichero y el emisor solo envía los bloques que han cambiado
+  bool delta = false;
+  // Si es true, se envía o recibe un directorio entero (con sus subdirectorios) en una sola sesión
+  bool recursive = false;
+  // Si es true (y el núcleo lo admite), el emisor agrupa los datagramas con UDP_SEGMENT (GSO) y el receptor los recibe
+  // agregados con UDP_GRO, para que cada grupo recorra la pila de red una sola vez
+  bool udp_offload = true;
+  // Caminos entre los que el emisor reparte los bloques, según la tasa de entrega que mide en cada uno (vacío para uno solo,
+  // desde cualquier dirección local hasta NETCP_IP)
+  std::vector<transfer_path> paths;
+  // Receptores de un envío en abanico: el fichero se lee una sola vez y se envía a todos, cada uno con su propio emisor
+  // (vacío para enviarlo solo a NETCP_IP; con puerto 0, al de NETCP_PORT)
+  std::vector<sockaddr_storage> receivers;
+  // Cifrado autenticado: clave compartida (el emisor cifra con ella los datos y el receptor solo acepta datos cifrados con
+  // ella; sin clave, los datos viajan en claro) y algoritmo con el que cifra el emisor
+  std::optional<aead_secret> secret;
+  aead_algorithm cipher = aead_algorithm::automatic;
+  // Si es true, se muestra cada segundo lo transferido y la velocidad
+  bool progress = false;
+  // Fichero en el que se escribe el resumen JSON de las métricas al terminar ("-" para la salida estándar, vacío para ninguno)
+  std::string stats_path;
+  // Socket UNIX en el que se atienden peticiones de las métricas durante la transferencia (vacío para ninguno)
+  std::string stats_socket;
+};
+
+// Número máximo de datagramas que el núcleo acepta en un mensaje con UDP_SEGMENT, y tamaño máximo del mensaje (el de los
+// datos de un datagrama UDP sobre IPv4, que también cabe sobre IPv6)
+constexpr size_t GSO_MAX_SEGMENTS = 64;
+constexpr size_t GSO_MAX_PAYLOAD = 65507;
+
+// Límites del tamaño de bloque: el máximo es el que llena un datagrama UDP sobre IPv4 junto con la cabecera
+constexpr size_t MIN_CHUNK_SIZE = 512;
+constexpr size_t MAX_CHUNK_SIZE = GSO_MAX_PAYLOAD - PACKET_HEADER_SIZE;
+// Cabeceras IPv4 (sin opciones) o IPv6 (sin extensiones) y UDP que se descuentan de la MTU, y MTU que se supone si no se
+// puede averiguar la del camino
+constexpr size_t IP_UDP_HEADER_SIZE = 20 + 8;
+constexpr size_t IPV6_UDP_HEADER_SIZE = 40 + 8;
+constexpr size_t FALLBACK_MTU = 1500;
+// Número máximo de fragmentos (páginas) de un mensaje enviado con MSG_ZEROCOPY (MAX_SKB_FRAGS en el núcleo)
+constexpr size_t ZEROCOPY_MAX_FRAGMENTS = 17;
+
+// Número máximo de flujos en los que se puede repartir una transferencia (-j); el receptor descarta los datagramas que
+// indican más
+constexpr size_t MAX_STREAMS = 256;
+
+// Capacidad que se pide para la tubería por la que llega la salida del comando que se envía con -c
+constexpr int PIPE_BUFFER_SIZE = 1 << 20;
+
+// Datagrama que se va a enviar, formado por uno o dos trozos de memoria (por ejemplo, cabecera y datos) que el núcleo concatena.
+struct datagram {
+  iovec parts[2];
+  size_t part_count = 1;
+};
+
+// Estructura que lleva la cuenta de los envíos realizados con MSG_ZEROCOPY y de las notificaciones de finalización recibidas.
+struct zerocopy_tracker {
+  uint64_t sent = 0;
+  uint64_t completed = 0;
+  // Indica si el núcleo ha tenido que copiar los datos de algún envío (por ejemplo, en la interfaz de loopback)
+  bool copied = false;
+};
 
 // Función para enviar el mensaje que proporciona el manejo de señales del programa.
 void signal_handler(int);
@@ -30,21 +150,80 @@ void setup_signal_handler();
 // Función para mostrar ayuda sobre el funcionamiento del programa.
 void show_help();
 
+// Función que interpreta una cantidad con sufijo opcional K, M o G (potencias de 1000).
+std::optional<uint64_t> parse_size(std::string_view);
+
 // Función para leer un fichero, y guardar su contenido en un buffer.
 std::error_code read_file(int, std::vector<uint8_t>&);
 
 // Función que crea un descriptor de archivo del socket en la dirección IP que le indiquemos.
 using make_socket_result = std::expected<int, std::error_code>;
-make_socket_result make_socket(std::optional<sockaddr_in>);
+make_socket_result make_socket(std::optional<sockaddr_storage>, bool = false);
+
+// Función que reparte los datagramas que llegan a un grupo de sockets con SO_REUSEPORT según su transferencia y su flujo.
+void steer_streams(const std::vector<int>&);
+
+// Funciones que abren los sockets de los caminos de un flujo del emisor (los de las opciones o, si no hay, uno hasta NETCP_IP
+// y NETCP_PORT) y que los cierran.
+using open_paths_result = std::expected<std::vector<path_socket>, std::error_code>;
+open_paths_result open_paths(const netcp_options&);
+void close_paths(const std::vector<path_socket>&);
+
+// Función que devuelve el tamaño de bloque de una transferencia: el indicado en las opciones o, si no, el mayor que cabe en
+// un datagrama sin fragmentar según la MTU de los caminos hasta el destino.
+size_t choose_chunk_size(const std::vector<path_socket>&, const netcp_options&);
+
+// Función que amplía el buffer de recepción de un socket para que quepan varios lotes de los datagramas más grandes.
+void set_receive_buffer(int, const netcp_options&);
 
 // Función que crea y configura un socket con la dirección IP eespecificada.
-std::optional<sockaddr_in> make_ip_address(const std::optional<std::string>, uint16_t);
+std::optional<sockaddr_storage> make_ip_address(const std::optional<std::string>, uint16_t);
+
+// Funciones que devuelven el tamaño de una dirección IPv4 o IPv6 y la dirección en texto, sin y con su puerto ("[::1]:8080").
+socklen_t address_length(const sockaddr_storage&);
+std::string ip_to_string(const sockaddr_storage&);
+std::string address_to_string(const sockaddr_storage&);
 
 // Función que envía datos a través de un socket UDP a una dirección especificada por parámetros.
-std::error_code send_to(int, const std::vector<uint8_t>&, const sockaddr_in&);
+std::error_code send_to(int, const std::vector<uint8_t>&, const sockaddr_storage&);
+
+// Función que envía un lote de datagramas con una única llamada a sendmmsg(), agrupándolos con UDP_SEGMENT si se indica.
+std::error_code send_batch(int, const std::vector<datagram>&, const sockaddr_storage&, zerocopy_tracker* = nullptr, bool* = nullptr);
+
+// Función que indica si el núcleo admite la segmentación UDP (GSO) en un socket.
+bool udp_segmentation_supported(int);
+
+// Función que activa o desactiva la agregación de datagramas en la recepción (GRO) de un socket.
+bool set_udp_coalescing(int, bool);
+
+// Función que recoge las notificaciones de los envíos con MSG_ZEROCOPY completados, devolviendo cuántos se han notificado.
+size_t drain_zerocopy(int, zerocopy_tracker&, bool);
+
+// Función que recibe un lote de datagramas con una única llamada a recvmmsg(), separando los que el núcleo haya agregado con
+// UDP_GRO, y devuelve cuántos se han recibido.
+using receive_batch_result = std::expected<size_t, std::error_code>;
+receive_batch_result receive_batch(int, const std::vector<iovec>&, std::vector<iovec>&, std::vector<sockaddr_storage>&);
+
+// Función que escribe en una posición de un fichero varios bloques de datos con una única llamada a pwritev().
+std::error_code write_file_batch(int, std::vector<iovec>, off_t);
+
+// Función que envía unos datos repartidos en flujos, cada uno por sus caminos, devolviendo el CRC32C confirmado por el receptor.
+std::expected<uint32_t, std::error_code> send_streams(const std::vector<std::vector<path_socket>>&, int, size_t, const uint8_t*,
+                                                      const netcp_options&);
+
+// Función que recibe en un fichero los flujos de una transferencia, devolviendo el CRC32C de los datos recibidos.
+std::expected<uint32_t, std::error_code> receive_streams(const std::vector<int>&, int, const netcp_options&);
+
+// Función que recibe un fichero en modo diferencias, reconstruyéndolo a partir de la copia que ya existe.
+std::error_code receive_delta(const std::string&, const std::vector<int>&, const netcp_options&);
 
 // Función que envía los datos de un fichero (especificado por parámetros) a través de un socket UDP haciendo uso de una dirección IP.
-std::error_code netcp_send_file(const std::string&);
+std::error_code netcp_send_file(const std::string&, const netcp_options&);
+
+// Función que ejecuta un comando y envía su salida (estándar, de error o ambas) a medida que la produce.
+std::error_code netcp_send_command(const std::vector<std::string>&, subprocess::stdio, const netcp_options&);
 
 // Función que recibe los datos de un fichero (especificado por parámetros) a través de un socket UDP haciendo uso de una dirección IP.
-std::error_code netcp_receive_file(const std::string&);
\ No newline at end of file
+std::error_code netcp_receive_file(const std::string&, const netcp_options&);
+
+#endif // NETCP_H
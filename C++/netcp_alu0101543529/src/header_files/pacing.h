@@ -0,0 +1,76 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de las clases token_bucket y congestion_controller, que regulan el ritmo de envío del emisor
+ */
+
+#ifndef PACING_H
+#define PACING_H
+
+#include "netcp.h"
+
+class token_bucket {
+ public:
+  // CONSTRUCTOR (UNA TASA DE 0 BYTES/S SIGNIFICA SIN LÍMITE)
+  token_bucket(double rate, size_t burst);
+
+  // MÉTODOS PARA CONSULTAR Y CAMBIAR LA TASA, EN BYTES POR SEGUNDO
+  double rate() const;
+  void set_rate(double rate);
+
+  // MÉTODO QUE DEVUELVE LOS MICROSEGUNDOS QUE HAY QUE ESPERAR PARA PODER ENVIAR (0 SI YA SE PUEDE)
+  uint64_t delay(uint64_t now);
+
+  // MÉTODO PARA DESCONTAR LOS BYTES ENVIADOS
+  void consume(size_t bytes, uint64_t now);
+
+ private:
+  // MÉTODO PARA AÑADIR LOS TOKENS GENERADOS DESDE LA ÚLTIMA ACTUALIZACIÓN
+  void refill(uint64_t now);
+
+  // Tasa de generación de tokens (bytes/s), tokens disponibles (negativos si hay deuda) y máximo acumulable
+  double tokens_per_second;
+  double tokens;
+  double burst;
+  uint64_t last_update;
+};
+
+class congestion_controller {
+ public:
+  // CONSTRUCTOR
+  congestion_controller(congestion_mode mode, size_t chunk_size, size_t min_window);
+
+  // MÉTODOS QUE ACTUALIZAN LA VENTANA CON LAS CONFIRMACIONES, LAS PÉRDIDAS Y LOS VENCIMIENTOS DEL RTO
+  void on_ack(uint64_t acked_chunks, uint64_t srtt, uint64_t min_rtt, uint64_t now);
+  void on_loss(uint64_t sent_time, uint64_t now);
+  void on_timeout(uint64_t now);
+
+  // MÉTODO QUE DEVUELVE LA VENTANA DE CONGESTIÓN, EN BLOQUES
+  size_t window() const;
+
+  // MÉTODO QUE DEVUELVE LA TASA DE ENVÍO QUE CORRESPONDE A LA VENTANA (BYTES/S), O 0 SI NO HAY CONTROL DE CONGESTIÓN
+  double pacing_rate(uint64_t srtt) const;
+
+ private:
+  // MÉTODO PARA REDUCIR LA VENTANA COMO MUCHO UNA VEZ POR RTT
+  void decrease(uint64_t now, double factor);
+
+  congestion_mode mode;
+  size_t chunk_size;
+  size_t min_window;
+
+  // Ventana de congestión y umbral de arranque lento, en bloques (con decimales para el incremento aditivo)
+  double congestion_window;
+  double slow_start_threshold;
+
+  // Instante de la última reducción: las pérdidas de bloques enviados antes pertenecen al mismo episodio de congestión
+  uint64_t last_decrease = 0;
+  uint64_t last_srtt = 0;
+};
+
+#endif // PACING_H
@@ -0,0 +1,119 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración del formato de los datagramas del protocolo de netcp
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Tipos de datagrama del protocolo
+enum class packet_type : uint8_t {
+  data = 1,     // Bloque del fichero, identificado por su número de secuencia
+  ack = 2,      // Confirmación acumulada del receptor, con bloques SACK de lo recibido fuera de orden
+  fin = 3,      // Fin de la transferencia, con el número total de bloques enviados
+  fin_ack = 4,  // Confirmación del receptor de que tiene el fichero completo
+  signature_request = 5,  // Petición del emisor de la firma del fichero que ya tiene el receptor (transferencia por diferencias)
+  keepalive = 6,          // Aviso del emisor de que sigue activo aunque no tenga datos que enviar (salida de un comando)
+  parity = 7              // Bloque de paridad (corrección de errores) de un grupo de bloques de datos consecutivos
+};
+
+// Cabecera que precede a todos los datagramas. En la red se codifica en orden de bytes de red (big-endian).
+struct packet_header {
+  packet_type type = packet_type::data;
+  // Combinación de bits FLAG_*
+  uint8_t flags = 0;
+  // Número de bytes que siguen a la cabecera
+  uint16_t length = 0;
+  // Identificador aleatorio de la transferencia, para descartar datagramas de transferencias anteriores
+  uint32_t session = 0;
+  // Flujo al que pertenece el datagrama y número total de flujos en los que se ha repartido el fichero
+  uint16_t stream = 0;
+  uint16_t stream_count = 1;
+  // data: número del bloque dentro de su flujo; ack: siguiente bloque que espera el receptor; fin: número total de bloques del
+  // flujo; parity: primer bloque del grupo
+  uint64_t sequence = 0;
+  // data: posición del bloque en el fichero; parity: posición del primer bloque del grupo
+  uint64_t offset = 0;
+  // data: instante de envío en microsegundos; ack: instante del último bloque recibido, para medir el RTT
+  uint64_t timestamp = 0;
+  // data y fin: tamaño total de la transferencia (de todos los flujos), para que el receptor reserve el fichero de una vez
+  uint64_t total_size = 0;
+  // data: tamaño de bloque del flujo, que elige el emisor al empezar (todos los bloques lo ocupan salvo el último)
+  uint32_t chunk_size = 0;
+  // Tras la cabecera codificada va el CRC32C de todo el datagrama (calculado con ese campo a cero), que escribe seal_header()
+};
+
+// Rango de bloques [start, end) recibidos por encima de la confirmación acumulada
+struct sack_block {
+  uint64_t start;
+  uint64_t end;
+};
+
+// Bits del campo flags de la cabecera
+constexpr uint8_t FLAG_COMPRESSED = 0x01;   // data: los datos del bloque van comprimidos con deflate
+constexpr uint8_t FLAG_ENCRYPTED = 0x02;    // data, parity, fin y fin_ack: los datos van cifrados (sal, datos cifrados y etiqueta)
+constexpr uint8_t FLAG_CHACHA20 = 0x04;     // Con FLAG_ENCRYPTED: cifrados con ChaCha20-Poly1305 en lugar de AES-256-GCM
+
+// Datos de un bloque de paridad, que preceden al símbolo (del tamaño de bloque del flujo) en el datagrama
+struct fec_parity_info {
+  // Bloques de datos y de paridad por grupo que ha elegido el emisor
+  uint8_t data_count = 0;
+  uint8_t parity_count = 0;
+  // Fila de paridad de este bloque, y bloques de datos del grupo (menos que data_count si el grupo termina el flujo)
+  uint8_t index = 0;
+  uint8_t group_count = 0;
+  // Tamaño del último bloque de datos del grupo (los demás ocupan el tamaño de bloque)
+  uint32_t last_length = 0;
+};
+
+// Tamaño de los datos de un bloque de paridad codificados antes del símbolo
+constexpr size_t FEC_PARITY_PREFIX = 8;
+
+// Valor de total_size cuando el emisor todavía no conoce el tamaño de la transferencia (la salida de un comando)
+constexpr uint64_t UNKNOWN_TOTAL_SIZE = UINT64_MAX;
+
+// Tamaño de la cabecera codificada
+constexpr size_t PACKET_HEADER_SIZE = 52;
+
+// Posición del CRC32C del datagrama dentro de la cabecera
+constexpr size_t PACKET_CHECKSUM_OFFSET = 48;
+
+// Número máximo de rangos SACK que caben en una confirmación
+constexpr size_t MAX_SACK_BLOCKS = 32;
+
+// Función que codifica una cabecera en PACKET_HEADER_SIZE bytes.
+void encode_header(const packet_header&, uint8_t*);
+
+// Función que decodifica la cabecera de un datagrama recibido, comprobando que su longitud es coherente.
+bool decode_header(const uint8_t*, size_t, packet_header&);
+
+// Función que escribe en una cabecera codificada el CRC32C del datagrama, a partir del CRC32C de los datos que la siguen.
+void seal_header(uint8_t*, uint32_t, size_t);
+
+// Función que comprueba el CRC32C de un datagrama recibido.
+bool verify_checksum(const uint8_t*, size_t);
+
+// Función que codifica los rangos SACK de una confirmación, devolviendo el número de bytes escritos.
+size_t encode_sack(const std::vector<sack_block>&, uint8_t*);
+
+// Función que decodifica los rangos SACK de una confirmación.
+bool decode_sack(const uint8_t*, size_t, std::vector<sack_block>&);
+
+// Funciones que codifican y decodifican los datos de un bloque de paridad (FEC_PARITY_PREFIX bytes).
+void encode_parity_info(const fec_parity_info&, uint8_t*);
+bool decode_parity_info(const uint8_t*, size_t, fec_parity_info&);
+
+// Función que devuelve el instante actual en microsegundos, según un reloj monótono.
+uint64_t now_microseconds();
+
+#endif // PROTOCOL_H
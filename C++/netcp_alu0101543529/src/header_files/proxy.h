@@ -0,0 +1,36 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración del proxy UDP local que introduce pérdidas, reordenaciones, duplicados y retardo, para probar la
+ *         transferencia fiable
+ */
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include "netcp.h"
+
+// Estructura con las alteraciones que el proxy introduce en los datagramas que reenvía.
+struct proxy_options {
+  // Probabilidad (entre 0 y 1) de descartar cada datagrama
+  double loss = 0.0;
+  // Probabilidad de retener un datagrama REORDER_HOLD más que los demás, de forma que llega detrás de los siguientes
+  double reorder = 0.0;
+  // Probabilidad de reenviar un datagrama dos veces
+  double duplicate = 0.0;
+  // Retardo que se añade a todos los datagramas, en microsegundos
+  uint64_t delay = 0;
+};
+
+// Tiempo adicional que se retienen los datagramas escogidos para llegar desordenados, en microsegundos
+constexpr uint64_t REORDER_HOLD = 2000;
+
+// Función que reenvía los datagramas recibidos en un puerto local hacia un destino (y sus respuestas de vuelta), alterándolos.
+std::error_code netcp_proxy(uint16_t, const sockaddr_storage&, const proxy_options&);
+
+#endif // PROXY_H
@@ -0,0 +1,463 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de las clases reliable_sender y reliable_receiver, que implementan la transferencia fiable sobre UDP
+ */
+
+#ifndef RELIABLE_H
+#define RELIABLE_H
+
+#include "netcp.h"
+#include "protocol.h"
+#include "pacing.h"
+#include "uring.h"
+#include "compression.h"
+#include "checksum.h"
+#include "metrics.h"
+#include "buffer_pool.h"
+#include "fec.h"
+#include "aead.h"
+#include <mutex>
+#include <deque>
+#include <map>
+#include <memory>
+
+// Tiempo máximo sin confirmaciones (o sin datos) antes de dar por perdido al otro extremo, en microsegundos
+constexpr uint64_t PEER_TIMEOUT = 10000000;
+
+// Tiempo que el receptor sigue respondiendo a FIN repetidos una vez completado el fichero, en milisegundos
+constexpr int LINGER_TIMEOUT = 500;
+
+// Con UDP_GRO, tamaño del espacio para cada mensaje agregado (el de un datagrama UDP) y número máximo de mensajes por lote
+constexpr size_t GRO_SLOT_SIZE = 65536;
+constexpr size_t GRO_MAX_SLOTS = 64;
+
+// Límites de la ventana de envío (en bloques): la ventana se ajusta al producto ancho de banda-retardo medido entre ambos
+constexpr size_t INITIAL_WINDOW = 64;
+constexpr size_t MIN_WINDOW = 32;
+constexpr size_t MAX_WINDOW = 32768;
+
+// Memoria del estado de recepción de cada flujo (el mapa de bloques recibidos y sus CRC32C), que se reserva con su primer
+// datagrama
+constexpr size_t RECEIVE_STREAM_MEMORY = MAX_WINDOW / 8 + MAX_WINDOW * sizeof(uint32_t);
+
+struct shared_chunk;
+class chunk_feed;
+
+// Bloque enviado cuya confirmación todavía no ha llegado al emisor
+struct inflight_chunk {
+  uint8_t header[PACKET_HEADER_SIZE];
+  // Datos del bloque: apuntan a la proyección del fichero, a storage o, si se ha comprimido o cifrado, a packed (ranuras del
+  // pool del emisor, que se devuelven cuando el bloque sale de la ventana)
+  iovec payload;
+  pool_buffer storage;
+  pool_buffer packed;
+  bool compressed = false;
+  // Datos originales del bloque (antes de comprimirlo), con los que se calcula la paridad de su grupo, y su tamaño
+  const uint8_t* raw_data = nullptr;
+  size_t raw_length = 0;
+  // CRC32C de los datos tal y como viajan (comprimidos o no) y de los datos originales del fichero
+  uint32_t checksum = 0;
+  uint32_t raw_checksum = 0;
+  // Instantes del primer y del último envío del bloque, en microsegundos
+  uint64_t first_sent = 0;
+  uint64_t last_sent = 0;
+  // Instante del envío de la paridad del grupo del bloque (0 mientras no se ha enviado, o sin corrección de errores)
+  uint64_t parity_sent = 0;
+  // Camino (de reliable_sender::paths) por el que se ha enviado por última vez
+  uint16_t path = 0;
+  bool acked = false;
+  bool lost = false;
+  // En un envío en abanico, bloque compartido del que se toman los datos (y que los conserva mientras esté en la ventana)
+  std::shared_ptr<shared_chunk> shared;
+};
+
+// Bloque de un envío en abanico: lo prepara (lo lee, lo comprime y lo cifra) el primer emisor que lo necesita y lo toman
+// de él los emisores de los demás receptores; ready indica cuándo han terminado de comprimirlo los hilos de compresión
+struct shared_chunk {
+  inflight_chunk chunk;
+  std::shared_future<void> ready;
+};
+
+// Camino por el que envía un emisor: socket y destino, E/S del socket, bloques enviados por él que siguen en vuelo y bloques
+// que ha entregado, y su tasa de entrega (bloques/µs, media de las muestras que toma el emisor)
+struct send_path {
+  path_socket route;
+  zerocopy_tracker zerocopy;
+  bool use_zerocopy = false;
+  bool segmentation = false;
+  size_t inflight = 0;
+  uint64_t delivered = 0;
+  uint64_t sample_delivered = 0;
+  double rate = 0;
+  bool measured = false;
+  // Instante de envío más reciente de un bloque confirmado que se envió por él (para RACK, que compara cada bloque solo con
+  // los de su camino) e instante del primer envío por él sin ninguna entrega posterior (0 si no hay ninguno)
+  uint64_t rack_time = 0;
+  uint64_t unanswered_since = 0;
+  // Si es false, el camino no responde y no se usa hasta retry_at
+  bool alive = true;
+  uint64_t retry_at = 0;
+};
+
+// Lote de bloques preparados que todavía no se han enviado, con el trabajo que los está comprimiendo (si hay compresión)
+struct staged_batch {
+  size_t remaining;
+  std::future<void> done;
+};
+
+// Grupo de bloques consecutivos de un flujo protegido con paridad: primer bloque, bloques que lleva, tamaño del último y
+// símbolos de paridad (uno por fila)
+struct parity_group {
+  uint64_t first = 0;
+  size_t count = 0;
+  size_t last_length = 0;
+  std::vector<pool_buffer> symbols;
+};
+
+// Resultado de un paso de reliable_sender::step() o de reliable_receiver::step(): si la transferencia ha terminado, con qué
+// resultado; si no, el instante (en microsegundos) en que hay que volver a llamarlo aunque no llegue nada al socket y, en el
+// emisor de una tubería, si también hay que hacerlo en cuanto haya algo que leer de ella
+struct transfer_progress {
+  bool done = false;
+  std::error_code error;
+  uint64_t wake_at = 0;
+  bool wants_input = false;
+};
+
+// Fases del envío: sin empezar, enviando los bloques, y esperando la confirmación del FIN
+enum class send_phase { idle, data, finishing };
+
+// Función que genera el identificador aleatorio (distinto de 0) de una transferencia.
+uint32_t make_session_id();
+
+class reliable_sender {
+ public:
+  // CONSTRUCTOR
+  reliable_sender(const std::vector<path_socket>& paths, const netcp_options& options, uint32_t session,
+                  uint16_t stream = 0, uint16_t stream_count = 1, worker_pool* compressor = nullptr, uint64_t transfer_size = 0,
+                  chunk_feed* feed = nullptr);
+
+  // MÉTODO PARA ENVIAR UN RANGO DEL FICHERO, LEYÉNDOLO DEL DESCRIPTOR O, SI SE INDICA, DE SU PROYECCIÓN EN MEMORIA
+  std::error_code send(int fd, size_t range_offset, size_t range_size, const uint8_t* mapping);
+
+  // MÉTODO PARA ENVIAR TODO LO QUE SE LEA DE UNA TUBERÍA (NO BLOQUEANTE) HASTA QUE SE CIERRE, SIN CONOCER SU TAMAÑO
+  std::error_code send_pipe(int fd);
+
+  // MÉTODOS PARA PREPARAR EL ENVÍO DE UN RANGO DEL FICHERO O DE UNA TUBERÍA SIN EMPEZARLO, PARA AVANZARLO CON step()
+  void prepare(int fd, size_t range_offset, size_t range_size, const uint8_t* mapping);
+  void prepare_pipe(int fd);
+
+  // MÉTODO QUE AVANZA EL ENVÍO TODO LO POSIBLE SIN BLOQUEARSE, PARA QUE LO LLEVE UN BUCLE DE EVENTOS
+  transfer_progress step();
+
+  // MÉTODO QUE DEVUELVE EL CRC32C DEL RANGO ENVIADO
+  uint32_t digest() const;
+
+ private:
+  // MÉTODO CON EL BUCLE PRINCIPAL DEL ENVÍO, COMÚN A LOS RANGOS DE FICHERO Y A LAS TUBERÍAS: AVANZA CON step() Y ESPERA
+  std::error_code transfer();
+
+  // MÉTODOS PARA PREPARAR EL SOCKET Y LA E/S AL EMPEZAR, Y PARA TERMINAR (UNA SOLA VEZ) CON EL RESULTADO INDICADO
+  void start();
+  transfer_progress complete(std::error_code error);
+
+  // MÉTODO PARA ENVIAR EL FIN Y RECOGER SU CONFIRMACIÓN, REINTENTÁNDOLO CUANDO VENCE SU PLAZO
+  transfer_progress step_finish();
+
+  // MÉTODO PARA LEER DE LA TUBERÍA LO QUE HAYA DISPONIBLE, PREPARANDO HASTA count BLOQUES COMPLETOS (O EL ÚLTIMO, AL CERRARSE)
+  std::expected<size_t, std::error_code> read_pipe(size_t count);
+
+  // MÉTODO PARA AVISAR AL RECEPTOR DE QUE EL EMISOR SIGUE ACTIVO AUNQUE NO TENGA DATOS QUE ENVIAR
+  std::error_code send_keepalive();
+
+  // MÉTODO PARA ENVIAR UN DATAGRAMA DE CONTROL (AVISO DE ACTIVIDAD O FIN) POR TODOS LOS CAMINOS QUE RESPONDEN
+  bool send_control(const uint8_t* packet, size_t length);
+
+  // MÉTODOS PARA PREPARAR (LEER Y COMPRIMIR) Y ENVIAR BLOQUES NUEVOS, REENVIAR LOS PERDIDOS Y PROCESAR LAS CONFIRMACIONES
+  std::error_code stage_chunks();
+  std::error_code send_new_chunks();
+  std::error_code retransmit();
+  std::error_code process_acks();
+  void handle_ack(const packet_header& header, const std::vector<sack_block>& blocks);
+  uint64_t loss_reference(const inflight_chunk& chunk) const;
+  void mark_lost(uint64_t sequence);
+
+  // MÉTODOS PARA ELEGIR EL CAMINO DE CADA BLOQUE Y PARA DAR POR CAÍDOS (Y VOLVER A PROBAR) LOS CAMINOS QUE NO RESPONDEN
+  size_t select_path() const;
+  void check_paths(uint64_t now);
+
+  // MÉTODOS PARA AÑADIR UN BLOQUE A LA PARIDAD DE SU GRUPO Y PARA ENVIAR LA PARIDAD DE LOS GRUPOS COMPLETOS
+  void encode_parity(const inflight_chunk& chunk, uint64_t sequence);
+  std::error_code send_parity();
+
+  // MÉTODOS PARA ACTUALIZAR LAS ESTIMACIONES DEL RTT, DEL TAMAÑO DE LA VENTANA Y DEL RITMO DE ENVÍO
+  void update_rtt(uint64_t sample);
+  void update_window(uint64_t now);
+  void update_pacing();
+
+  // MÉTODO PARA ENVIAR UN LOTE DE BLOQUES DE LA VENTANA, ACTUALIZANDO SU CABECERA
+  std::error_code send_chunks(const std::vector<uint64_t>& sequences);
+
+  // MÉTODOS DEL MODO io_uring: PREPARAR LA COLA, PEDIR LAS LECTURAS ADELANTADAS, ENVIAR UN LOTE Y RECOGER LAS COMPLETADAS
+  std::error_code setup_uring();
+  std::error_code submit_reads();
+  std::error_code send_uring(const std::vector<datagram>& datagrams, const std::vector<uint16_t>& owners);
+  std::error_code reap_completions(unsigned wait_count);
+
+  // Caminos (socket y destino de cada uno) y opciones de la transferencia, y flujo de la transferencia que envía este emisor
+  std::vector<send_path> paths;
+  netcp_options options;
+  uint32_t session;
+  uint16_t stream;
+  uint16_t stream_count;
+  worker_pool* compressor;
+  // Almacén de bloques compartido con los emisores de los demás receptores de un envío en abanico (nullptr si no lo es)
+  chunk_feed* feed;
+  // Tamaño de toda la transferencia (todos los flujos), que se indica al receptor en cada datagrama
+  uint64_t transfer_size;
+  // Tamaño de los bloques, que también se indica en cada datagrama para que el receptor lo conozca sin configurarlo
+  size_t chunk_size;
+  // Ranuras de un bloque para las copias leídas del fichero o de la tubería y para los bloques comprimidos. Se declara antes
+  // que los bloques que las usan, para que estos se las devuelvan antes de que se destruya
+  buffer_pool chunk_pool;
+
+  // Rango del fichero que se envía
+  int fd;
+  size_t range_offset;
+  size_t range_size;
+  const uint8_t* mapping;
+  uint64_t total_chunks;
+
+  // Si es true, se envía lo que se lee de la tubería fd: su tamaño (y total_chunks) no se conoce hasta que se cierra. Los
+  // bytes leídos que todavía no completan un bloque esperan en pipe_buffer
+  bool streaming = false;
+  bool pipe_closed = false;
+  pool_buffer pipe_buffer;
+  uint64_t pipe_bytes = 0;
+  // Ranuras y trozos de la lectura en curso de la tubería, que se conservan entre lecturas para no reservarlos cada vez
+  std::vector<pool_buffer> pipe_buffers;
+  std::vector<iovec> pipe_parts;
+  // Instante del último datagrama enviado, para saber cuándo hay que avisar al receptor de que seguimos activos
+  uint64_t last_sent = 0;
+
+  // Ventana de envío: window[i] es el bloque base_sequence + i
+  std::deque<inflight_chunk> window;
+  uint64_t base_sequence = 0;
+  uint64_t next_sequence = 0;
+  size_t window_limit = INITIAL_WINDOW;
+  std::vector<uint64_t> lost_queue;
+
+  // Bloques leídos (y comprimiéndose) por delante de la ventana: staged[i] es el bloque next_sequence + i
+  std::deque<inflight_chunk> staged;
+  std::deque<staged_batch> staged_batches;
+  uint64_t staged_sequence = 0;
+  // Corrección de errores: grupo cuya paridad se está calculando (con sus filas y sus símbolos), y grupos completos cuya
+  // paridad falta por enviar. Los símbolos ocupan ranuras de chunk_pool
+  parity_group fec_group;
+  std::vector<size_t> fec_rows;
+  std::vector<uint8_t*> fec_symbols;
+  std::vector<parity_group> fec_ready;
+  // Bytes del fichero enviados y bytes que han ocupado en la red (sin contar reenvíos ni cabeceras)
+  uint64_t raw_bytes = 0;
+  uint64_t wire_bytes = 0;
+  // CRC32C de los bloques del rango que ya han pasado a la ventana, que al final se compara con el que calcula el receptor
+  uint32_t range_digest = 0;
+  // Cifrado autenticado: clave de este emisor (con su sal, que se genera al empezar) y contexto con el que se cifra en este
+  // hilo (los hilos de compresión cifran con el suyo)
+  std::optional<aead_key> cipher_key;
+  std::unique_ptr<aead_context> sealer;
+
+  // Estimaciones del RTT (en microsegundos) y del tiempo de retransmisión
+  uint64_t srtt = 0;
+  uint64_t rttvar = 0;
+  uint64_t min_rtt = UINT64_MAX;
+  uint64_t rto = 200000;
+
+  // Estimación de la tasa de entrega (bloques/µs), como máximo de las últimas muestras
+  uint64_t delivered = 0;
+  uint64_t rate_sample_start = 0;
+  uint64_t rate_sample_delivered = 0;
+  double rate_samples[8] = {};
+  size_t rate_sample_index = 0;
+
+  // Control de congestión y ritmo de envío: el cubo de tokens reparte los lotes en el tiempo según la tasa permitida,
+  // salvo que el ritmo lo imponga el núcleo con SO_MAX_PACING_RATE
+  congestion_controller congestion;
+  token_bucket pacer;
+  double bdp_window = INITIAL_WINDOW;
+  double kernel_pacing_rate = 0;
+
+  // Instante de la última confirmación de datos nuevos, para detectar que el receptor ha dejado de responder
+  uint64_t last_progress = 0;
+
+  // Fase del envío y, al esperar la confirmación del FIN, intentos hechos, plazo del último y plazo del siguiente
+  send_phase phase = send_phase::idle;
+  int fin_attempts = 0;
+  uint64_t fin_deadline = 0;
+  uint64_t fin_timeout = 0;
+
+  // Cola de io_uring y zona de memoria registrada en la que se leen por adelantado los bloques del fichero: el bloque de
+  // secuencia s ocupa la ranura s % uring_slots hasta que sale de la ventana
+  io_uring_queue ring;
+  aligned_region uring_arena;
+  std::vector<bool> uring_loaded;
+  size_t uring_slots = 0;
+  uint64_t read_sequence = 0;
+  size_t reads_in_flight = 0;
+  size_t sends_in_flight = 0;
+};
+
+// Estado de una transferencia compartido por todos los hilos receptores (uno por socket con SO_REUSEPORT)
+struct receive_state {
+  // Transferencia en curso (0 mientras no ha llegado ningún datagrama) y número de flujos en los que se ha repartido
+  std::atomic<uint32_t> session{0};
+  std::atomic<uint32_t> stream_count{0};
+  // Flujos que ya han recibido todos sus bloques
+  std::atomic<uint32_t> finished_streams{0};
+  // Se activa si algún hilo falla, para que terminen los demás
+  std::atomic<bool> failed{false};
+  // Se activa cuando el primer hilo que conoce el tamaño de la transferencia reserva el fichero
+  std::atomic<bool> preallocated{false};
+  // CRC32C y tamaño de lo recibido en cada flujo completado, para calcular el del fichero
+  std::mutex digest_mutex;
+  std::map<uint16_t, std::pair<uint32_t, uint64_t>> digests;
+};
+
+// Grupo del que el receptor ha recibido paridad sin tener todavía sus bloques completos: datos del grupo, posición de su
+// primer bloque en el fichero, tamaño de la transferencia, instante de envío de la última paridad y símbolos recibidos, con
+// su fila
+struct fec_group {
+  fec_parity_info info;
+  uint64_t offset = 0;
+  uint64_t total_size = 0;
+  uint64_t timestamp = 0;
+  std::vector<std::pair<size_t, pool_buffer>> symbols;
+};
+
+// Estado de recepción de uno de los flujos de la transferencia
+struct receive_stream {
+  sockaddr_storage peer{};
+  // Siguiente bloque que esperamos en orden
+  uint64_t cumulative = 0;
+  // Bloques recibidos (y ya escritos) por encima de cumulative: un bit por bloque en un anillo de MAX_WINDOW bits, el CRC32C
+  // de cada uno para incorporarlo al del flujo cuando le lleguen los anteriores, y el tamaño del último bloque del flujo, que
+  // es el único que puede no estar completo
+  std::vector<uint64_t> received;
+  std::vector<uint32_t> received_digests;
+  size_t received_count = 0;
+  uint64_t highest_received = 0;
+  uint64_t short_sequence = UINT64_MAX;
+  size_t short_length = 0;
+  // Tamaño de bloque del flujo, que fija su primer bloque (0 mientras no ha llegado ninguno)
+  size_t chunk_size = 0;
+  uint64_t echo_timestamp = 0;
+  bool finished = false;
+  // Con cifrado, contexto de la clave del emisor del flujo (la del primer datagrama que la supera) y de la clave propia con
+  // la que el receptor cifra la confirmación del FIN
+  std::unique_ptr<aead_context> cipher;
+  std::unique_ptr<aead_context> reply_cipher;
+  // Grupos con paridad pendientes de completar, por su primer bloque (como mucho FEC_MAX_PENDING_GROUPS)
+  std::map<uint64_t, fec_group> fec_groups;
+  // CRC32C y tamaño de los datos recibidos en orden
+  uint32_t digest = 0;
+  uint64_t bytes = 0;
+};
+
+// Tramo de bloques consecutivos en el fichero que se escribe con una sola llamada a pwritev()
+struct write_run {
+  uint16_t stream;
+  off_t offset;
+  size_t length;
+  std::vector<iovec> blocks;
+};
+
+class reliable_receiver {
+ public:
+  // CONSTRUCTOR
+  reliable_receiver(int socket_fd, int fd, const netcp_options& options, receive_state& shared);
+
+  // MÉTODO PARA RECIBIR LOS FLUJOS QUE LLEGUEN A ESTE SOCKET Y ESCRIBIRLOS EN SU POSICIÓN DEL FICHERO: AVANZA CON step() Y ESPERA
+  std::error_code receive();
+
+  // MÉTODO QUE AVANZA LA RECEPCIÓN SIN BLOQUEARSE: SI readable ES true (EL SOCKET TIENE DATOS), RECIBE UN LOTE
+  transfer_progress step(bool readable);
+
+  // MÉTODO PARA PROCESAR UN DATAGRAMA (YA VERIFICADO) DE ESTA TRANSFERENCIA; LOS DATOS SE ESCRIBEN EN flush()
+  std::error_code accept(const packet_header& header, uint8_t* packet, const sockaddr_storage& source);
+
+  // MÉTODO PARA ESCRIBIR LOS BLOQUES ACEPTADOS DESDE LA ÚLTIMA LLAMADA Y CONFIRMARLOS A SUS FLUJOS
+  std::error_code flush();
+
+  // MÉTODO QUE INDICA SI ALGÚN FLUJO NO HA COINCIDIDO CON EL CRC32C DEL EMISOR
+  bool digest_failed() const;
+
+ private:
+  // MÉTODOS PARA PREPARAR LA RECEPCIÓN AL EMPEZAR, Y PARA TERMINAR (UNA SOLA VEZ) CON EL RESULTADO INDICADO
+  void start();
+  transfer_progress complete(std::error_code error);
+
+  // MÉTODO PARA COMPROBAR Y DESCIFRAR EN SU SITIO UN DATAGRAMA CIFRADO, CON EL CONTEXTO DE SU FLUJO O CON UNO NUEVO
+  std::optional<size_t> open_payload(const packet_header& header, uint8_t* payload, std::unique_ptr<aead_context>& candidate);
+
+  // MÉTODO PARA PROCESAR UN BLOQUE DE DATOS, AÑADIENDO A LOS TRAMOS QUE SE ESCRIBEN LOS BLOQUES QUE YA ESTÁN EN ORDEN
+  std::error_code handle_data(uint16_t stream_id, receive_stream& stream, const packet_header& header, uint8_t* payload,
+                              std::vector<write_run>& runs);
+
+  // MÉTODOS PARA GUARDAR UN BLOQUE DE PARIDAD Y PARA RECONSTRUIR CON ELLA LOS BLOQUES PERDIDOS DE LOS GRUPOS QUE YA PUEDEN
+  void handle_parity(uint16_t stream_id, receive_stream& stream, const packet_header& header, const uint8_t* payload);
+  void recover_groups();
+
+  // MÉTODO PARA ESCRIBIR LOS TRAMOS PENDIENTES, CADA UNO CON UNA SOLA LLAMADA A pwritev()
+  std::error_code write_runs();
+
+  // MÉTODO PARA ENVIAR AL EMISOR DE UN FLUJO LA CONFIRMACIÓN ACUMULADA Y LOS RANGOS SACK
+  std::error_code send_ack(uint16_t stream_id, const receive_stream& stream, packet_type type);
+
+  int socket_fd;
+  int fd;
+  netcp_options options;
+  receive_state& shared;
+
+  // Bloques descomprimidos o reconstruidos en este lote, que se guardan hasta que se escriben, en ranuras del tamaño máximo
+  // de bloque; en ellas se guardan también los símbolos de paridad de los grupos pendientes
+  buffer_pool inflate_pool;
+  std::vector<pool_buffer> inflated;
+
+  // Flujos que el núcleo ha repartido a este socket (se declaran después del pool, porque guardan ranuras suyas)
+  std::map<uint16_t, receive_stream> streams;
+
+  // Grupos (flujo y primer bloque) con paridad suficiente para reconstruirlos al terminar el lote, y si se puede leer del
+  // fichero lo ya escrito, que hace falta para ello (no se puede si, por ejemplo, es una tubería)
+  std::vector<std::pair<uint16_t, uint64_t>> fec_pending;
+  bool fec_enabled = true;
+
+  // Tramos del lote pendientes de escribir, y flujos que han enviado algo en el lote (con true si ha sido el FIN)
+  std::vector<write_run> runs;
+  std::map<uint16_t, bool> touched;
+
+  // Datagramas descartados por tener el CRC32C incorrecto o por no superar la autenticación (con cifrado), y si algún flujo
+  // no ha coincidido con el CRC32C del emisor
+  uint64_t corrupt_datagrams = 0;
+  uint64_t forged_datagrams = 0;
+  bool digest_mismatch = false;
+
+  // Buffer de recepción de los lotes (se prepara al empezar, en start()), si el núcleo agrega los datagramas con UDP_GRO,
+  // si ya se ha empezado, y el instante del último lote recibido
+  aligned_region buffer;
+  std::vector<iovec> slots;
+  std::vector<iovec> datagrams;
+  std::vector<sockaddr_storage> sources;
+  bool coalescing = false;
+  bool started = false;
+  uint64_t last_activity = 0;
+
+  std::vector<uint8_t> ack_packet;
+};
+
+#endif // RELIABLE_H
@@ -0,0 +1,103 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración del modo servidor: un receptor que no termina y atiende a la vez las transferencias de muchos emisores,
+ *         cada una en su propio fichero, repartidas entre varios hilos con su socket y su bucle de epoll
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "netcp.h"
+#include "reliable.h"
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+
+// Estructura con los límites del servidor que se obtienen de la línea de comandos.
+struct server_options {
+  // Número máximo de transferencias en curso a la vez; las que llegan de más se ignoran hasta que haya sitio
+  size_t max_sessions = 256;
+  // Tamaño máximo de cada transferencia en bytes (0 para no fijar ninguno); las que lo superan se abandonan
+  uint64_t max_session_size = 0;
+  // Número máximo de flujos de cada transferencia; las que indican más se rechazan
+  size_t max_streams = MAX_STREAMS;
+  // Memoria máxima, en bytes, del estado de recepción de los flujos de todas las transferencias en curso; las que no caben se
+  // ignoran hasta que haya sitio
+  uint64_t max_memory = 1000ULL * 1000 * 1000;
+};
+
+// Cada cuánto revisa cada hilo las transferencias inactivas, en milisegundos
+constexpr int SERVER_TICK = 100;
+
+// Clave de una transferencia: identificador de sesión y dirección IP del emisor (las IPv4, como IPv6 mapeadas). El puerto no
+// forma parte de ella, porque cada flujo llega desde el suyo
+using session_key = std::pair<uint32_t, std::array<uint8_t, 16>>;
+
+// Función que devuelve la clave de la transferencia de un datagrama.
+session_key make_session_key(uint32_t, const sockaddr_storage&);
+
+// Transferencia de un emisor: se identifica por la dirección IP del emisor y el identificador de sesión (cada flujo puede
+// llegar desde otro puerto, y a otro hilo), y se guarda en <directorio>/<IP>-<sesión> al completarse. Los caminos de un emisor
+// con varios que llegan desde otras direcciones solo se unen a ella si superan la autenticación (con --key)
+struct server_session {
+  // CONSTRUCTOR (ABRE EL FICHERO PROVISIONAL) Y DESTRUCTOR (LO GUARDA CON SU NOMBRE DEFINITIVO SI SE HA COMPLETADO, O LO BORRA)
+  server_session(const std::string& path, uint32_t session, uint16_t stream_count);
+  ~server_session();
+  server_session(const server_session&) = delete;
+  server_session& operator=(const server_session&) = delete;
+
+  // MÉTODO QUE INDICA SI TODOS LOS FLUJOS HAN TERMINADO
+  bool complete() const;
+
+  std::string path;
+  int fd = -1;
+  receive_state state;
+  // Instante del último datagrama, en microsegundos
+  std::atomic<uint64_t> last_activity;
+  // Se activa cuando la tabla deja de ofrecerla, para que los hilos suelten sus receptores
+  std::atomic<bool> retired{false};
+};
+
+class session_table {
+ public:
+  // CONSTRUCTOR
+  session_table(const std::string& directory, const server_options& options);
+
+  // MÉTODO QUE DEVUELVE LA TRANSFERENCIA DE UN DATAGRAMA, CREÁNDOLA SI ES UN BLOQUE DE UNA NUEVA, O UNIÉNDOLE UN CAMINO
+  // DESDE OTRA DIRECCIÓN SI EL BLOQUE ESTÁ AUTENTICADO (O nullptr SI NO SE ATIENDE). authenticate SOLO SE LLAMA SI EL
+  // BLOQUE VA A CREAR, UNIR O RECHAZAR ALGO
+  std::shared_ptr<server_session> find(const sockaddr_storage& source, const packet_header& header, const std::function<bool()>& authenticate);
+
+  // MÉTODO PARA RETIRAR LAS TRANSFERENCIAS TERMINADAS O ABANDONADAS POR SU EMISOR
+  void expire(uint64_t now);
+
+ private:
+  // Transferencia de la tabla: mientras está en curso, session la mantiene; al retirarla queda un rato sin ella, para no
+  // confundir con una nueva los datagramas atrasados de la que ya ha terminado. Los caminos unidos desde otra dirección
+  // tienen su propia entrada (joined), que apunta a la misma transferencia y no cuenta en los límites
+  struct table_entry {
+    std::shared_ptr<server_session> session;
+    uint64_t retired_at = 0;
+    bool joined = false;
+  };
+
+  std::string directory;
+  server_options options;
+  std::mutex mutex;
+  std::map<session_key, table_entry> sessions;
+  size_t active = 0;
+  // Memoria del estado de recepción de las transferencias en curso (RECEIVE_STREAM_MEMORY por flujo)
+  uint64_t memory = 0;
+};
+
+// Función que atiende transferencias en el puerto indicado hasta que se pide terminar, guardándolas en un directorio.
+std::error_code netcp_serve(const std::string&, const netcp_options&, const server_options&);
+
+#endif // SERVER_H
@@ -6,7 +6,7 @@
  *
  * @author Raúl González Acosta (alu0101543529@ull.edu.es)
  * @date   30/10/2023
- * @brief  Declaración de la clase Subprocess
+ * @brief  Declaración de la clase Subprocess y del conjunto de procesos subprocess_pool
 */
 
 #ifndef SUBPROCESS_H
@@ -14,6 +14,9 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
+#include <expected>
 #include <system_error>
 #include <unistd.h>
 #include <sys/types.h>
@@ -35,6 +38,10 @@ class subprocess {
   // DESTRUCTOR
   ~subprocess();
 
+  // El objeto es dueño de la tubería y del pidfd del hijo, así que no se puede copiar
+  subprocess(const subprocess&) = delete;
+  subprocess& operator=(const subprocess&) = delete;
+
   // MÉTODO PARA SABER SI EL PROCESO HIJO ESTÁ EN EJECUCUÓN
   bool is_alive();
 
@@ -44,26 +51,72 @@ class subprocess {
   // MÉTODO PARA ESPERAR A QUE EL PROCESO HIJO TERMINE
   std::error_code wait();
 
+  // MÉTODO PARA SABER CON QUÉ CÓDIGO HA TERMINADO EL PROCESO HIJO (128 + SEÑAL SI LO HA TERMINADO UNA SEÑAL)
+  int exit_code();
+
   // MÉTODO PARA ENVIAR LA SEÑAL SIGKILL AL PROCESO HIJO FORZANDO SU TERMINACIÓN
   std::error_code kill();
 
   // MÉTODO PARA SABER EL PID DEL PROCESO HIJO
   pid_t pid();
 
+  // MÉTODO PARA OBTENER EL DESCRIPTOR pidfd DEL PROCESO HIJO, QUE SE PUEDE VIGILAR CON poll()/epoll PARA SABER CUÁNDO TERMINA
+  int pid_fd();
+
   // MÉTODOS PARA DEVOLVER LOS DESCRIPTORES DE FICHERO I/O DEL PROCESO HIJO, DEPENDIENDO DE TU REDIRECCIÓN
   int stdin_fd();
   int stdout_fd();
   int stderr_fd();
 
  private:
-  // MÉTODO PARA CONFIGURAR EL ENTORNO DEL PROCESO HIJO
-  void setup_child_process();
-
   // Atributos que guardan los argumentos del comando a ejecutar, así como un indicador de cómo se manejará la entrada/salida estándar del proceso hijo, y el PID del proceso hijo
   std::vector<std::string> args;
   subprocess::stdio redirected_io;
   pid_t child_pid;
   int std_pipe[2];
+  int status = 0;
+  int child_pidfd = -1;
+};
+
+// Proceso de un subprocess_pool que ya ha terminado: identificador que le dio launch() y código con el que terminó
+struct finished_process {
+  size_t id;
+  int exit_code;
+};
+
+class subprocess_pool {
+ public:
+  // CONSTRUCTOR
+  subprocess_pool();
+  // DESTRUCTOR
+  ~subprocess_pool();
+
+  subprocess_pool(const subprocess_pool&) = delete;
+  subprocess_pool& operator=(const subprocess_pool&) = delete;
+
+  // MÉTODO PARA LANZAR UN COMANDO SIN ESPERAR A QUE TERMINE, DEVOLVIENDO SU IDENTIFICADOR DENTRO DEL CONJUNTO
+  std::expected<size_t, std::error_code> launch(const std::vector<std::string>& args, subprocess::stdio redirected_io);
+
+  // MÉTODO PARA ACCEDER A UN PROCESO QUE TODAVÍA NO SE HA RECOGIDO (POR EJEMPLO, PARA LEER SU SALIDA)
+  subprocess& process(size_t id);
+
+  // MÉTODO PARA RECOGER LOS PROCESOS QUE HAYAN TERMINADO, ESPERANDO COMO MUCHO timeout MILISEGUNDOS (-1 SIN LÍMITE) AL PRIMERO
+  // (SI FALLA CON ALGUNO, DEVUELVE LOS DEMÁS Y EL ERROR EN LA SIGUIENTE LLAMADA)
+  std::expected<std::vector<finished_process>, std::error_code> reap(int timeout);
+
+  // MÉTODO PARA ESPERAR A QUE TERMINEN TODOS LOS PROCESOS LANZADOS
+  std::expected<std::vector<finished_process>, std::error_code> wait_all();
+
+  // MÉTODO PARA SABER CUÁNTOS PROCESOS LANZADOS NO SE HAN RECOGIDO TODAVÍA
+  size_t running() const;
+
+ private:
+  // Descriptor de epoll en el que se vigilan los pidfd de los procesos en ejecución, y procesos por identificador
+  int epoll_fd;
+  std::map<size_t, std::unique_ptr<subprocess>> processes;
+  size_t next_id = 0;
+  // Error al recoger algún proceso, que se devuelve en la siguiente llamada para no perder los que sí se recogieron con él
+  std::error_code pending_error;
 };
 
 #endif // SUBPROCESS_H
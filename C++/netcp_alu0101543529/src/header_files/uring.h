@@ -0,0 +1,76 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Declaración de la clase io_uring_queue, que envuelve las llamadas al sistema de io_uring
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include "netcp.h"
+#include <linux/io_uring.h>
+
+class io_uring_queue {
+ public:
+  // CONSTRUCTOR Y DESTRUCTOR (LA COLA NO SE PUEDE COPIAR: ES DUEÑA DEL DESCRIPTOR Y DE LAS PROYECCIONES DE LOS ANILLOS)
+  io_uring_queue() = default;
+  ~io_uring_queue();
+  io_uring_queue(const io_uring_queue&) = delete;
+  io_uring_queue& operator=(const io_uring_queue&) = delete;
+
+  // MÉTODO PARA CREAR LA COLA, CON entries PETICIONES Y completions COMPLETADAS COMO MÁXIMO
+  std::error_code setup(unsigned entries, unsigned completions);
+  bool active() const;
+
+  // MÉTODOS PARA REGISTRAR EN EL NÚCLEO LOS BUFFERS Y LOS DESCRIPTORES QUE USARÁN LAS PETICIONES
+  std::error_code register_buffers(const std::vector<iovec>& buffers);
+  std::error_code register_files(const std::vector<int>& files);
+
+  // MÉTODOS PARA PREPARAR PETICIONES SOBRE UN DESCRIPTOR REGISTRADO (SE ENVÍAN AL NÚCLEO CON submit())
+  std::error_code prepare_read_fixed(unsigned file_index, void* buffer, unsigned length, uint64_t offset, uint16_t buffer_index,
+                                     uint64_t user_data);
+  std::error_code prepare_sendmsg(unsigned file_index, const msghdr* message, uint64_t user_data);
+
+  // MÉTODO PARA ENVIAR LAS PETICIONES PREPARADAS Y ESPERAR A QUE HAYA wait_count COMPLETADAS
+  std::error_code submit(unsigned wait_count);
+
+  // MÉTODO PARA SACAR UNA PETICIÓN COMPLETADA DEL ANILLO (DEVUELVE false SI NO HAY NINGUNA)
+  bool pop_completion(io_uring_cqe& completion);
+
+ private:
+  // MÉTODO QUE DEVUELVE UNA ENTRADA LIBRE DEL ANILLO DE PETICIONES, ENVIANDO LAS PREPARADAS SI ESTÁ LLENO
+  std::expected<io_uring_sqe*, std::error_code> next_entry();
+
+  int ring_fd = -1;
+
+  // Proyecciones de los anillos de peticiones y de completadas, y del vector de peticiones
+  void* sq_mapping = nullptr;
+  size_t sq_mapping_size = 0;
+  void* cq_mapping = nullptr;
+  size_t cq_mapping_size = 0;
+  io_uring_sqe* entries = nullptr;
+  size_t entries_size = 0;
+
+  // Campos del anillo de peticiones: las posiciones head y tail las comparten el núcleo y el proceso
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned sq_mask = 0;
+  unsigned sq_entries = 0;
+
+  // Campos del anillo de completadas
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  io_uring_cqe* cqes = nullptr;
+  unsigned cq_mask = 0;
+
+  // Peticiones preparadas que todavía no se han enviado al núcleo
+  unsigned pending = 0;
+};
+
+#endif // URING_H
@@ -0,0 +1,225 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del registro de mensajes asíncrono
+ */
+
+#include "header_files/logger.h"
+#include <array>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <sys/uio.h>
+#include <unistd.h>
+
+std::atomic<int> log_threshold{static_cast<int>(log_level::info)};
+
+// Posición del anillo. sequence indica de quién es: si vale p, el emisor que reserve la posición p puede escribir en ella; si
+// vale p + 1, el mensaje p está listo para el hilo de fondo, que al sacarlo la deja en p + LOG_RING_SIZE para la siguiente vuelta
+struct log_slot {
+  std::atomic<size_t> sequence;
+  log_level level;
+  size_t length;
+  char text[LOG_MESSAGE_SIZE];
+};
+
+// Registro de mensajes: anillo acotado con varios emisores y un solo lector (el hilo de fondo)
+class logger {
+ public:
+  // CONSTRUCTOR Y DESTRUCTOR
+  logger();
+  ~logger();
+
+  // MÉTODO PARA DEJAR UN MENSAJE EN EL ANILLO (SI ESTÁ LLENO, LOS ERRORES Y AVISOS SE ESCRIBEN DIRECTAMENTE Y EL RESTO SE
+  // DESCARTA: LOS EMISORES NUNCA ESPERAN AL HILO DE FONDO)
+  void push(log_level level, const char* text, size_t length);
+
+  // MÉTODO PARA ESPERAR A QUE SE HAYAN ESCRITO LOS MENSAJES EMITIDOS HASTA AHORA
+  void flush();
+
+ private:
+  // MÉTODO DEL HILO DE FONDO, QUE SACA LOS MENSAJES DEL ANILLO Y LOS ESCRIBE
+  void run();
+
+  std::array<log_slot, LOG_RING_SIZE> ring;
+  std::atomic<size_t> tail{0};
+  size_t head = 0;
+  // Mensajes emitidos y escritos: el hilo de fondo espera a que cambie pushed, y flush() a que cambie written (que sigue a head:
+  // cuenta las posiciones ya sacadas del anillo y escritas)
+  std::atomic<uint64_t> pushed{0};
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<bool> stopping{false};
+  std::thread worker;
+};
+
+/**
+ * @brief Función que devuelve el registro de mensajes, creándolo (con su hilo de fondo) la primera vez. Se destruye al terminar
+ *        el programa, también con exit(), después de escribir los mensajes pendientes.
+ */
+static logger& instance() {
+  static logger log;
+  return log;
+}
+
+/**
+ * @brief Constructor de logger: prepara las posiciones del anillo y arranca el hilo de fondo.
+ */
+logger::logger() {
+  for (size_t i = 0; i < LOG_RING_SIZE; ++i) { ring[i].sequence.store(i, std::memory_order_relaxed); }
+  worker = std::thread(&logger::run, this);
+}
+
+/**
+ * @brief Destructor de logger: el hilo de fondo escribe los mensajes que queden y termina.
+ */
+logger::~logger() {
+  stopping = true;
+  pushed.fetch_add(1);
+  pushed.notify_one();
+  // Si el programa termina desde el propio hilo de fondo (por ejemplo, con una señal), no puede esperarse a sí mismo
+  if (worker.get_id() == std::this_thread::get_id()) {
+    worker.detach();
+  } else if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+/**
+ * @brief Método que deja un mensaje en el anillo. Cada emisor reserva una posición con una comparación e intercambio sobre
+ *        tail, copia el mensaje y la marca como lista. Si el hilo de fondo va tan retrasado que el anillo está lleno, los
+ *        mensajes informativos y de depuración se descartan y se cuentan, pero los errores y avisos no se pierden: el emisor
+ *        los escribe él mismo por la salida de error (con una sola llamada, así que no se mezclan con otras líneas, aunque
+ *        pueden adelantarse a los que siguen en el anillo).
+ * @param[in] level: nivel del mensaje.
+ * @param[in] text: texto del mensaje, sin el salto de línea final.
+ * @param[in] length: longitud del texto (como mucho LOG_MESSAGE_SIZE).
+ */
+void logger::push(log_level level, const char* text, size_t length) {
+  size_t position = tail.load(std::memory_order_relaxed);
+  log_slot* slot;
+  while (true) {
+    slot = &ring[position % LOG_RING_SIZE];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) { break; }
+    } else if (sequence < position) {
+      if (level <= log_level::warning) {
+        iovec line[2] = {{const_cast<char*>(text), length}, {const_cast<char*>("\n"), 1}};
+        [[maybe_unused]] ssize_t result = writev(STDERR_FILENO, line, 2);
+      } else {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      return;
+    } else {
+      position = tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->level = level;
+  slot->length = length;
+  std::memcpy(slot->text, text, length);
+  slot->sequence.store(position + 1, std::memory_order_release);
+  pushed.fetch_add(1, std::memory_order_release);
+  pushed.notify_one();
+}
+
+/**
+ * @brief Método del hilo de fondo: espera a que haya mensajes, los saca del anillo en orden y escribe juntos los de cada
+ *        salida (errores y avisos por la de error, el resto por la estándar) con una sola llamada a write() por salida.
+ */
+void logger::run() {
+  std::string out, err;
+  while (true) {
+    uint64_t seen = pushed.load(std::memory_order_acquire);
+    uint64_t taken = 0;
+    out.clear();
+    err.clear();
+    while (true) {
+      log_slot& slot = ring[head % LOG_RING_SIZE];
+      if (slot.sequence.load(std::memory_order_acquire) != head + 1) { break; }
+      std::string& output = (slot.level <= log_level::warning) ? err : out;
+      output.append(slot.text, slot.length);
+      output.push_back('\n');
+      slot.sequence.store(head + LOG_RING_SIZE, std::memory_order_release);
+      ++head;
+      ++taken;
+    }
+
+    for (auto [fd, text] : {std::pair<int, std::string*>{STDOUT_FILENO, &out}, {STDERR_FILENO, &err}}) {
+      for (size_t offset = 0; offset < text->size();) {
+        ssize_t result = write(fd, text->data() + offset, text->size() - offset);
+        if (result <= 0) { break; }
+        offset += static_cast<size_t>(result);
+      }
+    }
+    if (taken > 0) {
+      written.fetch_add(taken, std::memory_order_release);
+      written.notify_all();
+      continue;
+    }
+
+    if (stopping) { break; }
+    pushed.wait(seen, std::memory_order_acquire);
+  }
+
+  if (uint64_t lost = dropped.load(); lost > 0) {
+    std::string notice = "Aviso: Se han descartado " + std::to_string(lost) + " mensajes informativos o de depuración del registro.\n";
+    [[maybe_unused]] ssize_t result = write(STDERR_FILENO, notice.data(), notice.size());
+  }
+}
+
+/**
+ * @brief Método que espera a que el hilo de fondo haya escrito todos los mensajes que se habían dejado en el anillo: las
+ *        posiciones reservadas hasta la llamada, que son las de tail. Los mensajes descartados no reservan posición (no
+ *        avanzan tail), así que no se descuentan.
+ */
+void logger::flush() {
+  uint64_t target = tail.load(std::memory_order_acquire);
+  for (uint64_t current = written.load(std::memory_order_acquire); current < target; current = written.load(std::memory_order_acquire)) {
+    written.wait(current, std::memory_order_acquire);
+  }
+}
+
+/**
+ * @brief Función que cambia el nivel de los mensajes que se muestran.
+ * @param[in] level: nivel máximo de los mensajes que se muestran.
+ */
+void set_log_level(log_level level) { log_threshold.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+/**
+ * @brief Función que espera a que se hayan escrito todos los mensajes emitidos hasta ahora, por ejemplo antes de escribir
+ *        directamente en la salida estándar.
+ */
+void log_flush() { instance().flush(); }
+
+/**
+ * @brief Constructor de fixed_buffer: el texto se escribe en el array del propio objeto.
+ */
+fixed_buffer::fixed_buffer() { setp(text, text + LOG_MESSAGE_SIZE); }
+
+/**
+ * @brief Métodos que devuelven el texto formateado y su longitud.
+ */
+const char* fixed_buffer::data() const { return pbase(); }
+
+size_t fixed_buffer::size() const { return static_cast<size_t>(pptr() - pbase()); }
+
+/**
+ * @brief Constructor de log_message: si el nivel del mensaje no se muestra, no se formatea nada.
+ * @param[in] level: nivel del mensaje.
+ */
+log_message::log_message(log_level level)
+    : level(level), enabled(static_cast<int>(level) <= log_threshold.load(std::memory_order_relaxed)), stream(&buffer) {}
+
+/**
+ * @brief Destructor de log_message: deja el mensaje formateado en el anillo.
+ */
+log_message::~log_message() {
+  if (enabled) { instance().push(level, buffer.data(), buffer.size()); }
+}
@@ -11,6 +11,12 @@
 
 #include "header_files/netcp.h"
 #include "header_files/subprocess.h"
+#include "header_files/proxy.h"
+#include "header_files/server.h"
+#include "header_files/fanout.h"
+#include "header_files/metrics.h"
+#include "header_files/fec.h"
+#include <climits>
 
 int main(int argc, char *argv[]) {
   // "Inicializamos" el manejo de señales, en caso de que recibiese alguna se invocaría a la función
@@ -18,12 +24,22 @@ int main(int argc, char *argv[]) {
 
   // Comprobamos si se especifican los argumentos necesarios para el correcto funcionamiento del programa
   if (argc <= 1) {
-    std::cerr << "Error: Faltan argumentos, use la opción -h para ver una descripción de su funcionamiento." << std::endl; 
+    log_error() << "Error: Faltan argumentos, use la opción -h para ver una descripción de su funcionamiento."; 
     return EXIT_FAILURE;
   }
 
   std::vector<std::string_view> args(argv + 1, argv + argc);
   std::string output_filename;
+  netcp_options options;
+  proxy_options proxy;
+  server_options server;
+  uint16_t proxy_port = 0;
+  std::optional<sockaddr_storage> proxy_target;
+  std::vector<std::string> command;
+  subprocess::stdio redirected_io = subprocess::stdio::out;
+  // Modo de funcionamiento escogido en la línea de comandos: 'o' para enviar, 'l' para recibir, 'p' para hacer de proxy,
+  // 'c' para enviar la salida de un comando, 's' para atender transferencias sin terminar
+  char mode = 0;
 
   // Analizamos la línea de comandos
   for (auto it = args.begin(), end = args.end(); it != end; ++it) {
@@ -33,16 +49,223 @@ int main(int argc, char *argv[]) {
       return EXIT_SUCCESS;
     }
 
+    // Opción -b | --batch: Para especificar cuántos datagramas se envían o reciben en cada llamada al sistema
+    if (*it == "-b" || *it == "--batch") {
+      if (++it == end) {
+        log_error() << "Error: Falta el tamaño del lote, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      int batch_size = std::atoi(std::string(*it).c_str());
+      // El lote no puede superar el máximo de iovec que admiten readv()/writev() ni de mensajes de sendmmsg()/recvmmsg()
+      if (batch_size < 1 || batch_size > IOV_MAX) {
+        log_error() << "Error: El tamaño del lote debe estar entre 1 y " << IOV_MAX << "."; 
+        return EXIT_FAILURE;
+      }
+      options.batch_size = static_cast<size_t>(batch_size);
+    }
+
+    // Opción --chunk-size N: Para fijar el tamaño de los bloques de cada datagrama en lugar de elegirlo según la MTU del camino
+    if (*it == "--chunk-size") {
+      std::optional<uint64_t> chunk_size = (++it != end) ? parse_size(*it) : std::nullopt;
+      if (!chunk_size || *chunk_size < MIN_CHUNK_SIZE || *chunk_size > MAX_CHUNK_SIZE) {
+        log_error() << "Error: El tamaño de bloque debe estar entre " << MIN_CHUNK_SIZE << " y " << MAX_CHUNK_SIZE << " bytes.";
+        return EXIT_FAILURE;
+      }
+      options.chunk_size = static_cast<size_t>(*chunk_size);
+    }
+
+    // Opción --fec K,M: Para enviar M bloques de paridad por cada grupo de K bloques de datos (corrección de errores)
+    if (*it == "--fec") {
+      std::string groups = (++it != end) ? std::string(*it) : std::string();
+      size_t comma = groups.find(',');
+      int data_count = (comma != std::string::npos) ? std::atoi(groups.substr(0, comma).c_str()) : 0;
+      int parity_count = (comma != std::string::npos) ? std::atoi(groups.substr(comma + 1).c_str()) : 0;
+      if (data_count < 1 || static_cast<size_t>(data_count) > FEC_MAX_DATA || parity_count < 1 ||
+          static_cast<size_t>(parity_count) > FEC_MAX_PARITY) {
+        log_error() << "Error: La corrección de errores se indica como K,M, con K entre 1 y " << FEC_MAX_DATA << " bloques de datos y M entre 1 y "
+                    << FEC_MAX_PARITY << " de paridad.";
+        return EXIT_FAILURE;
+      }
+      options.fec_data = static_cast<size_t>(data_count);
+      options.fec_parity = static_cast<size_t>(parity_count);
+    }
+
+    // Opción --path LOCAL[,DESTINO]: Para añadir un camino por el que el emisor reparte los bloques, desde una dirección local
+    // (de la interfaz por la que deben salir) hasta el receptor (NETCP_IP y NETCP_PORT si no se indica, o IP:PUERTO)
+    if (*it == "--path") {
+      if (++it == end) {
+        log_error() << "Error: Falta la dirección local del camino, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      std::string addresses(*it);
+      size_t comma = addresses.find(',');
+      auto local = make_ip_address(addresses.substr(0, comma), 0);
+      auto remote = (comma != std::string::npos) ? make_ip_address(addresses.substr(comma + 1), 0) : std::make_optional(sockaddr_storage{});
+      if (!local || !remote) { return EXIT_FAILURE; }
+      options.paths.push_back({*local, *remote});
+    }
+
+    // Opción --to IP[:PUERTO]: Para añadir un receptor al que se envía el fichero de -o; con varios, se envía a todos a la vez
+    if (*it == "--to") {
+      auto receiver = (++it != end) ? make_ip_address(std::string(*it), 0) : std::nullopt;
+      if (!receiver) {
+        log_error() << "Error: Falta la dirección del receptor o es incorrecta, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      options.receivers.push_back(*receiver);
+    }
+
+    // Opción -m | --mmap: Para enviar el fichero proyectándolo en memoria en lugar de copiarlo a un buffer intermedio
+    if (*it == "-m" || *it == "--mmap") { options.use_mmap = true; }
+
+    // Opción -j N: Para repartir la transferencia en N flujos, cada uno con su socket y su hilo
+    if (*it == "-j") {
+      int streams = (++it != end) ? std::atoi(std::string(*it).c_str()) : 0;
+      if (streams < 1 || static_cast<size_t>(streams) > MAX_STREAMS) {
+        log_error() << "Error: El número de flujos debe estar entre 1 y 256."; 
+        return EXIT_FAILURE;
+      }
+      options.streams = static_cast<size_t>(streams);
+    }
+
+    // Opción -r | --rate VELOCIDAD: Para limitar la tasa de envío, en bytes por segundo
+    if (*it == "-r" || *it == "--rate") {
+      std::optional<uint64_t> rate = (++it != end) ? parse_size(*it) : std::nullopt;
+      if (!rate || *rate == 0) {
+        log_error() << "Error: Falta la tasa de envío o es incorrecta, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      options.pacing_rate = static_cast<double>(*rate);
+    }
+
+    // Opción --cc ALGORITMO: Para escoger el control de congestión del emisor
+    if (*it == "--cc") {
+      if (++it != end && *it == "aimd") { options.congestion = congestion_mode::aimd; }
+      else if (it != end && *it == "delay") { options.congestion = congestion_mode::delay; }
+      else if (it != end && *it == "none") { options.congestion = congestion_mode::none; }
+      else {
+        log_error() << "Error: El control de congestión debe ser aimd, delay o none."; 
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Opción --kernel-pacing: Para que sea el núcleo quien reparta los envíos en el tiempo
+    if (*it == "--kernel-pacing") { options.kernel_pacing = true; }
+
+    // Opción --io-uring: Para leer el fichero y enviar los datagramas con io_uring en lugar de con llamadas bloqueantes
+    if (*it == "--io-uring") { options.use_io_uring = true; }
+
+    // Opción -z | --compress: Para comprimir los bloques del fichero antes de enviarlos
+    if (*it == "-z" || *it == "--compress") { options.compress = true; }
+
+    // Opción --key FICHERO: Para cifrar y autenticar los datagramas con la clave compartida del fichero
+    if (*it == "--key") {
+      if (++it == end) {
+        log_error() << "Error: Falta el fichero de la clave, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      auto secret = load_secret(std::string(*it));
+      if (!secret) { return EXIT_FAILURE; }
+      options.secret = *secret;
+    }
+
+    // Opción --cipher ALGORITMO: Para escoger el algoritmo con el que cifra el emisor
+    if (*it == "--cipher") {
+      if (++it != end && *it == "aes-gcm") { options.cipher = aead_algorithm::aes_256_gcm; }
+      else if (it != end && *it == "chacha20") { options.cipher = aead_algorithm::chacha20_poly1305; }
+      else {
+        log_error() << "Error: El algoritmo de cifrado debe ser aes-gcm o chacha20."; 
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Opción -d | --delta: Para enviar solo las diferencias con la copia del fichero que ya tiene el receptor
+    if (*it == "-d" || *it == "--delta") { options.delta = true; }
+
+    // Opción -R | --recursive: Para enviar o recibir un directorio entero en lugar de un fichero
+    if (*it == "-R" || *it == "--recursive") { options.recursive = true; }
+
+    // Opción --no-offload: Para enviar y recibir los datagramas de uno en uno, sin UDP_SEGMENT ni UDP_GRO
+    if (*it == "--no-offload") { options.udp_offload = false; }
+
+    // Opción --progress: Para mostrar cada segundo lo transferido y la velocidad
+    if (*it == "--progress") { options.progress = true; }
+
+    // Opciones -q | --quiet y -v | --verbose: Para mostrar solo los errores, o también cada paso que da el programa
+    if (*it == "-q" || *it == "--quiet") { set_log_level(log_level::error); }
+    if (*it == "-v" || *it == "--verbose") { set_log_level(log_level::debug); }
+
+    // Opciones --stats FICHERO y --stats-socket RUTA: Para escribir al terminar el resumen JSON de las métricas ("-" para la
+    // salida estándar), o para atender peticiones de las métricas en un socket UNIX durante la transferencia
+    if (*it == "--stats" || *it == "--stats-socket") {
+      bool socket_path = (*it == "--stats-socket");
+      if (++it == end) {
+        log_error() << "Error: Falta la ruta de las métricas, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      (socket_path ? options.stats_socket : options.stats_path) = *it;
+    }
+
+    // Opción --proxy PUERTO DESTINO: Para reenviar los datagramas de un puerto local al destino (IP:PUERTO), alterándolos
+    if (*it == "--proxy") {
+      if (++it == end || std::next(it) == end) {
+        log_error() << "Error: Faltan el puerto y el destino del proxy, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      proxy_port = static_cast<uint16_t>(std::atoi(std::string(*it).c_str()));
+      proxy_target = make_ip_address(std::string(*++it), 0);
+      if (!proxy_target) { return EXIT_FAILURE; }
+      mode = 'p';
+    }
+
+    // Opción --loss P: Para especificar la probabilidad (entre 0 y 1) con la que el proxy descarta cada datagrama
+    if (*it == "--loss") {
+      if (++it == end) {
+        log_error() << "Error: Falta la probabilidad de pérdida, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      proxy.loss = std::atof(std::string(*it).c_str());
+      if (proxy.loss < 0.0 || proxy.loss > 1.0) {
+        log_error() << "Error: La probabilidad de pérdida debe estar entre 0 y 1."; 
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Opciones --reorder P y --duplicate P: Para especificar la probabilidad con la que el proxy desordena o duplica cada datagrama
+    if (*it == "--reorder" || *it == "--duplicate") {
+      bool reorder = (*it == "--reorder");
+      if (++it == end) {
+        log_error() << "Error: Falta la probabilidad, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      double probability = std::atof(std::string(*it).c_str());
+      if (probability < 0.0 || probability > 1.0) {
+        log_error() << "Error: La probabilidad de desordenar o duplicar debe estar entre 0 y 1."; 
+        return EXIT_FAILURE;
+      }
+      (reorder ? proxy.reorder : proxy.duplicate) = probability;
+    }
+
+    // Opción --delay MS: Para especificar el retardo (en milisegundos) que el proxy añade a cada datagrama
+    if (*it == "--delay") {
+      double delay = (++it != end) ? std::atof(std::string(*it).c_str()) : -1.0;
+      if (delay < 0.0) {
+        log_error() << "Error: Falta el retardo del proxy o es negativo."; 
+        return EXIT_FAILURE;
+      }
+      proxy.delay = static_cast<uint64_t>(delay * 1000);
+    }
+
     // Opción -o | --output: Para especificar un fichero que se leera y se enviara su contenido por la red
     if (*it == "-o" || *it == "--output") {
       if (++it != end) {
         output_filename = *it;
-        std::cout << "El archivo escogido para el envío de datos es " << output_filename << std::endl;
-        netcp_send_file(output_filename);
+        mode = 'o';
+        log_info() << "El archivo escogido para el envío de datos es " << output_filename;
       }
       // Si no se ha especificado un archivo despues de la opción -o, mostraremos un mensaje de error y saldremos con código de error != 0
       else { 
-        std::cerr << "Error: Falta un fichero, por favor introduzca la opción -h para ver una descripción de su funcionamiento." << std::endl; 
+        log_error() << "Error: Falta un fichero, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
         return EXIT_FAILURE;
       }
     }
@@ -51,30 +274,76 @@ int main(int argc, char *argv[]) {
     if (*it == "-l") {
       if (++it != end) {
         output_filename = *it;
-        std::cout << "El archivo escogido para la recepción de datos es " << output_filename << std::endl;
-        netcp_receive_file(output_filename);
+        mode = 'l';
+        log_info() << "El archivo escogido para la recepción de datos es " << output_filename;
       }
       // Si no se ha especificado un archivo despues de la opción -l, mostraremos un mensaje de error y saldremos con código de error != 0
       else { 
-        std::cerr << "Error: Falta un fichero, por favor introduzca la opción -h para ver una descripción de su funcionamiento." << std::endl; 
+        log_error() << "Error: Falta un fichero, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
         return EXIT_FAILURE;
       }
     }
 
-    // Opción -c: Para especificar un comando que se va a envíar la salida estándar/error por la red
-    if (*it == "-c") {
-      std::vector<std::string> command = {"ls", "-l"};
-      subprocess myProcess(command, subprocess::stdio::out);
+    // Opción --serve DIRECTORIO: Para atender sin terminar las transferencias de cualquier número de emisores, guardando cada
+    // una en su propio fichero del directorio
+    if (*it == "--serve") {
+      if (++it == end) {
+        log_error() << "Error: Falta el directorio, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      output_filename = *it;
+      mode = 's';
+    }
 
-      if (myProcess.exec() == std::error_code(0, std::system_category())) {
-        // Proceso iniciado con éxito
-        std::cout << "Proceso iniciado con PID: " << myProcess.pid() << std::endl;
-      } else {
-        // Error al iniciar el proceso
-        std::cerr << "Error al iniciar el proceso." << std::endl;
+    // Opciones --max-sessions N, --max-size TAMAÑO, --max-streams N y --max-memory TAMAÑO: Para limitar las transferencias en
+    // curso del servidor, su tamaño, sus flujos y la memoria que ocupan
+    if (*it == "--max-sessions" || *it == "--max-size" || *it == "--max-streams" || *it == "--max-memory") {
+      std::string_view option = *it;
+      std::optional<uint64_t> limit = (++it != end) ? parse_size(*it) : std::nullopt;
+      if (!limit || (option != "--max-size" && *limit == 0) || (option == "--max-streams" && *limit > MAX_STREAMS)) {
+        log_error() << "Error: Falta el límite del servidor o es incorrecto, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      if (option == "--max-sessions") { server.max_sessions = *limit; }
+      else if (option == "--max-size") { server.max_session_size = *limit; }
+      else if (option == "--max-streams") { server.max_streams = *limit; }
+      else { server.max_memory = *limit; }
+    }
+
+    // Opción --stdio out|err|outerr: Para escoger qué salida del comando de -c se envía (por defecto, la estándar)
+    if (*it == "--stdio") {
+      if (++it != end && *it == "out") { redirected_io = subprocess::stdio::out; }
+      else if (it != end && *it == "err") { redirected_io = subprocess::stdio::err; }
+      else if (it != end && *it == "outerr") { redirected_io = subprocess::stdio::outerr; }
+      else {
+        log_error() << "Error: La salida del comando debe ser out, err u outerr."; 
+        return EXIT_FAILURE;
       }
     }
+
+    // Opción -c COMANDO ARGUMENTOS...: Para ejecutar un comando y enviar su salida estándar/error por la red. Todo lo que
+    // sigue a -c son el comando y sus argumentos
+    if (*it == "-c") {
+      if (std::next(it) == end) {
+        log_error() << "Error: Falta el comando, por favor introduzca la opción -h para ver una descripción de su funcionamiento."; 
+        return EXIT_FAILURE;
+      }
+      command.assign(std::next(it), end);
+      mode = 'c';
+      break;
+    }
   }
 
+  // Una vez analizadas todas las opciones, realizamos el envío o la recepción del fichero, recogiendo sus métricas (el
+  // resumen se escribe también si la transferencia falla, para poder ver dónde se ha quedado)
+  metrics_reporter reporter(options);
+  std::error_code error(0, std::system_category());
+  if (mode == 'o') { error = options.receivers.empty() ? netcp_send_file(output_filename, options) : netcp_send_fanout(output_filename, options); }
+  if (mode == 'c') { error = netcp_send_command(command, redirected_io, options); }
+  if (mode == 's') { error = netcp_serve(output_filename, options, server); }
+  if (mode == 'l') { error = netcp_receive_file(output_filename, options); }
+  if (mode == 'p') { error = netcp_proxy(proxy_port, *proxy_target, proxy); }
+  if (reporter.finish(!error) || error) { return EXIT_FAILURE; }
+
   return EXIT_SUCCESS;
 }
\ No newline at end of file
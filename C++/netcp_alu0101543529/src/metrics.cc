@@ -0,0 +1,193 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de las métricas de la transferencia y de la clase metrics_reporter
+ */
+
+#include "header_files/metrics.h"
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <poll.h>
+#include <sys/un.h>
+
+// Métricas de todos los hilos que han participado en la transferencia. Es una deque para que las de cada hilo no cambien de
+// sitio al registrar las de otro; siguen ahí cuando el hilo termina, así que el resumen final incluye a todos
+static std::mutex metrics_mutex;
+static std::deque<metrics_block> metrics_blocks;
+
+// Cada cuánto se muestra el progreso, en milisegundos
+constexpr int PROGRESS_INTERVAL = 1000;
+
+/**
+ * @brief Función que registra las métricas de un hilo nuevo.
+ * @return Devuelve las métricas del hilo, que se mantienen hasta que termina el programa.
+ */
+metrics_block& register_metrics_block() {
+  std::lock_guard<std::mutex> lock(metrics_mutex);
+  return metrics_blocks.emplace_back();
+}
+
+/**
+ * @brief Función que suma las métricas de todos los hilos. Se puede llamar mientras los hilos las actualizan: cada contador se
+ *        lee entero, aunque la suma puede mezclar valores de instantes ligeramente distintos.
+ * @return Devuelve la suma de las métricas.
+ */
+metrics_snapshot collect_metrics() {
+  metrics_snapshot snapshot;
+  std::lock_guard<std::mutex> lock(metrics_mutex);
+  for (const metrics_block& block : metrics_blocks) {
+    for (size_t i = 0; i < METRIC_COUNT; ++i) { snapshot.counters[i] += block.counters[i].load(std::memory_order_relaxed); }
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) { snapshot.latency[i] += block.latency[i].load(std::memory_order_relaxed); }
+  }
+  return snapshot;
+}
+
+/**
+ * @brief Función que estima un percentil de la latencia de los bloques a partir del histograma.
+ * @param[in] latency: histograma de latencias.
+ * @param[in] fraction: percentil, entre 0 y 1.
+ * @return Devuelve el límite superior (en µs) del intervalo en el que cae el percentil, o 0 si el histograma está vacío.
+ */
+static uint64_t latency_percentile(const std::array<uint64_t, LATENCY_BUCKETS>& latency, double fraction) {
+  uint64_t total = 0;
+  for (uint64_t count : latency) { total += count; }
+  if (total == 0) { return 0; }
+  uint64_t accumulated = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+    accumulated += latency[i];
+    if (accumulated >= fraction * total) { return uint64_t{1} << i; }
+  }
+  return uint64_t{1} << (LATENCY_BUCKETS - 1);
+}
+
+/**
+ * @brief Constructor de metrics_reporter: si se ha pedido el progreso o el socket UNIX, crea el socket y el hilo que los atiende.
+ * @param[in] options: opciones de la transferencia (progress, stats_path y stats_socket).
+ */
+metrics_reporter::metrics_reporter(const netcp_options& options) : options(options), start(std::chrono::steady_clock::now()) {
+  if (!options.stats_socket.empty()) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (options.stats_socket.size() >= sizeof(address.sun_path)) {
+      log_warning() << "Aviso: La ruta del socket de métricas es demasiado larga, no se atenderá.";
+    } else {
+      std::memcpy(address.sun_path, options.stats_socket.c_str(), options.stats_socket.size() + 1);
+      unlink(address.sun_path);
+      listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, 8) < 0) {
+        log_warning() << "Aviso: No se ha podido crear el socket de métricas " << options.stats_socket << ".";
+        if (listen_fd >= 0) { close(listen_fd); }
+        listen_fd = -1;
+      }
+    }
+  }
+  if (options.progress || listen_fd >= 0) { worker = std::thread(&metrics_reporter::run, this); }
+}
+
+/**
+ * @brief Destructor de metrics_reporter: detiene el hilo si finish() no lo ha hecho.
+ */
+metrics_reporter::~metrics_reporter() {
+  stopping = true;
+  if (worker.joinable()) { worker.join(); }
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(options.stats_socket.c_str());
+  }
+}
+
+/**
+ * @brief Método del hilo que cada PROGRESS_INTERVAL muestra lo transferido y la velocidad desde la muestra anterior, y que
+ *        responde a cada conexión al socket UNIX con las métricas actuales en JSON.
+ */
+void metrics_reporter::run() {
+  pollfd descriptor = {listen_fd, POLLIN, 0};
+  auto next_progress = std::chrono::steady_clock::now() + std::chrono::milliseconds(PROGRESS_INTERVAL);
+  uint64_t previous_bytes = 0;
+  while (!stopping) {
+    // Esperamos poco cada vez para terminar enseguida cuando nos lo pidan
+    if (poll(&descriptor, listen_fd >= 0 ? 1 : 0, 100) > 0 && (descriptor.revents & POLLIN)) {
+      int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client >= 0) {
+        std::string json = to_json(true, false);
+        // El cliente puede cerrar antes de leerlo todo; no queremos que eso nos mate con SIGPIPE
+        send(client, json.data(), json.size(), MSG_NOSIGNAL);
+        close(client);
+      }
+    }
+
+    if (options.progress && std::chrono::steady_clock::now() >= next_progress) {
+      next_progress += std::chrono::milliseconds(PROGRESS_INTERVAL);
+      metrics_snapshot snapshot = collect_metrics();
+      uint64_t sent = snapshot.counters[static_cast<size_t>(metric::bytes_sent)];
+      uint64_t received = snapshot.counters[static_cast<size_t>(metric::bytes_received)];
+      uint64_t bytes = std::max(sent, received);
+      log_info() << "Progreso: " << std::fixed << std::setprecision(1) << bytes / 1e6 << " MB " << (sent >= received ? "enviados" : "recibidos")
+                 << " (" << (bytes - previous_bytes) / (PROGRESS_INTERVAL * 1e3) << " MB/s), "
+                 << snapshot.counters[static_cast<size_t>(metric::retransmits)] << " reenvíos";
+      previous_bytes = bytes;
+    }
+  }
+}
+
+/**
+ * @brief Método que devuelve las métricas actuales en JSON: contadores, histograma de latencia de los bloques y sus percentiles.
+ * @param[in] running: si la transferencia sigue en curso.
+ * @param[in] succeeded: si la transferencia ha terminado bien (solo tiene sentido si running es false).
+ * @return Devuelve el objeto JSON, en una línea.
+ */
+std::string metrics_reporter::to_json(bool running, bool succeeded) const {
+  metrics_snapshot snapshot = collect_metrics();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::ostringstream json;
+  json << "{\"running\":" << (running ? "true" : "false");
+  if (!running) { json << ",\"ok\":" << (succeeded ? "true" : "false"); }
+  json << ",\"elapsed_seconds\":" << std::fixed << std::setprecision(6) << elapsed.count();
+  for (size_t i = 0; i < METRIC_COUNT; ++i) { json << ",\"" << METRIC_NAMES[i] << "\":" << snapshot.counters[i]; }
+  json << ",\"chunk_latency_us\":{\"p50\":" << latency_percentile(snapshot.latency, 0.5)
+       << ",\"p99\":" << latency_percentile(snapshot.latency, 0.99) << ",\"buckets\":[";
+  bool first = true;
+  for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+    if (snapshot.latency[i] == 0) { continue; }
+    json << (first ? "" : ",") << "{\"lt\":" << (uint64_t{1} << i) << ",\"count\":" << snapshot.latency[i] << "}";
+    first = false;
+  }
+  json << "]}}";
+  return json.str();
+}
+
+/**
+ * @brief Método que detiene el hilo del progreso y del socket UNIX y, si se ha pedido, escribe el resumen JSON en el fichero
+ *        indicado ("-" para la salida estándar).
+ * @param[in] succeeded: si la transferencia ha terminado bien.
+ * @return Devuelve un código de error si no se ha podido escribir el resumen, o un código de éxito en caso contrario.
+ */
+std::error_code metrics_reporter::finish(bool succeeded) {
+  stopping = true;
+  if (worker.joinable()) { worker.join(); }
+  if (options.stats_path.empty()) { return std::error_code(0, std::system_category()); }
+
+  std::string json = to_json(false, succeeded);
+  if (options.stats_path == "-") {
+    // Los mensajes pendientes del registro deben salir antes que el resumen, para no mezclarse con él
+    log_flush();
+    std::cout << json << std::endl;
+    return std::error_code(0, std::system_category());
+  }
+  std::ofstream file(options.stats_path, std::ios::trunc);
+  file << json << std::endl;
+  if (!file) {
+    log_error() << "Error: No se ha podido escribir el resumen de métricas en " << options.stats_path << ".";
+    return std::error_code(EIO, std::system_category());
+  }
+  return std::error_code(0, std::system_category());
+}
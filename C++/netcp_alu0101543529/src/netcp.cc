@@ -10,8 +10,22 @@
  */
 
 #include "header_files/netcp.h"
+#include "header_files/reliable.h"
+#include "header_files/delta.h"
+#include "header_files/archive.h"
+#include "header_files/metrics.h"
 #include <thread>
+#include <memory>
+#include <iomanip>
 #include <chrono>
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <poll.h>
+#include <sys/mman.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <netinet/udp.h>
 
 /**
  * @brief Función para enviar el mensaje que proporciona el manejo de señales del programa.
@@ -43,11 +57,62 @@ void setup_signal_handler() {
  * @brief Función para mostrar ayuda sobre el funcionamiento del programa.
  */
 void show_help() {
-  std::cout << "Modo de uso: ./netcp [-h | --help ] [ -o | --output NombreArchivo ] [ -l NombreArchivo ]" << std::endl << std::endl;
+  std::cout << "Modo de uso: ./netcp [-h | --help ] [ -b | --batch N ] [ --chunk-size N ] [ --fec K,M ] [ --path LOCAL[,IP:PUERTO] ... ] [ --to IP[:PUERTO] ... ] [ -m | --mmap ] [ -j N ] [ -r | --rate VELOCIDAD ] [ --cc aimd|delay|none ] [ --kernel-pacing ] [ --io-uring ] [ -z | --compress ] [ --key FICHERO [ --cipher aes-gcm|chacha20 ] ] [ -d | --delta ] [ -R | --recursive ] [ --no-offload ] [ -q | --quiet ] [ -v | --verbose ] [ --progress ] [ --stats FICHERO ] [ --stats-socket RUTA ] [ -o | --output NombreArchivo ] [ -l NombreArchivo ] [ --serve DIRECTORIO [ --max-sessions N ] [ --max-size TAMAÑO ] [ --max-streams N ] [ --max-memory TAMAÑO ] ] [ --stdio out|err|outerr ] [ -c COMANDO [ARGUMENTOS...] ] [ --proxy PUERTO IP:PUERTO [ --loss P ] [ --reorder P ] [ --duplicate P ] [ --delay MS ] ]" << std::endl << std::endl;
   std::cout << "Compilar con: g++ netcp.cc -o netcp" << std::endl;
   std::cout << "-h | --help: Muestra el funcionamiento del programa." << std::endl;
   std::cout << "-o | --output NombreArchivo: Envía por medio de la red el archivo indicado, leyendo su contenido." << std::endl;
   std::cout << "-l NombreArchivo: Recibe por medio de la red un archivo y escribe los datos en el archivo indicado." << std::endl;
+  std::cout << "--serve DIRECTORIO: Atiende sin terminar las transferencias de cualquier número de emisores a la vez, guardando cada una en DIRECTORIO/IP-SESIÓN (con -j N, reparte los emisores entre N hilos). Los caminos (--path) de un emisor que llegan desde otras direcciones solo se unen a su transferencia con --key." << std::endl;
+  std::cout << "--max-sessions N | --max-size TAMAÑO: Con --serve, atiende como mucho N transferencias a la vez (por defecto 256) y abandona las que superan TAMAÑO bytes." << std::endl;
+  std::cout << "--max-streams N | --max-memory TAMAÑO: Con --serve, rechaza las transferencias de más de N flujos (por defecto y como mucho " << MAX_STREAMS << ") e ignora las nuevas mientras el estado de recepción de todas las que están en curso (" << RECEIVE_STREAM_MEMORY / 1024 << " KiB por flujo) ocupe más de TAMAÑO bytes (por defecto 1G)." << std::endl;
+  std::cout << "-c COMANDO [ARGUMENTOS...]: Ejecuta el comando y envía su salida a medida que la produce (debe ser la última opción)." << std::endl;
+  std::cout << "--stdio out|err|outerr: Salida del comando de -c que se envía: la estándar (por defecto), la de error o ambas." << std::endl;
+  std::cout << "-b | --batch N: Envía o recibe los datos en lotes de N datagramas por llamada al sistema (por defecto 32)." << std::endl;
+  std::cout << "--chunk-size N: Envía bloques de N bytes por datagrama (entre " << MIN_CHUNK_SIZE << " y " << MAX_CHUNK_SIZE << "); por defecto, el emisor usa los mayores que caben sin fragmentar según la MTU del camino hasta el receptor, que los adopta al recibirlos." << std::endl;
+  std::cout << "--fec K,M: Envía M bloques de paridad (Reed-Solomon; con M = 1, XOR) por cada K bloques de datos, con los que el receptor reconstruye hasta M bloques perdidos de cada grupo sin esperar a que se reenvíen, a cambio de un M/K más de datagramas (K hasta 128, M hasta 16)." << std::endl;
+  std::cout << "--path LOCAL[,IP:PUERTO]: Añade un camino desde la dirección local indicada (la de la interfaz por la que debe salir) hasta el receptor (NETCP_IP y NETCP_PORT si no se indica, o IP:PUERTO; las direcciones IPv6 se escriben entre corchetes si llevan puerto, [::1]:8080). Con varios caminos, el emisor reparte los bloques entre ellos según la tasa de entrega que mide en cada uno, y deja de usar el que no responde hasta que vuelve a hacerlo." << std::endl;
+  std::cout << "--to IP[:PUERTO]: Envía el fichero de -o a este receptor (NETCP_PORT si no se indica el puerto); repetida, a todos los receptores indicados a la vez, leyendo cada bloque del fichero (y comprimiéndolo y cifrándolo) una sola vez. Cada receptor tiene su propia ventana y sus propios reenvíos, así que uno lento no frena a los demás." << std::endl;
+  std::cout << "-m | --mmap: Envía el fichero proyectándolo en memoria, sin copiarlo a un buffer intermedio (con MSG_ZEROCOPY si está disponible)." << std::endl;
+  std::cout << "-j N: Reparte el fichero en N flujos, cada uno con su socket y su hilo (el receptor atiende con N hilos)." << std::endl;
+  std::cout << "-r | --rate VELOCIDAD: Limita la tasa de envío a VELOCIDAD bytes por segundo (admite los sufijos K, M y G)." << std::endl;
+  std::cout << "--cc aimd|delay|none: Control de congestión del emisor: por pérdidas (por defecto), por retardo, o ninguno." << std::endl;
+  std::cout << "--kernel-pacing: Delega el ritmo de envío en el núcleo (SO_MAX_PACING_RATE, requiere la disciplina de colas fq)." << std::endl;
+  std::cout << "--io-uring: Lee el fichero por adelantado y envía los datagramas con io_uring, solapando disco y red (sin -m; si el núcleo no lo admite, se usa la E/S normal)." << std::endl;
+  std::cout << "-z | --compress: Comprime los bloques con deflate en varios hilos mientras se envían los anteriores (el receptor los descomprime)." << std::endl;
+  std::cout << "--key FICHERO: Cifra y autentica cada datagrama con la clave compartida del fichero (32 bytes o 64 dígitos hexadecimales, por ejemplo head -c 32 /dev/urandom > clave), de la que el emisor deriva una clave propia con una sal aleatoria; el receptor descarta lo que no supere la autenticación (ambos lados deben usar la misma clave)." << std::endl;
+  std::cout << "--cipher aes-gcm|chacha20: Algoritmo con el que cifra el emisor (por defecto, AES-256-GCM si el procesador tiene AES-NI y ChaCha20-Poly1305 si no)." << std::endl;
+  std::cout << "-d | --delta: Envía solo los bloques que han cambiado respecto a la copia que ya tiene el receptor (ambos lados deben usar -d)." << std::endl;
+  std::cout << "-R | --recursive: Envía o recibe un directorio entero (subdirectorios, ficheros y enlaces simbólicos, con sus permisos) en una sola sesión (ambos lados deben usar -R)." << std::endl;
+  std::cout << "--no-offload: No agrupa los datagramas con UDP_SEGMENT al enviar ni con UDP_GRO al recibir (por defecto se usan si el núcleo los admite)." << std::endl;
+  std::cout << "-q | --quiet: Solo muestra los errores." << std::endl;
+  std::cout << "-v | --verbose: Muestra también cada paso que da el programa (crear el socket, abrir el fichero...)." << std::endl;
+  std::cout << "--progress: Muestra cada segundo lo transferido, la velocidad y los reenvíos." << std::endl;
+  std::cout << "--stats FICHERO: Al terminar, escribe en FICHERO (\"-\" para la salida estándar) un resumen JSON con los contadores de la transferencia y el histograma de latencia de los bloques." << std::endl;
+  std::cout << "--stats-socket RUTA: Durante la transferencia, responde con las métricas en JSON a cada conexión al socket UNIX RUTA." << std::endl;
+  std::cout << "--proxy PUERTO IP:PUERTO [--loss P]: Reenvía los datagramas del puerto local indicado al destino, descartando cada uno con probabilidad P." << std::endl;
+  std::cout << "--reorder P | --duplicate P | --delay MS: Con --proxy, retiene cada datagrama con probabilidad P para que llegue desordenado, lo duplica con probabilidad P, o retrasa todos MS milisegundos." << std::endl;
+}
+
+/**
+ * @brief Función que interpreta una cantidad de la línea de comandos, como "100M" o "2G".
+ * @param[in] text: número entero, seguido opcionalmente del sufijo K, M o G (potencias de 1000).
+ * @return Devuelve la cantidad, o std::nullopt si el texto no tiene el formato correcto.
+ */
+std::optional<uint64_t> parse_size(std::string_view text) {
+  uint64_t multiplier = 1;
+  if (!text.empty()) {
+    switch (text.back()) {
+      case 'K': case 'k': multiplier = 1000ULL; break;
+      case 'M': case 'm': multiplier = 1000ULL * 1000; break;
+      case 'G': case 'g': multiplier = 1000ULL * 1000 * 1000; break;
+    }
+    if (multiplier != 1) { text.remove_suffix(1); }
+  }
+
+  uint64_t value = 0;
+  auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (text.empty() || error != std::errc() || end != text.data() + text.size()) { return std::nullopt; }
+  return value * multiplier;
 }
 
 /**
@@ -57,13 +122,13 @@ void show_help() {
  * @return Devuelve un código de error si no se ha podido leer correctamente del archivo, o un código de éxito si ocurre lo contrario.
  */
 std::error_code read_file(int fd, std::vector<uint8_t>& buffer) {
-  std::cout << "Leyendo el fichero..." << std::endl;
+  log_debug() << "Leyendo el fichero...";
 
   ssize_t bytes_read = read(fd, buffer.data(), buffer.size());
 
   // Si no se ha podido leer nada del fichero, mostraremos un mensaje de error y salimos con código de error != 0
   if (bytes_read < 0 || static_cast<size_t>(bytes_read) > buffer.size()) { 
-    std::cerr << "Error: No se ha podido leer el archivo correctamente." << std::endl;
+    log_error() << "Error: No se ha podido leer el archivo correctamente.";
     return std::error_code(errno, std::system_category());
   }
 
@@ -75,28 +140,41 @@ std::error_code read_file(int fd, std::vector<uint8_t>& buffer) {
 
 /**
  * @brief Función que crea un descriptor de fichero del socket en la dirección IP que le indiquemos.
- * @param[in] address: dirección IP a la cual enlazaremos el socket que creamos.
+ * @param[in] address: dirección IP (IPv4 o IPv6) a la cual enlazaremos el socket que creamos.
+ * @param[in] reuse_port: si es true, se permite que otros sockets se enlacen al mismo puerto (SO_REUSEPORT).
  * @return Devuelve el socket enlazado con la dirección y el puerto especificados por parámetros.
  */
-make_socket_result make_socket(std::optional<sockaddr_in> address = std::nullopt) {
-  std::cout << "Creando el socket..." << std::endl;  
+make_socket_result make_socket(std::optional<sockaddr_storage> address = std::nullopt, bool reuse_port) {
+  log_debug() << "Creando el socket...";  
   
-  // Creamos un socket de datagramas UDP (SOCK_DGRAM), en el dominio de direcciones IPv4 (AF_INET)
-  int socket_fd_s = socket(AF_INET, SOCK_DGRAM, 0);
+  // Creamos un socket de datagramas UDP (SOCK_DGRAM), en el dominio de direcciones de la dirección (AF_INET o AF_INET6)
+  int socket_fd_s = socket(address.value().ss_family, SOCK_DGRAM, 0);
   
   // Si hay un error al crear el socket mostramos un mensaje de error, y salimos con código de error != 0
   if (socket_fd_s < 0) {
-    std::cerr << "Error: No se ha podido crear el socket correctamente." << std::endl;
+    log_error() << "Error: No se ha podido crear el socket correctamente.";
     std::error_code error(errno, std::system_category());
     return std::unexpected(error);
   }
 
-  std::cout << "Enlazando el socket a la dirección IP..." << std::endl;  
+  // Con SO_REUSEPORT varios sockets pueden enlazarse al mismo puerto, y el núcleo reparte entre ellos los datagramas según su origen
+  int enable = 1;
+  if (reuse_port && setsockopt(socket_fd_s, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+    log_error() << "Error: No se ha podido compartir el puerto del socket.";
+    close(socket_fd_s);
+    return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+
+  // Un socket IPv6 enlazado a :: también recibe de emisores IPv4 (con direcciones ::ffff:a.b.c.d)
+  int disable = 0;
+  if (address.value().ss_family == AF_INET6) { setsockopt(socket_fd_s, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable)); }
+
+  log_debug() << "Enlazando el socket a la dirección IP...";  
 
-  int result = bind(socket_fd_s, reinterpret_cast<const sockaddr*>(&address.value()), sizeof(address.value()));
+  int result = bind(socket_fd_s, reinterpret_cast<const sockaddr*>(&address.value()), address_length(address.value()));
 
   if (result < 0) {
-    std::cerr << "Error: No se ha podido asignar una dirección IP correcta." << std::endl;
+    log_error() << "Error: No se ha podido asignar una dirección IP correcta.";
     close(socket_fd_s);
     std::error_code error(errno, std::system_category());
     return std::unexpected(error);
@@ -105,41 +183,228 @@ make_socket_result make_socket(std::optional<sockaddr_in> address = std::nullopt
   return socket_fd_s;
 }
 
+/**
+ * @brief Función que reparte los datagramas que llegan a un grupo de sockets enlazados al mismo puerto con SO_REUSEPORT: un
+ *        programa BPF elige el socket con el identificador de la transferencia y el flujo de la cabecera, en lugar de con las
+ *        direcciones de origen, de forma que todos los datagramas de un flujo llegan al mismo hilo aunque el emisor los
+ *        reparta entre varios caminos. Si el núcleo no lo admite, el reparto sigue siendo por origen.
+ * @param[in] sockets: sockets del grupo, en el orden en el que se han enlazado.
+ */
+void steer_streams(const std::vector<int>& sockets) {
+  if (sockets.size() < 2) { return; }
+  // Los datos empiezan tras la cabecera UDP: la transferencia va en los bytes 4 a 7 de la cabecera y el flujo en el 8 y el 9
+  sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, 4},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_LD | BPF_H | BPF_ABS, 0, 0, 8},
+      {BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(sockets.size())},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog program = {static_cast<unsigned short>(std::size(code)), code};
+  if (setsockopt(sockets[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+    log_debug() << "El núcleo no admite SO_ATTACH_REUSEPORT_CBPF, los flujos se repartirán según su origen.";
+  }
+}
+
+/**
+ * @brief Función que abre los caminos de un flujo del emisor: un socket enlazado a la dirección local de cada camino de las
+ *        opciones, con la dirección del receptor por él. Sin caminos en las opciones hay uno solo, desde cualquier dirección
+ *        local; y los caminos que no indican el receptor van a NETCP_IP, y los que no indican su puerto, a NETCP_PORT.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve los caminos abiertos, o un código de error si no se ha podido crear alguno de sus sockets.
+ */
+open_paths_result open_paths(const netcp_options& options) {
+  // Obtenemos el puerto y la dirección IP desde las variables de entorno
+  const char* netcp_port = std::getenv("NETCP_PORT");
+  const char* netcp_ip = std::getenv("NETCP_IP");
+  uint16_t port = (netcp_port != nullptr) ? std::stoi(netcp_port) : 8080;
+  std::optional<std::string> ip_address = (netcp_ip != nullptr) ? std::make_optional(netcp_ip) : "127.0.0.1";
+
+  auto default_remote = make_ip_address(ip_address, port);
+  if (!default_remote) {
+    log_error() << "Error: No se ha podido crear la dirección IP.";
+    return std::unexpected(std::error_code(EINVAL, std::system_category()));
+  }
+  std::vector<transfer_path> paths = options.paths;
+  if (paths.empty()) { paths.push_back({*make_ip_address(default_remote->ss_family == AF_INET6 ? "::" : "0.0.0.0", 0), {}}); }
+
+  std::vector<path_socket> sockets;
+  for (transfer_path& path : paths) {
+    if (path.remote.ss_family == AF_UNSPEC) { path.remote = *default_remote; }
+    if (path.local.ss_family != path.remote.ss_family) {
+      log_error() << "Error: Las direcciones del camino " << address_to_string(path.local) << " -> " << address_to_string(path.remote)
+                  << " no son de la misma familia (IPv4 o IPv6).";
+      close_paths(sockets);
+      return std::unexpected(std::error_code(EAFNOSUPPORT, std::system_category()));
+    }
+    uint16_t& remote_port = (path.remote.ss_family == AF_INET6) ? reinterpret_cast<sockaddr_in6&>(path.remote).sin6_port
+                                                                 : reinterpret_cast<sockaddr_in&>(path.remote).sin_port;
+    if (remote_port == 0) { remote_port = htons(port); }
+    auto socket_result = make_socket(path.local);
+    if (!socket_result) {
+      log_error() << "Error: No se ha podido crear el socket del camino " << address_to_string(path.local) << " -> "
+                  << address_to_string(path.remote) << ".";
+      close_paths(sockets);
+      return std::unexpected(socket_result.error());
+    }
+    sockets.push_back({*socket_result, path.remote});
+  }
+  return sockets;
+}
+
+/**
+ * @brief Función que cierra los sockets de los caminos de un flujo del emisor.
+ * @param[in] paths: caminos abiertos con open_paths().
+ */
+void close_paths(const std::vector<path_socket>& paths) {
+  for (const path_socket& path : paths) { close(path.socket_fd); }
+}
+
+/**
+ * @brief Función que elige el tamaño de bloque de una transferencia. Si no se ha indicado en la línea de comandos, se conecta
+ *        un socket de prueba a cada destino con IP_PMTUDISC_DO (sin fragmentación) y se consulta con IP_MTU (o IPV6_MTU) la
+ *        MTU que el núcleo conoce del camino: los bloques ocupan lo que queda del datagrama tras las cabeceras IP, UDP y la
+ *        del protocolo en el camino de menor MTU, de forma que ninguno se fragmenta en la red (en loopback, con su MTU de
+ *        64 KiB, cada bloque llena un datagrama UDP).
+ * @param[in] paths: caminos hasta el receptor.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve el tamaño de bloque, entre MIN_CHUNK_SIZE y MAX_CHUNK_SIZE.
+ */
+size_t choose_chunk_size(const std::vector<path_socket>& paths, const netcp_options& options) {
+  // Los bloques de paridad llevan sus datos delante del símbolo, que ocupa un bloque, así que con corrección de errores los
+  // bloques son algo menores para que la paridad también quepa en el datagrama; y lo mismo con la sal y la etiqueta del
+  // cifrado autenticado
+  size_t overhead = (options.fec_parity > 0) ? FEC_PARITY_PREFIX : 0;
+  if (options.secret) { overhead += AEAD_OVERHEAD; }
+  if (options.chunk_size != 0) { return std::min(options.chunk_size, MAX_CHUNK_SIZE - overhead); }
+
+  size_t chunk_size = MAX_CHUNK_SIZE - overhead;
+  for (const path_socket& path : paths) {
+    bool ipv6 = (path.destination.ss_family == AF_INET6);
+    int mtu = static_cast<int>(FALLBACK_MTU);
+    int probe_fd = socket(path.destination.ss_family, SOCK_DGRAM, 0);
+    if (probe_fd >= 0) {
+      int discover = ipv6 ? IPV6_PMTUDISC_DO : IP_PMTUDISC_DO;
+      int path_mtu = 0;
+      socklen_t length = sizeof(path_mtu);
+      int level = ipv6 ? IPPROTO_IPV6 : IPPROTO_IP;
+      if (setsockopt(probe_fd, level, ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER, &discover, sizeof(discover)) == 0 &&
+          connect(probe_fd, reinterpret_cast<const sockaddr*>(&path.destination), address_length(path.destination)) == 0 &&
+          getsockopt(probe_fd, level, ipv6 ? IPV6_MTU : IP_MTU, &path_mtu, &length) == 0 && path_mtu > 0) {
+        mtu = path_mtu;
+      }
+      close(probe_fd);
+    }
+
+    size_t headers = (ipv6 ? IPV6_UDP_HEADER_SIZE : IP_UDP_HEADER_SIZE) + PACKET_HEADER_SIZE + overhead;
+    size_t available = static_cast<size_t>(mtu) > headers ? mtu - headers : 0;
+    chunk_size = std::min(chunk_size, std::clamp(available, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE - overhead));
+    log_debug() << "MTU del camino hasta " << address_to_string(path.destination) << ": " << mtu << " bytes.";
+  }
+  log_debug() << "Bloques de " << chunk_size << " bytes.";
+  return chunk_size;
+}
+
+/**
+ * @brief Función que amplía el buffer de recepción de un socket: con lotes grandes llegan ráfagas de muchos datagramas, y el
+ *        receptor no sabe de antemano el tamaño de bloque que elegirá el emisor, así que se reserva para el mayor (el
+ *        núcleo lo limita a net.core.rmem_max, por lo que un fallo aquí no es grave).
+ * @param[in] socket_fd: socket del receptor.
+ * @param[in] options: opciones de la transferencia (tamaño del lote y, si se ha indicado, de bloque).
+ */
+void set_receive_buffer(int socket_fd, const netcp_options& options) {
+  size_t chunk_size = (options.chunk_size != 0) ? options.chunk_size : MAX_CHUNK_SIZE;
+  int receive_buffer_size = static_cast<int>(std::max((PACKET_HEADER_SIZE + chunk_size) * options.batch_size * 4, 1UL << 22));
+  setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size));
+}
+
 /**
  * @brief Función que crea y configura una dirección IP especificada.
- * @param[in] ip_address: dirección IP que creamos y configuramos.
- * @param[in] port: numero de puerto en el cual enlazaremos la dirección IP creada.
+ * @param[in] ip_address: dirección IP que creamos y configuramos: IPv4 ("127.0.0.1" o "127.0.0.1:8080") o IPv6 ("::1" o,
+ *            con puerto, "[::1]:8080").
+ * @param[in] port: numero de puerto en el cual enlazaremos la dirección IP creada, si la dirección no indica otro.
  * @return Devuelve la dirección IP configurada con el puerto especificado por parámetros.
  */
-std::optional<sockaddr_in> make_ip_address(const std::optional<std::string> ip_address = std::nullopt, uint16_t port = 0) {
-  std::cout << "Configurando la dirección IP " << ip_address.value() << " al puerto " << port << "..." << std::endl;  
+std::optional<sockaddr_storage> make_ip_address(const std::optional<std::string> ip_address = std::nullopt, uint16_t port = 0) {
+  log_debug() << "Configurando la dirección IP " << ip_address.value_or("") << " al puerto " << port << "...";  
 
   // Configuramos la direeción IP en el puerto especificado por parámetros (port)
-  sockaddr_in remote_address{};
-  remote_address.sin_family = AF_INET;
+  sockaddr_storage remote_address{};
+  remote_address.ss_family = AF_INET;
+  std::string ip;
 
-  // Si se especifica una dirección IP, la configuramos
+  // Si se especifica una dirección IP, separamos el puerto si lo lleva
   if (ip_address) {
-    size_t separador = ip_address.value().find(':');
-    std::string ip = ip_address.value();
-    if (separador != std::string::npos) {
-      // Formato "127.0.0.1:8080"
-      ip = ip_address.value().substr(0, separador);
-      port = std::stoi(ip_address.value().substr(separador + 1));
+    ip = ip_address.value();
+    size_t separador = ip.rfind(':');
+    size_t cierre = ip.find(']');
+    if (!ip.empty() && ip.front() == '[' && cierre != std::string::npos && (cierre + 1 == ip.size() || separador == cierre + 1)) {
+      // Formato "[::1]:8080" (los corchetes separan la dirección IPv6 del puerto)
+      if (separador == cierre + 1) { port = std::stoi(ip.substr(separador + 1)); }
+      ip = ip.substr(1, cierre - 1);
+    } else if (separador != std::string::npos && ip.find(':') == separador) {
+      // Formato "127.0.0.1:8080" (con más de un ':' es una dirección IPv6 sin puerto)
+      port = std::stoi(ip.substr(separador + 1));
+      ip = ip.substr(0, separador);
     }
+    if (ip.find(':') != std::string::npos) { remote_address.ss_family = AF_INET6; }
+  }
 
-    if (inet_aton(ip.c_str(), &remote_address.sin_addr) == 0) {
+  sockaddr_in& ipv4 = reinterpret_cast<sockaddr_in&>(remote_address);
+  sockaddr_in6& ipv6 = reinterpret_cast<sockaddr_in6&>(remote_address);
+  if (ip_address) {
+    void* destination = (remote_address.ss_family == AF_INET6) ? static_cast<void*>(&ipv6.sin6_addr) : static_cast<void*>(&ipv4.sin_addr);
+    if (inet_pton(remote_address.ss_family, ip.c_str(), destination) != 1) {
       // Si no se ha podido convertir la dirección IP correctamente, mostramos un mensaje de error, y salimos con código de error != 0
-      std::cerr << "Error: La dirección IP propocionada está en un formato incorrecto." << std::endl;
+      log_error() << "Error: La dirección IP propocionada está en un formato incorrecto.";
       return std::nullopt;
     }
   }
 
-  remote_address.sin_port = htons(port);
+  if (remote_address.ss_family == AF_INET6) {
+    ipv6.sin6_port = htons(port);
+  } else {
+    ipv4.sin_port = htons(port);
+  }
 
   return remote_address;
 }
 
+/**
+ * @brief Función que devuelve el tamaño de una dirección, para las llamadas al sistema que la reciben.
+ * @param[in] address: dirección IPv4 o IPv6.
+ * @return Devuelve el tamaño de la estructura que corresponde a su familia.
+ */
+socklen_t address_length(const sockaddr_storage& address) {
+  return (address.ss_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+
+/**
+ * @brief Función que devuelve en texto la dirección IP de una dirección, sin el puerto.
+ * @param[in] address: dirección IPv4 o IPv6.
+ * @return Devuelve la dirección IP ("127.0.0.1" o "::1").
+ */
+std::string ip_to_string(const sockaddr_storage& address) {
+  char text[INET6_ADDRSTRLEN] = {};
+  const void* source = (address.ss_family == AF_INET6) ? static_cast<const void*>(&reinterpret_cast<const sockaddr_in6&>(address).sin6_addr)
+                                                        : static_cast<const void*>(&reinterpret_cast<const sockaddr_in&>(address).sin_addr);
+  inet_ntop(address.ss_family, source, text, sizeof(text));
+  return text;
+}
+
+/**
+ * @brief Función que devuelve en texto una dirección con su puerto.
+ * @param[in] address: dirección IPv4 o IPv6.
+ * @return Devuelve la dirección ("127.0.0.1:8080" o "[::1]:8080").
+ */
+std::string address_to_string(const sockaddr_storage& address) {
+  if (address.ss_family == AF_INET6) {
+    return "[" + ip_to_string(address) + "]:" + std::to_string(ntohs(reinterpret_cast<const sockaddr_in6&>(address).sin6_port));
+  }
+  return ip_to_string(address) + ":" + std::to_string(ntohs(reinterpret_cast<const sockaddr_in&>(address).sin_port));
+}
+
 /**
  * @brief Función que envía los datos de un fichero a través de un socket UDP a una dirección especificada por parámetros.
  * @param[in] socket_fd_s: descriptor de fichero del socket que hemos configurado con la dirección IP y puerto específico.
@@ -147,12 +412,12 @@ std::optional<sockaddr_in> make_ip_address(const std::optional<std::string> ip_a
  * @param[in] address: dirección IP a la cuál enviaremos el socket.
  * @return Devuelve un código de error si no se ha podido enviar un mensaje, o un código de éxito en caso contrario.
  */
-std::error_code send_to(int socket_fd_s, const std::vector<uint8_t>& buffer, const sockaddr_in& address) {
-  int bytes_sent = sendto(socket_fd_s, buffer.data(), buffer.size(), 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+std::error_code send_to(int socket_fd_s, const std::vector<uint8_t>& buffer, const sockaddr_storage& address) {
+  int bytes_sent = sendto(socket_fd_s, buffer.data(), buffer.size(), 0, reinterpret_cast<const sockaddr*>(&address), address_length(address));
   
   // Si no se ha podido enviar el contenido del fichero, mostramos un mensaje de error, y salimos con código de error != 0
   if (bytes_sent < 0) { 
-    std::cerr << "Error: No se ha podido enviar el mensaje." << std::endl;
+    log_error() << "Error: No se ha podido enviar el mensaje.";
     return std::error_code(errno, std::system_category());
   }
 
@@ -166,14 +431,14 @@ std::error_code send_to(int socket_fd_s, const std::vector<uint8_t>& buffer, con
  * @param[in] address: dirección IP a la cuál enviaremos el socket.
  * @return Devuelve un código de error si no se ha podido enviar un mensaje, o un código de éxito en caso contrario.
  */
-std::error_code receive_from(int fd_s, std::vector<uint8_t>& buffer, sockaddr_in& address) {
+std::error_code receive_from(int fd_s, std::vector<uint8_t>& buffer, sockaddr_storage& address) {
   socklen_t address_length = sizeof(address);
 
   ssize_t bytes_received = recvfrom(fd_s, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&address), &address_length);
 
   if (bytes_received == -1) {
     // Si hay un error al recibir los datos en el socket mostramos un mensaje de error, y salimos con código de error != 0
-    std::cerr << "Error: No se ha podido recibir datos por el socket." << std::endl;
+    log_error() << "Error: No se ha podido recibir datos por el socket.";
     return std::error_code(errno, std::system_category());
   }
 
@@ -187,121 +452,626 @@ std::error_code write_file(int fd_s, const std::vector<uint8_t>& buffer) {
 
   if (bytes_written == -1) {
     // Si hay un error al escribir los datos recibidos por el socket en el archivo mostramos un mensaje de error, y salimos con código de error != 0
-    std::cerr << "Error: No se han podido escribir los datos recibidos en el archivo." << std::endl;
+    log_error() << "Error: No se han podido escribir los datos recibidos en el archivo.";
     return std::error_code(errno, std::system_category());
   }
 
   return std::error_code(0, std::system_category());
 }
 
+/**
+ * @brief Función que indica si el núcleo admite la segmentación UDP (UDP_SEGMENT) en un socket.
+ * @param[in] socket_fd_s: descriptor de fichero del socket emisor.
+ * @return Devuelve true si se pueden enviar varios datagramas como un único mensaje que el núcleo segmenta.
+ */
+bool udp_segmentation_supported(int socket_fd_s) {
+  int segment_size = 0;
+  socklen_t option_size = sizeof(segment_size);
+  return getsockopt(socket_fd_s, SOL_UDP, UDP_SEGMENT, &segment_size, &option_size) == 0;
+}
+
+/**
+ * @brief Función que activa o desactiva la agregación de datagramas en la recepción (UDP_GRO) de un socket.
+ * @param[in] socket_fd_s: descriptor de fichero del socket receptor.
+ * @param[in] enable: true para activarla y false para desactivarla.
+ * @return Devuelve true si el núcleo ha aceptado el cambio.
+ */
+bool set_udp_coalescing(int socket_fd_s, bool enable) {
+  int value = enable ? 1 : 0;
+  return setsockopt(socket_fd_s, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+}
+
+/**
+ * @brief Función que envía un lote de datagramas a través de un socket UDP con una única llamada a sendmmsg(). Si se indica,
+ *        los datagramas consecutivos del mismo tamaño se agrupan en un solo mensaje con UDP_SEGMENT, y es el núcleo (o la
+ *        tarjeta de red) quien los separa, de forma que cada grupo recorre la pila UDP/IP una sola vez.
+ * @param[in] socket_fd_s: descriptor de fichero del socket que hemos configurado con la dirección IP y puerto específico.
+ * @param[in] datagrams: datagramas que se envían, cada uno formado por uno o dos trozos de memoria.
+ * @param[in] address: dirección IP a la cuál enviaremos los datagramas.
+ * @param[in,out] zerocopy: si no es nulo, los datagramas se envían con MSG_ZEROCOPY y se cuentan en él para esperar su notificación.
+ * @param[in,out] segmentation: si no es nulo y es true, se agrupan los datagramas con UDP_SEGMENT; si el núcleo rechaza los
+ *                grupos, se pone a false y se envían por separado.
+ * @return Devuelve un código de error si no se ha podido enviar algún datagrama, o un código de éxito en caso contrario.
+ */
+std::error_code send_batch(int socket_fd_s, const std::vector<datagram>& datagrams, const sockaddr_storage& address, zerocopy_tracker* zerocopy,
+                           bool* segmentation) {
+  // Espacio para el mensaje de control de UDP_SEGMENT, con la alineación que exige cmsghdr
+  struct segment_control {
+    alignas(cmsghdr) char data[CMSG_SPACE(sizeof(uint16_t))];
+  };
+
+  std::vector<mmsghdr> messages;
+  std::vector<size_t> first_datagram;
+  std::vector<iovec> parts;
+  std::vector<segment_control> controls;
+  auto length = [&](size_t i) { return datagrams[i].parts[0].iov_len + (datagrams[i].part_count > 1 ? datagrams[i].parts[1].iov_len : 0); };
+  // Con MSG_ZEROCOPY cada página de los datos es un fragmento del mensaje, y el núcleo no admite más de ZEROCOPY_MAX_FRAGMENTS
+  auto pages = [&](size_t i) {
+    size_t count = 0;
+    for (size_t j = 0; j < datagrams[i].part_count; ++j) {
+      uintptr_t start = reinterpret_cast<uintptr_t>(datagrams[i].parts[j].iov_base);
+      if (datagrams[i].parts[j].iov_len > 0) { count += (start + datagrams[i].parts[j].iov_len - 1) / 4096 - start / 4096 + 1; }
+    }
+    return count;
+  };
+  // Prepara los mensajes de los datagramas desde first: agrupados mientras tengan el mismo tamaño (el último de cada grupo
+  // puede ser más pequeño) y quepan en un datagrama UDP, o uno por mensaje si no se agrupan
+  auto build = [&](size_t first) {
+    messages.clear();
+    first_datagram.clear();
+    parts.clear();
+    parts.reserve(2 * datagrams.size());
+    controls.assign(datagrams.size(), {});
+    bool group = segmentation != nullptr && *segmentation;
+    for (size_t i = first; i < datagrams.size();) {
+      size_t segment_size = length(i);
+      size_t count = 1;
+      size_t total = segment_size;
+      size_t fragments = zerocopy != nullptr ? pages(i) : 0;
+      while (group && i + count < datagrams.size() && count < GSO_MAX_SEGMENTS && length(i + count - 1) == segment_size &&
+             length(i + count) <= segment_size && total + length(i + count) <= GSO_MAX_PAYLOAD &&
+             (zerocopy == nullptr || fragments + pages(i + count) <= ZEROCOPY_MAX_FRAGMENTS)) {
+        total += length(i + count);
+        if (zerocopy != nullptr) { fragments += pages(i + count); }
+        ++count;
+      }
+
+      mmsghdr message{};
+      message.msg_hdr.msg_name = const_cast<sockaddr_storage*>(&address);
+      message.msg_hdr.msg_namelen = address_length(address);
+      message.msg_hdr.msg_iov = parts.data() + parts.size();
+      for (size_t j = i; j < i + count; ++j) { parts.insert(parts.end(), datagrams[j].parts, datagrams[j].parts + datagrams[j].part_count); }
+      message.msg_hdr.msg_iovlen = static_cast<size_t>(parts.data() + parts.size() - message.msg_hdr.msg_iov);
+      if (count > 1) {
+        message.msg_hdr.msg_control = controls[messages.size()].data;
+        message.msg_hdr.msg_controllen = sizeof(controls[messages.size()].data);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&message.msg_hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t size = static_cast<uint16_t>(segment_size);
+        std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+      }
+      messages.push_back(message);
+      first_datagram.push_back(i);
+      i += count;
+    }
+  };
+  build(0);
+
+  // sendmmsg() puede enviar menos mensajes de los pedidos, así que repetimos la llamada con los que falten
+  size_t sent = 0;
+  int flags = (zerocopy != nullptr) ? MSG_ZEROCOPY : 0;
+  while (sent < messages.size()) {
+    int result;
+    {
+      metric_timer timer(metric::send_ns);
+      result = sendmmsg(socket_fd_s, messages.data() + sent, messages.size() - sent, flags);
+    }
+    count_metric(metric::syscalls);
+    if (result < 0) {
+      count_metric(metric::send_errors);
+      if (errno == EINTR) { continue; }
+      // Con MSG_ZEROCOPY el núcleo devuelve ENOBUFS cuando hay demasiadas notificaciones pendientes: las recogemos y lo reintentamos
+      if (errno == ENOBUFS && zerocopy != nullptr && zerocopy->completed < zerocopy->sent) {
+        drain_zerocopy(socket_fd_s, *zerocopy, true);
+        continue;
+      }
+      // Si la interfaz no puede segmentar (por ejemplo, sin cálculo de sumas de comprobación en la tarjeta), dejamos de agrupar
+      // y enviamos por separado los datagramas que falten
+      if ((errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EMSGSIZE) && segmentation != nullptr && *segmentation) {
+        *segmentation = false;
+        build(first_datagram[sent]);
+        sent = 0;
+        continue;
+      }
+      log_error() << "Error: No se ha podido enviar el lote de datagramas.";
+      return std::error_code(errno, std::system_category());
+    }
+    sent += static_cast<size_t>(result);
+    // Cada llamada interna a sendmsg() con MSG_ZEROCOPY generará una notificación cuando el núcleo deje de usar los datos
+    if (zerocopy != nullptr) { zerocopy->sent += static_cast<uint64_t>(result); }
+  }
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Función que recoge de la cola de errores del socket las notificaciones de los envíos con MSG_ZEROCOPY ya completados.
+ * @param[in] socket_fd_s: descriptor de fichero del socket por el que se han enviado los datagramas.
+ * @param[in,out] zerocopy: contador de envíos pendientes, que se actualiza con las notificaciones recibidas.
+ * @param[in] wait: si es true, esperamos a que llegue al menos una notificación antes de volver.
+ * @return Devuelve el número de envíos cuya finalización se ha notificado.
+ */
+size_t drain_zerocopy(int socket_fd_s, zerocopy_tracker& zerocopy, bool wait) {
+  if (wait) {
+    // Las notificaciones se señalizan como POLLERR, que poll() siempre comprueba aunque no se pida
+    pollfd descriptor = {socket_fd_s, 0, 0};
+    poll(&descriptor, 1, 100);
+  }
+
+  size_t completed = 0;
+  while (true) {
+    char control[CMSG_SPACE(sizeof(sock_extended_err))];
+    msghdr message{};
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket_fd_s, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) { break; }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+      if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) { continue; }
+      const sock_extended_err* notification = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+      if (notification->ee_errno != 0 || notification->ee_origin != SO_EE_ORIGIN_ZEROCOPY) { continue; }
+
+      // Cada notificación indica el rango [ee_info, ee_data] de envíos completados
+      completed += notification->ee_data - notification->ee_info + 1;
+      if (notification->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) { zerocopy.copied = true; }
+    }
+  }
+
+  zerocopy.completed += completed;
+  return completed;
+}
+
+/**
+ * @brief Función que recibe un lote de datagramas a través de un socket UDP con una única llamada a recvmmsg(). Si el socket
+ *        tiene activado UDP_GRO, cada mensaje puede traer varios datagramas seguidos del mismo tamaño (el último puede ser
+ *        más pequeño), que se separan usando el tamaño que indica el núcleo en el mensaje de control.
+ * @param[in] fd_s: descriptor de fichero del socket que hemos configurado con la dirección IP y puerto específico.
+ * @param[in] buffers: vector de iovec, donde cada elemento es el espacio disponible para un mensaje.
+ * @param[out] datagrams: posición y tamaño, dentro de los buffers, de cada uno de los datagramas recibidos.
+ * @param[out] addresses: dirección IP desde la que se ha enviado cada datagrama.
+ * @return Devuelve el número de datagramas recibidos (0 si no había ninguno en cola), o un código de error si no se ha podido
+ *         recibir.
+ */
+receive_batch_result receive_batch(int fd_s, const std::vector<iovec>& buffers, std::vector<iovec>& datagrams, std::vector<sockaddr_storage>& addresses) {
+  // Espacio para el mensaje de control de UDP_GRO, con la alineación que exige cmsghdr
+  struct coalescing_control {
+    alignas(cmsghdr) char data[CMSG_SPACE(sizeof(int))];
+  };
+
+  std::vector<mmsghdr> messages(buffers.size());
+  std::vector<sockaddr_storage> sources(buffers.size());
+  std::vector<coalescing_control> controls(buffers.size());
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    messages[i].msg_hdr.msg_name = &sources[i];
+    messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+    messages[i].msg_hdr.msg_iov = const_cast<iovec*>(&buffers[i]);
+    messages[i].msg_hdr.msg_iovlen = 1;
+    messages[i].msg_hdr.msg_control = controls[i].data;
+    messages[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+  }
+
+  // Nos llevamos los datagramas que ya estén en cola sin bloquearnos: quien llama ha esperado a que el socket tenga datos, y
+  // si el aviso era falso (un bucle de eventos puede recibir avisos atrasados) no hay nada que recibir
+  int received = recvmmsg(fd_s, messages.data(), messages.size(), MSG_DONTWAIT, nullptr);
+  count_metric(metric::syscalls);
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { received = 0; }
+  if (received < 0) {
+    // Si hay un error al recibir los datos en el socket mostramos un mensaje de error, y salimos con código de error != 0
+    log_error() << "Error: No se ha podido recibir el lote de datagramas por el socket.";
+    return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+
+  datagrams.clear();
+  addresses.clear();
+  for (int i = 0; i < received; ++i) {
+    uint8_t* data = static_cast<uint8_t*>(buffers[i].iov_base);
+    size_t length = messages[i].msg_len;
+    size_t segment_size = length;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int size;
+        std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+        if (size > 0) { segment_size = static_cast<size_t>(size); }
+      }
+    }
+
+    for (size_t offset = 0; offset < length; offset += segment_size) {
+      datagrams.push_back({data + offset, std::min(segment_size, length - offset)});
+      addresses.push_back(sources[i]);
+    }
+    count_metric(metric::bytes_received, length);
+  }
+  count_metric(metric::datagrams_received, datagrams.size());
+
+  return datagrams.size();
+}
+
+/**
+ * @brief Función que escribe en una posición de un fichero varios bloques de datos consecutivos con una única llamada a pwritev().
+ * @param[in] fd_s: descriptor del fichero en el que escribiremos los datos.
+ * @param[in] blocks: bloques de datos que se escribirán de forma consecutiva en el fichero.
+ * @param[in] offset: posición del fichero en la que se escribe el primer bloque.
+ * @return Devuelve un código de error si no se han podido escribir los datos, o un código de éxito en caso contrario.
+ */
+std::error_code write_file_batch(int fd_s, std::vector<iovec> blocks, off_t offset) {
+  size_t first = 0;
+  while (first < blocks.size()) {
+    size_t count = std::min(blocks.size() - first, static_cast<size_t>(IOV_MAX));
+    ssize_t bytes_written;
+    {
+      metric_timer timer(metric::write_ns);
+      bytes_written = pwritev(fd_s, blocks.data() + first, static_cast<int>(count), offset);
+    }
+    count_metric(metric::syscalls);
+
+    if (bytes_written == -1) {
+      if (errno == EINTR) { continue; }
+      log_error() << "Error: No se han podido escribir los datos recibidos en el archivo.";
+      return std::error_code(errno, std::system_category());
+    }
+
+    // Si la escritura ha sido parcial, avanzamos por los bloques ya escritos y ajustamos el primero que quede a medias
+    offset += bytes_written;
+    size_t remaining = static_cast<size_t>(bytes_written);
+    size_t requested = 0;
+    for (size_t i = first; i < first + count; ++i) { requested += blocks[i].iov_len; }
+    if (remaining < requested) { count_metric(metric::short_writes); }
+    while (first < blocks.size() && remaining >= blocks[first].iov_len) {
+      remaining -= blocks[first].iov_len;
+      ++first;
+    }
+    if (remaining > 0) {
+      blocks[first].iov_base = static_cast<uint8_t*>(blocks[first].iov_base) + remaining;
+      blocks[first].iov_len -= remaining;
+    }
+  }
+
+  return std::error_code(0, std::system_category());
+}
+
 //-------------------------------------------------------------------------------------------------------------------------------------
 
+/**
+ * @brief Función que envía un fichero (o un buffer) repartido en tantos rangos de bloques consecutivos como flujos: cada
+ *        hilo envía su rango por los caminos de su flujo, reenviando los bloques que el receptor no confirme, hasta que lo
+ *        tenga completo.
+ * @param[in] streams: caminos de cada flujo del emisor, cada uno con su socket.
+ * @param[in] fd: descriptor del fichero (-1 si los datos se envían desde memoria).
+ * @param[in] size: tamaño de los datos.
+ * @param[in] mapping: datos en memoria (proyección del fichero o buffer), o nullptr para leerlos del descriptor.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve el CRC32C de los datos, confirmado por el receptor, o un código de error si no se han podido enviar.
+ */
+std::expected<uint32_t, std::error_code> send_streams(const std::vector<std::vector<path_socket>>& streams, int fd, size_t size,
+                                                      const uint8_t* mapping, const netcp_options& options) {
+  size_t stream_count = streams.size();
+  uint32_t session = make_session_id();
+  // Los hilos de compresión los comparten todos los flujos
+  std::unique_ptr<worker_pool> compressor;
+  if (options.compress) { compressor = std::make_unique<worker_pool>(std::thread::hardware_concurrency()); }
+  // Todos los flujos usan el mismo tamaño de bloque, y los rangos empiezan en un múltiplo de él
+  netcp_options stream_options = options;
+  stream_options.chunk_size = choose_chunk_size(streams[0], options);
+  size_t chunk_size = stream_options.chunk_size;
+  uint64_t total_chunks = (size + chunk_size - 1) / chunk_size;
+  auto range_start = [&](size_t i) { return std::min(size, static_cast<size_t>(total_chunks * i / stream_count) * chunk_size); };
+
+  std::vector<std::error_code> errors(stream_count);
+  std::vector<uint32_t> digests(stream_count);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < stream_count; ++i) {
+    threads.emplace_back([&, i]() {
+      reliable_sender sender(streams[i], stream_options, session, static_cast<uint16_t>(i), static_cast<uint16_t>(stream_count),
+                             compressor.get(), size);
+      errors[i] = sender.send(fd, range_start(i), range_start(i + 1) - range_start(i), mapping);
+      digests[i] = sender.digest();
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+
+  for (const std::error_code& error : errors) {
+    if (error) { return std::unexpected(error); }
+  }
+
+  // El receptor ha confirmado el CRC32C de cada rango, así que el del conjunto (que se obtiene combinándolos) también coincide
+  uint32_t digest = 0;
+  for (size_t i = 0; i < stream_count; ++i) { digest = crc32c_combine(digest, digests[i], range_start(i + 1) - range_start(i)); }
+  return digest;
+}
+
+/**
+ * @brief Función que recibe en un fichero los flujos de una transferencia: cada hilo recibe los bloques numerados de los flujos
+ *        que le lleguen a su socket, confirmando al emisor lo recibido, y los escribe con pwritev() en su posición del archivo.
+ * @param[in] sockets: sockets del receptor, enlazados a la misma dirección con SO_REUSEPORT.
+ * @param[in] fd: descriptor del fichero en el que se escriben los datos.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve el CRC32C de los datos recibidos, o un código de error si no se han podido recibir.
+ */
+std::expected<uint32_t, std::error_code> receive_streams(const std::vector<int>& sockets, int fd, const netcp_options& options) {
+  receive_state shared;
+  std::vector<std::error_code> errors(sockets.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sockets.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      reliable_receiver receiver(sockets[i], fd, options, shared);
+      errors[i] = receiver.receive();
+      if (errors[i]) { shared.failed = true; }
+    });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+
+  for (const std::error_code& error : errors) {
+    if (error) { return std::unexpected(error); }
+  }
+
+  uint32_t digest = 0;
+  for (const auto& [stream, part] : shared.digests) { digest = crc32c_combine(digest, part.first, part.second); }
+  return digest;
+}
+
+/**
+ * @brief Función que recibe un fichero en modo diferencias: envía al emisor la firma de la copia actual del fichero, recibe
+ *        la delta en un fichero anónimo en memoria y reconstruye el fichero nuevo en un temporal que sustituye al original.
+ * @param[in] filename: fichero de destino (si no existe, la delta contendrá el fichero entero).
+ * @param[in] sockets: sockets del receptor.
+ * @param[in] options: opciones de la transferencia.
+ * @return Devuelve un código de error si no se ha podido recibir o reconstruir el fichero, o un código de éxito en caso contrario.
+ */
+std::error_code receive_delta(const std::string& filename, const std::vector<int>& sockets, const netcp_options& options) {
+  // La copia actual del fichero, si existe, es la base sobre la que se aplica la delta
+  int basis_fd = open(filename.c_str(), O_RDONLY);
+  struct stat basis_stat{};
+  const uint8_t* basis = nullptr;
+  if (basis_fd != -1 && fstat(basis_fd, &basis_stat) == 0 && basis_stat.st_size > 0) {
+    void* projection = mmap(nullptr, static_cast<size_t>(basis_stat.st_size), PROT_READ, MAP_SHARED, basis_fd, 0);
+    if (projection != MAP_FAILED) { basis = static_cast<const uint8_t*>(projection); }
+  }
+  size_t basis_size = basis != nullptr ? static_cast<size_t>(basis_stat.st_size) : 0;
+  auto close_basis = [&]() {
+    if (basis != nullptr) { munmap(const_cast<uint8_t*>(basis), basis_size); }
+    if (basis_fd != -1) { close(basis_fd); }
+  };
+
+  log_info() << "Esperando la petición de firma del emisor...";
+  if (std::error_code error = serve_signature(sockets, basis, basis_size, options)) {
+    close_basis();
+    return error;
+  }
+
+  log_info() << "Recibiendo la delta...";
+  int delta_fd = memfd_create("netcp-delta", 0);
+  if (delta_fd == -1) {
+    close_basis();
+    return std::error_code(errno, std::system_category());
+  }
+  auto result = receive_streams(sockets, delta_fd, options);
+  struct stat delta_stat{};
+  const uint8_t* delta = nullptr;
+  if (result && fstat(delta_fd, &delta_stat) == 0 && delta_stat.st_size > 0) {
+    void* projection = mmap(nullptr, static_cast<size_t>(delta_stat.st_size), PROT_READ, MAP_SHARED, delta_fd, 0);
+    if (projection != MAP_FAILED) { delta = static_cast<const uint8_t*>(projection); }
+  }
+  close(delta_fd);
+  if (!result || delta == nullptr) {
+    close_basis();
+    return result ? std::error_code(EBADMSG, std::system_category()) : result.error();
+  }
+
+  // El fichero nuevo se construye aparte (la delta copia bloques del actual) y solo sustituye al actual si es correcto
+  log_info() << "Reconstruyendo el fichero...";
+  std::string temporary = filename + ".netcp-tmp";
+  int fd_s = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  std::error_code error = fd_s == -1 ? std::error_code(errno, std::system_category())
+                                     : apply_delta(delta, static_cast<size_t>(delta_stat.st_size), basis_fd, fd_s);
+  munmap(const_cast<uint8_t*>(delta), static_cast<size_t>(delta_stat.st_size));
+  close_basis();
+  if (fd_s != -1) { close(fd_s); }
+  if (!error && rename(temporary.c_str(), filename.c_str()) != 0) { error = std::error_code(errno, std::system_category()); }
+  if (error) {
+    unlink(temporary.c_str());
+    return error;
+  }
+  return std::error_code(0, std::system_category());
+}
+
 /**
  * @brief Función que envía los datos de un fichero (especificado por parámetros) a través de un socket UDP haciendo uso de una dirección IP.
  * @param[in] filename: fichero del que leeremos su contenido y lo enviaremos haciendo uso de un socket, que hemos configurado con la dirección IP y puerto específico..
+ * @param[in] options: opciones de la transferencia (tamaño del lote de datagramas, ...).
  * @return Devuelve un código de error si no se ha podido enviar un mensaje, o un código de éxito en caso contrario.
  */
-std::error_code netcp_send_file(const std::string& filename) {
+std::error_code netcp_send_file(const std::string& filename, const netcp_options& options) {
   // Verificamos el tamaño del archivo que recibimos por parámetros
   struct stat file_stat;
 
   if (stat(filename.c_str(), &file_stat) != 0) {
-    std::cerr << "Error: No se puede abrir el fichero " << filename << ". Compruebe que existe el archivo." << std::endl;
+    log_error() << "Error: No se puede abrir el fichero " << filename << ". Compruebe que existe el archivo.";
     return std::error_code(errno, std::system_category());
   }
 
-  std::cout << "Abriendo el fichero..." << std::endl;
+  // Los directorios viajan enteros en una sola sesión, pero el receptor tiene que saber que debe extraerlos
+  if (S_ISDIR(file_stat.st_mode) != options.recursive) {
+    log_error() << "Error: " << filename << (options.recursive ? " no es un directorio." : " es un directorio, use la opción -R para enviarlo.");
+    return std::error_code(options.recursive ? ENOTDIR : EISDIR, std::system_category());
+  }
+  if (options.recursive) { return netcp_send_directory(filename, options); }
+
+  log_debug() << "Abriendo el fichero...";
   // Abrimos el archivo y lo guardamos en un descriptor de fichero
   int fd_s = open(filename.c_str(), O_RDONLY, 0);
   // Si no se ha podido abrir, mostramos un mensaje de error y salimos con código de error != 0
   if (fd_s == -1) {
-    std::cerr << "Error: No se puede abrir el fichero " << filename << "." << std::endl;
+    log_error() << "Error: No se puede abrir el fichero " << filename << ".";
     return std::error_code(errno, std::system_category());
   }
 
-  // Creamos y configuramos la dirección IP y puerto especificado
-  auto address = make_ip_address("127.0.0.1", 0);
-  // Si no hemos podido crear correctamente la dirección IP, mostramos un mensaje de error y salimos con código de error != 0
-  if (!address) {
-    std::cerr << "Error: No se ha podido crear la dirección IP." << std::endl;
-    std::cout << "Cerrando el descriptor de fichero..." << std::endl;
+  // Abrimos los caminos de cada flujo en el que repartimos el fichero, cada uno con su socket enlazado a su dirección local
+  std::vector<std::vector<path_socket>> streams;
+  auto close_all = [&]() {
+    log_debug() << "Cerrando los descriptores de fichero...";
+    for (const std::vector<path_socket>& paths : streams) { close_paths(paths); }
     close(fd_s);
-    return std::error_code(errno, std::system_category());
+  };
+  for (size_t i = 0; i < options.streams; ++i) {
+    auto paths = open_paths(options);
+    // Si no hemos podido crear correctamente los sockets, mostramos un mensaje de error y salimos con código de error != 0
+    if (!paths) {
+      log_error() << "Error: No se ha podido crear el socket.";
+      close_all();
+      return paths.error();
+    }
+    // Si se han creado correctamente los guardamos en el vector de flujos
+    streams.push_back(std::move(*paths));
   }
 
-  // Creamos el socket con la dirección IP y puerto especificado previamente
-  auto socket_result = make_socket(*address);
-  // Si no hemos podido crear correctamente el socket, mostramos un mensaje de error y salimos con código de error != 0
-  if (!socket_result) {
-    std::cerr << "Error: No se ha podido crear el socket." << std::endl;
-    std::cout << "Cerrando el descriptor de fichero..." << std::endl;
-    close(fd_s);
-    return std::error_code(errno, std::system_category());
+  // Si se ha pedido, proyectamos el fichero en memoria para enviar sus bloques sin copiarlos a un buffer intermedio
+  // (un fichero vacío no se puede proyectar, pero tampoco tiene nada que enviar)
+  size_t file_size = static_cast<size_t>(file_stat.st_size);
+  const uint8_t* mapping = nullptr;
+  if (options.use_mmap && file_size > 0) {
+    void* result = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd_s, 0);
+    if (result == MAP_FAILED) {
+      log_error() << "Error: No se ha podido proyectar el fichero en memoria.";
+      close_all();
+      return std::error_code(errno, std::system_category());
+    }
+    // Avisamos al núcleo de que vamos a recorrer el fichero de principio a fin, para que adelante la lectura de las páginas
+    madvise(result, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    mapping = static_cast<const uint8_t*>(result);
   }
-  // Si se ha creado correctamente lo guardamos en una variable
-  int socket_fd_s = *socket_result;
 
-  // Obtenemos el puerto y la dirección IP desde las variables de entorno
-  const char* netcp_port = std::getenv("NETCP_PORT");
-  const char* netcp_ip = std::getenv("NETCP_IP");
+  std::expected<uint32_t, std::error_code> result;
+  if (options.delta) {
+    // En modo diferencias necesitamos el fichero entero en memoria para buscar en él los bloques que ya tiene el receptor
+    if (mapping == nullptr && file_size > 0) {
+      void* projection = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd_s, 0);
+      if (projection == MAP_FAILED) {
+        log_error() << "Error: No se ha podido proyectar el fichero en memoria.";
+        close_all();
+        return std::error_code(errno, std::system_category());
+      }
+      mapping = static_cast<const uint8_t*>(projection);
+    }
 
-  uint16_t port = (netcp_port != nullptr) ? std::stoi(netcp_port) : 8080;
-  std::optional<std::string> ip_address = (netcp_ip != nullptr) ? std::make_optional(netcp_ip) : "127.0.0.1";
+    log_info() << "Pidiendo al receptor la firma de su copia del fichero...";
+    auto signature = request_signature(streams[0][0].socket_fd, streams[0][0].destination, options);
+    if (!signature) {
+      if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), file_size); }
+      close_all();
+      return signature.error();
+    }
 
-  auto address_send = make_ip_address(ip_address, port);
+    delta_stats stats;
+    std::vector<uint8_t> delta = make_delta(mapping, file_size, *signature, std::max(1U, std::thread::hardware_concurrency()), stats);
+    if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), file_size); }
+    log_info() << "Delta calculada: " << stats.literal_bytes << " bytes nuevos y " << stats.copied_bytes
+               << " bytes que ya tiene el receptor (" << delta.size() << " bytes a enviar).";
 
-  // Enviamos el mensaje del fichero por bloques de 4 KiB de datos
-  std::vector<uint8_t> buffer(4096UL);
+    log_info() << "Enviando la delta...";
+    result = send_streams(streams, -1, delta.size(), delta.data(), options);
+  } else {
+    log_info() << "Enviando el fichero...";
+    result = send_streams(streams, fd_s, file_size, mapping, options);
+    if (mapping != nullptr) { munmap(const_cast<uint8_t*>(mapping), file_size); }
+  }
 
-  std::cout << "Enviando el fichero..." << std::endl;
-  // Empezamos un bucle que mientras que haya datos para leer en el fichero, se van a estar leyendo-enviando
-  while (true && !quit_requested) {
-    ssize_t bytesRead = read(fd_s, buffer.data(), buffer.size());
+  if (!result) {
+    log_error() << "Error: No se ha podido enviar el fichero " << filename << ".";
+    close_all();
+    return result.error();
+  }
 
-    // Si no hemos podido leer correctamente el contenido del fichero, mostramos un mensaje de error y salimos con código de error != 0
-    if (bytesRead == -1) {
-      std::cerr << "Error: No se puede leer el fichero " << filename << "." << std::endl;
-      std::cout << "Cerrando los descriptores de fichero..." << std::endl;
-      close(socket_fd_s);
-      close(fd_s);
-      return std::error_code(errno, std::system_category());
-    }
+  // Si el mensaje se ha podido enviar cerramos tanto el descriptor de fichero del archivo que leímos como los sockets que creamos
+  close_all();
+
+  log_info() << (options.delta ? "CRC32C de la delta: " : "CRC32C del fichero: ") << std::hex << std::setw(8) << std::setfill('0')
+             << *result << std::dec << " (coincide con el del receptor).";
+  
+  log_info() << "El envío de datos ha finalizado correctamente.";
+
+  return std::error_code(0, std::system_category());
+}
 
-    buffer.resize(static_cast<size_t>(bytesRead));
+/**
+ * @brief Función que ejecuta un comando y envía al receptor su salida a medida que la produce, sin guardarla antes en disco.
+ *        El emisor lee la tubería sin bloquearse, así que sigue atendiendo las confirmaciones y los reenvíos mientras el
+ *        comando no escribe nada; el tamaño de la transferencia se conoce cuando el comando cierra su salida.
+ * @param[in] command: comando y sus argumentos.
+ * @param[in] redirected_io: salida del comando que se envía (out, err u outerr).
+ * @param[in] options: opciones de la transferencia (tamaño del lote de datagramas, ...).
+ * @return Devuelve un código de error si no se ha podido enviar la salida o el comando ha terminado con error, o un código de
+ *         éxito en caso contrario.
+ */
+std::error_code netcp_send_command(const std::vector<std::string>& command, subprocess::stdio redirected_io, const netcp_options& options) {
+  // La salida del comando no existe de antemano, así que no hay nada con lo que calcular diferencias
+  if (options.delta) {
+    log_error() << "Error: La opción -d no se puede usar con -c.";
+    return std::error_code(EINVAL, std::system_category());
+  }
 
-    // Si el buffer de datos esta vacío, es porque ya hemos llegado al fin de la transmisión
-    if (buffer.empty()) { break; }
+  auto paths = open_paths(options);
+  if (!paths) {
+    log_error() << "Error: No se ha podido crear el socket.";
+    return paths.error();
+  }
 
-    // Enviamos el mensaje del fichero que hemos leído previamente, en caso de fallo, mostramos un mensaje de error y salimos con código de error != 0
-    if (send_to(socket_fd_s, buffer, *address_send)) {
-      std::cerr << "Error: No se ha podido enviar el bloque por el socket." << std::endl;
-      std::cout << "Cerrando los descriptores de fichero..." << std::endl;
-      close(socket_fd_s);
-      close(fd_s);
-      return std::error_code(errno, std::system_category());
-    }
-    // En grandes ficheros, debemos esperar un tiempo prudencial a que se envien todos los datos cargados en el buffer
-    std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+  subprocess process(command, redirected_io);
+  if (std::error_code error = process.exec()) {
+    close_paths(*paths);
+    return error;
   }
-  // Se invoca a la función send_to de forma vacía, para terminar que termine el envío de archivos automaticamente
-  send_to(socket_fd_s, buffer, *address_send);
+  log_info() << "Comando " << command[0] << " iniciado con PID " << process.pid() << ", enviando su salida...";
 
-  std::cout << "Cerrando los descriptores de fichero..." << std::endl;
-  // Si el mensaje se ha podido enviar cerramos tanto el descriptor de fichero del archivo que leímos como del socket que creamos
-  close(socket_fd_s);
-  close(fd_s);
-  
-  std::cout << "El envío de datos ha finalizado correctamente." << std::endl;
+  // Leemos la tubería sin bloquearnos, y la agrandamos para que el comando pueda adelantarse mientras esperamos a la red
+  int pipe_fd = (redirected_io == subprocess::stdio::err) ? process.stderr_fd() : process.stdout_fd();
+  fcntl(pipe_fd, F_SETFL, fcntl(pipe_fd, F_GETFL) | O_NONBLOCK);
+  fcntl(pipe_fd, F_SETPIPE_SZ, PIPE_BUFFER_SIZE);
+
+  std::unique_ptr<worker_pool> compressor;
+  if (options.compress) { compressor = std::make_unique<worker_pool>(std::thread::hardware_concurrency()); }
+  reliable_sender sender(*paths, options, make_session_id(), 0, 1, compressor.get());
+  std::error_code error = sender.send_pipe(pipe_fd);
+  log_debug() << "Cerrando los descriptores de los sockets...";
+  close_paths(*paths);
+
+  // Si la transferencia ha fallado, el comando no tiene a quién enviar el resto de su salida
+  if (error) { process.kill(); }
+  if (std::error_code wait_error = process.wait(); wait_error && !error) { error = wait_error; }
+  if (error) {
+    log_error() << "Error: No se ha podido enviar la salida del comando " << command[0] << ".";
+    return error;
+  }
+  if (process.exit_code() != 0) {
+    log_error() << "Error: El comando " << command[0] << " ha terminado con el código " << process.exit_code() << ".";
+    return std::error_code(ECHILD, std::system_category());
+  }
 
+  log_info() << "CRC32C de la salida del comando: " << std::hex << std::setw(8) << std::setfill('0') << sender.digest() << std::dec
+             << " (coincide con el del receptor).";
+  log_info() << "El envío de datos ha finalizado correctamente.";
   return std::error_code(0, std::system_category());
 }
 
 /**
  * @brief Función que recibe los datos de un fichero a través de un socket UDP a una dirección IP específica.
  * @param[in] filename: descriptor de fichero del socket que hemos configurado con la dirección IP y puerto específico.
+ * @param[in] options: opciones de la transferencia (tamaño del lote de datagramas, ...).
  * @return Devuelve un código de error si no se ha podido enviar un mensaje, o un código de éxito en caso contrario.
  */
-std::error_code netcp_receive_file(const std::string& filename) {
+std::error_code netcp_receive_file(const std::string& filename, const netcp_options& options) {
   // Obtenemos el puerto y la dirección IP desde las variables de entorno
   const char* netcp_port = std::getenv("NETCP_PORT");
   const char* netcp_ip = std::getenv("NETCP_IP");
@@ -313,69 +1083,68 @@ std::error_code netcp_receive_file(const std::string& filename) {
   auto address = make_ip_address(ip_address, port);
   // Si no hemos podido crear correctamente la dirección IP, mostramos un mensaje de error y salimos con código de error != 0
   if (!address) {
-    std::cerr << "Error: No se ha podido crear la dirección IP." << std::endl;
+    log_error() << "Error: No se ha podido crear la dirección IP.";
     return std::error_code(errno, std::system_category());
   }
 
-  // Creamos el socket configurado en la dirección IP que hemos creado previamente
-  auto socket_result = make_socket(*address);
-  // Si no hemos podido crear correctamente el socket, mostramos un mensaje de error y salimos con código de error != 0
-  if (!socket_result) {
-    std::cerr << "Error: No se ha podido crear el socket." << std::endl;
-    return std::error_code(errno, std::system_category());
+  // Creamos un socket por cada hilo receptor, todos enlazados a la dirección IP que hemos creado previamente con SO_REUSEPORT,
+  // de forma que el núcleo reparte entre ellos los flujos del emisor (cada flujo a un socket, aunque llegue por varios caminos)
+  std::vector<int> sockets;
+  auto close_sockets = [&]() {
+    for (int socket_fd : sockets) { close(socket_fd); }
+  };
+  for (size_t i = 0; i < options.streams; ++i) {
+    auto socket_result = make_socket(*address, true);
+    // Si no hemos podido crear correctamente el socket, mostramos un mensaje de error y salimos con código de error != 0
+    if (!socket_result) {
+      log_error() << "Error: No se ha podido crear el socket.";
+      close_sockets();
+      return socket_result.error();
+    }
+    sockets.push_back(*socket_result);
+    set_receive_buffer(*socket_result, options);
   }
+  steer_streams(sockets);
 
-  int socket_fd = *socket_result;
+  if (options.delta || options.recursive) {
+    std::error_code error = options.recursive ? receive_directory(filename, sockets, options) : receive_delta(filename, sockets, options);
+    close_sockets();
+    if (error) {
+      log_error() << "Error: No se ha podido recibir el fichero " << filename << ".";
+      return error;
+    }
+    log_info() << "La recepción de datos ha finalizado correctamente.";
+    return std::error_code(0, std::system_category());
+  }
 
-  std::cout << "Abriendo el fichero..." << std::endl;
+  log_debug() << "Abriendo el fichero...";
   // Abrir el archivo de destino en modo escritura
-  int fd_s = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  int fd_s = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
   if (fd_s == -1) {
-    std::cerr << "Error: No se puede abrir el fichero " << filename << "." << std::endl;
-    std::cout << "Cerrando el descriptor de fichero..." << std::endl;
-    close(socket_fd);
+    log_error() << "Error: No se puede abrir el fichero " << filename << ".";
+    log_debug() << "Cerrando el descriptor de fichero...";
+    close_sockets();
     return std::error_code(errno, std::system_category());
   }
 
-  // Recibimos los datos por el socket y los escribimos en el archivo que se nos especifique
-  // Creamos un buffer del que iremos recibiendo los datos para irlos escribiendo poco a poco
-  std::vector<uint8_t> buffer(4096UL);
-
-  std::cout << "Recibiendo datos al fichero..." << std::endl;
-  std::cout << "Escribiendo datos en el fichero..." << std::endl;
-  // Hacemos un bucle infinito, para enviar los datos, y su condición de parada será cuando el buffer de datos no tenga nada para recibir
-  while (true && !quit_requested) {
-    auto result = receive_from(socket_fd, buffer, address.value());
+  log_debug() << "Recibiendo datos al fichero...";
+  log_debug() << "Escribiendo datos en el fichero...";
+  auto result = receive_streams(sockets, fd_s, options);
 
-    if (result) {
-      // Si no hemos podido recibir los datos correctamente por el socket, mostramos un mensaje de error y salimos con código de error != 0
-      std::cerr << "Error: No se han podido recibir los datos por el socket correctamente." << std::endl;
-      std::cout << "Cerrando los descriptores de fichero..." << std::endl;
-      close(fd_s);
-      close(socket_fd);
-      return std::error_code(errno, std::system_category());
-    }
-
-    // Si el buffer de datos esta vacío, es porque ya hemos llegado al fin de la recepción
-    if (buffer.empty()) { break; }
+  log_debug() << "Cerrando los descriptores de fichero...";
+  // Tanto si se ha podido recibir el fichero como si no, cerramos el descriptor de fichero del archivo y los sockets que creamos
+  close(fd_s);
+  close_sockets();
 
-    // Escribiremos los datos que hemos ido leyendo en el archivo especificado por parámetros
-    if (write_file(fd_s, buffer)) {
-      // Si no hemos podido escribir los datos correctamente en el fichero, mostramos un mensaje de error y salimos con código de error != 0
-      std::cerr << "Error: No se ha podido escribir en el fichero " << filename << "." << std::endl;
-      std::cout << "Cerrando los descriptores de fichero..." << std::endl;
-      close(fd_s);
-      close(socket_fd);
-      return std::error_code(errno, std::system_category());
-    }
+  if (!result) {
+    log_error() << "Error: No se ha podido recibir el fichero " << filename << ".";
+    return result.error();
   }
 
-  std::cout << "Cerrando los descriptores de fichero..." << std::endl;
-  // Si el mensaje se ha podido tanto recibir como escribir en el fichero especificado, cerramos tanto el descriptor de fichero del archivo que leímos como del socket que creamos
-  close(fd_s);
-  close(socket_fd);
+  log_info() << "CRC32C del fichero: " << std::hex << std::setw(8) << std::setfill('0') << *result << std::dec
+             << " (coincide con el del emisor).";
 
-  std::cout << "La recepción de datos ha finalizado correctamente." << std::endl;
+  log_info() << "La recepción de datos ha finalizado correctamente.";
 
   return std::error_code(0, std::system_category());
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del ritmo de envío (cubo de tokens) y del control de congestión del emisor
+ */
+
+#include "header_files/pacing.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief Constructor de token_bucket
+ * @param[in] rate: tasa de envío permitida, en bytes por segundo (0 para no limitarla).
+ * @param[in] burst: máximo de bytes que se pueden enviar de golpe tras un periodo sin enviar.
+ */
+token_bucket::token_bucket(double rate, size_t burst)
+    : tokens_per_second(rate), tokens(static_cast<double>(burst)), burst(static_cast<double>(burst)), last_update(0) {}
+
+/**
+ * @brief Método que devuelve la tasa de envío permitida.
+ * @return Devuelve la tasa en bytes por segundo (0 si no hay límite).
+ */
+double token_bucket::rate() const { return tokens_per_second; }
+
+/**
+ * @brief Método que cambia la tasa de envío permitida, conservando los tokens acumulados.
+ * @param[in] rate: nueva tasa, en bytes por segundo (0 para no limitarla).
+ */
+void token_bucket::set_rate(double rate) { tokens_per_second = rate; }
+
+/**
+ * @brief Método que añade los tokens generados desde la última actualización, sin superar la ráfaga máxima.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void token_bucket::refill(uint64_t now) {
+  if (last_update != 0 && now > last_update) {
+    tokens = std::min(burst, tokens + tokens_per_second * static_cast<double>(now - last_update) / 1e6);
+  }
+  last_update = now;
+}
+
+/**
+ * @brief Método que calcula cuánto hay que esperar para poder enviar. Los envíos pueden dejar el cubo en negativo (una
+ *        deuda), de forma que un lote entero sale de golpe y la espera posterior compensa su tamaño.
+ * @param[in] now: instante actual, en microsegundos.
+ * @return Devuelve los microsegundos de espera, o 0 si ya se puede enviar.
+ */
+uint64_t token_bucket::delay(uint64_t now) {
+  if (tokens_per_second <= 0) { return 0; }
+  refill(now);
+  if (tokens >= 0) { return 0; }
+  return static_cast<uint64_t>(std::ceil(-tokens / tokens_per_second * 1e6));
+}
+
+/**
+ * @brief Método que descuenta del cubo los bytes enviados.
+ * @param[in] bytes: bytes enviados.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void token_bucket::consume(size_t bytes, uint64_t now) {
+  if (tokens_per_second <= 0) { return; }
+  refill(now);
+  tokens -= static_cast<double>(bytes);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Constructor de congestion_controller
+ * @param[in] mode: algoritmo de control de congestión (ninguno, AIMD por pérdidas o basado en el retardo).
+ * @param[in] chunk_size: tamaño de cada bloque, para convertir la ventana en una tasa.
+ * @param[in] min_window: ventana mínima, en bloques.
+ */
+congestion_controller::congestion_controller(congestion_mode mode, size_t chunk_size, size_t min_window)
+    : mode(mode), chunk_size(chunk_size), min_window(min_window), congestion_window(static_cast<double>(2 * min_window)),
+      slow_start_threshold(std::numeric_limits<double>::max()) {}
+
+/**
+ * @brief Método que hace crecer la ventana con los bloques confirmados: la duplica cada RTT en el arranque lento, y le suma
+ *        un bloque por RTT después (incremento aditivo). En el modo por retardo, un RTT que crece sobre el mínimo indica
+ *        que se está formando cola en algún punto del camino, y se reduce la ventana antes de que haya pérdidas.
+ * @param[in] acked_chunks: bloques confirmados por la última confirmación.
+ * @param[in] srtt: RTT suavizado, en microsegundos.
+ * @param[in] min_rtt: RTT mínimo observado, en microsegundos.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void congestion_controller::on_ack(uint64_t acked_chunks, uint64_t srtt, uint64_t min_rtt, uint64_t now) {
+  if (mode == congestion_mode::none || acked_chunks == 0) { return; }
+  last_srtt = srtt;
+
+  if (mode == congestion_mode::delay && srtt != 0 && srtt > min_rtt) {
+    uint64_t queue_delay = srtt - min_rtt;
+    if (queue_delay > std::max<uint64_t>(min_rtt / 2, 1000)) {
+      decrease(now, 0.85);
+      return;
+    }
+  }
+
+  if (congestion_window < slow_start_threshold) {
+    congestion_window += static_cast<double>(acked_chunks);
+  } else {
+    congestion_window += static_cast<double>(acked_chunks) / congestion_window;
+  }
+}
+
+/**
+ * @brief Método que reduce la ventana multiplicativamente al detectar una pérdida.
+ * @param[in] sent_time: instante en el que se envió el bloque perdido, en microsegundos.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void congestion_controller::on_loss(uint64_t sent_time, uint64_t now) {
+  if (mode == congestion_mode::none) { return; }
+  // Si el bloque se envió antes de la última reducción, su pérdida ya se ha tenido en cuenta
+  if (sent_time <= last_decrease) { return; }
+  decrease(now, 0.7);
+}
+
+/**
+ * @brief Método que vuelve a la ventana mínima y al arranque lento cuando vence el RTO (no llegan confirmaciones).
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void congestion_controller::on_timeout(uint64_t now) {
+  if (mode == congestion_mode::none) { return; }
+  slow_start_threshold = std::max(congestion_window / 2, static_cast<double>(min_window));
+  congestion_window = static_cast<double>(min_window);
+  last_decrease = now;
+}
+
+/**
+ * @brief Método que reduce la ventana por un factor, como mucho una vez por RTT, y sale del arranque lento.
+ * @param[in] now: instante actual, en microsegundos.
+ * @param[in] factor: factor de reducción de la ventana.
+ */
+void congestion_controller::decrease(uint64_t now, double factor) {
+  if (last_decrease != 0 && now - last_decrease < last_srtt) { return; }
+  congestion_window = std::max(congestion_window * factor, static_cast<double>(min_window));
+  slow_start_threshold = congestion_window;
+  last_decrease = now;
+}
+
+/**
+ * @brief Método que devuelve la ventana de congestión.
+ * @return Devuelve la ventana en bloques, o el máximo representable si no hay control de congestión.
+ */
+size_t congestion_controller::window() const {
+  if (mode == congestion_mode::none) { return std::numeric_limits<size_t>::max(); }
+  return static_cast<size_t>(congestion_window);
+}
+
+/**
+ * @brief Método que calcula la tasa de envío que reparte la ventana a lo largo de un RTT, con un margen (el doble durante el
+ *        arranque lento) para que la tasa no impida que la ventana crezca.
+ * @param[in] srtt: RTT suavizado, en microsegundos.
+ * @return Devuelve la tasa en bytes por segundo, o 0 si no hay control de congestión o todavía no se conoce el RTT.
+ */
+double congestion_controller::pacing_rate(uint64_t srtt) const {
+  if (mode == congestion_mode::none || srtt == 0) { return 0; }
+  double gain = (congestion_window < slow_start_threshold) ? 2.0 : 1.25;
+  return gain * congestion_window * static_cast<double>(chunk_size) * 1e6 / static_cast<double>(srtt);
+}
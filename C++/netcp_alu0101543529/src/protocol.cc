@@ -0,0 +1,199 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del formato de los datagramas del protocolo de netcp
+ */
+
+#include "header_files/protocol.h"
+#include "header_files/checksum.h"
+#include <cstring>
+#include <chrono>
+#include <endian.h>
+
+/**
+ * @brief Función que codifica una cabecera en orden de bytes de red.
+ * @param[in] header: cabecera que vamos a codificar.
+ * @param[out] out: memoria de al menos PACKET_HEADER_SIZE bytes donde se escribe la cabecera.
+ */
+void encode_header(const packet_header& header, uint8_t* out) {
+  uint16_t length = htobe16(header.length);
+  uint32_t session = htobe32(header.session);
+  uint16_t stream = htobe16(header.stream);
+  uint16_t stream_count = htobe16(header.stream_count);
+  uint64_t sequence = htobe64(header.sequence);
+  uint64_t offset = htobe64(header.offset);
+  uint64_t timestamp = htobe64(header.timestamp);
+  uint64_t total_size = htobe64(header.total_size);
+  uint32_t chunk_size = htobe32(header.chunk_size);
+
+  out[0] = static_cast<uint8_t>(header.type);
+  out[1] = header.flags;
+  std::memcpy(out + 2, &length, sizeof(length));
+  std::memcpy(out + 4, &session, sizeof(session));
+  std::memcpy(out + 8, &stream, sizeof(stream));
+  std::memcpy(out + 10, &stream_count, sizeof(stream_count));
+  std::memcpy(out + 12, &sequence, sizeof(sequence));
+  std::memcpy(out + 20, &offset, sizeof(offset));
+  std::memcpy(out + 28, &timestamp, sizeof(timestamp));
+  std::memcpy(out + 36, &total_size, sizeof(total_size));
+  std::memcpy(out + 44, &chunk_size, sizeof(chunk_size));
+  std::memset(out + PACKET_CHECKSUM_OFFSET, 0, sizeof(uint32_t));
+}
+
+/**
+ * @brief Función que escribe en una cabecera ya codificada el CRC32C del datagrama completo. El de los datos se calcula una
+ *        sola vez aunque el bloque se reenvíe: solo hay que calcular el de la cabecera (que cambia en cada envío) y combinarlos.
+ * @param[in,out] header: cabecera codificada, con el campo del CRC32C a cero.
+ * @param[in] payload_checksum: CRC32C de los datos que siguen a la cabecera.
+ * @param[in] payload_length: tamaño de los datos que siguen a la cabecera.
+ */
+void seal_header(uint8_t* header, uint32_t payload_checksum, size_t payload_length) {
+  uint32_t checksum = crc32c_combine(crc32c(header, PACKET_HEADER_SIZE), payload_checksum, payload_length);
+  checksum = htobe32(checksum);
+  std::memcpy(header + PACKET_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+}
+
+/**
+ * @brief Función que comprueba el CRC32C de un datagrama recibido, calculándolo con el campo del CRC32C a cero.
+ * @param[in] in: contenido del datagrama.
+ * @param[in] size: tamaño del datagrama.
+ * @return Devuelve true si el CRC32C coincide con el de la cabecera, y false si el datagrama es demasiado corto o está dañado.
+ */
+bool verify_checksum(const uint8_t* in, size_t size) {
+  if (size < PACKET_HEADER_SIZE) { return false; }
+
+  static const uint8_t zeros[sizeof(uint32_t)] = {};
+  uint32_t stored;
+  std::memcpy(&stored, in + PACKET_CHECKSUM_OFFSET, sizeof(stored));
+  uint32_t checksum = crc32c(in, PACKET_CHECKSUM_OFFSET);
+  checksum = crc32c(zeros, sizeof(zeros), checksum);
+  checksum = crc32c(in + PACKET_HEADER_SIZE, size - PACKET_HEADER_SIZE, checksum);
+  return checksum == be32toh(stored);
+}
+
+/**
+ * @brief Función que decodifica la cabecera de un datagrama recibido.
+ * @param[in] in: contenido del datagrama.
+ * @param[in] size: tamaño del datagrama.
+ * @param[out] header: cabecera decodificada.
+ * @return Devuelve false si el datagrama es demasiado corto o su longitud no coincide con la de la cabecera, y true en caso contrario.
+ */
+bool decode_header(const uint8_t* in, size_t size, packet_header& header) {
+  if (size < PACKET_HEADER_SIZE) { return false; }
+
+  uint16_t length, stream, stream_count;
+  uint32_t session, chunk_size;
+  uint64_t sequence, offset, timestamp, total_size;
+  std::memcpy(&length, in + 2, sizeof(length));
+  std::memcpy(&session, in + 4, sizeof(session));
+  std::memcpy(&stream, in + 8, sizeof(stream));
+  std::memcpy(&stream_count, in + 10, sizeof(stream_count));
+  std::memcpy(&sequence, in + 12, sizeof(sequence));
+  std::memcpy(&offset, in + 20, sizeof(offset));
+  std::memcpy(&timestamp, in + 28, sizeof(timestamp));
+  std::memcpy(&total_size, in + 36, sizeof(total_size));
+  std::memcpy(&chunk_size, in + 44, sizeof(chunk_size));
+
+  header.type = static_cast<packet_type>(in[0]);
+  header.flags = in[1];
+  header.length = be16toh(length);
+  header.session = be32toh(session);
+  header.stream = be16toh(stream);
+  header.stream_count = be16toh(stream_count);
+  header.sequence = be64toh(sequence);
+  header.offset = be64toh(offset);
+  header.timestamp = be64toh(timestamp);
+  header.total_size = be64toh(total_size);
+  header.chunk_size = be32toh(chunk_size);
+
+  // Un datagrama truncado o con basura al final, o de un flujo que no existe, no se da por válido
+  return size == PACKET_HEADER_SIZE + header.length && header.stream < header.stream_count;
+}
+
+/**
+ * @brief Función que codifica los rangos SACK de una confirmación.
+ * @param[in] blocks: rangos de bloques recibidos fuera de orden (como máximo MAX_SACK_BLOCKS).
+ * @param[out] out: memoria donde se escriben los rangos, 16 bytes por rango.
+ * @return Devuelve el número de bytes escritos.
+ */
+size_t encode_sack(const std::vector<sack_block>& blocks, uint8_t* out) {
+  size_t written = 0;
+  for (size_t i = 0; i < blocks.size() && i < MAX_SACK_BLOCKS; ++i) {
+    uint64_t start = htobe64(blocks[i].start);
+    uint64_t end = htobe64(blocks[i].end);
+    std::memcpy(out + written, &start, sizeof(start));
+    std::memcpy(out + written + 8, &end, sizeof(end));
+    written += 16;
+  }
+  return written;
+}
+
+/**
+ * @brief Función que decodifica los rangos SACK de una confirmación.
+ * @param[in] in: rangos codificados.
+ * @param[in] size: número de bytes de los rangos codificados.
+ * @param[out] blocks: rangos decodificados.
+ * @return Devuelve false si el tamaño no corresponde a un número entero de rangos válidos, y true en caso contrario.
+ */
+bool decode_sack(const uint8_t* in, size_t size, std::vector<sack_block>& blocks) {
+  blocks.clear();
+  if (size % 16 != 0 || size / 16 > MAX_SACK_BLOCKS) { return false; }
+
+  for (size_t offset = 0; offset < size; offset += 16) {
+    uint64_t start, end;
+    std::memcpy(&start, in + offset, sizeof(start));
+    std::memcpy(&end, in + offset + 8, sizeof(end));
+    sack_block block{be64toh(start), be64toh(end)};
+    if (block.start >= block.end) { return false; }
+    blocks.push_back(block);
+  }
+  return true;
+}
+
+/**
+ * @brief Función que codifica los datos de un bloque de paridad, que van delante del símbolo.
+ * @param[in] info: datos del bloque de paridad.
+ * @param[out] out: memoria de al menos FEC_PARITY_PREFIX bytes donde se escriben.
+ */
+void encode_parity_info(const fec_parity_info& info, uint8_t* out) {
+  uint32_t last_length = htobe32(info.last_length);
+  out[0] = info.data_count;
+  out[1] = info.parity_count;
+  out[2] = info.index;
+  out[3] = info.group_count;
+  std::memcpy(out + 4, &last_length, sizeof(last_length));
+}
+
+/**
+ * @brief Función que decodifica los datos de un bloque de paridad recibido.
+ * @param[in] in: datos del bloque de paridad (tras la cabecera).
+ * @param[in] size: tamaño de los datos del bloque de paridad, con el símbolo.
+ * @param[out] info: datos decodificados.
+ * @return Devuelve false si el bloque es demasiado corto o sus datos no son coherentes, y true en caso contrario.
+ */
+bool decode_parity_info(const uint8_t* in, size_t size, fec_parity_info& info) {
+  if (size < FEC_PARITY_PREFIX) { return false; }
+
+  uint32_t last_length;
+  std::memcpy(&last_length, in + 4, sizeof(last_length));
+  info.data_count = in[0];
+  info.parity_count = in[1];
+  info.index = in[2];
+  info.group_count = in[3];
+  info.last_length = be32toh(last_length);
+  return info.index < info.parity_count && info.group_count > 0 && info.group_count <= info.data_count && info.last_length > 0;
+}
+
+/**
+ * @brief Función que devuelve el instante actual en microsegundos.
+ * @return Devuelve los microsegundos transcurridos según un reloj monótono (que no salta si se cambia la hora del sistema).
+ */
+uint64_t now_microseconds() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
@@ -0,0 +1,142 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del proxy UDP local que introduce pérdidas, reordenaciones, duplicados y retardo, para probar la
+ *         transferencia fiable
+ */
+
+#include "header_files/proxy.h"
+#include "header_files/protocol.h"
+#include <poll.h>
+#include <random>
+#include <queue>
+
+// Datagrama retenido por el proxy hasta el instante en que debe reenviarse
+struct delayed_datagram {
+  uint64_t release;
+  // Orden de llegada, para que los datagramas con el mismo instante de salida mantengan su orden
+  uint64_t order;
+  bool to_target;
+  std::vector<uint8_t> data;
+  // La cola de prioridad saca primero el mayor, así que el "mayor" es el que sale antes
+  bool operator<(const delayed_datagram& other) const {
+    return release != other.release ? release > other.release : order > other.order;
+  }
+};
+
+/**
+ * @brief Función que hace de intermediario entre un emisor y un receptor de netcp, alterando los datagramas en ambos sentidos:
+ *        los descarta, duplica o retiene al azar, y les añade un retardo fijo. Los datagramas que llegan al puerto local se
+ *        reenvían al destino, y las respuestas del destino se devuelven a la última dirección que nos ha escrito. Los que
+ *        tienen que esperar se guardan en una cola ordenada por su instante de salida.
+ * @param[in] listen_port: puerto local en el que escucha el proxy (el emisor debe usarlo como NETCP_PORT).
+ * @param[in] target: dirección del receptor al que se reenvían los datagramas.
+ * @param[in] options: alteraciones que se introducen en los datagramas.
+ * @return Devuelve un código de error si no se ha podido crear algún socket o reenviar un datagrama, y no termina en otro caso.
+ */
+std::error_code netcp_proxy(uint16_t listen_port, const sockaddr_storage& target, const proxy_options& options) {
+  // Socket en el que recibimos a los clientes, y socket (en un puerto cualquiera, y de la familia del destino) desde el que
+  // hablamos con el destino
+  auto client_socket = make_socket(make_ip_address("127.0.0.1", listen_port));
+  if (!client_socket) { return client_socket.error(); }
+  auto target_socket = make_socket(make_ip_address(target.ss_family == AF_INET6 ? "::" : "0.0.0.0", 0));
+  if (!target_socket) {
+    close(*client_socket);
+    return target_socket.error();
+  }
+
+  std::mt19937_64 random(std::random_device{}());
+  std::bernoulli_distribution drop(options.loss);
+  std::bernoulli_distribution hold(options.reorder);
+  std::bernoulli_distribution repeat(options.duplicate);
+
+  sockaddr_storage client{};
+  bool has_client = false;
+  uint64_t forwarded = 0, dropped = 0, reordered = 0, duplicated = 0, arrivals = 0;
+  std::vector<uint8_t> buffer(65536);
+  std::priority_queue<delayed_datagram> delayed;
+  pollfd descriptors[2] = {{*client_socket, POLLIN, 0}, {*target_socket, POLLIN, 0}};
+
+  // Reenvía un datagrama a su destino (el receptor o el último cliente)
+  auto forward = [&](bool to_target, const uint8_t* data, size_t length) {
+    const sockaddr_storage& destination = to_target ? target : client;
+    int output = to_target ? *target_socket : *client_socket;
+    if (sendto(output, data, length, 0, reinterpret_cast<const sockaddr*>(&destination), address_length(destination)) < 0 && errno != ECONNREFUSED) {
+      log_error() << "Error: El proxy no ha podido reenviar un datagrama.";
+      return std::error_code(errno, std::system_category());
+    }
+    ++forwarded;
+    return std::error_code(0, std::system_category());
+  };
+
+  log_info() << "Reenviando datagramas del puerto " << listen_port << " con una pérdida del " << options.loss * 100 << "%, "
+             << options.reorder * 100 << "% desordenados, " << options.duplicate * 100 << "% duplicados y " << options.delay / 1000.0
+             << " ms de retardo...";
+  std::error_code error(0, std::system_category());
+  while (!quit_requested && !error) {
+    // Si hay datagramas retenidos, esperamos como mucho hasta que le toque salir al primero
+    int timeout = -1;
+    if (!delayed.empty()) {
+      uint64_t now = now_microseconds();
+      timeout = (delayed.top().release > now) ? static_cast<int>((delayed.top().release - now + 999) / 1000) : 0;
+    }
+    if (poll(descriptors, 2, timeout) < 0) {
+      if (errno == EINTR) { continue; }
+      error = std::error_code(errno, std::system_category());
+      break;
+    }
+
+    for (int i = 0; i < 2 && !error; ++i) {
+      if (!(descriptors[i].revents & POLLIN)) { continue; }
+
+      sockaddr_storage source{};
+      socklen_t source_length = sizeof(source);
+      ssize_t received = recvfrom(descriptors[i].fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&source), &source_length);
+      if (received < 0) { continue; }
+
+      // Los datagramas del cliente van al destino, y los del destino vuelven al cliente
+      if (i == 0) {
+        client = source;
+        has_client = true;
+      } else if (!has_client) {
+        continue;
+      }
+
+      if (drop(random)) {
+        ++dropped;
+        continue;
+      }
+
+      // Sin retardo, los datagramas que no se retienen ni se duplican salen sin pasar por la cola
+      bool held = hold(random);
+      int copies = repeat(random) ? 2 : 1;
+      reordered += held;
+      duplicated += copies - 1;
+      if (options.delay == 0 && !held) {
+        for (int copy = 0; copy < copies && !error; ++copy) { error = forward(i == 0, buffer.data(), static_cast<size_t>(received)); }
+        continue;
+      }
+      uint64_t release = now_microseconds() + options.delay + (held ? REORDER_HOLD : 0);
+      for (int copy = 0; copy < copies; ++copy) {
+        delayed.push({release, arrivals++, i == 0, std::vector<uint8_t>(buffer.begin(), buffer.begin() + received)});
+      }
+    }
+
+    // Reenviamos los datagramas retenidos a los que ya les ha llegado su momento
+    for (uint64_t now = now_microseconds(); !error && !delayed.empty() && delayed.top().release <= now;) {
+      error = forward(delayed.top().to_target, delayed.top().data.data(), delayed.top().data.size());
+      delayed.pop();
+    }
+  }
+
+  log_info() << "Datagramas reenviados: " << forwarded << ", descartados: " << dropped << ", desordenados: " << reordered
+             << ", duplicados: " << duplicated;
+  close(*client_socket);
+  close(*target_socket);
+  return error;
+}
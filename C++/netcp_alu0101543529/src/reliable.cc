@@ -0,0 +1,2009 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de la transferencia fiable sobre UDP: números de secuencia, ventana deslizante y confirmaciones selectivas
+ */
+
+#include "header_files/reliable.h"
+#include "header_files/fanout.h"
+#include <poll.h>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <endian.h>
+#include <bit>
+#include <sys/ioctl.h>
+
+// Número máximo de intentos de envío del FIN
+constexpr int MAX_FIN_ATTEMPTS = 20;
+
+// Tiempo sin enviar nada tras el cual el emisor de una tubería avisa al receptor de que sigue activo, en microsegundos
+constexpr uint64_t KEEPALIVE_INTERVAL = 1000000;
+
+// Modo io_uring: entradas de los anillos de peticiones y completadas, tamaño de la zona de lecturas adelantadas (sus ranuras
+// de un bloque limitan la ventana) y lecturas en curso como máximo. Las peticiones de lectura se marcan en user_data con URING_READ
+constexpr unsigned URING_ENTRIES = 256;
+constexpr unsigned URING_COMPLETIONS = 2048;
+constexpr size_t URING_ARENA_SIZE = 16 * 1024 * 1024;
+constexpr size_t URING_MAX_READS = 32;
+constexpr uint64_t URING_READ = 1ULL << 63;
+
+// Con varios caminos: tiempo mínimo sin ninguna entrega de un camino con envíos pendientes para darlo por caído, tiempo tras
+// el que se vuelve a probar, y parte mínima de la tasa del mejor camino con la que se reparte a los que responden
+constexpr uint64_t PATH_TIMEOUT = 200000;
+constexpr uint64_t PATH_RETRY = 1000000;
+constexpr double PATH_MIN_SHARE = 1.0 / 16;
+
+/**
+ * @brief Constructor de reliable_sender
+ * @param[in] paths: caminos (socket local y dirección del receptor) entre los que se reparten los bloques; por todos ellos
+ *            se reciben las confirmaciones.
+ * @param[in] options: opciones de la transferencia (tamaño del lote de datagramas, ...).
+ * @param[in] session: identificador de la transferencia.
+ * @param[in] stream: flujo de la transferencia que envía este emisor.
+ * @param[in] stream_count: número total de flujos de la transferencia.
+ * @param[in] compressor: hilos que comprimen los bloques antes de enviarlos, o nullptr para enviarlos sin comprimir.
+ * @param[in] transfer_size: tamaño de toda la transferencia (0 si es solo el rango de este emisor).
+ * @param[in] feed: almacén de bloques compartido con los emisores de los demás receptores de un envío en abanico, o nullptr.
+ */
+reliable_sender::reliable_sender(const std::vector<path_socket>& paths, const netcp_options& options, uint32_t session,
+                                 uint16_t stream, uint16_t stream_count, worker_pool* compressor, uint64_t transfer_size,
+                                 chunk_feed* feed)
+    : paths(paths.size()), options(options), session(session), stream(stream), stream_count(stream_count),
+      compressor(compressor), feed(feed), transfer_size(transfer_size), chunk_size(choose_chunk_size(paths, options)),
+      chunk_pool(chunk_size + (options.secret ? FEC_PARITY_PREFIX + AEAD_OVERHEAD : 0), 0),
+      fd(-1), range_offset(0), range_size(0), mapping(nullptr), total_chunks(0),
+      congestion(options.congestion, chunk_size, std::max(MIN_WINDOW, 2 * options.batch_size)),
+      pacer(options.pacing_rate, options.batch_size * (PACKET_HEADER_SIZE + chunk_size)) {
+  // La tasa máxima que se haya pedido es para toda la transferencia, así que se reparte entre los flujos
+  this->options.pacing_rate = options.pacing_rate / stream_count;
+  pacer.set_rate(this->options.pacing_rate);
+  for (size_t i = 0; i < paths.size(); ++i) { this->paths[i].route = paths[i]; }
+  for (size_t row = 0; row < options.fec_parity; ++row) { fec_rows.push_back(row); }
+}
+
+/**
+ * @brief Función que genera el identificador aleatorio de una transferencia, para que el receptor descarte los datagramas de
+ *        transferencias anteriores que le sigan llegando.
+ * @return Devuelve un identificador distinto de 0 (el 0 indica que el receptor aún no tiene transferencia).
+ */
+uint32_t make_session_id() {
+  std::random_device random;
+  uint32_t session = 0;
+  while (session == 0) { session = random(); }
+  return session;
+}
+
+/**
+ * @brief Método que envía un rango del fichero y espera a que el receptor confirme todos sus bloques.
+ * @param[in] fd: descriptor del fichero que vamos a enviar (se lee con preadv() si no hay proyección).
+ * @param[in] range_offset: posición del fichero en la que empieza el rango (múltiplo del tamaño de bloque).
+ * @param[in] range_size: tamaño del rango.
+ * @param[in] mapping: proyección del fichero completo en memoria, o nullptr si los bloques se deben leer del descriptor.
+ * @return Devuelve un código de error si no se ha podido completar la transferencia, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send(int fd, size_t range_offset, size_t range_size, const uint8_t* mapping) {
+  prepare(fd, range_offset, range_size, mapping);
+  return transfer();
+}
+
+/**
+ * @brief Método que envía lo que se vaya leyendo de una tubería (por ejemplo, la salida de un comando) hasta que se cierre,
+ *        y espera a que el receptor lo confirme todo. El tamaño no se conoce hasta el final, así que los datagramas lo
+ *        indican como desconocido y el número de bloques se fija al leer el fin de la tubería.
+ * @param[in] fd: extremo de lectura de la tubería, en modo no bloqueante.
+ * @return Devuelve un código de error si no se ha podido completar la transferencia, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send_pipe(int fd) {
+  prepare_pipe(fd);
+  return transfer();
+}
+
+/**
+ * @brief Método que prepara el envío de un rango del fichero, sin empezarlo: lo empieza la primera llamada a step().
+ * @param[in] fd: descriptor del fichero que vamos a enviar (se lee con preadv() si no hay proyección).
+ * @param[in] range_offset: posición del fichero en la que empieza el rango (múltiplo del tamaño de bloque).
+ * @param[in] range_size: tamaño del rango.
+ * @param[in] mapping: proyección del fichero completo en memoria, o nullptr si los bloques se deben leer del descriptor.
+ */
+void reliable_sender::prepare(int fd, size_t range_offset, size_t range_size, const uint8_t* mapping) {
+  this->fd = fd;
+  this->range_offset = range_offset;
+  this->range_size = range_size;
+  this->mapping = mapping;
+  total_chunks = (range_size + chunk_size - 1) / chunk_size;
+  // Si no se ha indicado el tamaño de toda la transferencia, es que este rango es el último (o el único)
+  transfer_size = std::max<uint64_t>(transfer_size, range_offset + range_size);
+}
+
+/**
+ * @brief Método que prepara el envío de una tubería, sin empezarlo: lo empieza la primera llamada a step().
+ * @param[in] fd: extremo de lectura de la tubería, en modo no bloqueante.
+ */
+void reliable_sender::prepare_pipe(int fd) {
+  this->fd = fd;
+  range_offset = 0;
+  range_size = 0;
+  mapping = nullptr;
+  streaming = true;
+  pipe_buffer = chunk_pool.acquire();
+  total_chunks = UINT64_MAX;
+  transfer_size = UNKNOWN_TOTAL_SIZE;
+}
+
+/**
+ * @brief Método que realiza la transferencia ya configurada por send() o send_pipe(): la avanza con step() y, entre paso y
+ *        paso, espera a que llegue alguna confirmación (o a que haya algo que leer de la tubería) hasta el instante que indique.
+ * @return Devuelve un código de error si no se ha podido completar la transferencia, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::transfer() {
+  std::vector<pollfd> descriptors;
+  for (;;) {
+    transfer_progress progress = step();
+    if (progress.done) { return progress.error; }
+
+    // Usamos ppoll() porque el ritmo de envío necesita esperas más finas que el milisegundo de poll()
+    uint64_t now = now_microseconds();
+    uint64_t timeout = (progress.wake_at > now) ? progress.wake_at - now : 0;
+    // Las confirmaciones pueden llegar por cualquiera de los caminos, y la tubería va detrás de sus sockets
+    descriptors.clear();
+    for (const send_path& path : paths) { descriptors.push_back({path.route.socket_fd, POLLIN, 0}); }
+    if (progress.wants_input) { descriptors.push_back({fd, POLLIN, 0}); }
+    timespec wait = {static_cast<time_t>(timeout / 1000000), static_cast<long>(timeout % 1000000) * 1000};
+    if (timeout > 0) { ppoll(descriptors.data(), descriptors.size(), &wait, nullptr); }
+  }
+}
+
+/**
+ * @brief Método que avanza la transferencia todo lo que se pueda sin bloquearse: recoge las confirmaciones que hayan llegado,
+ *        reenvía los bloques perdidos y envía los nuevos que permitan la ventana y el ritmo de envío; y, cuando el receptor
+ *        lo tiene todo, envía el FIN y recoge su confirmación. La primera llamada prepara el socket y la E/S.
+ * @return Devuelve si la transferencia ha terminado y con qué resultado o, si no, cuándo hay que volver a llamarlo.
+ */
+transfer_progress reliable_sender::step() {
+  if (phase == send_phase::idle) {
+    start();
+    if (options.secret && !sealer) { return complete(std::error_code(EIO, std::system_category())); }
+  }
+  if (quit_requested) { return complete(std::error_code(0, std::system_category())); }
+  if (phase == send_phase::finishing) { return step_finish(); }
+
+  if (std::error_code error = process_acks()) { return complete(error); }
+  if (std::error_code error = retransmit()) { return complete(error); }
+  if (std::error_code error = send_new_chunks()) { return complete(error); }
+
+  // Sin nada pendiente de confirmar no hay nada que esperar del receptor; si la tubería lleva tiempo sin datos, le avisamos
+  // de que seguimos ahí para que no dé por perdida la transferencia
+  uint64_t now = now_microseconds();
+  if (window.empty()) {
+    last_progress = now;
+    if (streaming && now - last_sent > KEEPALIVE_INTERVAL) {
+      if (std::error_code error = send_keepalive()) { return complete(error); }
+    }
+  }
+  if (now - last_progress > PEER_TIMEOUT) {
+    log_error() << "Error: El receptor no responde.";
+    return complete(std::error_code(ETIMEDOUT, std::system_category()));
+  }
+
+  if (next_sequence >= total_chunks && window.empty()) {
+    phase = send_phase::finishing;
+    fin_timeout = std::max<uint64_t>(rto, 10000);
+    return step_finish();
+  }
+
+  // Si hay algo que enviar, solo esperamos lo que nos imponga el ritmo de envío; si no, a que llegue alguna confirmación (o
+  // a que venza el RTO, o a que haya algo que leer de la tubería, que si no hay nada pendiente de confirmar es lo único que
+  // esperamos)
+  transfer_progress progress;
+  bool can_send = !lost_queue.empty() || (next_sequence < total_chunks && window.size() < window_limit && (!streaming || !staged.empty()));
+  uint64_t idle_wait = (streaming && window.empty()) ? KEEPALIVE_INTERVAL : 1000;
+  progress.wake_at = now + (can_send ? pacer.delay(now) : idle_wait);
+  progress.wants_input = streaming && !pipe_closed && staged.empty() && window.size() < window_limit;
+  return progress;
+}
+
+/**
+ * @brief Método que prepara el socket y la E/S al empezar la transferencia: la clave del cifrado, MSG_ZEROCOPY, UDP_SEGMENT,
+ *        io_uring y el ritmo de envío del núcleo, según lo que se haya pedido y lo que admita el sistema.
+ */
+void reliable_sender::start() {
+  phase = send_phase::data;
+
+  // Con clave compartida, cada envío cifra con su propia clave, derivada de ella con una sal nueva (la misma para todos los
+  // emisores de un envío en abanico, que comparten los bloques ya cifrados)
+  if (options.secret) {
+    cipher_key = feed ? feed->key() : make_key(*options.secret, options.cipher);
+    if (cipher_key) {
+      sealer = std::make_unique<aead_context>(*cipher_key);
+      if (feed == nullptr) { log_info() << "Flujo " << stream << ": los datos se cifran con " << aead_name(cipher_key->algorithm) << "."; }
+    }
+  }
+
+  // Si enviamos desde la proyección y el socket admite MSG_ZEROCOPY, el núcleo envía las páginas sin copiarlas (siempre que
+  // cada datagrama, con la cabecera y los datos sin alinear, quepa en ZEROCOPY_MAX_FRAGMENTS páginas)
+  for (send_path& path : paths) {
+    if (mapping != nullptr && (chunk_size - 1) / 4096 + 4 <= ZEROCOPY_MAX_FRAGMENTS) {
+      int enable = 1;
+      path.use_zerocopy = setsockopt(path.route.socket_fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+      if (!path.use_zerocopy) {
+        log_info() << "El socket no admite MSG_ZEROCOPY, se enviarán los datos copiándolos.";
+      }
+    }
+
+    // Si el núcleo lo admite, los datagramas de cada lote se agrupan con UDP_SEGMENT y el núcleo los separa
+    path.segmentation = options.udp_offload && udp_segmentation_supported(path.route.socket_fd);
+  }
+
+  // Si se ha pedido io_uring y leemos del descriptor, las lecturas del fichero se adelantan a los envíos (salvo en un envío en
+  // abanico, cuyos bloques no pueden quedarse en las ranuras de la zona de lecturas de un emisor)
+  if (options.use_io_uring && mapping == nullptr && !streaming && feed == nullptr && total_chunks > 0) {
+    if (std::error_code error = setup_uring()) {
+      log_info() << "io_uring no está disponible (" << error.message() << "), se usará la E/S normal.";
+    }
+  }
+
+  // Si se ha pedido, el núcleo reparte los envíos en el tiempo; si no admite SO_MAX_PACING_RATE, lo hace el cubo de tokens.
+  // La tasa del núcleo es la de un socket, así que con varios caminos el ritmo de toda la transferencia lo lleva netcp
+  if (options.kernel_pacing && paths.size() > 1) {
+    log_info() << "Con varios caminos, el ritmo de envío lo controlará netcp.";
+    options.kernel_pacing = false;
+  }
+  if (options.kernel_pacing) {
+    uint64_t rate = (options.pacing_rate > 0) ? static_cast<uint64_t>(options.pacing_rate) : ~0ULL;
+    if (setsockopt(paths[0].route.socket_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0) {
+      kernel_pacing_rate = static_cast<double>(rate);
+      pacer.set_rate(0);
+    } else {
+      log_info() << "El socket no admite SO_MAX_PACING_RATE, el ritmo de envío lo controlará netcp.";
+      options.kernel_pacing = false;
+    }
+  }
+  update_pacing();
+
+  last_progress = now_microseconds();
+}
+
+/**
+ * @brief Método que termina la transferencia: espera a los bloques que sigan en manos de los hilos de compresión y a que el
+ *        núcleo suelte las páginas enviadas con MSG_ZEROCOPY.
+ * @param[in] error: resultado de la transferencia.
+ * @return Devuelve el progreso final, con el resultado indicado.
+ */
+transfer_progress reliable_sender::complete(std::error_code error) {
+  phase = send_phase::idle;
+
+  // Los bloques preparados que no se hayan llegado a enviar pueden estar aún en manos de los hilos de compresión
+  for (staged_batch& batch : staged_batches) {
+    if (batch.done.valid()) { batch.done.wait(); }
+  }
+  for (inflight_chunk& chunk : staged) {
+    if (chunk.shared && chunk.shared->ready.valid()) { chunk.shared->ready.wait(); }
+  }
+  if (compressor != nullptr && !error) {
+    log_info() << "Flujo " << stream << ": " << raw_bytes << " bytes del fichero enviados en " << wire_bytes << " bytes comprimidos.";
+  }
+
+  // Las páginas de la proyección no se pueden liberar hasta que el núcleo haya terminado de enviar los datagramas que las usan
+  for (send_path& path : paths) {
+    while (path.use_zerocopy && path.zerocopy.completed < path.zerocopy.sent) {
+      if (drain_zerocopy(path.route.socket_fd, path.zerocopy, true) == 0 && errno != EAGAIN && errno != EINTR) { break; }
+    }
+    if (path.use_zerocopy && path.zerocopy.copied) {
+      log_info() << "El núcleo ha tenido que copiar los datos (MSG_ZEROCOPY no es efectivo en esta interfaz).";
+    }
+  }
+
+  transfer_progress progress;
+  progress.done = true;
+  progress.error = error;
+  return progress;
+}
+
+/**
+ * @brief Método que devuelve el CRC32C del rango enviado, calculado con los datos originales del fichero.
+ * @return Devuelve el CRC32C de los bloques que han pasado a la ventana (el del rango completo si send() ha terminado bien).
+ */
+uint32_t reliable_sender::digest() const { return range_digest; }
+
+/**
+ * @brief Método que envía un lote de bloques de la ventana, escribiendo en su cabecera el instante de envío. Con varios
+ *        caminos, cada bloque va por el que elige select_path(), y los de cada camino se envían juntos.
+ * @param[in] sequences: números de secuencia de los bloques que se envían.
+ * @return Devuelve un código de error si no se ha podido enviar el lote, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send_chunks(const std::vector<uint64_t>& sequences) {
+  std::vector<datagram> datagrams(sequences.size());
+  std::vector<uint16_t> owners(sequences.size());
+  uint64_t now = now_microseconds();
+
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    inflight_chunk& chunk = window[sequences[i] - base_sequence];
+    packet_header header;
+    header.type = packet_type::data;
+    header.flags = (chunk.compressed ? FLAG_COMPRESSED : 0) | (sealer ? sealer->flags() : 0);
+    header.length = static_cast<uint16_t>(chunk.payload.iov_len);
+    header.session = session;
+    header.stream = stream;
+    header.stream_count = stream_count;
+    header.sequence = sequences[i];
+    header.offset = range_offset + static_cast<size_t>(sequences[i]) * chunk_size;
+    header.total_size = transfer_size;
+    header.chunk_size = static_cast<uint32_t>(chunk_size);
+    header.timestamp = now;
+    encode_header(header, chunk.header);
+    seal_header(chunk.header, chunk.checksum, chunk.payload.iov_len);
+    chunk.last_sent = now;
+    if (chunk.first_sent == 0) { chunk.first_sent = now; }
+    chunk.lost = false;
+    chunk.path = owners[i] = static_cast<uint16_t>(select_path());
+    send_path& path = paths[chunk.path];
+    ++path.inflight;
+    if (path.unanswered_since == 0) { path.unanswered_since = now; }
+
+    datagrams[i].parts[0] = {chunk.header, PACKET_HEADER_SIZE};
+    datagrams[i].parts[1] = chunk.payload;
+    datagrams[i].part_count = 2;
+  }
+
+  size_t bytes = 0;
+  for (const datagram& packet : datagrams) { bytes += packet.parts[0].iov_len + packet.parts[1].iov_len; }
+  pacer.consume(bytes, now);
+  last_sent = now;
+  count_metric(metric::datagrams_sent, datagrams.size());
+
+  if (ring.active()) { return send_uring(datagrams, owners); }
+
+  std::vector<datagram> selected;
+  for (size_t index = 0; index < paths.size(); ++index) {
+    send_path& path = paths[index];
+    // Con un solo camino el lote entero es suyo; con varios, se separan los datagramas de cada uno
+    if (paths.size() > 1) {
+      selected.clear();
+      for (size_t i = 0; i < datagrams.size(); ++i) {
+        if (owners[i] == index) { selected.push_back(datagrams[i]); }
+      }
+      if (selected.empty()) { continue; }
+    }
+    const std::vector<datagram>& batch = (paths.size() > 1) ? selected : datagrams;
+
+    bool segmented = path.segmentation;
+    std::error_code error = send_batch(path.route.socket_fd, batch, path.route.destination, path.use_zerocopy ? &path.zerocopy : nullptr,
+                                       &path.segmentation);
+    if (segmented && !path.segmentation) { log_info() << "La interfaz no admite UDP_SEGMENT, se enviarán los datagramas por separado."; }
+    // Recogemos sin bloquearnos las notificaciones de los envíos ya completados, para que no se acumulen en la cola de errores
+    if (path.use_zerocopy) { drain_zerocopy(path.route.socket_fd, path.zerocopy, false); }
+    if (error) { return error; }
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que elige el camino de un bloque: el que antes vaciaría sus bloques en vuelo (más uno) a su tasa de entrega
+ *        medida. Un camino que aún no tiene medida cuenta con la del mejor, y ninguno que responda baja de PATH_MIN_SHARE de
+ *        ella, para que siga habiendo entregas con las que medirlo.
+ * @return Devuelve la posición del camino en paths.
+ */
+size_t reliable_sender::select_path() const {
+  if (paths.size() == 1) { return 0; }
+
+  double best = 0;
+  for (const send_path& path : paths) {
+    if (path.alive && path.measured) { best = std::max(best, path.rate); }
+  }
+  if (best <= 0) { best = 1; }
+
+  // check_paths() nunca da por caído el último camino que responde, pero si no quedara ninguno se usarían todos
+  bool any_alive = std::any_of(paths.begin(), paths.end(), [](const send_path& path) { return path.alive; });
+  size_t chosen = 0;
+  double chosen_cost = INFINITY;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (any_alive && !paths[i].alive) { continue; }
+    double rate = paths[i].measured ? std::max(paths[i].rate, best * PATH_MIN_SHARE) : best;
+    double cost = static_cast<double>(paths[i].inflight + 1) / rate;
+    if (cost < chosen_cost) {
+      chosen = i;
+      chosen_cost = cost;
+    }
+  }
+  return chosen;
+}
+
+/**
+ * @brief Método que, con varios caminos, da por caído el que lleva más de PATH_TIMEOUT (o dos RTO) con envíos sin ninguna
+ *        entrega: sus bloques en vuelo se dan por perdidos y se reenvían por los demás. Pasado PATH_RETRY, el camino se vuelve
+ *        a probar empezando por la parte mínima del reparto.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void reliable_sender::check_paths(uint64_t now) {
+  if (paths.size() == 1) { return; }
+
+  uint64_t timeout = std::max(2 * rto, PATH_TIMEOUT);
+  for (size_t index = 0; index < paths.size(); ++index) {
+    send_path& path = paths[index];
+    if (!path.alive) {
+      if (now >= path.retry_at) {
+        path.alive = true;
+        path.measured = true;
+        path.rate = 0;
+        path.unanswered_since = 0;
+        log_info() << "Se vuelve a probar el camino " << address_to_string(path.route.destination) << ".";
+      }
+      continue;
+    }
+
+    size_t alive = static_cast<size_t>(std::count_if(paths.begin(), paths.end(), [](const send_path& other) { return other.alive; }));
+    if (alive == 1 || path.unanswered_since == 0 || now - path.unanswered_since <= timeout) { continue; }
+
+    path.alive = false;
+    path.retry_at = now + PATH_RETRY;
+    log_warning() << "Aviso: El camino hacia " << address_to_string(path.route.destination)
+                  << " no responde, sus bloques se reenviarán por los demás.";
+    for (size_t i = 0; i < window.size(); ++i) {
+      if (!window[i].acked && !window[i].lost && window[i].path == index) { mark_lost(base_sequence + i); }
+    }
+    path.unanswered_since = 0;
+  }
+}
+
+/**
+ * @brief Método que envía un datagrama de control por todos los caminos que responden, para que llegue aunque alguno se
+ *        haya caído sin que el emisor lo sepa todavía.
+ * @param[in] packet: datagrama.
+ * @param[in] length: tamaño del datagrama.
+ * @return Devuelve true si se ha podido enviar por algún camino (errno indica el error si no).
+ */
+bool reliable_sender::send_control(const uint8_t* packet, size_t length) {
+  bool sent = false;
+  for (const send_path& path : paths) {
+    if (!path.alive && paths.size() > 1) { continue; }
+    // Un ICMP de puerto inalcanzable (el receptor aún no escucha) lo resolverá el reintento
+    if (sendto(path.route.socket_fd, packet, length, 0, reinterpret_cast<const sockaddr*>(&path.route.destination),
+               address_length(path.route.destination)) >= 0 || errno == ECONNREFUSED) {
+      sent = true;
+    }
+  }
+  return sent;
+}
+
+/**
+ * @brief Método que avisa al receptor de que el emisor sigue activo con un datagrama sin datos, para que no dé por abandonada
+ *        la transferencia mientras la tubería de la que enviamos no produce nada.
+ * @return Devuelve un código de error si no se ha podido enviar el aviso, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send_keepalive() {
+  uint8_t packet[PACKET_HEADER_SIZE];
+  packet_header header;
+  header.type = packet_type::keepalive;
+  header.session = session;
+  header.stream = stream;
+  header.stream_count = stream_count;
+  header.sequence = next_sequence;
+  header.total_size = transfer_size;
+  header.timestamp = now_microseconds();
+  encode_header(header, packet);
+  seal_header(packet, 0, 0);
+  if (!send_control(packet, sizeof(packet))) {
+    log_error() << "Error: No se ha podido enviar el aviso de actividad al receptor.";
+    return std::error_code(errno, std::system_category());
+  }
+  last_sent = header.timestamp;
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que prepara el modo io_uring: crea la cola, registra el fichero y el socket, y registra la zona de memoria
+ *        en la que se leen por adelantado los bloques, con una ranura para cada bloque que pueda estar en la ventana.
+ * @return Devuelve un código de error si el núcleo no admite io_uring o no se ha podido preparar la cola, o un código de éxito
+ *         en caso contrario (la cola solo queda activa si todo ha ido bien).
+ */
+std::error_code reliable_sender::setup_uring() {
+  if (std::error_code error = ring.setup(URING_ENTRIES, URING_COMPLETIONS)) { return error; }
+
+  uring_slots = static_cast<size_t>(std::min<uint64_t>(total_chunks, URING_ARENA_SIZE / chunk_size));
+  uring_arena = aligned_region(uring_slots * chunk_size);
+  uring_loaded.assign(uring_slots, false);
+
+  // Los descriptores registrados se identifican por su posición: 0 es el fichero y 1 + i el socket del camino i
+  std::vector<int> files = {fd};
+  for (const send_path& path : paths) { files.push_back(path.route.socket_fd); }
+  if (std::error_code error = ring.register_files(files)) { return error; }
+  if (std::error_code error = ring.register_buffers({{uring_arena.data(), uring_arena.size()}})) { return error; }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que pide al núcleo la lectura de los bloques siguientes a los ya pedidos, mientras haya ranuras libres en
+ *        la zona registrada. Cada lectura abarca hasta un lote de bloques consecutivos de la zona. Las peticiones no se
+ *        envían hasta la siguiente llamada a submit(), junto con los envíos del lote.
+ * @return Devuelve un código de error si no se han podido preparar las lecturas, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::submit_reads() {
+  uint64_t limit = std::min<uint64_t>(total_chunks, base_sequence + uring_slots);
+  while (read_sequence < limit && reads_in_flight < URING_MAX_READS) {
+    size_t slot = read_sequence % uring_slots;
+    size_t count = std::min({options.batch_size, uring_slots - slot, static_cast<size_t>(limit - read_sequence)});
+    size_t offset = range_offset + static_cast<size_t>(read_sequence) * chunk_size;
+    size_t length = std::min(count * chunk_size, range_offset + range_size - offset);
+
+    uint64_t user_data = URING_READ | (read_sequence << 16) | count;
+    if (std::error_code error = ring.prepare_read_fixed(0, uring_arena.data() + slot * chunk_size, static_cast<unsigned>(length),
+                                                        offset, 0, user_data)) {
+      return error;
+    }
+    read_sequence += count;
+    ++reads_in_flight;
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que envía un lote de datagramas con io_uring. Los envíos se mandan al núcleo en la misma llamada que las
+ *        lecturas adelantadas pendientes, de forma que el disco y la red trabajan a la vez, y se espera a que terminen los
+ *        envíos (no las lecturas) porque los mensajes son locales a este método.
+ * @param[in] datagrams: datagramas que se envían.
+ * @param[in] owners: camino por el que se envía cada datagrama.
+ * @return Devuelve un código de error si no se ha podido enviar el lote, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send_uring(const std::vector<datagram>& datagrams, const std::vector<uint16_t>& owners) {
+  std::vector<msghdr> messages(datagrams.size());
+  for (size_t i = 0; i < datagrams.size(); ++i) {
+    path_socket& route = paths[owners[i]].route;
+    messages[i].msg_name = &route.destination;
+    messages[i].msg_namelen = address_length(route.destination);
+    messages[i].msg_iov = const_cast<iovec*>(datagrams[i].parts);
+    messages[i].msg_iovlen = datagrams[i].part_count;
+    if (std::error_code error = ring.prepare_sendmsg(1 + owners[i], &messages[i], 0)) { return error; }
+    ++sends_in_flight;
+  }
+
+  if (std::error_code error = submit_reads()) { return error; }
+  while (sends_in_flight > 0) {
+    if (std::error_code error = reap_completions(1)) { return error; }
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que envía al núcleo las peticiones preparadas y procesa las completadas: las lecturas marcan sus bloques
+ *        como disponibles y los envíos se descuentan de los que hay en curso.
+ * @param[in] wait_count: número de peticiones completadas que se esperan (0 para no esperar).
+ * @return Devuelve un código de error si alguna lectura o envío ha fallado, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::reap_completions(unsigned wait_count) {
+  if (std::error_code error = ring.submit(wait_count)) { return error; }
+
+  io_uring_cqe completion;
+  while (ring.pop_completion(completion)) {
+    if ((completion.user_data & URING_READ) == 0) {
+      --sends_in_flight;
+      // Un ICMP de puerto inalcanzable (el receptor aún no escucha) lo resolverá la retransmisión, como en process_acks()
+      if (completion.res < 0 && completion.res != -ECONNREFUSED) {
+        log_error() << "Error: No se han podido enviar los datagramas.";
+        return std::error_code(-completion.res, std::system_category());
+      }
+      continue;
+    }
+
+    --reads_in_flight;
+    uint64_t first = (completion.user_data & ~URING_READ) >> 16;
+    size_t count = completion.user_data & 0xFFFF;
+    size_t offset = range_offset + static_cast<size_t>(first) * chunk_size;
+    size_t expected = std::min(count * chunk_size, range_offset + range_size - offset);
+    if (completion.res < 0 || static_cast<size_t>(completion.res) != expected) {
+      log_error() << "Error: No se puede leer el fichero (¿ha cambiado de tamaño durante el envío?).";
+      return std::error_code(completion.res < 0 ? -completion.res : EIO, std::system_category());
+    }
+    for (size_t i = 0; i < count; ++i) { uring_loaded[(first + i) % uring_slots] = true; }
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que lee de la tubería lo que haya disponible (según FIONREAD) con una sola llamada a readv(): los bytes van
+ *        directamente al bloque a medio llenar y a buffers de bloques nuevos, que pasan a staged en cuanto se completan. Al
+ *        leer el fin de la tubería, el último bloque (incompleto) también se prepara y queda fijado el número total de bloques.
+ * @param[in] count: número máximo de bloques que se pueden preparar.
+ * @return Devuelve el número de bloques añadidos a staged (0 si la tubería no tiene nada), o un código de error si no se ha
+ *         podido leer.
+ */
+std::expected<size_t, std::error_code> reliable_sender::read_pipe(size_t count) {
+  if (pipe_closed) { return 0; }
+
+  // Aunque no haya nada disponible intentamos leer un byte, para detectar el cierre de la tubería
+  int available = 0;
+  if (ioctl(fd, FIONREAD, &available) < 0) { available = 0; }
+  size_t fill = static_cast<size_t>(pipe_bytes % chunk_size);
+  size_t wanted = std::clamp<size_t>(static_cast<size_t>(available), 1, count * chunk_size - fill);
+
+  pipe_buffers.clear();
+  pipe_parts.assign(1, {pipe_buffer.data() + fill, std::min(chunk_size - fill, wanted)});
+  for (size_t planned = pipe_parts[0].iov_len; planned < wanted; planned += chunk_size) {
+    pool_buffer& buffer = pipe_buffers.emplace_back(chunk_pool.acquire());
+    pipe_parts.push_back({buffer.data(), std::min(chunk_size, wanted - planned)});
+  }
+
+  ssize_t bytes_read;
+  {
+    metric_timer timer(metric::read_ns);
+    bytes_read = readv(fd, pipe_parts.data(), static_cast<int>(pipe_parts.size()));
+  }
+  count_metric(metric::syscalls);
+  if (bytes_read > 0 && static_cast<size_t>(bytes_read) < wanted) { count_metric(metric::short_reads); }
+  if (bytes_read < 0) {
+    if (errno == EAGAIN || errno == EINTR) { return 0; }
+    log_error() << "Error: No se ha podido leer la salida del comando.";
+    return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+
+  // Cada bloque completo se lleva su ranura, y la siguiente pasa a ser la del bloque a medio llenar (las que no se han llegado
+  // a usar vuelven al pool en la siguiente lectura)
+  size_t produced = 0;
+  size_t pending = fill + static_cast<size_t>(bytes_read);
+  pipe_bytes += static_cast<uint64_t>(bytes_read);
+  auto emit = [&](size_t length) {
+    inflight_chunk& chunk = staged.emplace_back();
+    chunk.storage = std::move(pipe_buffer);
+    chunk.payload = {chunk.storage.data(), length};
+    chunk.raw_length = length;
+    ++produced;
+  };
+  for (size_t next = 0; pending >= chunk_size; ++next, pending -= chunk_size) {
+    emit(chunk_size);
+    pipe_buffer = (next < pipe_buffers.size()) ? std::move(pipe_buffers[next]) : chunk_pool.acquire();
+  }
+
+  if (bytes_read == 0) {
+    if (pending > 0) { emit(pending); }
+    pipe_closed = true;
+    total_chunks = staged_sequence + produced;
+    transfer_size = pipe_bytes;
+  }
+  return produced;
+}
+
+/**
+ * @brief Función que cifra un bloque preparado en su ranura packed (donde ya está, tras el hueco de la sal, si se ha
+ *        comprimido) y calcula el CRC32C de lo que viaja. Si no se puede cifrar, el bloque se queda sin datos.
+ * @param[in] cipher: contexto de cifrado del emisor.
+ * @param[in,out] chunk: bloque.
+ * @param[in] header: cabecera del primer bloque del lote.
+ * @param[in] index: posición del bloque en el lote.
+ */
+static void seal_chunk(aead_context& cipher, inflight_chunk& chunk, packet_header header, size_t index) {
+  header.flags = (chunk.compressed ? FLAG_COMPRESSED : 0) | cipher.flags();
+  header.sequence += index;
+  header.offset += index * header.chunk_size;
+  size_t length = cipher.seal(header, static_cast<const uint8_t*>(chunk.payload.iov_base), chunk.payload.iov_len, chunk.packed.data());
+  chunk.payload = {chunk.packed.data(), length};
+  chunk.checksum = crc32c(chunk.packed.data(), length);
+}
+
+/**
+ * @brief Método que prepara por adelantado los siguientes bloques del fichero: los lee, los cifra si hay clave y, si hay
+ *        compresión, encarga a los hilos de compresión que los compriman (y los cifren). Así, mientras se envía un lote, los
+ *        hilos ya están comprimiendo el siguiente. En un envío en abanico, los bloques que ya ha preparado el emisor de otro
+ *        receptor se toman del almacén compartido, y los que se preparan aquí se dejan en él.
+ * @return Devuelve un código de error si no se ha podido leer algún bloque, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::stage_chunks() {
+  std::vector<iovec> reads;
+  std::vector<inflight_chunk*> batch;
+  size_t lookahead = (compressor != nullptr) ? 2 * options.batch_size : options.batch_size;
+  buffer_pool& pool = (feed != nullptr) ? feed->pool() : chunk_pool;
+
+  while (staged_sequence < total_chunks && staged.size() < lookahead && !quit_requested) {
+    size_t count = std::min(lookahead - staged.size(), static_cast<size_t>(total_chunks - staged_sequence));
+
+    // En un envío en abanico, los bloques que ya están en el almacén no se vuelven a leer; de los demás, se preparan los que
+    // faltan hasta el siguiente que ya está
+    if (feed != nullptr) {
+      size_t reused = 0;
+      for (std::shared_ptr<shared_chunk> prepared; reused < count && (prepared = feed->find(staged_sequence + reused)); ++reused) {
+        staged.emplace_back().shared = std::move(prepared);
+      }
+      if (reused > 0) {
+        staged_batches.push_back({reused, {}});
+        staged_sequence += reused;
+        continue;
+      }
+      count = feed->missing(staged_sequence, count);
+    }
+
+    // De una tubería solo se preparan los bloques que ya se han podido leer
+    if (streaming) {
+      auto result = read_pipe(count);
+      if (!result) { return result.error(); }
+      if (*result == 0) { break; }
+      count = *result;
+      batch.clear();
+      for (size_t i = staged.size() - count; i < staged.size(); ++i) { batch.push_back(&staged[i]); }
+    }
+
+    // Con io_uring solo se preparan los bloques cuya lectura ya ha terminado; si no hay ninguno listo para enviar, esperamos
+    // a alguna lectura
+    if (ring.active()) {
+      if (std::error_code error = submit_reads()) { return error; }
+      size_t loaded = 0;
+      while (loaded < count && uring_loaded[(staged_sequence + loaded) % uring_slots]) { ++loaded; }
+      if (loaded == 0) {
+        if (!staged.empty()) { break; }
+        if (std::error_code error = reap_completions(1)) { return error; }
+        continue;
+      }
+      count = loaded;
+    }
+
+    reads.clear();
+    if (!streaming) { batch.clear(); }
+    for (size_t i = 0; i < count && !streaming; ++i) {
+      uint64_t sequence = staged_sequence + i;
+      size_t offset = range_offset + static_cast<size_t>(sequence) * chunk_size;
+      size_t length = std::min(chunk_size, range_offset + range_size - offset);
+
+      // En un envío en abanico, el bloque se prepara en un bloque compartido, del que lo toman los demás emisores
+      inflight_chunk& slot = staged.emplace_back();
+      if (feed != nullptr) { slot.shared = std::make_shared<shared_chunk>(); }
+      inflight_chunk& chunk = slot.shared ? slot.shared->chunk : slot;
+      chunk.raw_length = length;
+      if (mapping != nullptr) {
+        // Con la proyección, el bloque apunta directamente a las páginas del fichero
+        chunk.payload = {const_cast<uint8_t*>(mapping + offset), length};
+      } else if (ring.active()) {
+        // Con io_uring, el bloque ya está leído en su ranura de la zona registrada
+        chunk.payload = {uring_arena.data() + (sequence % uring_slots) * chunk_size, length};
+      } else {
+        // Sin ella, guardamos una copia del bloque hasta que se confirme, por si hay que reenviarlo
+        chunk.storage = pool.acquire();
+        chunk.payload = {chunk.storage.data(), length};
+        reads.push_back(chunk.payload);
+      }
+      batch.push_back(&chunk);
+    }
+
+    // Los bloques nuevos del lote se leen del fichero con una sola llamada a preadv(), que no depende de la posición del
+    // descriptor y permite que varios flujos lean a la vez del mismo fichero
+    if (!reads.empty()) {
+      size_t expected = 0;
+      for (const iovec& read_block : reads) { expected += read_block.iov_len; }
+      off_t position = static_cast<off_t>(range_offset + static_cast<size_t>(staged_sequence) * chunk_size);
+      ssize_t bytes_read;
+      {
+        metric_timer timer(metric::read_ns);
+        bytes_read = preadv(fd, reads.data(), static_cast<int>(reads.size()), position);
+      }
+      count_metric(metric::syscalls);
+      if (bytes_read < 0 || static_cast<size_t>(bytes_read) != expected) {
+        if (bytes_read >= 0) { count_metric(metric::short_reads); }
+        log_error() << "Error: No se puede leer el fichero (¿ha cambiado de tamaño durante el envío?).";
+        return std::error_code(bytes_read < 0 ? errno : EIO, std::system_category());
+      }
+    }
+
+    // La paridad se calcula con los datos originales, que siguen disponibles hasta que el bloque pasa a la ventana
+    for (inflight_chunk* chunk : batch) { chunk->raw_data = static_cast<const uint8_t*>(chunk->payload.iov_base); }
+
+    // Cabecera con la que se cifran los bloques del lote (seal_chunk pone el número de secuencia y la posición de cada uno)
+    packet_header sealed;
+    sealed.type = packet_type::data;
+    sealed.session = session;
+    sealed.stream = stream;
+    sealed.sequence = staged_sequence;
+    sealed.offset = range_offset + static_cast<size_t>(staged_sequence) * chunk_size;
+    sealed.chunk_size = static_cast<uint32_t>(chunk_size);
+
+    // Los bloques que se comprimen a menos de su tamaño viajan comprimidos; los demás, tal cual. Los elementos de una deque
+    // no se mueven al añadir otros al final, así que los hilos pueden trabajar sobre ellos mientras seguimos preparando
+    std::future<void> done;
+    if (compressor == nullptr) {
+      for (inflight_chunk* chunk : batch) {
+        chunk->checksum = chunk->raw_checksum = crc32c(static_cast<const uint8_t*>(chunk->payload.iov_base), chunk->payload.iov_len);
+      }
+      if (sealer) {
+        for (size_t i = 0; i < batch.size(); ++i) {
+          batch[i]->packed = pool.acquire();
+          seal_chunk(*sealer, *batch[i], sealed, i);
+        }
+      }
+    } else {
+      // El pool no se puede usar desde los hilos de compresión, así que cada bloque se lleva ya su ranura para el resultado.
+      // Si se cifra, el bloque se comprime detrás del hueco de la sal, para cifrarlo ahí mismo, y cada lote usa su propio
+      // contexto de cifrado con una copia de la clave
+      for (inflight_chunk* chunk : batch) { chunk->packed = pool.acquire(); }
+      done = compressor->submit([batch, sealed, key = cipher_key]() {
+        std::unique_ptr<aead_context> cipher = key ? std::make_unique<aead_context>(*key) : nullptr;
+        size_t gap = cipher ? AEAD_SALT_SIZE : 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+          inflight_chunk* chunk = batch[i];
+          chunk->raw_checksum = crc32c(static_cast<const uint8_t*>(chunk->payload.iov_base), chunk->payload.iov_len);
+          chunk->checksum = chunk->raw_checksum;
+          size_t packed_size = compress_block(static_cast<const uint8_t*>(chunk->payload.iov_base), chunk->payload.iov_len,
+                                              chunk->packed.data() + gap);
+          if (packed_size > 0) {
+            chunk->payload = {chunk->packed.data() + gap, packed_size};
+            chunk->compressed = true;
+            if (!cipher) { chunk->checksum = crc32c(chunk->packed.data(), packed_size); }
+          }
+          if (cipher) { seal_chunk(*cipher, *chunk, sealed, i); }
+        }
+      });
+    }
+
+    // Los bloques compartidos pasan al almacén ya, aunque se estén comprimiendo: quien los tome espera a que estén listos
+    if (feed != nullptr) {
+      std::shared_future<void> ready = done.valid() ? done.share() : std::shared_future<void>();
+      for (size_t i = 0; i < count; ++i) {
+        inflight_chunk& slot = staged[staged.size() - count + i];
+        slot.shared->ready = ready;
+        feed->publish(staged_sequence + i, slot.shared);
+      }
+    }
+    staged_batches.push_back({count, std::move(done)});
+    staged_sequence += count;
+  }
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que añade a la ventana los bloques ya preparados y los envía, en lotes de batch_size bloques.
+ * @return Devuelve un código de error si no se ha podido leer o enviar algún bloque, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send_new_chunks() {
+  std::vector<uint64_t> sequences;
+
+  while (next_sequence < total_chunks && window.size() < window_limit && !quit_requested && pacer.delay(now_microseconds()) == 0) {
+    if (std::error_code error = stage_chunks()) { return error; }
+    size_t count = std::min({options.batch_size, window_limit - window.size(), staged.size()});
+    // De una tubería puede no haber nada que leer todavía
+    if (count == 0 && streaming) { break; }
+    if (count == 0) { continue; }
+
+    // Esperamos a que terminen de comprimirse los lotes preparados que vamos a enviar
+    size_t covered = 0;
+    for (staged_batch& batch : staged_batches) {
+      if (covered >= count) { break; }
+      if (batch.done.valid()) { batch.done.get(); }
+      covered += batch.remaining;
+    }
+
+    sequences.clear();
+    for (size_t i = 0; i < count; ++i) {
+      // Un bloque compartido se envía con los datos que ha preparado el emisor que lo ha leído, cuando estén listos
+      inflight_chunk& chunk = staged.front();
+      if (chunk.shared) {
+        if (chunk.shared->ready.valid()) { chunk.shared->ready.wait(); }
+        const inflight_chunk& prepared = chunk.shared->chunk;
+        chunk.payload = prepared.payload;
+        chunk.compressed = prepared.compressed;
+        chunk.raw_data = prepared.raw_data;
+        chunk.raw_length = prepared.raw_length;
+        chunk.checksum = prepared.checksum;
+        chunk.raw_checksum = prepared.raw_checksum;
+      }
+      if (chunk.payload.iov_len == 0 && sealer) {
+        log_error() << "Error: No se ha podido cifrar el bloque " << next_sequence + i << ".";
+        return std::error_code(EIO, std::system_category());
+      }
+      // Del bloque comprimido o cifrado solo hace falta lo que viaja, y del que no se ha reducido, el original (una vez sumado
+      // a la paridad de su grupo). Del compartido, el original se conserva si los demás emisores lo necesitan para su paridad
+      if (options.fec_parity > 0) { encode_parity(chunk, next_sequence + i); }
+      inflight_chunk& prepared = chunk.shared ? chunk.shared->chunk : chunk;
+      if (chunk.compressed || sealer) {
+        if (!chunk.shared || options.fec_parity == 0) { prepared.storage.reset(); }
+      } else {
+        prepared.packed.reset();
+      }
+      size_t raw_length = chunk.raw_length;
+      raw_bytes += raw_length;
+      count_metric(metric::bytes_sent, raw_length);
+      range_digest = crc32c_combine(range_digest, staged.front().raw_checksum, raw_length);
+      wire_bytes += staged.front().payload.iov_len;
+      window.push_back(std::move(staged.front()));
+      staged.pop_front();
+      if (--staged_batches.front().remaining == 0) { staged_batches.pop_front(); }
+      sequences.push_back(next_sequence + i);
+    }
+
+    next_sequence += count;
+    if (std::error_code error = send_chunks(sequences)) { return error; }
+    if (std::error_code error = send_parity()) { return error; }
+  }
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que suma un bloque que pasa a la ventana a los símbolos de paridad de su grupo (el primero del grupo los
+ *        crea a cero). Cuando el grupo se completa (o termina el flujo), su paridad queda pendiente de enviar tras el lote.
+ * @param[in] chunk: bloque, con sus datos originales.
+ * @param[in] sequence: número de secuencia del bloque.
+ */
+void reliable_sender::encode_parity(const inflight_chunk& chunk, uint64_t sequence) {
+  if (fec_group.count == 0) {
+    fec_group.first = sequence;
+    fec_symbols.clear();
+    for (size_t row = 0; row < options.fec_parity; ++row) {
+      pool_buffer& symbol = fec_group.symbols.emplace_back(chunk_pool.acquire());
+      std::memset(symbol.data(), 0, chunk_size);
+      fec_symbols.push_back(symbol.data());
+    }
+  }
+  fec_accumulate(fec_symbols, fec_rows, fec_group.count, chunk.raw_data, chunk.raw_length);
+  fec_group.last_length = chunk.raw_length;
+  ++fec_group.count;
+
+  if (fec_group.count == options.fec_data || sequence + 1 == total_chunks) {
+    fec_ready.push_back(std::move(fec_group));
+    fec_group = parity_group();
+  }
+}
+
+/**
+ * @brief Método que envía la paridad de los grupos completados en el último lote, justo detrás de sus bloques, y anota en
+ *        ellos cuándo se ha enviado: hasta que llegue, su pérdida se puede reparar sin reenvío.
+ * @return Devuelve un código de error si no se ha podido enviar la paridad, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::send_parity() {
+  if (fec_ready.empty()) { return std::error_code(0, std::system_category()); }
+
+  constexpr size_t prefix_size = PACKET_HEADER_SIZE + FEC_PARITY_PREFIX;
+  std::vector<uint8_t> prefixes(fec_ready.size() * options.fec_parity * prefix_size);
+  // Cifrada, la paridad lleva el prefijo en claro (autenticado, y con la fila en el nonce) y el símbolo cifrado en una ranura
+  // que vive hasta enviarla
+  std::vector<pool_buffer> sealed;
+  std::vector<datagram> datagrams;
+  uint64_t now = now_microseconds();
+  size_t bytes = 0;
+
+  for (const parity_group& group : fec_ready) {
+    for (size_t row = 0; row < group.symbols.size(); ++row) {
+      uint8_t* prefix = prefixes.data() + datagrams.size() * prefix_size;
+      fec_parity_info info;
+      info.data_count = static_cast<uint8_t>(options.fec_data);
+      info.parity_count = static_cast<uint8_t>(options.fec_parity);
+      info.index = static_cast<uint8_t>(row);
+      info.group_count = static_cast<uint8_t>(group.count);
+      info.last_length = static_cast<uint32_t>(group.last_length);
+      encode_parity_info(info, prefix + PACKET_HEADER_SIZE);
+
+      packet_header header;
+      header.type = packet_type::parity;
+      header.length = static_cast<uint16_t>(FEC_PARITY_PREFIX + chunk_size);
+      header.session = session;
+      header.stream = stream;
+      header.stream_count = stream_count;
+      header.sequence = group.first;
+      header.offset = range_offset + static_cast<size_t>(group.first) * chunk_size;
+      header.total_size = transfer_size;
+      header.chunk_size = static_cast<uint32_t>(chunk_size);
+      header.timestamp = now;
+      iovec symbol = {group.symbols[row].data(), chunk_size};
+      if (sealer) {
+        header.flags = sealer->flags();
+        uint8_t* slot = sealed.emplace_back(chunk_pool.acquire()).data();
+        size_t length = sealer->seal(header, group.symbols[row].data(), chunk_size, slot,
+                                     {prefix + PACKET_HEADER_SIZE, FEC_PARITY_PREFIX, info.index});
+        if (length == 0) {
+          log_error() << "Error: No se ha podido cifrar la paridad del grupo " << group.first << ".";
+          return std::error_code(EIO, std::system_category());
+        }
+        symbol = {slot, length};
+        header.length = static_cast<uint16_t>(FEC_PARITY_PREFIX + length);
+      }
+      encode_header(header, prefix);
+      uint32_t checksum = crc32c_combine(crc32c(prefix + PACKET_HEADER_SIZE, FEC_PARITY_PREFIX),
+                                         crc32c(static_cast<const uint8_t*>(symbol.iov_base), symbol.iov_len), symbol.iov_len);
+      seal_header(prefix, checksum, header.length);
+
+      datagram& packet = datagrams.emplace_back();
+      packet.parts[0] = {prefix, prefix_size};
+      packet.parts[1] = symbol;
+      packet.part_count = 2;
+      bytes += prefix_size + symbol.iov_len;
+    }
+    uint64_t end = std::min<uint64_t>(group.first + group.count, base_sequence + window.size());
+    for (uint64_t sequence = std::max(group.first, base_sequence); sequence < end; ++sequence) {
+      window[sequence - base_sequence].parity_sent = now;
+    }
+  }
+
+  pacer.consume(bytes, now);
+  last_sent = now;
+  count_metric(metric::datagrams_sent, datagrams.size());
+  count_metric(metric::parity_sent, datagrams.size());
+  // La paridad va por el camino al que le toca el siguiente bloque
+  send_path& path = paths[select_path()];
+  std::error_code error = send_batch(path.route.socket_fd, datagrams, path.route.destination, nullptr, &path.segmentation);
+  fec_ready.clear();
+  return error;
+}
+
+/**
+ * @brief Método que reenvía los bloques que se han dado por perdidos, bien porque el receptor ha confirmado bloques enviados
+ *        después que ellos, o bien porque ha vencido su tiempo de retransmisión (RTO).
+ * @return Devuelve un código de error si no se ha podido enviar algún bloque, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::retransmit() {
+  if (window.empty()) { return std::error_code(0, std::system_category()); }
+  uint64_t now = now_microseconds();
+  check_paths(now);
+
+  // Si el bloque más antiguo sin confirmar ha superado el RTO, damos por perdidos todos los que lo hayan superado
+  if (now - loss_reference(window.front()) > rto) {
+    congestion.on_timeout(now);
+    update_pacing();
+    for (size_t i = 0; i < window.size(); ++i) {
+      inflight_chunk& chunk = window[i];
+      if (!chunk.acked && !chunk.lost && now - loss_reference(chunk) > rto) { mark_lost(base_sequence + i); }
+    }
+    // Duplicamos el RTO hasta que vuelva a haber progreso, para no saturar a un receptor que no responde
+    rto = std::min<uint64_t>(rto * 2, 1000000);
+  }
+
+  // Reenviamos los perdidos en lotes mientras el ritmo de envío lo permita; los que no quepan esperan a la siguiente vuelta
+  std::vector<uint64_t> sequences;
+  size_t processed = 0;
+  while (processed < lost_queue.size() && pacer.delay(now_microseconds()) == 0) {
+    sequences.clear();
+    for (; processed < lost_queue.size() && sequences.size() < options.batch_size; ++processed) {
+      uint64_t sequence = lost_queue[processed];
+      // Algunos bloques pueden haberse confirmado (o sacado de la ventana) desde que se marcaron como perdidos
+      if (sequence < base_sequence || !window[sequence - base_sequence].lost) { continue; }
+      sequences.push_back(sequence);
+    }
+    if (sequences.empty()) { continue; }
+    count_metric(metric::retransmits, sequences.size());
+    if (std::error_code error = send_chunks(sequences)) { return error; }
+  }
+  lost_queue.erase(lost_queue.begin(), lost_queue.begin() + static_cast<std::ptrdiff_t>(processed));
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que recibe y procesa las confirmaciones que haya enviado el receptor, sin esperar a las que no hayan llegado.
+ * @return Devuelve un código de error si no se ha podido leer del socket, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_sender::process_acks() {
+  uint8_t buffer[PACKET_HEADER_SIZE + MAX_SACK_BLOCKS * 16];
+  std::vector<sack_block> blocks;
+
+  // El receptor responde a quien le ha enviado lo último, así que las confirmaciones pueden llegar por cualquier camino
+  for (const send_path& path : paths) {
+    for (;;) {
+      ssize_t received = recv(path.route.socket_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+      count_metric(metric::syscalls);
+      if (received < 0) {
+        if (errno == EAGAIN || errno == EINTR) { break; }
+        // El receptor puede no estar escuchando todavía (ECONNREFUSED por ICMP): lo resolverá la retransmisión
+        if (errno == ECONNREFUSED) { continue; }
+        log_error() << "Error: No se han podido recibir las confirmaciones del receptor.";
+        return std::error_code(errno, std::system_category());
+      }
+
+      packet_header header;
+      if (!verify_checksum(buffer, static_cast<size_t>(received)) || !decode_header(buffer, static_cast<size_t>(received), header) ||
+          header.session != session || header.stream != stream) {
+        continue;
+      }
+      if (header.type == packet_type::ack && decode_sack(buffer + PACKET_HEADER_SIZE, header.length, blocks)) {
+        handle_ack(header, blocks);
+      }
+    }
+  }
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que procesa una confirmación: saca de la ventana los bloques confirmados y marca como perdidos los que el
+ *        receptor no tiene pero se enviaron claramente antes que otros que sí le han llegado.
+ * @param[in] header: cabecera de la confirmación, con el siguiente bloque que espera el receptor en orden.
+ * @param[in] blocks: rangos de bloques que el receptor ha recibido fuera de orden.
+ */
+void reliable_sender::handle_ack(const packet_header& header, const std::vector<sack_block>& blocks) {
+  uint64_t now = now_microseconds();
+  if (header.timestamp != 0 && header.timestamp <= now) { update_rtt(now - header.timestamp); }
+
+  uint64_t previously_delivered = delivered;
+
+  // Cada bloque confirmado cuenta como entrega de su camino. Si ya se había dado por perdido, deja de estar pendiente de reenvío
+  auto acknowledge = [&](inflight_chunk& chunk) {
+    if (chunk.acked) { return; }
+    send_path& path = paths[chunk.path];
+    if (!chunk.lost) { --path.inflight; }
+    chunk.acked = true;
+    chunk.lost = false;
+    ++delivered;
+    ++path.delivered;
+    path.rack_time = std::max(path.rack_time, chunk.last_sent);
+    path.unanswered_since = 0;
+    record_latency(now - chunk.first_sent);
+  };
+
+  // Confirmación acumulada: el receptor tiene todos los bloques anteriores a header.sequence
+  uint64_t cumulative = std::min(header.sequence, next_sequence);
+  for (uint64_t sequence = base_sequence; sequence < cumulative; ++sequence) { acknowledge(window[sequence - base_sequence]); }
+
+  // Confirmaciones selectivas: rangos recibidos por encima de la acumulada
+  uint64_t highest_sacked = 0;
+  for (const sack_block& block : blocks) {
+    uint64_t end = std::min(block.end, next_sequence);
+    for (uint64_t sequence = std::max(block.start, base_sequence); sequence < end; ++sequence) {
+      acknowledge(window[sequence - base_sequence]);
+    }
+    highest_sacked = std::max(highest_sacked, end);
+  }
+
+  // Un bloque sin confirmar que se envió antes que otro ya confirmado de su mismo camino (con un margen de un cuarto del RTT
+  // por si solo se han reordenado) se da por perdido, sin esperar a su RTO; entre caminos con distinto retardo, el orden de
+  // llegada no dice nada. Con corrección de errores, el que espera la paridad de su
+  // grupo no se da por perdido hasta que se confirme algo enviado después de ella
+  uint64_t reorder_window = (min_rtt == UINT64_MAX) ? 0 : min_rtt / 4;
+  uint64_t scan_end = std::min<uint64_t>(highest_sacked, base_sequence + window.size());
+  for (uint64_t sequence = base_sequence; sequence < scan_end; ++sequence) {
+    inflight_chunk& chunk = window[sequence - base_sequence];
+    if (options.fec_parity > 0 && chunk.first_sent == chunk.last_sent && chunk.parity_sent == 0) { continue; }
+    if (!chunk.acked && !chunk.lost && loss_reference(chunk) + reorder_window < paths[chunk.path].rack_time) {
+      mark_lost(sequence);
+      congestion.on_loss(chunk.last_sent, now);
+    }
+  }
+
+  // Sacamos de la ventana los bloques confirmados del principio
+  while (!window.empty() && window.front().acked) {
+    window.pop_front();
+    // Con io_uring, la ranura del bloque queda libre para una lectura adelantada
+    if (ring.active()) { uring_loaded[base_sequence % uring_slots] = false; }
+    ++base_sequence;
+  }
+
+  if (delivered > previously_delivered) {
+    last_progress = now;
+    // Con progreso, el RTO vuelve a su valor calculado a partir del RTT
+    if (srtt != 0) { rto = std::max<uint64_t>(srtt + 4 * rttvar, 2000); }
+  }
+  congestion.on_ack(delivered - previously_delivered, srtt, min_rtt, now);
+  update_window(now);
+  update_pacing();
+}
+
+/**
+ * @brief Método que devuelve el instante a partir del cual se mide si un bloque se ha perdido: el de su último envío o, si
+ *        solo se ha enviado una vez y el receptor puede reconstruirlo con la paridad de su grupo, el del envío de esa paridad
+ *        (hasta que no llegue, al receptor le puede faltar el bloque sin que se haya perdido para siempre).
+ * @param[in] chunk: bloque de la ventana.
+ * @return Devuelve el instante, en microsegundos.
+ */
+uint64_t reliable_sender::loss_reference(const inflight_chunk& chunk) const {
+  if (chunk.first_sent == chunk.last_sent && chunk.parity_sent != 0) { return std::max(chunk.last_sent, chunk.parity_sent); }
+  return chunk.last_sent;
+}
+
+/**
+ * @brief Método que da por perdido un bloque de la ventana: queda pendiente de reenvío y deja de contar como en vuelo en su
+ *        camino.
+ * @param[in] sequence: número de secuencia del bloque.
+ */
+void reliable_sender::mark_lost(uint64_t sequence) {
+  inflight_chunk& chunk = window[sequence - base_sequence];
+  chunk.lost = true;
+  lost_queue.push_back(sequence);
+  --paths[chunk.path].inflight;
+}
+
+/**
+ * @brief Método que actualiza el RTT suavizado y el RTO a partir de una nueva medida (RFC 6298).
+ * @param[in] sample: RTT medido, en microsegundos.
+ */
+void reliable_sender::update_rtt(uint64_t sample) {
+  if (srtt == 0) {
+    srtt = sample;
+    rttvar = sample / 2;
+  } else {
+    uint64_t difference = (srtt > sample) ? srtt - sample : sample - srtt;
+    rttvar = (3 * rttvar + difference) / 4;
+    srtt = (7 * srtt + sample) / 8;
+  }
+  min_rtt = std::min(min_rtt, sample);
+  rto = std::max<uint64_t>(srtt + 4 * rttvar, 2000);
+}
+
+/**
+ * @brief Método que ajusta la ventana al doble del producto ancho de banda-retardo: la tasa de entrega máxima reciente
+ *        multiplicada por el RTT mínimo. El factor dos deja que la ventana crezca mientras la tasa siga aumentando.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void reliable_sender::update_window(uint64_t now) {
+  if (rate_sample_start == 0) {
+    rate_sample_start = now;
+    rate_sample_delivered = delivered;
+    return;
+  }
+
+  // Tomamos una muestra de la tasa de entrega cada RTT (como mínimo cada milisegundo)
+  uint64_t elapsed = now - rate_sample_start;
+  if (elapsed < std::max<uint64_t>(srtt, 1000)) { return; }
+
+  rate_samples[rate_sample_index] = static_cast<double>(delivered - rate_sample_delivered) / static_cast<double>(elapsed);
+  rate_sample_index = (rate_sample_index + 1) % std::size(rate_samples);
+  rate_sample_start = now;
+  rate_sample_delivered = delivered;
+
+  // Con varios caminos, la muestra de cada uno (salvo el que no ha tenido nada que entregar) alimenta su media
+  for (send_path& path : paths) {
+    if (paths.size() == 1) { break; }
+    if (path.delivered == path.sample_delivered && path.inflight == 0) { continue; }
+    double sample = static_cast<double>(path.delivered - path.sample_delivered) / static_cast<double>(elapsed);
+    path.rate = path.measured ? 0.75 * path.rate + 0.25 * sample : sample;
+    path.measured = true;
+    path.sample_delivered = path.delivered;
+  }
+
+  double max_rate = *std::max_element(std::begin(rate_samples), std::end(rate_samples));
+  if (max_rate <= 0 || min_rtt == UINT64_MAX) { return; }
+
+  bdp_window = 2 * max_rate * static_cast<double>(min_rtt);
+}
+
+/**
+ * @brief Método que fija la ventana (la menor entre la del producto ancho de banda-retardo y la de congestión) y la tasa de
+ *        envío (la del control de congestión, limitada por la tasa fija que se haya pedido).
+ */
+void reliable_sender::update_pacing() {
+  size_t minimum = std::max(MIN_WINDOW, 2 * options.batch_size);
+  window_limit = std::clamp(std::min(static_cast<size_t>(bdp_window), congestion.window()), minimum, MAX_WINDOW);
+  // Con io_uring, los bloques de la ventana ocupan ranuras de la zona registrada, así que no puede haber más que ranuras
+  if (ring.active()) { window_limit = std::min(window_limit, uring_slots); }
+
+  double rate = congestion.pacing_rate(srtt);
+  if (options.pacing_rate > 0) { rate = (rate > 0) ? std::min(rate, options.pacing_rate) : options.pacing_rate; }
+
+  if (!options.kernel_pacing) {
+    pacer.set_rate(rate);
+    return;
+  }
+
+  // Con el ritmo en el núcleo, solo actualizamos la tasa del socket si ha cambiado más de un 10%, para ahorrar llamadas
+  if (rate > 0 && std::abs(rate - kernel_pacing_rate) > kernel_pacing_rate / 10) {
+    uint64_t value = static_cast<uint64_t>(rate);
+    if (setsockopt(paths[0].route.socket_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &value, sizeof(value)) == 0) { kernel_pacing_rate = rate; }
+  }
+}
+
+/**
+ * @brief Método que envía el FIN de la transferencia, con el número total de bloques y el CRC32C del rango, y recoge su
+ *        confirmación. Si vence el plazo sin ella, reenvía el FIN con el doble de plazo, hasta MAX_FIN_ATTEMPTS veces.
+ * @return Devuelve el progreso: terminado si el receptor ha confirmado el FIN (o se han agotado los intentos) o, si no,
+ *         cuándo vence el plazo del último FIN enviado.
+ */
+transfer_progress reliable_sender::step_finish() {
+  uint8_t buffer[PACKET_HEADER_SIZE + MAX_SACK_BLOCKS * 16];
+
+  // Recogemos la confirmación del FIN, con el CRC32C de lo que ha escrito el receptor; las confirmaciones de datos que sigan
+  // llegando se ignoran
+  for (const send_path& path : paths) {
+    for (ssize_t received; (received = recv(path.route.socket_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0 || errno == ECONNREFUSED;) {
+      packet_header reply;
+      if (received > 0 && verify_checksum(buffer, static_cast<size_t>(received)) &&
+          decode_header(buffer, static_cast<size_t>(received), reply) && reply.session == session && reply.stream == stream &&
+          reply.type == packet_type::fin_ack) {
+        // Con cifrado, la confirmación del FIN solo vale si la ha cifrado quien conoce la clave compartida. El receptor la
+        // cifra con su propia clave (de su sal): en un envío en abanico todos los emisores cifran con la misma, y dos
+        // receptores podrían confirmar CRC32C distintos con el mismo nonce
+        uint8_t* digest = buffer + PACKET_HEADER_SIZE;
+        if (sealer) {
+          std::optional<size_t> opened;
+          std::optional<aead_key> reply_key;
+          if ((reply.flags & FLAG_ENCRYPTED) && reply.length >= AEAD_OVERHEAD &&
+              (reply_key = derive_key(*options.secret, packet_algorithm(reply.flags), digest))) {
+            opened = aead_context(*reply_key).open(reply, digest, reply.length);
+          }
+          if (!opened || *opened != sizeof(uint32_t)) { continue; }
+          digest += AEAD_SALT_SIZE;
+        } else if (reply.length != sizeof(uint32_t)) {
+          continue;
+        }
+        uint32_t received_digest;
+        std::memcpy(&received_digest, digest, sizeof(received_digest));
+        if (be32toh(received_digest) != range_digest) {
+          log_error() << "Error: El CRC32C de lo recibido no coincide con el de lo enviado (flujo " << stream << ").";
+          return complete(std::error_code(EIO, std::system_category()));
+        }
+        return complete(std::error_code(0, std::system_category()));
+      }
+    }
+  }
+
+  uint64_t now = now_microseconds();
+  if (fin_attempts > 0 && now < fin_deadline) {
+    transfer_progress progress;
+    progress.wake_at = fin_deadline;
+    return progress;
+  }
+
+  // Todos los bloques se han confirmado, así que el fichero está completo aunque se haya perdido la confirmación del FIN
+  if (fin_attempts == MAX_FIN_ATTEMPTS) {
+    log_warning() << "Aviso: El receptor no ha confirmado el fin de la transferencia.";
+    return complete(std::error_code(0, std::system_category()));
+  }
+  if (fin_attempts > 0) { fin_timeout = std::min<uint64_t>(fin_timeout * 2, 1000000); }
+
+  uint8_t packet[PACKET_HEADER_SIZE + sizeof(uint32_t) + AEAD_OVERHEAD];
+  uint32_t encoded_digest = htobe32(range_digest);
+  std::memcpy(packet + PACKET_HEADER_SIZE, &encoded_digest, sizeof(encoded_digest));
+  packet_header header;
+  header.type = packet_type::fin;
+  header.session = session;
+  header.stream = stream;
+  header.stream_count = stream_count;
+  header.sequence = total_chunks;
+  header.total_size = transfer_size;
+  header.timestamp = now;
+  header.length = sizeof(uint32_t);
+  // Con cifrado, el CRC32C del flujo también va cifrado, para que nadie pueda dar por terminado el flujo en su lugar
+  if (sealer) {
+    header.flags = sealer->flags();
+    header.length = static_cast<uint16_t>(sealer->seal(header, reinterpret_cast<const uint8_t*>(&encoded_digest), sizeof(encoded_digest),
+                                                       packet + PACKET_HEADER_SIZE));
+  }
+  encode_header(header, packet);
+  seal_header(packet, crc32c(packet + PACKET_HEADER_SIZE, header.length), header.length);
+  if (!send_control(packet, PACKET_HEADER_SIZE + header.length)) {
+    log_error() << "Error: No se ha podido enviar el fin de la transferencia.";
+    return complete(std::error_code(errno, std::system_category()));
+  }
+  ++fin_attempts;
+  fin_deadline = now + fin_timeout;
+
+  transfer_progress progress;
+  progress.wake_at = fin_deadline;
+  return progress;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Función que reserva en disco el fichero completo con fallocate(), de forma que queda con su tamaño final y en pocas
+ *        extensiones, y los bloques se escriben sobre espacio ya asignado. Si el sistema de ficheros no lo admite, solo se fija
+ *        el tamaño con ftruncate().
+ * @param[in] fd: descriptor del fichero de destino.
+ * @param[in] size: tamaño total de la transferencia.
+ * @return Devuelve un código de error si no hay espacio para el fichero o no se ha podido ampliar, o un código de éxito en caso contrario.
+ */
+static std::error_code preallocate_file(int fd, uint64_t size) {
+  if (size == 0 || fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) { return std::error_code(0, std::system_category()); }
+  if (errno == ENOSPC) {
+    log_error() << "Error: No hay espacio en el disco para el fichero (" << size << " bytes).";
+    return std::error_code(errno, std::system_category());
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    log_error() << "Error: No se ha podido ampliar el fichero a su tamaño final.";
+    return std::error_code(errno, std::system_category());
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Constructor de reliable_receiver
+ * @param[in] socket_fd: socket por el que se reciben los bloques y se envían las confirmaciones.
+ * @param[in] fd: descriptor del fichero en el que se escriben los datos recibidos.
+ * @param[in] options: opciones de la transferencia (tamaño del lote de datagramas, ...).
+ * @param[in,out] shared: estado de la transferencia compartido con los demás hilos receptores.
+ */
+reliable_receiver::reliable_receiver(int socket_fd, int fd, const netcp_options& options, receive_state& shared)
+    : socket_fd(socket_fd), fd(fd), options(options), shared(shared), inflate_pool(MAX_CHUNK_SIZE, 0),
+      ack_packet(PACKET_HEADER_SIZE + MAX_SACK_BLOCKS * 16) {}
+
+/**
+ * @brief Método que recibe los bloques de los flujos que el núcleo reparta a este socket, los escribe en su posición del
+ *        fichero y confirma lo recibido tras cada lote. Termina cuando todos los flujos de la transferencia (también los que
+ *        atienden otros hilos) han terminado.
+ * @return Devuelve un código de error si no se ha podido recibir o escribir el fichero, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_receiver::receive() {
+  pollfd descriptor = {socket_fd, POLLIN, 0};
+  bool readable = false;
+  for (;;) {
+    transfer_progress progress = step(readable);
+    if (progress.done) { return progress.error; }
+
+    uint64_t now = now_microseconds();
+    int timeout = (progress.wake_at > now) ? static_cast<int>((progress.wake_at - now + 999) / 1000) : 0;
+    int ready = poll(&descriptor, 1, timeout);
+    if (ready < 0 && errno != EINTR) { return complete(std::error_code(errno, std::system_category())).error; }
+    readable = ready > 0;
+  }
+}
+
+/**
+ * @brief Método que avanza la recepción sin bloquearse: si el socket tiene datos, recibe un lote, escribe sus bloques y
+ *        confirma lo recibido; y comprueba si la transferencia ha terminado o si el emisor ha dejado de enviar. La primera
+ *        llamada prepara el socket y el buffer de recepción.
+ * @param[in] readable: si el socket tiene datagramas esperando (si no, no se intenta recibir, porque se bloquearía).
+ * @return Devuelve si la recepción ha terminado y con qué resultado o, si no, cuándo hay que volver a llamarlo aunque no
+ *         lleguen datagramas.
+ */
+transfer_progress reliable_receiver::step(bool readable) {
+  if (!started) { start(); }
+  if (quit_requested || shared.failed) { return complete(std::error_code(0, std::system_category())); }
+
+  if (readable) {
+    auto result = receive_batch(socket_fd, slots, datagrams, sources);
+    if (!result) { return complete(result.error()); }
+    if (*result > 0) { last_activity = now_microseconds(); }
+
+    for (size_t i = 0; i < *result; ++i) {
+      uint8_t* packet = static_cast<uint8_t*>(datagrams[i].iov_base);
+      // Los datagramas dañados se descartan como si se hubieran perdido: el emisor los reenviará
+      if (!verify_checksum(packet, datagrams[i].iov_len)) {
+        ++corrupt_datagrams;
+        count_metric(metric::corrupt_datagrams);
+        continue;
+      }
+      packet_header header;
+      if (!decode_header(packet, datagrams[i].iov_len, header) || header.session == 0) { continue; }
+      // Solo los bloques (de datos o de paridad) y el fin pueden abrir una transferencia (no, por ejemplo, una petición de firma
+      // repetida); los avisos de actividad del emisor ya han cumplido su función al renovar last_activity
+      if (header.type != packet_type::data && header.type != packet_type::parity && header.type != packet_type::fin) { continue; }
+
+      if (std::error_code error = accept(header, packet, sources[i])) {
+        shared.failed = true;
+        return complete(error);
+      }
+    }
+
+    if (std::error_code error = flush()) {
+      shared.failed = true;
+      return complete(error);
+    }
+  }
+
+  uint64_t now = now_microseconds();
+  bool all_finished = shared.stream_count != 0 && shared.finished_streams == shared.stream_count;
+  // Si nunca nos ha llegado ningún flujo, no hay FIN repetidos a los que responder; y, una vez completado el fichero, dejamos
+  // de escuchar cuando los emisores dejan de repetir el FIN
+  if (all_finished && (streams.empty() || now - last_activity >= LINGER_TIMEOUT * 1000ULL)) {
+    return complete(std::error_code(0, std::system_category()));
+  }
+  if (!all_finished && !streams.empty() && now - last_activity > PEER_TIMEOUT) {
+    log_error() << "Error: El emisor ha dejado de enviar datos.";
+    return complete(std::error_code(ETIMEDOUT, std::system_category()));
+  }
+
+  transfer_progress progress;
+  progress.wake_at = all_finished ? last_activity + LINGER_TIMEOUT * 1000ULL : now + 100000;
+  return progress;
+}
+
+/**
+ * @brief Método que prepara la recepción al empezar: activa UDP_GRO si se puede y crea el buffer de los lotes.
+ */
+void reliable_receiver::start() {
+  started = true;
+
+  // Con UDP_GRO el núcleo entrega agregados los datagramas seguidos del mismo emisor, así que cada mensaje puede ocupar hasta
+  // 64 KiB; se desactiva al terminar, porque el socket puede volver a usarse para recibir confirmaciones (modo diferencias)
+  coalescing = options.udp_offload && set_udp_coalescing(socket_fd, true);
+
+  // Creamos un buffer con espacio para batch_size mensajes (como mucho 64 si son agregados), que se reciben con una sola
+  // llamada al sistema
+  const size_t slot_size = coalescing ? GRO_SLOT_SIZE : PACKET_HEADER_SIZE + MAX_CHUNK_SIZE;
+  const size_t slot_count = coalescing ? std::min<size_t>(options.batch_size, GRO_MAX_SLOTS) : options.batch_size;
+  buffer = aligned_region(slot_size * slot_count);
+  slots.resize(slot_count);
+  for (size_t i = 0; i < slots.size(); ++i) { slots[i] = {buffer.data() + i * slot_size, slot_size}; }
+
+  last_activity = now_microseconds();
+}
+
+/**
+ * @brief Método que termina la recepción: desactiva UDP_GRO y avisa de los datagramas dañados o falsificados que se hayan
+ *        descartado.
+ * @param[in] error: resultado de la recepción.
+ * @return Devuelve el progreso final: con el error indicado o, si no lo hay pero algún flujo no ha coincidido con el CRC32C
+ *         del emisor, con EIO.
+ */
+transfer_progress reliable_receiver::complete(std::error_code error) {
+  if (coalescing) { set_udp_coalescing(socket_fd, false); }
+  coalescing = false;
+  started = false;
+
+  transfer_progress progress;
+  progress.done = true;
+  progress.error = error;
+  if (error) { return progress; }
+  if (corrupt_datagrams > 0) {
+    log_warning() << "Aviso: Se han descartado " << corrupt_datagrams << " datagramas con el CRC32C incorrecto.";
+  }
+  if (forged_datagrams > 0) {
+    log_warning() << "Aviso: Se han descartado " << forged_datagrams << " datagramas que no superan la autenticación.";
+  }
+  if (digest_mismatch) { progress.error = std::error_code(EIO, std::system_category()); }
+  return progress;
+}
+
+/**
+ * @brief Método que procesa un datagrama ya verificado: si va cifrado, lo autentica y lo descifra; comprueba que es de esta
+ *        transferencia (el primero fija la sesión); reserva el fichero con el primero que indica el tamaño, y añade los
+ *        bloques a los tramos del lote o registra el FIN de su flujo.
+ * @param[in] received: cabecera del datagrama (de tipo data, parity o fin).
+ * @param[in] packet: datagrama completo, que debe seguir existiendo hasta la siguiente llamada a flush().
+ * @param[in] source: dirección del emisor, a la que se envían las confirmaciones del flujo.
+ * @return Devuelve un código de error si no se ha podido reservar el fichero, el bloque no es válido o el emisor cifra sin
+ *         que tengamos la clave, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_receiver::accept(const packet_header& received, uint8_t* packet, const sockaddr_storage& source) {
+  packet_header header = received;
+  uint8_t* payload = packet + PACKET_HEADER_SIZE;
+
+  // Cada flujo reserva su estado con su primer datagrama, así que se descartan los que indican un flujo que no existe o más
+  // flujos de los que admite -j, antes de que puedan reservar nada
+  if (header.stream_count == 0 || header.stream_count > MAX_STREAMS || header.stream >= header.stream_count) {
+    return std::error_code(0, std::system_category());
+  }
+
+  // Con clave, solo se aceptan los datagramas que superan la autenticación, y antes de que puedan fijar la sesión: uno
+  // falsificado no puede ocupar el lugar de la transferencia
+  std::unique_ptr<aead_context> candidate;
+  if (options.secret || (header.flags & FLAG_ENCRYPTED)) {
+    if (!options.secret) {
+      log_error() << "Error: El emisor cifra la transferencia; indique la clave compartida con --key.";
+      return std::error_code(EACCES, std::system_category());
+    }
+    std::optional<size_t> plain_length = open_payload(header, payload, candidate);
+    if (!plain_length) {
+      if (forged_datagrams++ == 0) { log_warning() << "Aviso: Llegan datagramas que no superan la autenticación (¿el emisor usa otra clave?)."; }
+      count_metric(metric::forged_datagrams);
+      return std::error_code(0, std::system_category());
+    }
+    payload += AEAD_SALT_SIZE;
+    header.length = static_cast<uint16_t>(*plain_length);
+  }
+
+  // El primer datagrama que llega a cualquiera de los hilos fija la transferencia; los de otras sesiones se descartan
+  uint32_t expected = 0;
+  if (shared.session.compare_exchange_strong(expected, header.session)) { shared.stream_count = header.stream_count; }
+  if (header.session != shared.session || header.stream_count != shared.stream_count) { return std::error_code(0, std::system_category()); }
+
+  // El primer datagrama de la transferencia indica su tamaño, y reservamos el fichero completo para que cada bloque se
+  // escriba directamente en su posición, llegue en el orden que llegue, sin ir ampliando el fichero (salvo que el emisor
+  // envíe la salida de un comando y todavía no sepa cuánto ocupa)
+  if (header.total_size != UNKNOWN_TOTAL_SIZE && !shared.preallocated.exchange(true)) {
+    if (std::error_code error = preallocate_file(fd, header.total_size)) { return error; }
+  }
+
+  receive_stream& stream = streams[header.stream];
+  stream.peer = source;
+  if (candidate) {
+    std::optional<aead_key> reply_key = make_key(*options.secret, packet_algorithm(candidate->flags()));
+    if (reply_key) { stream.reply_cipher = std::make_unique<aead_context>(*reply_key); }
+    stream.cipher = std::move(candidate);
+  }
+
+  if (header.type == packet_type::data) {
+    if (std::error_code error = handle_data(header.stream, stream, header, payload, runs)) { return error; }
+    touched.try_emplace(header.stream, false);
+  } else if (header.type == packet_type::parity) {
+    handle_parity(header.stream, stream, header, payload);
+  } else if (header.type == packet_type::fin) {
+    if (!stream.finished && header.sequence == stream.cumulative && stream.received_count == 0 && header.length == sizeof(uint32_t)) {
+      uint32_t sender_digest;
+      std::memcpy(&sender_digest, payload, sizeof(sender_digest));
+      if (be32toh(sender_digest) != stream.digest) {
+        log_error() << "Error: El CRC32C de lo recibido no coincide con el de lo enviado (flujo " << header.stream << ").";
+        digest_mismatch = true;
+      }
+      {
+        std::lock_guard<std::mutex> lock(shared.digest_mutex);
+        shared.digests[header.stream] = {stream.digest, stream.bytes};
+      }
+      stream.finished = true;
+      ++shared.finished_streams;
+    }
+    touched[header.stream] = true;
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que comprueba y descifra en su sitio los datos de un datagrama cifrado. Cada flujo se queda con la clave del
+ *        primer datagrama suyo que la supera, derivada de la clave compartida y de la sal del emisor; los de otra sal se
+ *        descartan. La paridad lleva su prefijo en claro, que se mueve detrás de la sal para que siga delante del símbolo.
+ * @param[in] header: cabecera del datagrama.
+ * @param[in,out] payload: datos del datagrama, tal y como han llegado.
+ * @param[out] candidate: contexto de la clave nueva, si el flujo todavía no tenía ninguna.
+ * @return Devuelve el tamaño de los datos en claro, que quedan en payload + AEAD_SALT_SIZE, o nada si no superan la
+ *         autenticación.
+ */
+std::optional<size_t> reliable_receiver::open_payload(const packet_header& header, uint8_t* payload, std::unique_ptr<aead_context>& candidate) {
+  size_t clear_length = (header.type == packet_type::parity) ? FEC_PARITY_PREFIX : 0;
+  fec_parity_info info;
+  if (!(header.flags & FLAG_ENCRYPTED) || header.length < clear_length + AEAD_OVERHEAD ||
+      (clear_length > 0 && !decode_parity_info(payload, header.length, info))) {
+    return std::nullopt;
+  }
+  uint8_t* sealed = payload + clear_length;
+  aead_algorithm algorithm = packet_algorithm(header.flags);
+
+  auto found = streams.find(header.stream);
+  aead_context* cipher = (found != streams.end()) ? found->second.cipher.get() : nullptr;
+  if (cipher != nullptr && !cipher->matches(algorithm, sealed)) { return std::nullopt; }
+  if (cipher == nullptr) {
+    std::optional<aead_key> key = derive_key(*options.secret, algorithm, sealed);
+    if (!key) { return std::nullopt; }
+    candidate = std::make_unique<aead_context>(*key);
+    cipher = candidate.get();
+  }
+
+  std::optional<size_t> plain_length =
+      cipher->open(header, sealed, header.length - clear_length, {payload, clear_length, clear_length > 0 ? info.index : uint8_t{0}});
+  if (!plain_length) {
+    candidate.reset();
+    return std::nullopt;
+  }
+  if (clear_length > 0) { std::memmove(payload + AEAD_SALT_SIZE, payload, clear_length); }
+  return clear_length + *plain_length;
+}
+
+/**
+ * @brief Método que escribe los tramos de bloques aceptados desde la última llamada, reconstruye después (ya con ellos en el
+ *        fichero) los bloques perdidos de los grupos con paridad suficiente y los escribe también, y confirma lo recibido a
+ *        cada flujo que ha enviado algo (con fin_ack si ha pedido el fin y está completo).
+ * @return Devuelve un código de error si no se ha podido escribir o confirmar, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_receiver::flush() {
+  std::error_code result = write_runs();
+  if (!result && !fec_pending.empty()) {
+    recover_groups();
+    result = write_runs();
+  }
+  for (const auto& [stream_id, fin_received] : touched) {
+    if (result) { break; }
+    receive_stream& stream = streams[stream_id];
+    result = send_ack(stream_id, stream, stream.finished && fin_received ? packet_type::fin_ack : packet_type::ack);
+  }
+  runs.clear();
+  inflated.clear();
+  touched.clear();
+  fec_pending.clear();
+  return result;
+}
+
+/**
+ * @brief Método que escribe los tramos pendientes, cada uno con una sola llamada a pwritev().
+ * @return Devuelve un código de error si no se ha podido escribir algún tramo, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_receiver::write_runs() {
+  std::error_code result(0, std::system_category());
+  for (write_run& run : runs) {
+    if (std::error_code error = write_file_batch(fd, std::move(run.blocks), run.offset)) {
+      result = error;
+      break;
+    }
+  }
+  runs.clear();
+  return result;
+}
+
+/**
+ * @brief Función que indica si un flujo ya ha recibido (y escrito, o escribirá en este lote) un bloque.
+ * @param[in] stream: estado de recepción del flujo.
+ * @param[in] sequence: número de secuencia del bloque.
+ */
+static bool chunk_received(const receive_stream& stream, uint64_t sequence) {
+  if (sequence < stream.cumulative) { return true; }
+  if (sequence >= stream.cumulative + MAX_WINDOW || stream.received.empty()) { return false; }
+  size_t slot = sequence % MAX_WINDOW;
+  return (stream.received[slot / 64] >> (slot % 64)) & 1;
+}
+
+/**
+ * @brief Método que guarda un bloque de paridad hasta que se pueda usar: si a su grupo le faltan como mucho tantos bloques
+ *        como paridades se han recibido, se reconstruyen al terminar el lote. Los grupos ya completos no la necesitan, y de
+ *        los pendientes solo se conservan los FEC_MAX_PENDING_GROUPS más recientes.
+ * @param[in] stream_id: número del flujo al que pertenece el grupo.
+ * @param[in,out] stream: estado de recepción del flujo.
+ * @param[in] header: cabecera del bloque de paridad.
+ * @param[in] payload: datos del bloque de paridad (los de su grupo y el símbolo).
+ */
+void reliable_receiver::handle_parity(uint16_t stream_id, receive_stream& stream, const packet_header& header, const uint8_t* payload) {
+  fec_parity_info info;
+  if (!fec_enabled || stream.finished || !decode_parity_info(payload, header.length, info)) { return; }
+
+  // La paridad también puede fijar el tamaño de bloque del flujo, si llega antes que sus bloques
+  if (stream.chunk_size == 0 && header.chunk_size >= MIN_CHUNK_SIZE && header.chunk_size <= MAX_CHUNK_SIZE - FEC_PARITY_PREFIX) {
+    stream.chunk_size = header.chunk_size;
+  }
+  if (header.chunk_size != stream.chunk_size || header.length != FEC_PARITY_PREFIX + stream.chunk_size ||
+      info.last_length > stream.chunk_size || info.parity_count > FEC_MAX_PARITY || info.data_count > FEC_MAX_DATA) {
+    return;
+  }
+
+  // Los grupos que ya han quedado por debajo de la confirmación acumulada están completos
+  while (!stream.fec_groups.empty()) {
+    auto oldest = stream.fec_groups.begin();
+    if (oldest->first + oldest->second.info.group_count > stream.cumulative) { break; }
+    stream.fec_groups.erase(oldest);
+  }
+  uint64_t first = header.sequence;
+  if (first + info.group_count <= stream.cumulative || first + info.group_count > stream.cumulative + MAX_WINDOW) { return; }
+
+  size_t missing = 0;
+  for (uint64_t sequence = first; sequence < first + info.group_count; ++sequence) { missing += !chunk_received(stream, sequence); }
+  auto [position, created] = stream.fec_groups.try_emplace(first);
+  fec_group& group = position->second;
+  if (missing == 0) {
+    stream.fec_groups.erase(position);
+    return;
+  }
+  if (created) {
+    group.info = info;
+    group.offset = header.offset;
+    group.total_size = header.total_size;
+  } else if (group.info.group_count != info.group_count || group.info.last_length != info.last_length ||
+             std::any_of(group.symbols.begin(), group.symbols.end(), [&](const auto& symbol) { return symbol.first == info.index; })) {
+    return;
+  }
+
+  group.timestamp = header.timestamp;
+  pool_buffer& symbol = group.symbols.emplace_back(info.index, inflate_pool.acquire()).second;
+  std::memcpy(symbol.data(), payload + FEC_PARITY_PREFIX, stream.chunk_size);
+  if (group.symbols.size() >= missing) { fec_pending.emplace_back(stream_id, first); }
+
+  if (stream.fec_groups.size() > FEC_MAX_PENDING_GROUPS) { stream.fec_groups.erase(stream.fec_groups.begin()); }
+}
+
+/**
+ * @brief Método que reconstruye los bloques perdidos de los grupos que tienen paridad suficiente. La paridad es la suma de
+ *        los bloques del grupo por sus coeficientes, así que, al quitarle la aportación de los bloques que sí han llegado
+ *        (que se leen del fichero, donde ya están escritos), queda un sistema con los perdidos como incógnitas. Los bloques
+ *        reconstruidos se procesan como si hubieran llegado, con la cabecera que habrían traído. Si el fichero no se puede
+ *        leer, la corrección de errores se desactiva y los bloques perdidos se esperan del reenvío, como sin ella.
+ */
+void reliable_receiver::recover_groups() {
+  std::vector<size_t> rows;
+  std::vector<size_t> missing;
+  std::vector<uint8_t*> syndromes;
+  std::vector<uint8_t*> outputs;
+  pool_buffer scratch;
+
+  for (const auto& [stream_id, first] : fec_pending) {
+    receive_stream& stream = streams[stream_id];
+    auto position = stream.fec_groups.find(first);
+    if (position == stream.fec_groups.end()) { continue; }
+    fec_group& group = position->second;
+    size_t count = group.info.group_count;
+    auto block_length = [&](size_t index) { return (index + 1 == count) ? group.info.last_length : stream.chunk_size; };
+
+    missing.clear();
+    for (size_t index = 0; index < count; ++index) {
+      if (!chunk_received(stream, first + index)) { missing.push_back(index); }
+    }
+    if (missing.size() > group.symbols.size()) { continue; }
+    if (missing.empty()) {
+      stream.fec_groups.erase(position);
+      continue;
+    }
+
+    rows.clear();
+    syndromes.clear();
+    for (size_t i = 0; i < missing.size(); ++i) {
+      rows.push_back(group.symbols[i].first);
+      syndromes.push_back(group.symbols[i].second.data());
+    }
+    if (!scratch) { scratch = inflate_pool.acquire(); }
+    for (size_t index = 0, next = 0; index < count && fec_enabled; ++index) {
+      if (next < missing.size() && missing[next] == index) {
+        ++next;
+        continue;
+      }
+      size_t length = block_length(index);
+      ssize_t bytes_read = pread(fd, scratch.data(), length, static_cast<off_t>(group.offset + index * stream.chunk_size));
+      count_metric(metric::syscalls);
+      if (bytes_read != static_cast<ssize_t>(length)) {
+        log_info() << "No se puede leer el fichero de destino, se desactiva la corrección de errores (los bloques perdidos se reenviarán).";
+        fec_enabled = false;
+        break;
+      }
+      fec_accumulate(syndromes, rows, index, scratch.data(), length);
+    }
+    if (!fec_enabled) { break; }
+
+    outputs.clear();
+    for (size_t i = 0; i < missing.size(); ++i) { outputs.push_back(inflated.emplace_back(inflate_pool.acquire()).data()); }
+    if (!fec_recover(syndromes, rows, missing, outputs, stream.chunk_size)) { continue; }
+
+    for (size_t i = 0; i < missing.size(); ++i) {
+      packet_header header;
+      header.type = packet_type::data;
+      header.session = shared.session;
+      header.stream = stream_id;
+      header.stream_count = static_cast<uint16_t>(shared.stream_count);
+      header.sequence = first + missing[i];
+      header.offset = group.offset + missing[i] * stream.chunk_size;
+      header.total_size = group.total_size;
+      header.chunk_size = static_cast<uint32_t>(stream.chunk_size);
+      header.timestamp = group.timestamp;
+      header.length = static_cast<uint16_t>(block_length(missing[i]));
+      handle_data(stream_id, stream, header, outputs[i], runs);
+    }
+    count_metric(metric::fec_recovered, missing.size());
+    touched.try_emplace(stream_id, false);
+    stream.fec_groups.erase(position);
+  }
+
+  if (!fec_enabled) {
+    for (auto& [stream_id, stream] : streams) { stream.fec_groups.clear(); }
+  }
+}
+
+/**
+ * @brief Método que indica si algún flujo recibido por este receptor no ha coincidido con el CRC32C del emisor.
+ */
+bool reliable_receiver::digest_failed() const { return digest_mismatch; }
+
+/**
+ * @brief Método que procesa un bloque de datos recibido. Todos los bloques se añaden a los tramos que se escriben al final del
+ *        lote, en su posición del fichero, sin esperar a los anteriores; los que llegan adelantados se marcan en el mapa de bits
+ *        del flujo junto con su CRC32C, que se incorpora al del flujo cuando llegan los que faltaban. Los bloques comprimidos
+ *        se descomprimen al llegar.
+ * @param[in] stream_id: número del flujo al que pertenece el bloque.
+ * @param[in,out] stream: estado de recepción del flujo.
+ * @param[in] header: cabecera del bloque.
+ * @param[in] payload: datos del bloque, dentro del buffer de recepción del lote.
+ * @param[out] runs: tramos de bloques consecutivos que se escribirán en el fichero.
+ * @return Devuelve un código de error si el bloque comprimido no es válido, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_receiver::handle_data(uint16_t stream_id, receive_stream& stream, const packet_header& header, uint8_t* payload,
+                                               std::vector<write_run>& runs) {
+  stream.echo_timestamp = header.timestamp;
+
+  // El tamaño de bloque lo elige el emisor y lo fija el primer bloque del flujo; un bloque que no lo respeta no se acepta
+  if (stream.chunk_size == 0 && header.chunk_size >= MIN_CHUNK_SIZE && header.chunk_size <= MAX_CHUNK_SIZE) {
+    stream.chunk_size = header.chunk_size;
+  }
+  if (header.chunk_size != stream.chunk_size || (!(header.flags & FLAG_COMPRESSED) && header.length > stream.chunk_size)) {
+    return std::error_code(0, std::system_category());
+  }
+
+  // Los duplicados se ignoran; los que están demasiado adelantados, también (el emisor nunca supera MAX_WINDOW)
+  uint64_t sequence = header.sequence;
+  size_t slot = sequence % MAX_WINDOW;
+  if (sequence < stream.cumulative || sequence >= stream.cumulative + MAX_WINDOW ||
+      (sequence > stream.cumulative && !stream.received.empty() && ((stream.received[slot / 64] >> (slot % 64)) & 1))) {
+    return std::error_code(0, std::system_category());
+  }
+
+  uint8_t* data = payload;
+  size_t length = header.length;
+  if (header.flags & FLAG_COMPRESSED) {
+    pool_buffer plain = inflate_pool.acquire();
+    std::optional<size_t> plain_size = decompress_block(payload, header.length, plain.data(), stream.chunk_size);
+    if (!plain_size) {
+      log_error() << "Error: Se ha recibido un bloque comprimido que no se puede descomprimir.";
+      return std::error_code(EBADMSG, std::system_category());
+    }
+    // Los datos descomprimidos tienen que seguir existiendo hasta que se escriba el lote
+    data = plain.data();
+    length = *plain_size;
+    inflated.push_back(std::move(plain));
+  }
+  // Un bloque que se sale del tamaño anunciado de la transferencia no se escribe
+  if (header.offset + length > header.total_size) { return std::error_code(0, std::system_category()); }
+
+  // Los bloques consecutivos de un flujo lo son también en el fichero, así que continúan el último tramo si es de este flujo
+  if (runs.empty() || runs.back().stream != stream_id || runs.back().offset + static_cast<off_t>(runs.back().length) != static_cast<off_t>(header.offset)) {
+    runs.push_back({stream_id, static_cast<off_t>(header.offset), 0, {}});
+  }
+  runs.back().blocks.push_back({data, length});
+  runs.back().length += length;
+
+  if (sequence > stream.cumulative) {
+    if (stream.received.empty()) {
+      stream.received.assign(MAX_WINDOW / 64, 0);
+      stream.received_digests.assign(MAX_WINDOW, 0);
+    }
+    stream.received[slot / 64] |= 1ULL << (slot % 64);
+    stream.received_digests[slot] = crc32c(data, length);
+    if (length != stream.chunk_size) {
+      stream.short_sequence = sequence;
+      stream.short_length = length;
+    }
+    ++stream.received_count;
+    stream.highest_received = std::max(stream.highest_received, sequence);
+    return std::error_code(0, std::system_category());
+  }
+
+  // El bloque esperado avanza la confirmación acumulada, junto con los adelantados que ya estaban escritos detrás de él
+  stream.digest = crc32c(data, length, stream.digest);
+  stream.bytes += length;
+  ++stream.cumulative;
+  while (stream.received_count > 0) {
+    size_t next = stream.cumulative % MAX_WINDOW;
+    uint64_t bit = 1ULL << (next % 64);
+    if (!(stream.received[next / 64] & bit)) { break; }
+    stream.received[next / 64] &= ~bit;
+    --stream.received_count;
+    size_t block_length = (stream.cumulative == stream.short_sequence) ? stream.short_length : stream.chunk_size;
+    stream.digest = crc32c_combine(stream.digest, stream.received_digests[next], block_length);
+    stream.bytes += block_length;
+    ++stream.cumulative;
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que envía al emisor de un flujo la confirmación acumulada y los rangos de bloques recibidos fuera de orden.
+ * @param[in] stream_id: número del flujo.
+ * @param[in] stream: estado de recepción del flujo.
+ * @param[in] type: ack durante la transferencia, o fin_ack para confirmar que el flujo está completo.
+ * @return Devuelve un código de error si no se ha podido enviar la confirmación, o un código de éxito en caso contrario.
+ */
+std::error_code reliable_receiver::send_ack(uint16_t stream_id, const receive_stream& stream, packet_type type) {
+  // Agrupamos los bloques pendientes en rangos consecutivos. Si no caben todos, enviamos los primeros y el último,
+  // que es el que permite al emisor detectar las pérdidas anteriores a él
+  std::vector<sack_block> ranges;
+  uint64_t sequence = stream.cumulative + 1;
+  while (stream.received_count > 0 && sequence <= stream.highest_received) {
+    // Saltamos de una vez los bits a cero de cada palabra del mapa
+    size_t slot = sequence % MAX_WINDOW;
+    uint64_t word = stream.received[slot / 64] >> (slot % 64);
+    if (word == 0) {
+      sequence += 64 - slot % 64;
+      continue;
+    }
+    sequence += static_cast<uint64_t>(std::countr_zero(word));
+    if (sequence > stream.highest_received) { break; }
+    if (!ranges.empty() && ranges.back().end == sequence) {
+      ranges.back().end = sequence + 1;
+    } else {
+      ranges.push_back({sequence, sequence + 1});
+    }
+    ++sequence;
+  }
+  if (ranges.size() > MAX_SACK_BLOCKS) {
+    ranges[MAX_SACK_BLOCKS - 1] = ranges.back();
+    ranges.resize(MAX_SACK_BLOCKS);
+  }
+
+  packet_header header;
+  header.type = type;
+  header.session = shared.session;
+  header.stream = stream_id;
+  header.stream_count = static_cast<uint16_t>(shared.stream_count);
+  header.sequence = stream.cumulative;
+  header.timestamp = stream.echo_timestamp;
+  // La confirmación del FIN lleva el CRC32C de lo recibido en lugar de los rangos SACK (que ya no hay)
+  if (type == packet_type::fin_ack) {
+    uint32_t encoded_digest = htobe32(stream.digest);
+    std::memcpy(ack_packet.data() + PACKET_HEADER_SIZE, &encoded_digest, sizeof(encoded_digest));
+    header.length = sizeof(uint32_t);
+    // Con cifrado va cifrado con la clave propia del receptor, derivada de la compartida, así que el emisor sabe que la
+    // confirmación es de quien la conoce
+    if (stream.reply_cipher) {
+      header.flags = stream.reply_cipher->flags();
+      header.length = static_cast<uint16_t>(stream.reply_cipher->seal(header, reinterpret_cast<const uint8_t*>(&encoded_digest),
+                                                                      sizeof(encoded_digest), ack_packet.data() + PACKET_HEADER_SIZE));
+    }
+  } else {
+    header.length = static_cast<uint16_t>(encode_sack(ranges, ack_packet.data() + PACKET_HEADER_SIZE));
+  }
+  encode_header(header, ack_packet.data());
+  seal_header(ack_packet.data(), crc32c(ack_packet.data() + PACKET_HEADER_SIZE, header.length), header.length);
+
+  count_metric(metric::syscalls);
+  if (sendto(socket_fd, ack_packet.data(), PACKET_HEADER_SIZE + header.length, 0, reinterpret_cast<const sockaddr*>(&stream.peer),
+             address_length(stream.peer)) < 0) {
+    log_error() << "Error: No se ha podido enviar la confirmación al emisor.";
+    return std::error_code(errno, std::system_category());
+  }
+  return std::error_code(0, std::system_category());
+}
@@ -0,0 +1,441 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación del modo servidor y de la clase session_table
+ */
+
+#include "header_files/server.h"
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+/**
+ * @brief Constructor de server_session: abre el fichero provisional (<path>.part) en el que se escribe la transferencia.
+ * @param[in] path: fichero definitivo de la transferencia.
+ * @param[in] session: identificador de sesión de la transferencia.
+ * @param[in] stream_count: número de flujos en los que el emisor ha repartido la transferencia.
+ */
+server_session::server_session(const std::string& path, uint32_t session, uint16_t stream_count)
+    : path(path), last_activity(now_microseconds()) {
+  state.session = session;
+  state.stream_count = stream_count;
+  fd = open((path + ".part").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd == -1) { log_error() << "Error: No se puede crear el fichero " << path << ".part."; }
+}
+
+/**
+ * @brief Destructor de server_session: cuando ningún hilo la usa ya, guarda el fichero con su nombre definitivo si la
+ *        transferencia se ha completado bien, o lo borra si no.
+ */
+server_session::~server_session() {
+  if (fd == -1) { return; }
+  close(fd);
+  std::string partial = path + ".part";
+  if (!complete() || state.failed) {
+    unlink(partial.c_str());
+    log_warning() << "Aviso: La transferencia " << path << " no se ha completado y se ha descartado.";
+    return;
+  }
+  if (rename(partial.c_str(), path.c_str()) != 0) {
+    log_error() << "Error: No se ha podido guardar la transferencia en " << path << ".";
+    return;
+  }
+  uint32_t digest = 0;
+  uint64_t bytes = 0;
+  for (const auto& [stream, part] : state.digests) {
+    digest = crc32c_combine(digest, part.first, part.second);
+    bytes += part.second;
+  }
+  log_info() << "Transferencia guardada en " << path << ": " << bytes << " bytes, CRC32C " << std::hex << std::setw(8)
+             << std::setfill('0') << digest << std::dec << ".";
+}
+
+/**
+ * @brief Método que indica si han terminado todos los flujos de la transferencia.
+ */
+bool server_session::complete() const { return state.finished_streams == state.stream_count; }
+
+/**
+ * @brief Constructor de session_table
+ * @param[in] directory: directorio en el que se guardan las transferencias.
+ * @param[in] options: límites del servidor.
+ */
+session_table::session_table(const std::string& directory, const server_options& options) : directory(directory), options(options) {}
+
+/**
+ * @brief Función que devuelve la clave de la transferencia de un datagrama.
+ * @param[in] session: identificador de sesión.
+ * @param[in] source: dirección del emisor (solo cuenta la IP).
+ * @return Devuelve la clave, con las direcciones IPv4 como IPv6 mapeadas (::ffff:a.b.c.d).
+ */
+session_key make_session_key(uint32_t session, const sockaddr_storage& source) {
+  session_key key{session, {}};
+  if (source.ss_family == AF_INET6) {
+    std::memcpy(key.second.data(), &reinterpret_cast<const sockaddr_in6&>(source).sin6_addr, 16);
+  } else {
+    key.second[10] = key.second[11] = 0xff;
+    std::memcpy(key.second.data() + 12, &reinterpret_cast<const sockaddr_in&>(source).sin_addr, 4);
+  }
+  return key;
+}
+
+/**
+ * @brief Método que devuelve la transferencia a la que pertenece un datagrama, por la IP del emisor y el identificador de
+ *        sesión. Solo un bloque de datos puede abrir una transferencia nueva, y solo si no se ha alcanzado el máximo de
+ *        transferencias, no supera el tamaño ni el número de flujos máximos y el estado de recepción de sus flujos cabe en la
+ *        memoria que queda. Un bloque autenticado (con --key) desde otra dirección que lleva el identificador de una
+ *        transferencia en curso es otro camino de su emisor, y se une a ella; sin autenticación, cualquiera podría escribir
+ *        en la transferencia de otro emisor con solo conocer su identificador, así que abre una transferencia distinta.
+ *        Con clave, el bloque se autentica solo si de verdad va a unir un camino o a abrir (o rechazar) una transferencia:
+ *        los datagramas de las transferencias que ya están en la tabla, también los de las retiradas o rechazadas, y los que
+ *        se ignoran por falta de sitio no derivan ninguna clave.
+ * @param[in] source: dirección del emisor.
+ * @param[in] header: cabecera del datagrama.
+ * @param[in] authenticate: función que comprueba el bloque con la clave compartida (vacía si no hay clave).
+ * @return Devuelve la transferencia, o nullptr si el datagrama no se atiende (transferencia retirada, rechazada, sin sitio o
+ *         falsificada).
+ */
+std::shared_ptr<server_session> session_table::find(const sockaddr_storage& source, const packet_header& header,
+                                                    const std::function<bool()>& authenticate) {
+  session_key key = make_session_key(header.session, source);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = sessions.find(key);
+  if (it != sessions.end()) {
+    // Mientras el emisor de una transferencia retirada siga insistiendo, la recordamos para no confundirla con una nueva
+    if (!it->second.session) { it->second.retired_at = now_microseconds(); }
+    return it->second.session;
+  }
+  if (header.type != packet_type::data) { return nullptr; }
+
+  // Otra transferencia en curso con el mismo identificador, desde otra dirección
+  std::shared_ptr<server_session> origin;
+  for (auto other = sessions.lower_bound({header.session, {}}); other != sessions.end() && other->first.first == header.session; ++other) {
+    if (other->second.session && !other->second.joined) {
+      origin = other->second.session;
+      break;
+    }
+  }
+  std::optional<bool> verified;
+  auto authentic = [&]() {
+    if (!verified) { verified = !authenticate || authenticate(); }
+    return *verified;
+  };
+  if (origin && authenticate && header.stream_count == origin->state.stream_count) {
+    if (!authentic()) { return nullptr; }
+    sessions[key] = {origin, 0, true};
+    log_info() << "Nuevo camino de la transferencia " << origin->path << " desde " << address_to_string(source) << ".";
+    return origin;
+  }
+  if (origin && !authenticate) {
+    log_debug() << "Llega sin autenticar desde " << address_to_string(source) << " el identificador de la transferencia " << origin->path
+                << "; se trata como una transferencia distinta.";
+  }
+
+  std::ostringstream name;
+  name << directory << '/' << ip_to_string(source) << '-' << std::hex << std::setw(8) << std::setfill('0') << header.session;
+
+  if (active >= options.max_sessions) {
+    log_debug() << "Se ignora la transferencia " << name.str() << ": ya hay " << active << " en curso.";
+    return nullptr;
+  }
+  uint64_t cost = uint64_t{header.stream_count} * RECEIVE_STREAM_MEMORY;
+  if (memory + cost > options.max_memory) {
+    log_debug() << "Se ignora la transferencia " << name.str() << ": su estado no cabe en la memoria que queda (" << memory << " de "
+                << options.max_memory << " bytes en uso).";
+    return nullptr;
+  }
+  // Los rechazos se recuerdan, así que solo los puede provocar un bloque auténtico
+  if (!authentic()) { return nullptr; }
+  if (options.max_session_size != 0 && header.total_size != UNKNOWN_TOTAL_SIZE && header.total_size > options.max_session_size) {
+    log_warning() << "Aviso: Se rechaza la transferencia " << name.str() << " (" << header.total_size << " bytes), que supera el tamaño máximo.";
+    sessions[key] = {nullptr, now_microseconds()};
+    return nullptr;
+  }
+  if (header.stream_count == 0 || header.stream_count > options.max_streams || header.stream >= header.stream_count) {
+    log_warning() << "Aviso: Se rechaza la transferencia " << name.str() << " (" << header.stream_count << " flujos), que supera el número máximo de flujos.";
+    sessions[key] = {nullptr, now_microseconds()};
+    return nullptr;
+  }
+
+  auto session = std::make_shared<server_session>(name.str(), header.session, header.stream_count);
+  if (session->fd == -1) { return nullptr; }
+  sessions[key] = {session, 0};
+  ++active;
+  memory += cost;
+  log_info() << "Nueva transferencia de " << address_to_string(source) << " en " << header.stream_count
+             << (header.stream_count == 1 ? " flujo" : " flujos") << ", se guardará en " << name.str() << ".";
+  return session;
+}
+
+/**
+ * @brief Método que retira las transferencias completadas (o fallidas) que ya no reciben FIN repetidos y las que su emisor
+ *        ha abandonado, y olvida las retiradas hace tiempo. Cada hilo lo llama periódicamente.
+ * @param[in] now: instante actual, en microsegundos.
+ */
+void session_table::expire(uint64_t now) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = sessions.begin(); it != sessions.end();) {
+    table_entry& entry = it->second;
+    if (!entry.session) {
+      it = (now - entry.retired_at > PEER_TIMEOUT) ? sessions.erase(it) : std::next(it);
+      continue;
+    }
+    // Los caminos unidos se retiran con su transferencia, que es la que cuenta en los límites
+    if (entry.joined) {
+      if (entry.session->retired) {
+        entry.session.reset();
+        entry.retired_at = now;
+      }
+      ++it;
+      continue;
+    }
+    uint64_t idle = now - entry.session->last_activity;
+    bool finished = entry.session->complete() || entry.session->state.failed;
+    if ((finished && idle > LINGER_TIMEOUT * 1000ULL) || idle > PEER_TIMEOUT) {
+      if (!finished) {
+        log_warning() << "Aviso: El emisor de " << entry.session->path << " ha dejado de enviar datos.";
+        entry.session->state.failed = true;
+      }
+      entry.session->retired = true;
+      memory -= uint64_t{entry.session->state.stream_count} * RECEIVE_STREAM_MEMORY;
+      entry.session.reset();
+      entry.retired_at = now;
+      --active;
+    }
+    ++it;
+  }
+}
+
+/**
+ * @brief Función que comprueba, con clave compartida, que el bloque que abriría una transferencia nueva supera la
+ *        autenticación, para que los datagramas falsificados no ocupen sitio en la tabla ni creen ficheros. Se descifra una
+ *        copia: el receptor de la transferencia lo descifrará después en su sitio.
+ * @param[in] options: opciones de la recepción (con la clave compartida, si la hay).
+ * @param[in] header: cabecera del bloque.
+ * @param[in] payload: datos del bloque, tal y como han llegado.
+ * @return Devuelve si el bloque puede abrir la transferencia.
+ */
+static bool authentic(const netcp_options& options, const packet_header& header, const uint8_t* payload) {
+  if (!options.secret) { return true; }
+  if (!(header.flags & FLAG_ENCRYPTED) || header.length < AEAD_OVERHEAD) { return false; }
+  std::optional<aead_key> key = derive_key(*options.secret, packet_algorithm(header.flags), payload);
+  if (!key) { return false; }
+  aead_context cipher(*key);
+  std::vector<uint8_t> copy(payload, payload + header.length);
+  return cipher.open(header, copy.data(), copy.size()).has_value();
+}
+
+/**
+ * @brief Función de cada hilo del servidor: espera con epoll a que lleguen datagramas a su socket (o a que venza su
+ *        temporizador), reparte cada lote entre las transferencias a las que pertenece y, al final del lote, escribe y
+ *        confirma lo recibido en cada una.
+ * @param[in] socket_fd: socket del hilo (el núcleo reparte los flujos de las transferencias entre los sockets del servidor).
+ * @param[in,out] table: tabla de transferencias compartida por todos los hilos.
+ * @param[in] options: opciones de la recepción (tamaño del lote de datagramas, ...).
+ * @param[in] limits: límites del servidor.
+ * @return Devuelve un código de error si el hilo no puede seguir recibiendo, o un código de éxito si se le pide terminar.
+ */
+static std::error_code serve_shard(int socket_fd, session_table& table, const netcp_options& options, const server_options& limits) {
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (epoll_fd == -1 || timer_fd == -1) {
+    std::error_code error(errno, std::system_category());
+    if (epoll_fd != -1) { close(epoll_fd); }
+    if (timer_fd != -1) { close(timer_fd); }
+    return error;
+  }
+  itimerspec tick = {{0, SERVER_TICK * 1000000L}, {0, SERVER_TICK * 1000000L}};
+  timerfd_settime(timer_fd, 0, &tick, nullptr);
+  epoll_event events[2] = {};
+  events[0] = {EPOLLIN, {.fd = socket_fd}};
+  events[1] = {EPOLLIN, {.fd = timer_fd}};
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &events[0]);
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &events[1]);
+
+  bool coalescing = options.udp_offload && set_udp_coalescing(socket_fd, true);
+  const size_t slot_size = coalescing ? GRO_SLOT_SIZE : PACKET_HEADER_SIZE + MAX_CHUNK_SIZE;
+  const size_t slot_count = coalescing ? std::min<size_t>(options.batch_size, GRO_MAX_SLOTS) : options.batch_size;
+  aligned_region buffer(slot_size * slot_count);
+  std::vector<iovec> slots(slot_count);
+  for (size_t i = 0; i < slots.size(); ++i) { slots[i] = {buffer.data() + i * slot_size, slot_size}; }
+  std::vector<iovec> datagrams;
+  std::vector<sockaddr_storage> sources;
+
+  // Transferencias que han llegado a este hilo, cada una con su receptor (que lleva el estado de los flujos de este socket), y
+  // la de cada clave (IP del emisor e identificador de sesión): los caminos unidos desde otra dirección comparten el receptor
+  struct shard_session {
+    std::shared_ptr<server_session> session;
+    std::unique_ptr<reliable_receiver> receiver;
+    bool touched = false;
+  };
+  std::map<server_session*, shard_session> receivers;
+  std::map<session_key, shard_session*> local;
+  std::vector<shard_session*> touched;
+
+  std::error_code error(0, std::system_category());
+  while (!quit_requested) {
+    int ready = epoll_wait(epoll_fd, events, 2, -1);
+    if (ready < 0 && errno == EINTR) { continue; }
+    if (ready < 0) {
+      error = std::error_code(errno, std::system_category());
+      break;
+    }
+
+    for (int e = 0; e < ready; ++e) {
+      if (events[e].data.fd == timer_fd) {
+        uint64_t expirations;
+        [[maybe_unused]] ssize_t result = read(timer_fd, &expirations, sizeof(expirations));
+        table.expire(now_microseconds());
+        std::erase_if(local, [](const auto& item) { return item.second->session->retired.load(); });
+        std::erase_if(receivers, [](const auto& item) { return item.second.session->retired.load(); });
+        continue;
+      }
+
+      auto result = receive_batch(socket_fd, slots, datagrams, sources);
+      if (!result) {
+        error = result.error();
+        break;
+      }
+      uint64_t now = now_microseconds();
+      for (size_t i = 0; i < *result; ++i) {
+        uint8_t* packet = static_cast<uint8_t*>(datagrams[i].iov_base);
+        if (!verify_checksum(packet, datagrams[i].iov_len)) {
+          count_metric(metric::corrupt_datagrams);
+          continue;
+        }
+        packet_header header;
+        if (!decode_header(packet, datagrams[i].iov_len, header) || header.session == 0) { continue; }
+        bool keepalive = (header.type == packet_type::keepalive);
+        if (header.type != packet_type::data && header.type != packet_type::parity && header.type != packet_type::fin && !keepalive) {
+          continue;
+        }
+
+        session_key key = make_session_key(header.session, sources[i]);
+        auto it = local.find(key);
+        if (it == local.end() || it->second->session->retired) {
+          if (keepalive) { continue; }
+          std::function<bool()> authenticate;
+          if (options.secret) {
+            authenticate = [&]() {
+              if (authentic(options, header, packet + PACKET_HEADER_SIZE)) { return true; }
+              count_metric(metric::forged_datagrams);
+              return false;
+            };
+          }
+          std::shared_ptr<server_session> session = table.find(sources[i], header, authenticate);
+          if (!session) { continue; }
+          auto [shard, created] = receivers.try_emplace(session.get());
+          if (created) {
+            shard->second.receiver = std::make_unique<reliable_receiver>(socket_fd, session->fd, options, session->state);
+            shard->second.session = std::move(session);
+          }
+          it = local.insert_or_assign(key, &shard->second).first;
+        }
+        shard_session& entry = *it->second;
+        server_session& session = *entry.session;
+        // Las transferencias fallidas dejan de renovar su actividad, para que se retiren aunque el emisor siga insistiendo
+        if (session.state.failed || header.stream_count != session.state.stream_count) { continue; }
+        session.last_activity = now;
+        if (keepalive) { continue; }
+        if (limits.max_session_size != 0 && header.type == packet_type::data && header.offset + header.length > limits.max_session_size) {
+          log_warning() << "Aviso: La transferencia " << session.path << " supera el tamaño máximo y se abandona.";
+          session.state.failed = true;
+          continue;
+        }
+        if (std::error_code accept_error = entry.receiver->accept(header, packet, sources[i])) {
+          log_error() << "Error: No se puede escribir la transferencia " << session.path << ".";
+          session.state.failed = true;
+          continue;
+        }
+        if (!entry.touched) {
+          entry.touched = true;
+          touched.push_back(&entry);
+        }
+      }
+
+      // Al final del lote, cada transferencia escribe sus bloques y confirma a sus flujos
+      for (shard_session* entry : touched) {
+        entry->touched = false;
+        if (entry->receiver->flush() || entry->receiver->digest_failed()) { entry->session->state.failed = true; }
+      }
+      touched.clear();
+    }
+    if (error) { break; }
+  }
+
+  close(timer_fd);
+  close(epoll_fd);
+  return error;
+}
+
+/**
+ * @brief Función que atiende transferencias sin terminar: crea un socket por hilo en la dirección de NETCP_IP y NETCP_PORT
+ *        (todos con SO_REUSEPORT, y el núcleo reparte entre ellos los flujos de las transferencias) y guarda cada transferencia en su
+ *        propio fichero del directorio indicado. Las transferencias de varios flujos pueden repartirse entre varios hilos,
+ *        que comparten su estado a través de la tabla de transferencias.
+ * @param[in] directory: directorio en el que se guardan las transferencias (se crea si no existe).
+ * @param[in] options: opciones de la recepción (streams es el número de hilos).
+ * @param[in] limits: límites del servidor.
+ * @return Devuelve un código de error si no se ha podido iniciar el servidor o alguno de sus hilos falla.
+ */
+std::error_code netcp_serve(const std::string& directory, const netcp_options& options, const server_options& limits) {
+  if (mkdir(directory.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) != 0 && errno != EEXIST) {
+    log_error() << "Error: No se puede crear el directorio " << directory << ".";
+    return std::error_code(errno, std::system_category());
+  }
+
+  const char* netcp_port = std::getenv("NETCP_PORT");
+  const char* netcp_ip = std::getenv("NETCP_IP");
+  uint16_t port = (netcp_port != nullptr) ? std::stoi(netcp_port) : 8080;
+  std::optional<std::string> ip_address = (netcp_ip != nullptr) ? std::make_optional(netcp_ip) : "127.0.0.1";
+  auto address = make_ip_address(ip_address, port);
+  if (!address) {
+    log_error() << "Error: No se ha podido crear la dirección IP.";
+    return std::error_code(errno, std::system_category());
+  }
+
+  std::vector<int> sockets;
+  auto close_sockets = [&]() {
+    for (int socket_fd : sockets) { close(socket_fd); }
+  };
+  for (size_t i = 0; i < options.streams; ++i) {
+    auto socket_result = make_socket(*address, true);
+    if (!socket_result) {
+      log_error() << "Error: No se ha podido crear el socket.";
+      close_sockets();
+      return socket_result.error();
+    }
+    sockets.push_back(*socket_result);
+    set_receive_buffer(*socket_result, options);
+  }
+  steer_streams(sockets);
+
+  log_info() << "Atendiendo transferencias en " << *ip_address << ":" << port << " con " << sockets.size()
+             << (sockets.size() == 1 ? " hilo" : " hilos") << ", que se guardan en " << directory << "...";
+  session_table table(directory, limits);
+  std::vector<std::error_code> errors(sockets.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sockets.size(); ++i) {
+    threads.emplace_back([&, i]() { errors[i] = serve_shard(sockets[i], table, options, limits); });
+  }
+  for (std::thread& thread : threads) { thread.join(); }
+  close_sockets();
+
+  for (const std::error_code& error : errors) {
+    if (error) {
+      log_error() << "Error: El servidor ha dejado de recibir datos.";
+      return error;
+    }
+  }
+  return std::error_code(0, std::system_category());
+}
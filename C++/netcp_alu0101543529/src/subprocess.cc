@@ -6,11 +6,18 @@
  *
  * @author Raúl González Acosta (alu0101543529@ull.edu.es)
  * @date   30/10/2023
- * @brief  Implementación de la clase Subprocess
+ * @brief  Implementación de la clase Subprocess y del conjunto de procesos subprocess_pool
 */
 
 #include "header_files/subprocess.h"
-#include <iostream>
+#include "header_files/logger.h"
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <utility>
+
+// Entorno del proceso, que hereda el hijo
+extern char** environ;
 
 /**
  * @brief Constructor de subprocess
@@ -18,8 +25,10 @@
  * @param redirected_io: miembro de la enumeración `stdio` que indica cómo se manejará la entrada/salida estándar del proceso hijo.
  */
 subprocess::subprocess(const std::vector<std::string>& args, subprocess::stdio redirected_io) : args(args), redirected_io(redirected_io), child_pid(-1) {
-  if (pipe(std_pipe) < 0) { 
-    std::cerr << "Error: No se ha podido cerar la tubería correctamente." << std::endl;
+  // Con O_CLOEXEC, la tubería no la heredan los demás procesos que se lancen mientras tanto (solo este hijo, que la recibe
+  // duplicada en su entrada o salida); si la heredaran, su lector no vería el fin de la salida hasta que terminasen todos
+  if (pipe2(std_pipe, O_CLOEXEC) < 0) { 
+    log_error() << "Error: No se ha podido cerar la tubería correctamente.";
     exit(EXIT_FAILURE); 
   }
 }
@@ -28,9 +37,10 @@ subprocess::subprocess(const std::vector<std::string>& args, subprocess::stdio r
  * @brief Destructor de subprocess
  */
 subprocess::~subprocess() {
-  close(std_pipe[0]);
-  close(std_pipe[1]);
-  close(std_pipe[2]);
+  for (int fd : std_pipe) {
+    if (fd != -1) { close(fd); }
+  }
+  if (child_pidfd != -1) { close(child_pidfd); }
 }
 
 /**
@@ -38,38 +48,51 @@ subprocess::~subprocess() {
  * @return Devuelve true si el proceso hijo está vivo (en ejecución) y false en caso contrario
  */
 bool subprocess::is_alive() {
-  return (child_pid != -1) && (waitpid(child_pid, nullptr, WNOHANG) == 0);
+  // Con WNOWAIT el hijo que ya ha terminado no se recoge, para que wait() pueda obtener después su código de salida
+  siginfo_t info{};
+  return (child_pid != -1) && waitid(P_PID, static_cast<id_t>(child_pid), &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == 0;
 }
 
 /**
- * @brief Método que crea un nuevo proceso hijo, y ejecuta el comando especificado por argumentos
- * @return Devuelve true si el proceso hijo está vivo (en ejecución) y false en caso contrario
+ * @brief Método que crea un nuevo proceso hijo, y ejecuta el comando especificado por argumentos. Se lanza con posix_spawnp(),
+ *        que en Linux crea el hijo con clone(CLONE_VM | CLONE_VFORK): comparte la memoria del padre hasta que ejecuta el
+ *        comando, así que no se copian sus tablas de páginas por grande que sea. La redirección de la entrada/salida se
+ *        indica con acciones sobre los descriptores que aplica el propio posix_spawnp() en el hijo.
+ * @return Devuelve un código de error si no se ha podido crear el proceso o ejecutar el comando, o un código de éxito en caso contrario
  */
 std::error_code subprocess::exec() {
-  child_pid = fork();
+  // Como posix_spawnp() requiere que el vector de argumentos termine en un puntero nulo, se lo insertamos creando un nuevo vector
+  std::vector<char*> c_args;
+  for (const auto& arg : args) { c_args.push_back(const_cast<char*>(arg.c_str())); }
+  c_args.push_back(nullptr);
 
-  // Si no se ha podido cerar el proceso hijo (la llamada al sistema fork() falló), mostraremos un mensaje de error y saldremos con código de error != 0
-  if (child_pid == -1) {
-    std::cerr << "Error: No se ha podido crear el proceso hijo." << std::endl;
-    return std::error_code(errno, std::system_category());
-  }
+  // Con stdio::in el hijo lee del extremo de lectura; en los demás casos, escribe en el de escritura (con outerr, tanto la
+  // salida estándar como la de error). Los extremos originales tienen O_CLOEXEC, así que se cierran solos al ejecutar el comando
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (redirected_io == stdio::in) { posix_spawn_file_actions_adddup2(&actions, std_pipe[0], STDIN_FILENO); }
+  if (redirected_io == stdio::out || redirected_io == stdio::outerr) { posix_spawn_file_actions_adddup2(&actions, std_pipe[1], STDOUT_FILENO); }
+  if (redirected_io == stdio::err || redirected_io == stdio::outerr) { posix_spawn_file_actions_adddup2(&actions, std_pipe[1], STDERR_FILENO); }
 
-  // Dentro de este if solo entra el proceso hijo
-  if (child_pid == 0) {
-    setup_child_process();
-    
-    // Como la llamada execvp() requiere que el vector de argumentos termine en un puntero nulo, se lo insertamos creando un nuevo vector
-    std::vector<const char*> c_args;
-    for (const auto& arg : args) { c_args.push_back(arg.c_str()); }
-    c_args.push_back(nullptr);
-
-    // Si no se ha podido ejecutar el comando (la llamada al sistema execvp() falló), mostraremos un mensaje de error y saldremos con código de error != 0
-    if (!(execvp(args[0].c_str(), const_cast<char* const*>(c_args.data())))) {
-      std::cerr << "Error: No se ha podido ejecutar el comando." << std::endl;
-      return std::error_code(errno, std::system_category());
-    }
+  int result = posix_spawnp(&child_pid, args[0].c_str(), &actions, nullptr, c_args.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+
+  // Si no se ha podido crear el proceso o ejecutar el comando (posix_spawnp() devuelve el error, también el de la ejecución),
+  // mostraremos un mensaje de error y saldremos con código de error != 0
+  if (result != 0) {
+    child_pid = -1;
+    log_error() << "Error: No se ha podido ejecutar el comando " << args[0] << ".";
+    return std::error_code(result, std::system_category());
   }
 
+  // El pidfd permite esperar al hijo con poll()/epoll junto a otros descriptores, sin bloquearse en waitpid()
+  child_pidfd = static_cast<int>(syscall(SYS_pidfd_open, child_pid, 0));
+
+  // El padre cierra el extremo de la tubería que usa el hijo; si no, nunca leería el fin de su salida
+  int child_end = (redirected_io == stdio::in) ? 0 : 1;
+  close(std_pipe[child_end]);
+  std_pipe[child_end] = -1;
+
   return std::error_code(0, std::system_category());
 }
 
@@ -79,27 +102,36 @@ std::error_code subprocess::exec() {
  */
 std::error_code subprocess::wait() {
   if (child_pid != -1) {
-    int status;
-    if (waitpid(child_pid, &status, 0) == -1) {
-      return std::error_code(errno, std::system_category());
+    while (waitpid(child_pid, &status, 0) == -1) {
+      if (errno != EINTR) { return std::error_code(errno, std::system_category()); }
     }
     child_pid = -1;
   }
   return std::error_code(0, std::system_category());
 }
 
+/**
+ * @brief Método que indica cómo ha terminado el proceso hijo, una vez que wait() ha esperado por él
+ * @return Devuelve el código de salida del proceso hijo, o 128 más el número de la señal si lo ha terminado una señal
+ */
+int subprocess::exit_code() {
+  if (WIFSIGNALED(status)) { return 128 + WTERMSIG(status); }
+  return WEXITSTATUS(status);
+}
+
 /**
  * @brief Método que envía la señal SIGKILL al proceso hijo para forzar su terminación
  * @return Devuelve código de error 0 si la señal de finalización fue enviada con éxito; de lo contrario, devuelve el código de error producido
  */
 std::error_code subprocess::kill() {
   if (child_pid != -1) {
-    if (killpg(child_pid, SIGTERM) == -1) {
-      // Si no se ha podido matar al comando (la llamada al sistema killpg() falló), mostraremos un mensaje de error y saldremos con código de error != 0
-      std::cerr << "Error: No se ha podido matar al proceso hijo con la señal SIGTERM." << std::endl;
+    // Con el pidfd la señal llega seguro a nuestro hijo, aunque su PID se haya reutilizado
+    long result = (child_pidfd != -1) ? syscall(SYS_pidfd_send_signal, child_pidfd, SIGKILL, nullptr, 0) : ::kill(child_pid, SIGKILL);
+    if (result == -1) {
+      // Si no se ha podido matar al comando (la llamada al sistema kill() falló), mostraremos un mensaje de error y saldremos con código de error != 0
+      log_error() << "Error: No se ha podido matar al proceso hijo con la señal SIGKILL.";
       return std::error_code(errno, std::system_category());
     }
-    child_pid = -1;
   }
   return std::error_code(0, std::system_category());
 }
@@ -120,18 +152,128 @@ int subprocess::stdin_fd() { return std_pipe[redirected_io == stdio::in ? 1 : 0]
 
 int subprocess::stdout_fd() { return std_pipe[redirected_io == stdio::out ? 0 : (redirected_io == stdio::outerr ? 0 : 1)]; }
 
-int subprocess::stderr_fd() { return std_pipe[redirected_io == stdio::err ? 0 : (redirected_io == stdio::outerr ? 1 : 2)]; }
+int subprocess::stderr_fd() { return std_pipe[redirected_io == stdio::err || redirected_io == stdio::outerr ? 0 : 1]; }
 
 /**
- * @brief Métodos que configura el entorno del proceso hijo cerrando extremos no utilizados de los pipes y duplicando los descriptores de archivos necesarios para redirigir la entrada/salida estándar.
- * @return Devuelven los descriptores de archivos asociados con la entrada/salida estándar del proceso hijo, dependiendo del tipo de redirección.
+ * @brief Método para obtener el pidfd del proceso hijo
+ * @return Devuelve el descriptor pidfd del proceso hijo, o -1 si no se ha lanzado o el núcleo no admite pidfd_open()
+ */
+int subprocess::pid_fd() { return child_pidfd; }
+
+//-------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Constructor de subprocess_pool: crea el descriptor de epoll en el que se vigilan los procesos lanzados
+ */
+subprocess_pool::subprocess_pool() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+  if (epoll_fd < 0) {
+    log_error() << "Error: No se ha podido crear el descriptor de epoll.";
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief Destructor de subprocess_pool: los procesos que no se han recogido se terminan con SIGKILL (que no pueden ignorar,
+ *        así que la espera no se queda bloqueada) y se esperan, para no dejar zombis
  */
-void subprocess::setup_child_process() {
-  close(std_pipe[0]);
+subprocess_pool::~subprocess_pool() {
+  for (auto& [id, process] : processes) {
+    process->kill();
+    process->wait();
+  }
+  close(epoll_fd);
+}
+
+/**
+ * @brief Método que lanza un comando sin esperar a que termine y vigila su pidfd con epoll
+ * @param[in] args: comando y sus argumentos
+ * @param[in] redirected_io: entrada/salida estándar del proceso que se redirige a su tubería
+ * @return Devuelve el identificador del proceso dentro del conjunto, o un código de error si no se ha podido lanzar
+ */
+std::expected<size_t, std::error_code> subprocess_pool::launch(const std::vector<std::string>& args, subprocess::stdio redirected_io) {
+  auto process = std::make_unique<subprocess>(args, redirected_io);
+  if (std::error_code error = process->exec()) { return std::unexpected(error); }
+
+  size_t id = next_id++;
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = id;
+  if (process->pid_fd() < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, process->pid_fd(), &event) < 0) {
+    std::error_code error(process->pid_fd() < 0 ? ENOSYS : errno, std::system_category());
+    log_error() << "Error: No se puede vigilar la terminación del proceso " << process->pid() << ".";
+    process->kill();
+    process->wait();
+    return std::unexpected(error);
+  }
+  processes.emplace(id, std::move(process));
+  return id;
+}
+
+/**
+ * @brief Método para acceder a un proceso del conjunto que todavía no se ha recogido
+ * @param[in] id: identificador que devolvió launch()
+ * @return Devuelve el proceso, por ejemplo para leer su salida antes de que termine
+ */
+subprocess& subprocess_pool::process(size_t id) { return *processes.at(id); }
+
+/**
+ * @brief Método que recoge los procesos que han terminado: epoll indica qué pidfd son legibles (su proceso ha terminado), y
+ *        solo esos se recogen con waitpid(), que ya no se bloquea. Al recogerlos se cierran su tubería y su pidfd. Si no se
+ *        puede recoger alguno (por ejemplo, porque ya lo ha recogido otro), se retira del conjunto y se siguen recogiendo los
+ *        demás: se devuelven los recogidos y el error se devuelve en la siguiente llamada.
+ * @param[in] timeout: milisegundos que se espera como mucho a que termine alguno (0 para no esperar, -1 sin límite)
+ * @return Devuelve los procesos recogidos con su código de salida (ninguno si ha vencido el plazo), o un código de error si
+ *         no se ha recogido ninguno o quedaba el error de la llamada anterior
+ */
+std::expected<std::vector<finished_process>, std::error_code> subprocess_pool::reap(int timeout) {
+  std::vector<finished_process> finished;
+  if (pending_error) { return std::unexpected(std::exchange(pending_error, std::error_code())); }
+  if (processes.empty()) { return finished; }
 
-  if (redirected_io == stdio::in) { dup2(std_pipe[0], STDIN_FILENO); }
-  else if (redirected_io == stdio::out) { dup2(std_pipe[1], STDOUT_FILENO); }
-  else if (redirected_io == stdio::err) { dup2(std_pipe[1], STDERR_FILENO); }
+  epoll_event events[64];
+  int ready = epoll_wait(epoll_fd, events, 64, timeout);
+  if (ready < 0) {
+    if (errno == EINTR) { return finished; }
+    return std::unexpected(std::error_code(errno, std::system_category()));
+  }
+  for (int i = 0; i < ready; ++i) {
+    auto it = processes.find(events[i].data.u64);
+    if (it == processes.end()) { continue; }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second->pid_fd(), nullptr);
+    if (std::error_code error = it->second->wait()) {
+      log_error() << "Error: No se ha podido recoger el proceso " << it->second->pid() << ".";
+      if (!pending_error) { pending_error = error; }
+    } else {
+      finished.push_back({it->first, it->second->exit_code()});
+    }
+    processes.erase(it);
+  }
+  if (pending_error && finished.empty()) { return std::unexpected(std::exchange(pending_error, std::error_code())); }
+  return finished;
+}
 
-  close(std_pipe[1]);
-}
\ No newline at end of file
+/**
+ * @brief Método que espera a que terminen todos los procesos lanzados y los recoge. Si alguno no se puede recoger, se
+ *        devuelven los que ya se habían recogido y el error se devuelve en la siguiente llamada (a reap() o a wait_all())
+ * @return Devuelve los procesos recogidos con su código de salida, en el orden en que han terminado, o un código de error si
+ *         no se ha recogido ninguno
+ */
+std::expected<std::vector<finished_process>, std::error_code> subprocess_pool::wait_all() {
+  std::vector<finished_process> finished;
+  while (!processes.empty() || pending_error) {
+    auto result = reap(-1);
+    if (!result) {
+      if (finished.empty()) { return std::unexpected(result.error()); }
+      pending_error = result.error();
+      break;
+    }
+    finished.insert(finished.end(), result->begin(), result->end());
+  }
+  return finished;
+}
+
+/**
+ * @brief Método para saber cuántos procesos lanzados no se han recogido todavía
+ * @return Devuelve el número de procesos en ejecución (o terminados pero sin recoger)
+ */
+size_t subprocess_pool::running() const { return processes.size(); }
@@ -0,0 +1,212 @@
+/**
+ * Universidad de La Laguna
+ * Escuela Superior de Ingeniería y Tecnología
+ * Grado en Ingeniería Informática
+ * Sistemas Operativos 2023-2024
+ *
+ * @author Raúl González Acosta (alu0101543529@ull.edu.es)
+ * @date   30/10/2023
+ * @brief  Implementación de la cola de io_uring mediante las llamadas al sistema io_uring_setup, io_uring_enter e io_uring_register
+ */
+
+#include "header_files/uring.h"
+#include <atomic>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief Destructor de io_uring_queue: deshace las proyecciones de los anillos y cierra el descriptor de la cola.
+ */
+io_uring_queue::~io_uring_queue() {
+  if (entries != nullptr) { munmap(entries, entries_size); }
+  if (cq_mapping != nullptr && cq_mapping != sq_mapping) { munmap(cq_mapping, cq_mapping_size); }
+  if (sq_mapping != nullptr) { munmap(sq_mapping, sq_mapping_size); }
+  if (ring_fd != -1) { close(ring_fd); }
+}
+
+/**
+ * @brief Método que crea la cola de io_uring y proyecta en memoria sus anillos de peticiones y de completadas.
+ * @param[in] entries: número de entradas del anillo de peticiones.
+ * @param[in] completions: número de entradas del anillo de completadas (al menos tantas como peticiones pueda haber en curso).
+ * @return Devuelve un código de error si el núcleo no admite io_uring o no se ha podido crear la cola, o un código de éxito en caso contrario.
+ */
+std::error_code io_uring_queue::setup(unsigned entries, unsigned completions) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = completions;
+
+  int result = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (result < 0) { return std::error_code(errno, std::system_category()); }
+  ring_fd = result;
+
+  // Con IORING_FEAT_SINGLE_MMAP los dos anillos comparten una única proyección
+  sq_mapping_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_mapping_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mapping) { sq_mapping_size = cq_mapping_size = std::max(sq_mapping_size, cq_mapping_size); }
+
+  void* mapping = mmap(nullptr, sq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (mapping == MAP_FAILED) { return std::error_code(errno, std::system_category()); }
+  sq_mapping = mapping;
+
+  if (single_mapping) {
+    cq_mapping = sq_mapping;
+  } else {
+    mapping = mmap(nullptr, cq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (mapping == MAP_FAILED) { return std::error_code(errno, std::system_category()); }
+    cq_mapping = mapping;
+  }
+
+  entries_size = params.sq_entries * sizeof(io_uring_sqe);
+  mapping = mmap(nullptr, entries_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (mapping == MAP_FAILED) { return std::error_code(errno, std::system_category()); }
+  this->entries = static_cast<io_uring_sqe*>(mapping);
+
+  uint8_t* sq = static_cast<uint8_t*>(sq_mapping);
+  sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_entries = params.sq_entries;
+
+  uint8_t* cq = static_cast<uint8_t*>(cq_mapping);
+  cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que indica si la cola se ha creado correctamente.
+ * @return Devuelve true si la cola está lista para recibir peticiones.
+ */
+bool io_uring_queue::active() const { return entries != nullptr; }
+
+/**
+ * @brief Método que registra buffers en el núcleo, que los fija en memoria una sola vez en lugar de en cada petición.
+ * @param[in] buffers: buffers que se registran; las peticiones *_FIXED los identifican por su posición en el vector.
+ * @return Devuelve un código de error si no se han podido registrar, o un código de éxito en caso contrario.
+ */
+std::error_code io_uring_queue::register_buffers(const std::vector<iovec>& buffers) {
+  if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) < 0) {
+    return std::error_code(errno, std::system_category());
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que registra descriptores en el núcleo, que así no tiene que buscarlos y referenciarlos en cada petición.
+ * @param[in] files: descriptores que se registran; las peticiones los identifican por su posición en el vector.
+ * @return Devuelve un código de error si no se han podido registrar, o un código de éxito en caso contrario.
+ */
+std::error_code io_uring_queue::register_files(const std::vector<int>& files) {
+  if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, files.data(), files.size()) < 0) {
+    return std::error_code(errno, std::system_category());
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que devuelve una entrada libre del anillo de peticiones, ya añadida al final del anillo y puesta a cero.
+ *        Si el anillo está lleno, se envían antes al núcleo las peticiones preparadas.
+ * @return Devuelve la entrada, o un código de error si no se han podido enviar las peticiones pendientes.
+ */
+std::expected<io_uring_sqe*, std::error_code> io_uring_queue::next_entry() {
+  unsigned tail = *sq_tail;
+  if (tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire) >= sq_entries) {
+    if (std::error_code error = submit(0)) { return std::unexpected(error); }
+  }
+
+  unsigned index = tail & sq_mask;
+  io_uring_sqe* entry = &entries[index];
+  std::memset(entry, 0, sizeof(*entry));
+  sq_array[index] = index;
+  // El núcleo solo ve la entrada cuando avanzamos tail, así que se publica una vez escrita, al final de cada prepare_*()
+  ++pending;
+  return entry;
+}
+
+/**
+ * @brief Método que prepara la lectura de un fichero registrado en una zona de un buffer registrado.
+ * @param[in] file_index: posición del fichero en los descriptores registrados.
+ * @param[in] buffer: dirección en la que se leen los datos, dentro del buffer registrado.
+ * @param[in] length: número de bytes que se leen.
+ * @param[in] offset: posición del fichero desde la que se lee.
+ * @param[in] buffer_index: posición del buffer en los buffers registrados.
+ * @param[in] user_data: valor que identifica la petición cuando se complete.
+ * @return Devuelve un código de error si no se ha podido preparar la petición, o un código de éxito en caso contrario.
+ */
+std::error_code io_uring_queue::prepare_read_fixed(unsigned file_index, void* buffer, unsigned length, uint64_t offset,
+                                                   uint16_t buffer_index, uint64_t user_data) {
+  auto entry = next_entry();
+  if (!entry) { return entry.error(); }
+  (*entry)->opcode = IORING_OP_READ_FIXED;
+  (*entry)->flags = IOSQE_FIXED_FILE;
+  (*entry)->fd = static_cast<int>(file_index);
+  (*entry)->addr = reinterpret_cast<uint64_t>(buffer);
+  (*entry)->len = length;
+  (*entry)->off = offset;
+  (*entry)->buf_index = buffer_index;
+  (*entry)->user_data = user_data;
+  std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + 1, std::memory_order_release);
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que prepara el envío de un mensaje por un socket registrado. El mensaje y sus bloques deben seguir siendo
+ *        válidos hasta que la petición se complete.
+ * @param[in] file_index: posición del socket en los descriptores registrados.
+ * @param[in] message: mensaje que se envía (destino y bloques de datos).
+ * @param[in] user_data: valor que identifica la petición cuando se complete.
+ * @return Devuelve un código de error si no se ha podido preparar la petición, o un código de éxito en caso contrario.
+ */
+std::error_code io_uring_queue::prepare_sendmsg(unsigned file_index, const msghdr* message, uint64_t user_data) {
+  auto entry = next_entry();
+  if (!entry) { return entry.error(); }
+  (*entry)->opcode = IORING_OP_SENDMSG;
+  (*entry)->flags = IOSQE_FIXED_FILE;
+  (*entry)->fd = static_cast<int>(file_index);
+  (*entry)->addr = reinterpret_cast<uint64_t>(message);
+  (*entry)->len = 1;
+  (*entry)->user_data = user_data;
+  std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + 1, std::memory_order_release);
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que envía al núcleo las peticiones preparadas con una sola llamada a io_uring_enter() y, si se pide,
+ *        espera a que haya un número de peticiones completadas en el anillo.
+ * @param[in] wait_count: número de peticiones completadas que se esperan (0 para no esperar).
+ * @return Devuelve un código de error si no se han podido enviar las peticiones, o un código de éxito en caso contrario.
+ */
+std::error_code io_uring_queue::submit(unsigned wait_count) {
+  while (pending > 0 || wait_count > 0) {
+    unsigned flags = (wait_count > 0) ? IORING_ENTER_GETEVENTS : 0;
+    long result = syscall(__NR_io_uring_enter, ring_fd, pending, wait_count, flags, nullptr, 0);
+    if (result < 0) {
+      if (errno == EINTR) { continue; }
+      return std::error_code(errno, std::system_category());
+    }
+    pending -= static_cast<unsigned>(result);
+    // Las completadas que esperábamos ya están en el anillo aunque queden peticiones sin enviar (por falta de memoria en el núcleo)
+    if (pending == 0 || wait_count > 0) { break; }
+  }
+  return std::error_code(0, std::system_category());
+}
+
+/**
+ * @brief Método que saca del anillo la petición completada más antigua.
+ * @param[out] completion: resultado de la petición (res) y el valor que la identifica (user_data).
+ * @return Devuelve true si había alguna petición completada, o false en caso contrario.
+ */
+bool io_uring_queue::pop_completion(io_uring_cqe& completion) {
+  unsigned head = *cq_head;
+  if (head == std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire)) { return false; }
+  completion = cqes[head & cq_mask];
+  std::atomic_ref<unsigned>(*cq_head).store(head + 1, std::memory_order_release);
+  return true;
+}